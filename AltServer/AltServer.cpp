@@ -230,10 +230,11 @@ int CALLBACK WinMain(
 #define ID_MENU_CLOSE 103
 #define ID_MENU_CHECK_FOR_UPDATES 105
 
+#define ALL_DEVICES 199
 #define NO_DEVICES 200
 #define FIRST_DEVICE 201
 
-std::shared_ptr<Device> _selectedDevice;
+std::vector<std::shared_ptr<Device>> _selectedDevices;
 
 //  FUNCTION: WndProc(HWND, UINT, WPARAM, LPARAM)
 //
@@ -326,6 +327,13 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 					auto name = WideStringFromString(device->name());
 					AppendMenu(installMenu, MF_STRING, FIRST_DEVICE + i, name.c_str());
 				}
+
+				if (devices.size() > 1)
+				{
+					// Signs the app once and installs it on every device in parallel.
+					AppendMenu(installMenu, MF_SEPARATOR, 0, NULL);
+					AppendMenu(installMenu, MF_STRING, ALL_DEVICES, L"All Devices");
+				}
 			}
 
 			hPopupMenu = CreatePopupMenu();
@@ -370,12 +378,17 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 			{
 				// Ignore
 			}
-			else if (id >= FIRST_DEVICE)
+			else if (id >= FIRST_DEVICE || id == ALL_DEVICES)
 			{
-				int index = id - FIRST_DEVICE;
-
-				auto device = devices[index];
-				_selectedDevice = device;
+				if (id == ALL_DEVICES)
+				{
+					_selectedDevices = devices;
+				}
+				else
+				{
+					int index = id - FIRST_DEVICE;
+					_selectedDevices = { devices[index] };
+				}
 
 				if (isSideloadingIPA)
 				{
@@ -490,7 +503,7 @@ BOOL CALLBACK LoginDlgProc(HWND hwnd, UINT Message, WPARAM wParam, LPARAM lParam
 			Edit_GetText(appleIDTextField, appleID, 512);
 			Edit_GetText(passwordTextField, password, 512);
 			
-			auto task = AltServerApp::instance()->InstallApplication(_ipaFilepath, _selectedDevice, StringFromWideString(appleID), StringFromWideString(password));
+			auto task = AltServerApp::instance()->InstallApplication(_ipaFilepath, _selectedDevices, StringFromWideString(appleID), StringFromWideString(password));
 
 			EndDialog(hwnd, IDOK);
 
@@ -67,6 +67,37 @@ const char* APPLE_FOLDER_KEY = "AppleFolder";
 
 const char* STARTUP_ITEMS_KEY = "SOFTWARE\\Microsoft\\Windows\\CurrentVersion\\Run";
 
+// Cached sessions reuse their anisette data for at most this long, mirroring how long one install used to hold on to it.
+const time_t AnisetteDataRefreshInterval = 60;
+
+// Developer services answers requests made with an expired or revoked auth token with this result code.
+const int SessionExpiredResultCode = 1100;
+
+// Only these errors mean a cached session is no longer accepted. Anything else (no team, network or anisette failures)
+// would fail the same way after signing in again.
+static bool IsSessionRejectedError(Error& error)
+{
+	if (dynamic_cast<LocalizedError*>(&error) != nullptr)
+	{
+		return error.code() == SessionExpiredResultCode;
+	}
+
+	if (dynamic_cast<APIError*>(&error) != nullptr)
+	{
+		switch ((APIErrorCode)error.code())
+		{
+		case APIErrorCode::IncorrectCredentials:
+		case APIErrorCode::AuthenticationHandshakeFailed:
+			return true;
+
+		default:
+			return false;
+		}
+	}
+
+	return false;
+}
+
 std::string _verificationCode;
 
 HKEY OpenRegistryKey()
@@ -396,6 +427,9 @@ void AltServerApp::Start(HWND windowHandle, HINSTANCE instanceHandle)
 	ULONG_PTR gdiplusToken;
 	Gdiplus::GdiplusStartup(&gdiplusToken, &gdiplusStartupInput, NULL);
 
+	_provisioningProfileCache = std::make_shared<ProvisioningProfileCache>(this->provisioningProfilesDirectoryPath());
+	_signedAppCache = std::make_shared<SignedAppCache>(this->signedAppsDirectoryPath());
+
 	ConnectionManager::instance()->Start();
 
 	try
@@ -449,7 +483,13 @@ void AltServerApp::CheckForUpdates()
 
 pplx::task<std::shared_ptr<Application>> AltServerApp::InstallApplication(std::optional<std::string> filepath, std::shared_ptr<Device> installDevice, std::string appleID, std::string password)
 {
-	return this->_InstallApplication(filepath, installDevice, appleID, password)
+	std::vector<std::shared_ptr<Device>> installDevices = { installDevice };
+	return this->InstallApplication(filepath, installDevices, appleID, password);
+}
+
+pplx::task<std::shared_ptr<Application>> AltServerApp::InstallApplication(std::optional<std::string> filepath, std::vector<std::shared_ptr<Device>> installDevices, std::string appleID, std::string password)
+{
+	return this->_InstallApplication(filepath, installDevices, appleID, password)
 	.then([=](pplx::task<std::shared_ptr<Application>> task) -> pplx::task<std::shared_ptr<Application>> {
 		try
 		{
@@ -466,6 +506,9 @@ pplx::task<std::shared_ptr<Application>> AltServerApp::InstallApplication(std::o
 				// This appears to happen when iCloud is running simultaneously, and just happens to provision device at same time as AltServer.
 				AnisetteDataManager::instance()->ResetProvisioning();
 
+				// Sessions were signed in with the old provisioning, so sign in again as well.
+				this->InvalidateSession(appleID);
+
 				this->ShowNotification("Registering PC with Apple...", "This may take a few seconds.");
 
 				// Provisioning device can fail if attempted too soon after previous attempt.
@@ -473,7 +516,7 @@ pplx::task<std::shared_ptr<Application>> AltServerApp::InstallApplication(std::o
 				// 10-11 seconds appears to be too short, so wait for 12 seconds instead.
 				Sleep(12000);
 
-				return this->_InstallApplication(filepath, installDevice, appleID, password);
+				return this->_InstallApplication(filepath, installDevices, appleID, password);
 			}
 			else
 			{
@@ -487,7 +530,7 @@ pplx::task<std::shared_ptr<Application>> AltServerApp::InstallApplication(std::o
 			auto application = task.get();
 
 			std::stringstream ss;
-			ss << application->name() << " was successfully installed on " << installDevice->name() << ".";
+			ss << application->name() << " was successfully installed on " << this->DevicesDescription(installDevices) << ".";
 
 			this->ShowNotification("Installation Succeeded", ss.str());
 
@@ -510,6 +553,7 @@ pplx::task<std::shared_ptr<Application>> AltServerApp::InstallApplication(std::o
 			if ((APIErrorCode)error.code() == APIErrorCode::InvalidAnisetteData)
 			{
 				AnisetteDataManager::instance()->ResetProvisioning();
+				this->InvalidateSession(appleID);
 			}
 
 			this->ShowAlert("Installation Failed", error.localizedDescription());
@@ -535,25 +579,128 @@ pplx::task<std::shared_ptr<Application>> AltServerApp::InstallApplication(std::o
 	});
 }
 
-pplx::task<std::shared_ptr<Application>> AltServerApp::_InstallApplication(std::optional<std::string> filepath, std::shared_ptr<Device> installDevice, std::string appleID, std::string password)
+// Completes once every task has finished, whether or not it succeeded.
+// Unlike pplx::when_all, this never completes while a sibling task is still running.
+static pplx::task<void> WhenAllFinished(std::vector<pplx::task<void>> tasks)
+{
+	std::vector<pplx::task<void>> finishedTasks;
+	finishedTasks.reserve(tasks.size());
+
+	for (auto& task : tasks)
+	{
+		finishedTasks.push_back(task.then([](pplx::task<void> task) {
+			try
+			{
+				task.wait();
+			}
+			catch (...)
+			{
+				// Observed here, rethrown by whoever calls get() on the original task.
+			}
+		}));
+	}
+
+	return pplx::when_all(finishedTasks.begin(), finishedTasks.end());
+}
+
+// Describes why installing failed on a device, for summaries covering several devices.
+static std::string InstallErrorDescription(std::exception_ptr error)
+{
+	try
+	{
+		std::rethrow_exception(error);
+	}
+	catch (Error& error)
+	{
+		return error.localizedDescription();
+	}
+	catch (std::exception& exception)
+	{
+		return exception.what();
+	}
+	catch (...)
+	{
+		return "An unknown error occurred.";
+	}
+}
+
+// Rethrows the error as is when installing on a single device. Otherwise lists the outcome on every device,
+// so a failure on one device doesn't hide what happened on the others.
+static void ThrowIfInstallFailed(std::vector<std::pair<std::shared_ptr<Device>, std::exception_ptr>> outcomes)
+{
+	size_t failureCount = 0;
+
+	std::stringstream ss;
+	for (size_t i = 0; i < outcomes.size(); i++)
+	{
+		auto& [device, error] = outcomes[i];
+		if (error)
+		{
+			failureCount++;
+		}
+
+		ss << (i > 0 ? "\n" : "") << device->name() << ": " << (error ? InstallErrorDescription(error) : "Installed.");
+	}
+
+	if (failureCount == 0)
+	{
+		return;
+	}
+
+	if (outcomes.size() == 1)
+	{
+		std::rethrow_exception(outcomes.front().second);
+	}
+
+	odslog("Installation failed on " << failureCount << " of " << outcomes.size() << " devices:\n" << ss.str());
+
+	std::map<std::string, std::string> userInfo = {
+		{ "NSLocalizedFailureReason", ss.str() }
+	};
+	throw InstallError(InstallErrorCode::DevicesFailed, userInfo);
+}
+
+pplx::task<std::shared_ptr<Application>> AltServerApp::_InstallApplication(std::optional<std::string> filepath, std::vector<std::shared_ptr<Device>> installDevices, std::string appleID, std::string password)
 {
+	if (installDevices.empty())
+	{
+		return pplx::create_task([]() -> std::shared_ptr<Application> {
+			throw ServerError(ServerErrorCode::DeviceNotFound);
+		});
+	}
+
+	// A team provisioning profile only covers devices of one platform, so every device must share it.
+	bool isAppleTV = (installDevices.front()->type() == Device::Type::AppleTV);
+	for (auto& installDevice : installDevices)
+	{
+		if ((installDevice->type() == Device::Type::AppleTV) != isAppleTV)
+		{
+			return pplx::create_task([]() -> std::shared_ptr<Application> {
+				std::map<std::string, std::string> userInfo = {
+					{ "NSLocalizedFailureReason", "Apps cannot be installed on Apple TVs and other devices at the same time." }
+				};
+				throw ServerError(ServerErrorCode::InvalidRequest, userInfo);
+			});
+		}
+	}
+
     fs::path destinationDirectoryPath(temporary_directory());
     destinationDirectoryPath.append(make_uuid());
     
 	auto account = std::make_shared<Account>();
 	auto app = std::make_shared<Application>();
 	auto team = std::make_shared<Team>();
-	auto device = std::make_shared<Device>();
+	auto devices = std::make_shared<std::vector<std::shared_ptr<Device>>>();
 	auto appID = std::make_shared<AppID>();
 	auto certificate = std::make_shared<Certificate>();
 	auto profile = std::make_shared<ProvisioningProfile>();
 
 	auto session = std::make_shared<AppleAPISession>();
+	auto ipaHash = std::make_shared<std::string>();
 
-	return pplx::create_task([=]() {
-		auto anisetteData = AnisetteDataManager::instance()->FetchAnisetteData();
-		return this->Authenticate(appleID, password, anisetteData);
-	})
+	// Authenticate -> FetchTeam -> { RegisterDevice, FetchCertificate }, while the app is
+	// imported (or downloaded), unzipped and parsed alongside. Only provisioning needs all of them.
+	auto teamTask = this->FetchSession(appleID, password)
     .then([=](std::pair<std::shared_ptr<Account>, std::shared_ptr<AppleAPISession>> pair)
           {
               *account = *(pair.first);
@@ -563,24 +710,69 @@ pplx::task<std::shared_ptr<Application>> AltServerApp::_InstallApplication(std::
 
               return this->FetchTeam(account, session);
           })
-    .then([=](std::shared_ptr<Team> tempTeam)
+    .then([=](pplx::task<std::shared_ptr<Team>> task) -> pplx::task<std::shared_ptr<Team>>
           {
-			odslog("Registering device...");
+			  try
+			  {
+				  auto tempTeam = task.get();
+				  return pplx::create_task([tempTeam]() {
+					  return tempTeam;
+				  });
+			  }
+			  catch (Error& error)
+			  {
+				  if (!IsSessionRejectedError(error) || !this->InvalidateSession(appleID))
+				  {
+					  throw;
+				  }
+
+				  // FetchTeam is the first authenticated request, so a cached session that Apple no longer accepts fails here.
+				  odslog("Cached session was rejected, signing in again. " << error.localizedDescription());
+
+				  return pplx::create_task([=]() {
+					  auto anisetteData = AnisetteDataManager::instance()->FetchAnisetteData();
+					  return this->Authenticate(appleID, password, anisetteData);
+				  })
+				  .then([=](std::pair<std::shared_ptr<Account>, std::shared_ptr<AppleAPISession>> pair)
+				  {
+					  *account = *(pair.first);
+					  *session = *(pair.second);
 
+					  return this->FetchTeam(account, session);
+				  });
+			  }
+          })
+    .then([=](std::shared_ptr<Team> tempTeam)
+          {
               *team = *tempTeam;
-              return this->RegisterDevice(installDevice, team, session);
+
+			  this->CacheSession(appleID, password, account, session);
+          });
+
+	auto deviceTask = teamTask.then([=]()
+          {
+			odslog("Registering devices...");
+
+              return this->RegisterDevices(installDevices, team, session);
           })
-    .then([=](std::shared_ptr<Device> tempDevice)
+    .then([=](std::vector<std::shared_ptr<Device>> registeredDevices)
+          {
+              *devices = registeredDevices;
+          });
+
+	auto certificateTask = teamTask.then([=]()
           {
 			odslog("Fetching certificate...");
 
-              *device = *tempDevice;
               return this->FetchCertificate(team, session);
           })
     .then([=](std::shared_ptr<Certificate> tempCertificate)
           {
               *certificate = *tempCertificate;
+          });
 
+	auto appTask = pplx::create_task([=]()
+          {
 			  if (filepath.has_value())
 			  {
 				  odslog("Importing app...");
@@ -594,7 +786,7 @@ pplx::task<std::shared_ptr<Application>> AltServerApp::_InstallApplication(std::
 				  odslog("Downloading app...");
 
 				  // Show alert before downloading AltStore.
-				  this->ShowInstallationNotification("AltStore", device->name());
+				  this->ShowInstallationNotification("AltStore", this->DevicesDescription(installDevices));
 				  return this->DownloadApp();
 			  }
           })
@@ -602,15 +794,25 @@ pplx::task<std::shared_ptr<Application>> AltServerApp::_InstallApplication(std::
           {
 			odslog("Downloaded app!");
 
+			  try
+			  {
+				  // Identifies this build in the signed app cache.
+				  *ipaHash = SignedAppCache::FileHash(downloadedAppPath);
+			  }
+			  catch (std::exception& e)
+			  {
+				  odslog("Failed to hash app, it won't be cached once signed. " << e.what());
+			  }
+
               fs::create_directory(destinationDirectoryPath);
               
               auto appBundlePath = UnzipAppBundle(downloadedAppPath.string(), destinationDirectoryPath.string());
-			  auto app = std::make_shared<Application>(appBundlePath);
+			  auto tempApp = std::make_shared<Application>(appBundlePath);
 
 			  if (filepath.has_value())
 			  {
 				  // Show alert after "downloading" local .ipa.
-				  this->ShowInstallationNotification(app->name(), device->name());
+				  this->ShowInstallationNotification(tempApp->name(), this->DevicesDescription(installDevices));
 			  }
 			  else
 			  {
@@ -626,16 +828,22 @@ pplx::task<std::shared_ptr<Application>> AltServerApp::_InstallApplication(std::
 				  }
 			  }              
               
-              return app;
-          })
-    .then([=](std::shared_ptr<Application> tempApp)
-          {
               *app = *tempApp;
-			  return this->PrepareAllProvisioningProfiles(app, device, team, session);
+          });
+
+	return WhenAllFinished({ deviceTask, certificateTask, appTask })
+    .then([=]()
+          {
+			  // Rethrow the first failure, if any. Account errors take precedence over app errors.
+			  deviceTask.get();
+			  certificateTask.get();
+			  appTask.get();
+
+			  return this->PrepareAllProvisioningProfiles(app, *devices, team, certificate, session);
           })
     .then([=](std::map<std::string, std::shared_ptr<ProvisioningProfile>> profiles)
           {
-              return this->InstallApp(app, device, team, certificate, profiles);
+              return this->InstallApp(app, *devices, team, certificate, profiles, *ipaHash);
           })
     .then([=](pplx::task<std::shared_ptr<Application>> task)
           {
@@ -732,6 +940,69 @@ pplx::task<std::pair<std::shared_ptr<Account>, std::shared_ptr<AppleAPISession>>
 	});
 }
 
+pplx::task<std::pair<std::shared_ptr<Account>, std::shared_ptr<AppleAPISession>>> AltServerApp::FetchSession(std::string appleID, std::string password)
+{
+	std::optional<CachedSession> cachedSession;
+
+	{
+		std::lock_guard<std::mutex> lock(_cachedSessionsMutex);
+
+		auto iterator = _cachedSessions.find(appleID);
+		if (iterator != _cachedSessions.end() && iterator->second.passwordHash == std::hash<std::string>()(password))
+		{
+			cachedSession = iterator->second;
+		}
+	}
+
+	if (!cachedSession.has_value())
+	{
+		return pplx::create_task([=]() {
+			auto anisetteData = AnisetteDataManager::instance()->FetchAnisetteData();
+			return this->Authenticate(appleID, password, anisetteData);
+		});
+	}
+
+	return pplx::create_task([=]() {
+		auto account = cachedSession->account;
+		auto session = cachedSession->session;
+
+		time_t anisetteDataAge = time(NULL) - session->anisetteData()->date().tv_sec;
+		if (anisetteDataAge >= AnisetteDataRefreshInterval)
+		{
+			// The dsid and auth token outlive the anisette data's one-time password, so only the latter needs refreshing.
+			auto anisetteData = AnisetteDataManager::instance()->FetchAnisetteData();
+			if (anisetteData == NULL)
+			{
+				throw ServerError(ServerErrorCode::InvalidAnisetteData);
+			}
+
+			session = std::make_shared<AppleAPISession>(session->dsid(), session->authToken(), anisetteData);
+		}
+
+		odslog("Reusing session for " << appleID);
+
+		return std::make_pair(account, session);
+	});
+}
+
+void AltServerApp::CacheSession(std::string appleID, std::string password, std::shared_ptr<Account> account, std::shared_ptr<AppleAPISession> session)
+{
+	std::lock_guard<std::mutex> lock(_cachedSessionsMutex);
+
+	CachedSession cachedSession;
+	cachedSession.passwordHash = std::hash<std::string>()(password);
+	cachedSession.account = std::make_shared<Account>(*account);
+	cachedSession.session = std::make_shared<AppleAPISession>(*session);
+
+	_cachedSessions[appleID] = cachedSession;
+}
+
+bool AltServerApp::InvalidateSession(std::string appleID)
+{
+	std::lock_guard<std::mutex> lock(_cachedSessionsMutex);
+	return _cachedSessions.erase(appleID) > 0;
+}
+
 pplx::task<std::shared_ptr<Team>> AltServerApp::FetchTeam(std::shared_ptr<Account> account, std::shared_ptr<AppleAPISession> session)
 {
     auto task = AppleAPI::getInstance()->FetchTeams(account, session)
@@ -772,6 +1043,34 @@ pplx::task<std::shared_ptr<Certificate>> AltServerApp::FetchCertificate(std::sha
 			auto certificatesDirectoryPath = this->certificatesDirectoryPath();
 			auto cachedCertificatePath = certificatesDirectoryPath.append(team->identifier() + ".p12");
 
+			std::shared_ptr<Certificate> inMemoryCertificate = nullptr;
+
+			{
+				std::lock_guard<std::mutex> lock(_cachedCertificatesMutex);
+
+				auto iterator = _cachedCertificates.find(team->identifier());
+				if (iterator != _cachedCertificates.end())
+				{
+					inMemoryCertificate = iterator->second;
+				}
+			}
+
+			if (inMemoryCertificate != nullptr)
+			{
+				for (auto& certificate : certificates)
+				{
+					if (certificate->serialNumber() == inMemoryCertificate->serialNumber())
+					{
+						return pplx::create_task([inMemoryCertificate] {
+							return inMemoryCertificate;
+						});
+					}
+				}
+
+				// Certificate is no longer listed, so it has been revoked or has expired.
+				this->InvalidateCertificate(team, inMemoryCertificate);
+			}
+
 			std::shared_ptr<Certificate> preferredCertificate = nullptr;
 
 			for (auto& certificate : certificates)
@@ -808,6 +1107,8 @@ pplx::task<std::shared_ptr<Certificate>> AltServerApp::FetchCertificate(std::sha
 						// Manually set machineIdentifier so we can encrypt + embed certificate if needed.
 						cachedCertificate->setMachineIdentifier(*certificate->machineIdentifier());
 
+						this->CacheCertificate(team, cachedCertificate);
+
 						return pplx::create_task([cachedCertificate] {
 							return cachedCertificate;
 						});
@@ -839,6 +1140,8 @@ pplx::task<std::shared_ptr<Certificate>> AltServerApp::FetchCertificate(std::sha
               if (certificates.size() != 0)
               {
                   auto certificate = (preferredCertificate != nullptr) ? preferredCertificate : certificates[0];
+                  this->InvalidateCertificate(team, certificate);
+
                   return AppleAPI::getInstance()->RevokeCertificate(certificate, team, session).then([this, team, session](bool success)
                                                                                             {
                                                                                                 return this->FetchCertificate(team, session);
@@ -849,7 +1152,7 @@ pplx::task<std::shared_ptr<Certificate>> AltServerApp::FetchCertificate(std::sha
                   std::string machineName = "AltStore";
                   
                   return AppleAPI::getInstance()->AddCertificate(machineName, team, session)
-					  .then([team, session, cachedCertificatePath](std::shared_ptr<Certificate> addedCertificate)
+					  .then([this, team, session, cachedCertificatePath](std::shared_ptr<Certificate> addedCertificate)
                         {
                             auto privateKey = addedCertificate->privateKey();
                             if (privateKey == std::nullopt)
@@ -858,7 +1161,7 @@ pplx::task<std::shared_ptr<Certificate>> AltServerApp::FetchCertificate(std::sha
                             }
                                                                                              
                             return AppleAPI::getInstance()->FetchCertificates(team, session)
-                            .then([privateKey, addedCertificate, cachedCertificatePath](std::vector<std::shared_ptr<Certificate>> certificates)
+                            .then([this, team, privateKey, addedCertificate, cachedCertificatePath](std::vector<std::shared_ptr<Certificate>> certificates)
                                 {
                                     std::shared_ptr<Certificate> certificate = nullptr;
                                                                                                        
@@ -899,6 +1202,8 @@ pplx::task<std::shared_ptr<Certificate>> AltServerApp::FetchCertificate(std::sha
 										odslog("Failed to cache certificate:" << cachedCertificatePath << ". " << e.what())
 									}
 
+									this->CacheCertificate(team, certificate);
+
                                     return certificate;
                                 });
                         });
@@ -908,13 +1213,35 @@ pplx::task<std::shared_ptr<Certificate>> AltServerApp::FetchCertificate(std::sha
     return task;
 }
 
+void AltServerApp::CacheCertificate(std::shared_ptr<Team> team, std::shared_ptr<Certificate> certificate)
+{
+	std::lock_guard<std::mutex> lock(_cachedCertificatesMutex);
+	_cachedCertificates[team->identifier()] = certificate;
+}
+
+void AltServerApp::InvalidateCertificate(std::shared_ptr<Team> team, std::shared_ptr<Certificate> certificate)
+{
+	{
+		std::lock_guard<std::mutex> lock(_cachedCertificatesMutex);
+
+		auto iterator = _cachedCertificates.find(team->identifier());
+		if (iterator != _cachedCertificates.end() && iterator->second->serialNumber() == certificate->serialNumber())
+		{
+			_cachedCertificates.erase(iterator);
+		}
+	}
+
+	Signer::InvalidateCachedIdentity(certificate->serialNumber());
+}
+
 pplx::task<std::map<std::string, std::shared_ptr<ProvisioningProfile>>> AltServerApp::PrepareAllProvisioningProfiles(
 	std::shared_ptr<Application> application,
-	std::shared_ptr<Device> device,
+	std::vector<std::shared_ptr<Device>> devices,
 	std::shared_ptr<Team> team,
+	std::shared_ptr<Certificate> certificate,
 	std::shared_ptr<AppleAPISession> session)
 {
-	return this->PrepareProvisioningProfile(application, std::nullopt, device, team, session)
+	return this->PrepareProvisioningProfile(application, std::nullopt, devices, team, certificate, session)
 	.then([=](std::shared_ptr<ProvisioningProfile> profile) {
 		std::vector<pplx::task<std::pair<std::string, std::shared_ptr<ProvisioningProfile>>>> tasks;
 
@@ -925,7 +1252,7 @@ pplx::task<std::map<std::string, std::shared_ptr<ProvisioningProfile>>> AltServe
 
 		for (auto appExtension : application->appExtensions())
 		{
-			auto task = this->PrepareProvisioningProfile(appExtension, application, device, team, session)
+			auto task = this->PrepareProvisioningProfile(appExtension, application, devices, team, certificate, session)
 			.then([appExtension](std::shared_ptr<ProvisioningProfile> profile) {
 				return std::make_pair(appExtension->bundleIdentifier(), profile);
 			});
@@ -959,8 +1286,9 @@ pplx::task<std::map<std::string, std::shared_ptr<ProvisioningProfile>>> AltServe
 pplx::task<std::shared_ptr<ProvisioningProfile>> AltServerApp::PrepareProvisioningProfile(
 	std::shared_ptr<Application> app,
 	std::optional<std::shared_ptr<Application>> parentApp,
-	std::shared_ptr<Device> device,
+	std::vector<std::shared_ptr<Device>> devices,
 	std::shared_ptr<Team> team,
+	std::shared_ptr<Certificate> certificate,
 	std::shared_ptr<AppleAPISession> session)
 {
 	std::string preferredName;
@@ -993,6 +1321,17 @@ pplx::task<std::shared_ptr<ProvisioningProfile>> AltServerApp::PrepareProvisioni
 
 	std::string bundleID = std::regex_replace(app->bundleIdentifier(), std::regex(parentBundleID), updatedParentBundleID);
 
+	auto cachedProfile = this->CachedProvisioningProfile(bundleID, app, devices, team, certificate);
+	if (cachedProfile != nullptr)
+	{
+		odslog("Using cached provisioning profile for " << bundleID);
+
+		// App ID, features and app groups were all set up when this profile was fetched.
+		return pplx::create_task([cachedProfile]() {
+			return cachedProfile;
+		});
+	}
+
 	return this->RegisterAppID(preferredName, bundleID, team, session)
 	.then([=](std::shared_ptr<AppID> appID)
 	{
@@ -1004,14 +1343,87 @@ pplx::task<std::shared_ptr<ProvisioningProfile>> AltServerApp::PrepareProvisioni
 	})
 	.then([=](std::shared_ptr<AppID> appID)
 	{
-		return this->FetchProvisioningProfile(appID, device, team, session);
+		// Team profiles include every registered device, so one profile covers all devices we install to.
+		return this->FetchProvisioningProfile(appID, devices.front(), team, session);
 	})
 	.then([=](std::shared_ptr<ProvisioningProfile> profile)
 	{
+		for (auto& device : devices)
+		{
+			this->provisioningProfileCache()->CacheProfile(profile, device->identifier(), certificate->serialNumber());
+		}
+
 		return profile;
 	});
 }
 
+std::shared_ptr<ProvisioningProfile> AltServerApp::CachedProvisioningProfile(std::string bundleID,
+	std::shared_ptr<Application> app,
+	std::vector<std::shared_ptr<Device>> devices,
+	std::shared_ptr<Team> team,
+	std::shared_ptr<Certificate> certificate)
+{
+	auto profile = this->provisioningProfileCache()->CachedProfile(team->identifier(), bundleID, devices.front()->identifier(), certificate->serialNumber());
+	if (profile == nullptr)
+	{
+		return nullptr;
+	}
+
+	// The cached profile must also cover every other device, or the app can't be signed once for all of them.
+	if (devices.size() > 1)
+	{
+		auto provisionedDevices = profile->provisionedDevices();
+
+		for (auto& device : devices)
+		{
+			if (std::find(provisionedDevices.begin(), provisionedDevices.end(), device->identifier()) == provisionedDevices.end())
+			{
+				odslog("Cached provisioning profile for " << bundleID << " doesn't include device " << device->identifier());
+				return nullptr;
+			}
+		}
+	}
+
+	// The cached profile must already grant every app group the app asks for.
+	auto applicationGroupsNode = app->entitlements()["com.apple.security.application-groups"];
+	if (applicationGroupsNode == nullptr)
+	{
+		return profile;
+	}
+
+	auto profileGroupsNode = plist_dict_get_item(profile->entitlements(), "com.apple.security.application-groups");
+
+	for (int i = 0; i < plist_array_get_size(applicationGroupsNode); i++)
+	{
+		auto groupName = plist_get_string_ptr(plist_array_get_item(applicationGroupsNode, i), nullptr);
+		if (groupName == nullptr)
+		{
+			continue;
+		}
+
+		std::string adjustedGroupIdentifier = std::string(groupName) + "." + team->identifier();
+		bool isGroupAssigned = false;
+
+		for (int j = 0; j < plist_array_get_size(profileGroupsNode); j++)
+		{
+			auto profileGroupName = plist_get_string_ptr(plist_array_get_item(profileGroupsNode, j), nullptr);
+			if (profileGroupName != nullptr && adjustedGroupIdentifier == profileGroupName)
+			{
+				isGroupAssigned = true;
+				break;
+			}
+		}
+
+		if (!isGroupAssigned)
+		{
+			odslog("Cached provisioning profile for " << bundleID << " is missing app group " << adjustedGroupIdentifier);
+			return nullptr;
+		}
+	}
+
+	return profile;
+}
+
 pplx::task<std::shared_ptr<AppID>> AltServerApp::RegisterAppID(std::string appName, std::string bundleID, std::shared_ptr<Team> team, std::shared_ptr<AppleAPISession> session)
 {
     auto task = AppleAPI::getInstance()->FetchAppIDs(team, session)
@@ -1164,36 +1576,55 @@ pplx::task<std::shared_ptr<AppID>> AltServerApp::UpdateAppIDAppGroups(std::share
 	});
 }
 
-pplx::task<std::shared_ptr<Device>> AltServerApp::RegisterDevice(std::shared_ptr<Device> device, std::shared_ptr<Team> team, std::shared_ptr<AppleAPISession> session)
+pplx::task<std::vector<std::shared_ptr<Device>>> AltServerApp::RegisterDevices(std::vector<std::shared_ptr<Device>> devices, std::shared_ptr<Team> team, std::shared_ptr<AppleAPISession> session)
 {
-    auto task = AppleAPI::getInstance()->FetchDevices(team, device->type(), session)
-    .then([device, team, session](std::vector<std::shared_ptr<Device>> devices)
-          {
-              std::shared_ptr<Device> matchingDevice = nullptr;
-              
-              for (auto tempDevice : devices)
-              {
-                  if (tempDevice->identifier() == device->identifier())
-                  {
-                      matchingDevice = tempDevice;
-                      break;
-                  }
-              }
-              
-              if (matchingDevice != nullptr)
-              {
-                  return pplx::task<std::shared_ptr<Device>>([matchingDevice]()
-                                                             {
-                                                                 return matchingDevice;
-                                                             });
-              }
-              else
-              {
-                  return AppleAPI::getInstance()->RegisterDevice(device->name(), device->identifier(), device->type(), team, session);
-              }
-          });
-    
-    return task;
+	// All devices share the same type, so a single fetch tells us which ones still need registering.
+	auto task = AppleAPI::getInstance()->FetchDevices(team, devices.front()->type(), session)
+	.then([devices, team, session](std::vector<std::shared_ptr<Device>> registeredDevices)
+		  {
+			  std::vector<pplx::task<std::shared_ptr<Device>>> tasks;
+
+			  for (auto device : devices)
+			  {
+				  std::shared_ptr<Device> matchingDevice = nullptr;
+
+				  for (auto tempDevice : registeredDevices)
+				  {
+					  if (tempDevice->identifier() == device->identifier())
+					  {
+						  matchingDevice = tempDevice;
+						  break;
+					  }
+				  }
+
+				  if (matchingDevice != nullptr)
+				  {
+					  tasks.push_back(pplx::task_from_result(matchingDevice));
+				  }
+				  else
+				  {
+					  tasks.push_back(AppleAPI::getInstance()->RegisterDevice(device->name(), device->identifier(), device->type(), team, session));
+				  }
+			  }
+
+			  // when_all preserves the order of tasks, so devices are returned in the same order they were passed in.
+			  return pplx::when_all(tasks.begin(), tasks.end())
+				  .then([tasks](pplx::task<std::vector<std::shared_ptr<Device>>> task) {
+					  try
+					  {
+						  auto devices = task.get();
+						  observe_all_exceptions<std::shared_ptr<Device>>(tasks.begin(), tasks.end());
+						  return devices;
+					  }
+					  catch (std::exception& e)
+					  {
+						  observe_all_exceptions<std::shared_ptr<Device>>(tasks.begin(), tasks.end());
+						  throw;
+					  }
+				  });
+		  });
+
+	return task;
 }
 
 pplx::task<std::shared_ptr<ProvisioningProfile>> AltServerApp::FetchProvisioningProfile(std::shared_ptr<AppID> appID, std::shared_ptr<Device> device, std::shared_ptr<Team> team, std::shared_ptr<AppleAPISession> session)
@@ -1202,11 +1633,66 @@ pplx::task<std::shared_ptr<ProvisioningProfile>> AltServerApp::FetchProvisioning
 }
 
 pplx::task<std::shared_ptr<Application>> AltServerApp::InstallApp(std::shared_ptr<Application> app,
-                            std::shared_ptr<Device> device,
+                            std::vector<std::shared_ptr<Device>> devices,
                             std::shared_ptr<Team> team,
                             std::shared_ptr<Certificate> certificate,
-                            std::map<std::string, std::shared_ptr<ProvisioningProfile>> profilesByBundleID)
+                            std::map<std::string, std::shared_ptr<ProvisioningProfile>> profilesByBundleID,
+                            std::string ipaHash)
 {
+	if (app->isAltStoreApp() && devices.size() > 1)
+	{
+		// AltStore embeds the identifier of the device it's installed on, so each device needs its own signed copy.
+		return pplx::task<std::shared_ptr<Application>>([=]() {
+			std::vector<pplx::task<std::shared_ptr<Application>>> tasks;
+			std::vector<pplx::task<void>> finishedTasks;
+
+			fs::path appPath(app->path());
+
+			for (auto device : devices)
+			{
+				auto deviceDirectoryPath = appPath.parent_path();
+				deviceDirectoryPath.append(device->identifier());
+
+				auto deviceAppPath = deviceDirectoryPath;
+				deviceAppPath.append(appPath.filename().string());
+
+				fs::create_directories(deviceDirectoryPath);
+				fs::copy(appPath, deviceAppPath, fs::copy_options::recursive);
+
+				auto deviceApp = std::make_shared<Application>(deviceAppPath.string());
+
+				auto task = this->InstallApp(deviceApp, { device }, team, certificate, profilesByBundleID, ipaHash);
+				tasks.push_back(task);
+				finishedTasks.push_back(task.then([](std::shared_ptr<Application> app) {}));
+			}
+
+			return WhenAllFinished(finishedTasks)
+				.then([tasks, devices, app]() {
+					std::vector<std::pair<std::shared_ptr<Device>, std::exception_ptr>> outcomes;
+
+					for (size_t i = 0; i < tasks.size(); i++)
+					{
+						std::exception_ptr error = nullptr;
+
+						try
+						{
+							tasks[i].get();
+						}
+						catch (...)
+						{
+							error = std::current_exception();
+						}
+
+						outcomes.push_back(std::make_pair(devices[i], error));
+					}
+
+					ThrowIfInstallFailed(outcomes);
+
+					return app;
+				});
+		});
+	}
+
 	auto prepareInfoPlist = [profilesByBundleID](std::shared_ptr<Application> app, plist_t additionalValues){
 		auto profile = profilesByBundleID.at(app->bundleIdentifier());
 
@@ -1246,7 +1732,71 @@ pplx::task<std::shared_ptr<Application>> AltServerApp::InstallApp(std::shared_pt
 		fout.close();
 	};
 
+	std::vector<std::shared_ptr<ProvisioningProfile>> profiles;
+	std::set<std::string> profileIdentifiers;
+	for (auto pair : profilesByBundleID)
+	{
+		profiles.push_back(pair.second);
+		profileIdentifiers.insert(pair.second->bundleIdentifier());
+	}
+
+	std::optional<std::set<std::string>> activeProfiles = std::nullopt;
+	if (team->type() == Team::Type::Free && app->isAltStoreApp())
+	{
+		activeProfiles = profileIdentifiers;
+	}
+
+	std::vector<std::string> deviceUDIDs;
+	for (auto device : devices)
+	{
+		deviceUDIDs.push_back(device->identifier());
+	}
+
+	auto installSignedApp = [app, devices, deviceUDIDs, activeProfiles](std::string signedAppPath) {
+		return DeviceManager::instance()->InstallAppOnDevices(signedAppPath, deviceUDIDs, activeProfiles, [](std::string deviceUDID, double progress) {
+			odslog("Installation Progress (" << deviceUDID << "): " << progress);
+		})
+		.then([app, devices](std::vector<DeviceOperationResult> results) {
+			// Results are in the same order as deviceUDIDs, and so devices.
+			std::vector<std::pair<std::shared_ptr<Device>, std::exception_ptr>> outcomes;
+			for (size_t i = 0; i < results.size(); i++)
+			{
+				outcomes.push_back(std::make_pair(devices[i], results[i].error));
+			}
+
+			ThrowIfInstallFailed(outcomes);
+
+			return app;
+		});
+	};
+
     return pplx::task<std::shared_ptr<Application>>([=]() {
+		std::optional<std::string> deviceIdentifier = std::nullopt;
+		if (app->isAltStoreApp())
+		{
+			deviceIdentifier = devices.front()->identifier();
+		}
+
+		// Without a hash of the original .ipa we can't tell whether a cached app is the same build.
+		std::string cacheKey;
+		if (!ipaHash.empty())
+		{
+			cacheKey = SignedAppCache::Key(ipaHash, profiles, certificate->serialNumber(), deviceIdentifier);
+
+			auto cachedApp = this->signedAppCache()->CachedAppPath(cacheKey);
+			if (cachedApp.has_value())
+			{
+				auto cachedAppPath = cachedApp->first;
+				auto pin = cachedApp->second;
+				odslog("Installing previously signed app: " << cachedAppPath);
+
+				// Keep the cached app pinned until every device is done with it.
+				return installSignedApp(cachedAppPath.string()).then([pin](pplx::task<std::shared_ptr<Application>> task) {
+					return task.get();
+				});
+			}
+		}
+
         fs::path infoPlistPath(app->path());
         infoPlistPath.append("Info.plist");
         
@@ -1286,7 +1836,7 @@ pplx::task<std::shared_ptr<Application>> AltServerApp::InstallApp(std::shared_pt
 
 		if (app->isAltStoreApp())
 		{
-			plist_dict_set_item(additionalValues, "ALTDeviceID", plist_new_string(device->identifier().c_str()));
+			plist_dict_set_item(additionalValues, "ALTDeviceID", plist_new_string(devices.front()->identifier().c_str()));
 
 			auto serverID = this->serverID();
 			plist_dict_set_item(additionalValues, "ALTServerID", plist_new_string(serverID.c_str()));
@@ -1317,32 +1867,34 @@ pplx::task<std::shared_ptr<Application>> AltServerApp::InstallApp(std::shared_pt
 			prepareInfoPlist(appExtension, NULL);
 		}
 
-		std::vector<std::shared_ptr<ProvisioningProfile>> profiles;
-		std::set<std::string> profileIdentifiers;
-		for (auto pair : profilesByBundleID)
-		{
-			profiles.push_back(pair.second);
-			profileIdentifiers.insert(pair.second->bundleIdentifier());
-		}
-        
         Signer signer(team, certificate);
         signer.SignApp(app->path(), profiles);
 
-		std::optional<std::set<std::string>> activeProfiles = std::nullopt;
-		if (team->type() == Team::Type::Free && app->isAltStoreApp())
+		if (!cacheKey.empty())
 		{
-			activeProfiles = profileIdentifiers;
+			this->signedAppCache()->CacheApp(app->path(), cacheKey);
 		}
-        
-		return DeviceManager::instance()->InstallApp(app->path(), device->identifier(), activeProfiles, [](double progress) {
-			odslog("Installation Progress: " << progress);
-		})
-		.then([app] {
-			return app;
-		});
+
+		return installSignedApp(app->path());
     });
 }
 
+std::string AltServerApp::DevicesDescription(std::vector<std::shared_ptr<Device>> devices) const
+{
+	if (devices.size() == 1)
+	{
+		return devices.front()->name();
+	}
+	else if (devices.size() == 2)
+	{
+		return devices[0]->name() + " and " + devices[1]->name();
+	}
+	else
+	{
+		return std::to_string(devices.size()) + " devices";
+	}
+}
+
 void AltServerApp::ShowNotification(std::string title, std::string message)
 {
 	HICON icon = (HICON)LoadImage(this->instanceHandle(), MAKEINTRESOURCE(IMG_MENUBAR), IMAGE_ICON, 0, 0, LR_MONOCHROME);
@@ -1701,6 +2253,42 @@ fs::path AltServerApp::appDataDirectoryPath() const
 	return altserverDirectoryPath;
 }
 
+fs::path AltServerApp::provisioningProfilesDirectoryPath() const
+{
+	auto appDataPath = this->appDataDirectoryPath();
+	auto provisioningProfilesDirectoryPath = appDataPath.append("ProvisioningProfiles");
+
+	if (!fs::exists(provisioningProfilesDirectoryPath))
+	{
+		fs::create_directory(provisioningProfilesDirectoryPath);
+	}
+
+	return provisioningProfilesDirectoryPath;
+}
+
+std::shared_ptr<ProvisioningProfileCache> AltServerApp::provisioningProfileCache() const
+{
+	return _provisioningProfileCache;
+}
+
+fs::path AltServerApp::signedAppsDirectoryPath() const
+{
+	auto appDataPath = this->appDataDirectoryPath();
+	auto signedAppsDirectoryPath = appDataPath.append("SignedApps");
+
+	if (!fs::exists(signedAppsDirectoryPath))
+	{
+		fs::create_directory(signedAppsDirectoryPath);
+	}
+
+	return signedAppsDirectoryPath;
+}
+
+std::shared_ptr<SignedAppCache> AltServerApp::signedAppCache() const
+{
+	return _signedAppCache;
+}
+
 fs::path AltServerApp::certificatesDirectoryPath() const
 {
 	auto appDataPath = this->appDataDirectoryPath();
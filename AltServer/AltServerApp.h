@@ -9,6 +9,7 @@
 #pragma once
 
 #include <string>
+#include <mutex>
 
 #include "Account.hpp"
 #include "AppID.hpp"
@@ -20,6 +21,8 @@
 
 #include "AppleAPISession.h"
 #include "AnisetteDataManager.h"
+#include "ProvisioningProfileCache.hpp"
+#include "SignedAppCache.hpp"
 
 #include "Semaphore.h"
 
@@ -47,6 +50,10 @@ public:
     
 	pplx::task<std::shared_ptr<Application>> InstallApplication(std::optional<std::string> filepath, std::shared_ptr<Device> device, std::string appleID, std::string password);
 
+	// Signs the app once with a single team profile covering every device, then installs it on all of them in parallel.
+	// If it fails on any of several devices, the InstallError lists the outcome on each one.
+	pplx::task<std::shared_ptr<Application>> InstallApplication(std::optional<std::string> filepath, std::vector<std::shared_ptr<Device>> devices, std::string appleID, std::string password);
+
 	void ShowNotification(std::string title, std::string message);
 	void ShowAlert(std::string title, std::string message);
 
@@ -71,7 +78,7 @@ private:
 
 	static AltServerApp *_instance;
 
-	pplx::task<std::shared_ptr<Application>> _InstallApplication(std::optional<std::string> filepath, std::shared_ptr<Device> installDevice, std::string appleID, std::string password);
+	pplx::task<std::shared_ptr<Application>> _InstallApplication(std::optional<std::string> filepath, std::vector<std::shared_ptr<Device>> installDevices, std::string appleID, std::string password);
 
 	bool CheckDependencies();
 	bool CheckiCloudDependencies();
@@ -85,6 +92,24 @@ private:
 
 	Semaphore _appGroupSemaphore;
 
+	std::shared_ptr<ProvisioningProfileCache> _provisioningProfileCache;
+	std::shared_ptr<SignedAppCache> _signedAppCache;
+
+	struct CachedSession
+	{
+		size_t passwordHash;
+		std::shared_ptr<Account> account;
+		std::shared_ptr<AppleAPISession> session;
+	};
+
+	// Signed-in sessions keyed by Apple ID, reused across installs until Apple rejects them.
+	std::map<std::string, CachedSession> _cachedSessions;
+	std::mutex _cachedSessionsMutex;
+
+	// Signing certificates keyed by team identifier, so repeat installs skip decrypting the cached .p12.
+	std::map<std::string, std::shared_ptr<Certificate>> _cachedCertificates;
+	std::mutex _cachedCertificatesMutex;
+
 	bool presentedRunningNotification() const;
 	void setPresentedRunningNotification(bool presentedRunningNotification);
 
@@ -93,36 +118,55 @@ private:
 
 	fs::path appDataDirectoryPath() const;
 	fs::path certificatesDirectoryPath() const;
+	fs::path provisioningProfilesDirectoryPath() const;
+	fs::path signedAppsDirectoryPath() const;
+
+	std::shared_ptr<ProvisioningProfileCache> provisioningProfileCache() const;
+	std::shared_ptr<SignedAppCache> signedAppCache() const;
 
 	void HandleAnisetteError(AnisetteError& error);
     
     pplx::task<fs::path> DownloadApp();
 
 	void ShowInstallationNotification(std::string appName, std::string deviceName);
+	std::string DevicesDescription(std::vector<std::shared_ptr<Device>> devices) const;
     
 	pplx::task<std::pair<std::shared_ptr<Account>, std::shared_ptr<AppleAPISession>>>  Authenticate(std::string appleID, std::string password, std::shared_ptr<AnisetteData> anisetteData);
+	pplx::task<std::pair<std::shared_ptr<Account>, std::shared_ptr<AppleAPISession>>> FetchSession(std::string appleID, std::string password);
+	void CacheSession(std::string appleID, std::string password, std::shared_ptr<Account> account, std::shared_ptr<AppleAPISession> session);
+	bool InvalidateSession(std::string appleID);
     pplx::task<std::shared_ptr<Team>> FetchTeam(std::shared_ptr<Account> account, std::shared_ptr<AppleAPISession> session);
     pplx::task<std::shared_ptr<Certificate>> FetchCertificate(std::shared_ptr<Team> team, std::shared_ptr<AppleAPISession> session);
+	void CacheCertificate(std::shared_ptr<Team> team, std::shared_ptr<Certificate> certificate);
+	void InvalidateCertificate(std::shared_ptr<Team> team, std::shared_ptr<Certificate> certificate);
 	pplx::task<std::map<std::string, std::shared_ptr<ProvisioningProfile>>> PrepareAllProvisioningProfiles(
 		std::shared_ptr<Application> application,
-		std::shared_ptr<Device> device,
+		std::vector<std::shared_ptr<Device>> devices,
 		std::shared_ptr<Team> team,
+		std::shared_ptr<Certificate> certificate,
 		std::shared_ptr<AppleAPISession> session);
 	pplx::task<std::shared_ptr<ProvisioningProfile>> PrepareProvisioningProfile(
 		std::shared_ptr<Application> application,
 		std::optional<std::shared_ptr<Application>> parentApp,
-		std::shared_ptr<Device> device,
+		std::vector<std::shared_ptr<Device>> devices,
 		std::shared_ptr<Team> team,
+		std::shared_ptr<Certificate> certificate,
 		std::shared_ptr<AppleAPISession> session);
+	std::shared_ptr<ProvisioningProfile> CachedProvisioningProfile(std::string bundleID,
+		std::shared_ptr<Application> app,
+		std::vector<std::shared_ptr<Device>> devices,
+		std::shared_ptr<Team> team,
+		std::shared_ptr<Certificate> certificate);
     pplx::task<std::shared_ptr<AppID>> RegisterAppID(std::string appName, std::string identifier, std::shared_ptr<Team> team, std::shared_ptr<AppleAPISession> session);
 	pplx::task<std::shared_ptr<AppID>> UpdateAppIDFeatures(std::shared_ptr<AppID> appID, std::shared_ptr<Application> app, std::shared_ptr<Team> team, std::shared_ptr<AppleAPISession> session);
 	pplx::task<std::shared_ptr<AppID>> UpdateAppIDAppGroups(std::shared_ptr<AppID> appID, std::shared_ptr<Application> app, std::shared_ptr<Team> team, std::shared_ptr<AppleAPISession> session);
-    pplx::task<std::shared_ptr<Device>> RegisterDevice(std::shared_ptr<Device> device, std::shared_ptr<Team> team, std::shared_ptr<AppleAPISession> session);
+    pplx::task<std::vector<std::shared_ptr<Device>>> RegisterDevices(std::vector<std::shared_ptr<Device>> devices, std::shared_ptr<Team> team, std::shared_ptr<AppleAPISession> session);
     pplx::task<std::shared_ptr<ProvisioningProfile>> FetchProvisioningProfile(std::shared_ptr<AppID> appID, std::shared_ptr<Device> device, std::shared_ptr<Team> team, std::shared_ptr<AppleAPISession> session);
     
 	pplx::task<std::shared_ptr<Application>> InstallApp(std::shared_ptr<Application> app,
-		std::shared_ptr<Device> device,
+		std::vector<std::shared_ptr<Device>> devices,
 		std::shared_ptr<Team> team,
 		std::shared_ptr<Certificate> certificate,
-		std::map<std::string, std::shared_ptr<ProvisioningProfile>> profiles);
+		std::map<std::string, std::shared_ptr<ProvisioningProfile>> profiles,
+		std::string ipaHash);
 };
@@ -21,6 +21,8 @@
 #include <fstream>
 #include <sstream>
 #include <condition_variable>
+#include <atomic>
+#include <chrono>
 
 #include "Archiver.hpp"
 #include "ServerError.hpp"
@@ -31,6 +33,12 @@
 
 #define DEVICE_LISTENING_SOCKET 28151
 
+// Fleet operations work on at most this many devices at once.
+#define MAX_CONCURRENT_DEVICE_OPERATIONS 4
+
+// AFC uploads in flight at once across all devices.
+#define MAX_CONCURRENT_AFC_UPLOADS 2
+
 #define odslog(msg) { std::wstringstream ss; ss << msg << std::endl; OutputDebugStringW(ss.str().c_str()); }
 
 extern std::string StringFromWideString(std::wstring wideString);
@@ -80,7 +88,7 @@ DeviceManager* DeviceManager::instance()
     return _instance;
 }
 
-DeviceManager::DeviceManager()
+DeviceManager::DeviceManager() : _uploadSemaphore(MAX_CONCURRENT_AFC_UPLOADS)
 {
 }
 
@@ -92,414 +100,442 @@ void DeviceManager::Start()
 pplx::task<void> DeviceManager::InstallApp(std::string appFilepath, std::string deviceUDID, std::optional<std::set<std::string>> activeProfiles, std::function<void(double)> progressCompletionHandler)
 {
 	return pplx::task<void>([=] {
-		// Enforce only one installation at a time.
-		this->_mutex.lock();
+		fs::path temporaryDirectory(temporary_directory());
+		temporaryDirectory.append(make_uuid());
 
-		auto UUID = make_uuid();
+		fs::create_directory(temporaryDirectory);
 
-		char* uuidString = (char*)malloc(UUID.size() + 1);
-		strncpy(uuidString, (const char*)UUID.c_str(), UUID.size());
-		uuidString[UUID.size()] = '\0';
+		try
+		{
+			auto application = this->UnpackApp(appFilepath, temporaryDirectory.string());
+			this->InstallApp(application, deviceUDID, activeProfiles, progressCompletionHandler);
+		}
+		catch (std::exception& exception)
+		{
+			fs::remove_all(temporaryDirectory);
+			throw;
+		}
 
-		idevice_t device = nullptr;
-		lockdownd_client_t client = NULL;
-		instproxy_client_t ipc = NULL;
-		afc_client_t afc = NULL;
-		misagent_client_t mis = NULL;
-		lockdownd_service_descriptor_t service = NULL;
+		fs::remove_all(temporaryDirectory);
+	});
+}
 
-		fs::path temporaryDirectory(temporary_directory());
-		temporaryDirectory.append(make_uuid());
+std::shared_ptr<Application> DeviceManager::UnpackApp(std::string appFilepath, std::string temporaryDirectory)
+{
+	fs::path filepath(appFilepath);
 
-		fs::create_directory(temporaryDirectory);
+	auto extension = filepath.extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) {
+		return std::tolower(c);
+		});
 
-		auto installedProfiles = std::make_shared<std::vector<std::shared_ptr<ProvisioningProfile>>>();
-		auto cachedProfiles = std::make_shared<std::map<std::string, std::shared_ptr<ProvisioningProfile>>>();
+	fs::path appBundlePath;
 
-		auto finish = [this, installedProfiles, cachedProfiles, activeProfiles, temporaryDirectory, &uuidString]
-		(idevice_t device, lockdownd_client_t client, instproxy_client_t ipc, afc_client_t afc, misagent_client_t mis, lockdownd_service_descriptor_t service)
-		{
-			auto cleanUp = [=]() {
-				instproxy_client_free(ipc);
-				afc_client_free(afc);
-				lockdownd_client_free(client);
-				misagent_client_free(mis);
-				idevice_free(device);
-				lockdownd_service_descriptor_free(service);
+	if (extension == ".app")
+	{
+		appBundlePath = filepath;
+	}
+	else if (extension == ".ipa")
+	{
+		std::cout << "Unzipping .ipa..." << std::endl;
+		appBundlePath = UnzipAppBundle(filepath.string(), temporaryDirectory);
+	}
+	else
+	{
+		throw SignError(SignErrorCode::InvalidApp);
+	}
 
-				free(uuidString);
+	std::shared_ptr<Application> application = std::make_shared<Application>(appBundlePath.string());
+	if (application == NULL)
+	{
+		throw SignError(SignErrorCode::InvalidApp);
+	}
 
-				this->_mutex.unlock();
-				fs::remove_all(temporaryDirectory);
-			};
+	return application;
+}
+
+void DeviceManager::InstallApp(std::shared_ptr<Application> application, std::string deviceUDID, std::optional<std::set<std::string>> activeProfiles, std::function<void(double)> progressCompletionHandler)
+{
+	// Enforce only one installation per device at a time.
+	auto deviceMutex = this->mutexForDevice(deviceUDID);
+	deviceMutex->lock();
+
+	auto UUID = make_uuid();
+
+	char* uuidString = (char*)malloc(UUID.size() + 1);
+	strncpy(uuidString, (const char*)UUID.c_str(), UUID.size());
+	uuidString[UUID.size()] = '\0';
+
+	idevice_t device = nullptr;
+	lockdownd_client_t client = NULL;
+	instproxy_client_t ipc = NULL;
+	afc_client_t afc = NULL;
+	misagent_client_t mis = NULL;
+	lockdownd_service_descriptor_t service = NULL;
+
+	fs::path appBundlePath(application->path());
 
-			try
+	auto installedProfiles = std::make_shared<std::vector<std::shared_ptr<ProvisioningProfile>>>();
+	auto cachedProfiles = std::make_shared<std::map<std::string, std::shared_ptr<ProvisioningProfile>>>();
+
+	auto finish = [this, installedProfiles, cachedProfiles, activeProfiles, deviceMutex, &uuidString]
+	(idevice_t device, lockdownd_client_t client, instproxy_client_t ipc, afc_client_t afc, misagent_client_t mis, lockdownd_service_descriptor_t service)
+	{
+		auto cleanUp = [=]() {
+			instproxy_client_free(ipc);
+			afc_client_free(afc);
+			lockdownd_client_free(client);
+			misagent_client_free(mis);
+			idevice_free(device);
+			lockdownd_service_descriptor_free(service);
+
+			free(uuidString);
+
+			deviceMutex->unlock();
+		};
+
+		try
+		{
+			if (activeProfiles.has_value())
 			{
-				if (activeProfiles.has_value())
+				// Remove installed provisioning profiles if they're not active.
+				for (auto& installedProfile : *installedProfiles)
 				{
-					// Remove installed provisioning profiles if they're not active.
-					for (auto& installedProfile : *installedProfiles)
+					if (std::count(activeProfiles->begin(), activeProfiles->end(), installedProfile->bundleIdentifier()) == 0)
 					{
-						if (std::count(activeProfiles->begin(), activeProfiles->end(), installedProfile->bundleIdentifier()) == 0)
-						{
-							this->RemoveProvisioningProfile(installedProfile, mis);
-						}
+						this->RemoveProvisioningProfile(installedProfile, mis);
 					}
 				}
+			}
 
-				for (auto& pair : *cachedProfiles)
-				{
-					BOOL reinstall = true;
+			for (auto& pair : *cachedProfiles)
+			{
+				BOOL reinstall = true;
 
-					for (auto& installedProfile : *installedProfiles)
+				for (auto& installedProfile : *installedProfiles)
+				{
+					if (installedProfile->bundleIdentifier() == pair.second->bundleIdentifier())
 					{
-						if (installedProfile->bundleIdentifier() == pair.second->bundleIdentifier())
-						{
-							// Don't reinstall cached profile because it was installed with app.
-							reinstall = false;
-							break;
-						}
+						// Don't reinstall cached profile because it was installed with app.
+						reinstall = false;
+						break;
 					}
+				}
 
-					if (reinstall)
-					{
-						this->InstallProvisioningProfile(pair.second, mis);
-					}					
-				}				
-			}
-			catch (std::exception& exception)
+				if (reinstall)
+				{
+					this->InstallProvisioningProfile(pair.second, mis);
+				}					
+			}				
+		}
+		catch (std::exception& exception)
+		{
+			cleanUp();
+			throw;
+		}
+
+		// Clean up outside scope so if an exception is thrown, we don't
+		// catch it ourselves again.
+		cleanUp();
+	};
+
+	try
+	{
+		if (application->provisioningProfile())
+		{
+			installedProfiles->push_back(application->provisioningProfile());
+		}
+
+		for (auto& appExtension : application->appExtensions())
+		{
+			if (appExtension->provisioningProfile())
 			{
-				cleanUp();
-				throw;
+				installedProfiles->push_back(appExtension->provisioningProfile());
 			}
+		}
 
-			// Clean up outside scope so if an exception is thrown, we don't
-			// catch it ourselves again.
-			cleanUp();
-		};
+		/* Find Device */
+		if (idevice_new(&device, deviceUDID.c_str()) != IDEVICE_E_SUCCESS)
+		{
+			throw ServerError(ServerErrorCode::DeviceNotFound);
+		}
 
-		try
+		/* Connect to Device */
+		if (lockdownd_client_new_with_handshake(device, &client, "altserver") != LOCKDOWN_E_SUCCESS)
 		{
-			fs::path filepath(appFilepath);
+			throw ServerError(ServerErrorCode::ConnectionFailed);
+		}
 
-			auto extension = filepath.extension().string();
-			std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) {
-				return std::tolower(c);
-				});
+		/* Connect to Installation Proxy */
+		if ((lockdownd_start_service(client, "com.apple.mobile.installation_proxy", &service) != LOCKDOWN_E_SUCCESS) || service == NULL)
+		{
+			throw ServerError(ServerErrorCode::ConnectionFailed);
+		}
 
-			fs::path appBundlePath;
+		if (instproxy_client_new(device, service, &ipc) != INSTPROXY_E_SUCCESS)
+		{
+			throw ServerError(ServerErrorCode::ConnectionFailed);
+		}
 
-			if (extension == ".app")
-			{
-				appBundlePath = filepath;
-			}
-			else if (extension == ".ipa")
-			{
-				std::cout << "Unzipping .ipa..." << std::endl;
-				appBundlePath = UnzipAppBundle(filepath.string(), temporaryDirectory.string());
-			}
-			else
-			{
-				throw SignError(SignErrorCode::InvalidApp);
-			}
+		if (service)
+		{
+			lockdownd_service_descriptor_free(service);
+			service = NULL;
+		}
 
-			std::shared_ptr<Application> application = std::make_shared<Application>(appBundlePath.string());
-			if (application == NULL)
-			{
-				throw SignError(SignErrorCode::InvalidApp);
-			}
 
-			if (application->provisioningProfile())
-			{
-				installedProfiles->push_back(application->provisioningProfile());
-			}
+		/* Connect to Misagent */
+		// Must connect now, since if we take too long writing files to device, connecting may fail later when managing profiles.
+		if (lockdownd_start_service(client, "com.apple.misagent", &service) != LOCKDOWN_E_SUCCESS || service == NULL)
+		{
+			throw ServerError(ServerErrorCode::ConnectionFailed);
+		}
 
-			for (auto& appExtension : application->appExtensions())
-			{
-				if (appExtension->provisioningProfile())
-				{
-					installedProfiles->push_back(appExtension->provisioningProfile());
-				}
-			}
+		if (misagent_client_new(device, service, &mis) != MISAGENT_E_SUCCESS)
+		{
+			throw ServerError(ServerErrorCode::ConnectionFailed);
+		}
 
-			/* Find Device */
-			if (idevice_new(&device, deviceUDID.c_str()) != IDEVICE_E_SUCCESS)
-			{
-				throw ServerError(ServerErrorCode::DeviceNotFound);
-			}
 
-			/* Connect to Device */
-			if (lockdownd_client_new_with_handshake(device, &client, "altserver") != LOCKDOWN_E_SUCCESS)
-			{
-				throw ServerError(ServerErrorCode::ConnectionFailed);
-			}
+		/* Connect to AFC service */
+		if ((lockdownd_start_service(client, "com.apple.afc", &service) != LOCKDOWN_E_SUCCESS) || service == NULL)
+		{
+			throw ServerError(ServerErrorCode::ConnectionFailed);
+		}
 
-			/* Connect to Installation Proxy */
-			if ((lockdownd_start_service(client, "com.apple.mobile.installation_proxy", &service) != LOCKDOWN_E_SUCCESS) || service == NULL)
-			{
-				throw ServerError(ServerErrorCode::ConnectionFailed);
-			}
+		if (afc_client_new(device, service, &afc) != AFC_E_SUCCESS)
+		{
+			throw ServerError(ServerErrorCode::ConnectionFailed);
+		}
 
-			if (instproxy_client_new(device, service, &ipc) != INSTPROXY_E_SUCCESS)
-			{
-				throw ServerError(ServerErrorCode::ConnectionFailed);
-			}
+		fs::path stagingPath("PublicStaging");
 
-			if (service)
+		/* Prepare for installation */
+		char** files = NULL;
+		if (afc_get_file_info(afc, (const char*)stagingPath.c_str(), &files) != AFC_E_SUCCESS)
+		{
+			if (afc_make_directory(afc, (const char*)stagingPath.c_str()) != AFC_E_SUCCESS)
 			{
-				lockdownd_service_descriptor_free(service);
-				service = NULL;
+				throw ServerError(ServerErrorCode::DeviceWriteFailed);
 			}
+		}
 
+		if (files)
+		{
+			int i = 0;
 
-			/* Connect to Misagent */
-			// Must connect now, since if we take too long writing files to device, connecting may fail later when managing profiles.
-			if (lockdownd_start_service(client, "com.apple.misagent", &service) != LOCKDOWN_E_SUCCESS || service == NULL)
+			while (files[i])
 			{
-				throw ServerError(ServerErrorCode::ConnectionFailed);
+				free(files[i]);
+				i++;
 			}
 
-			if (misagent_client_new(device, service, &mis) != MISAGENT_E_SUCCESS)
-			{
-				throw ServerError(ServerErrorCode::ConnectionFailed);
-			}
+			free(files);
+		}
 
+		std::cout << "Writing to device..." << std::endl;
 
-			/* Connect to AFC service */
-			if ((lockdownd_start_service(client, "com.apple.afc", &service) != LOCKDOWN_E_SUCCESS) || service == NULL)
-			{
-				throw ServerError(ServerErrorCode::ConnectionFailed);
-			}
+		plist_t options = instproxy_client_options_new();
+		instproxy_client_options_add(options, "PackageType", "Developer", NULL);
+
+		fs::path destinationPath = stagingPath.append(appBundlePath.filename().string());
 
-			if (afc_client_new(device, service, &afc) != AFC_E_SUCCESS)
+		int numberOfFiles = 0;
+		for (auto& item : fs::recursive_directory_iterator(appBundlePath))
+		{
+			if (item.is_regular_file())
 			{
-				throw ServerError(ServerErrorCode::ConnectionFailed);
-			}
+				numberOfFiles++;
+			}				
+		}
+
+		int writtenFiles = 0;
 
-			fs::path stagingPath("PublicStaging");
+		try
+		{
+			this->WriteDirectory(afc, appBundlePath.string(), destinationPath.string(), [&writtenFiles, numberOfFiles, progressCompletionHandler](std::string filepath) {
+				writtenFiles++;
 
-			/* Prepare for installation */
-			char** files = NULL;
-			if (afc_get_file_info(afc, (const char*)stagingPath.c_str(), &files) != AFC_E_SUCCESS)
+				double progress = (double)writtenFiles / (double)numberOfFiles;
+				double weightedProgress = progress * 0.75;
+				progressCompletionHandler(weightedProgress);
+			});
+		}
+		catch (ServerError& e)
+		{
+			if (application->bundleIdentifier().find("science.xnu.undecimus") != std::string::npos)
 			{
-				if (afc_make_directory(afc, (const char*)stagingPath.c_str()) != AFC_E_SUCCESS)
-				{
-					throw ServerError(ServerErrorCode::DeviceWriteFailed);
-				}
-			}
+				auto userInfo = e.userInfo();
+				userInfo["NSLocalizedRecoverySuggestion"] = "Make sure Windows real-time protection is disabled on your computer then try again.";
 
-			if (files)
+				throw ServerError((ServerErrorCode)e.code(), userInfo);
+			}	
+			else
+			{
+				throw;
+			}				
+		}
+		catch (std::exception& exception)
+		{
+			if (application->bundleIdentifier().find("science.xnu.undecimus") != std::string::npos)
 			{
-				int i = 0;
+				std::map<std::string, std::string> userInfo = {
+					{ "NSLocalizedDescription", exception.what() },
+					{ "NSLocalizedRecoverySuggestion", "Make sure Windows real-time protection is disabled on your computer then try again." }
+				};
 
-				while (files[i])
+				if (std::string(exception.what()) == std::string("vector<T> too long"))
+				{
+					userInfo["NSLocalizedFailureReason"] = "Windows Defender Blocked Installation";
+				}
+				else
 				{
-					free(files[i]);
-					i++;
+					userInfo["NSLocalizedFailureReason"] = exception.what();
 				}
 
-				free(files);
+				throw ServerError(ServerErrorCode::Unknown, userInfo);
 			}
-
-			std::cout << "Writing to device..." << std::endl;
-
-			plist_t options = instproxy_client_options_new();
-			instproxy_client_options_add(options, "PackageType", "Developer", NULL);
-
-			fs::path destinationPath = stagingPath.append(appBundlePath.filename().string());
-
-			int numberOfFiles = 0;
-			for (auto& item : fs::recursive_directory_iterator(appBundlePath))
+			else
 			{
-				if (item.is_regular_file())
-				{
-					numberOfFiles++;
-				}				
+				throw;
 			}
+		}
 
-			int writtenFiles = 0;
+		std::cout << "Finished writing to device." << std::endl;
 
-			try
-			{
-				this->WriteDirectory(afc, appBundlePath.string(), destinationPath.string(), [&writtenFiles, numberOfFiles, progressCompletionHandler](std::string filepath) {
-					writtenFiles++;
 
-					double progress = (double)writtenFiles / (double)numberOfFiles;
-					double weightedProgress = progress * 0.75;
-					progressCompletionHandler(weightedProgress);
-				});
-			}
-			catch (ServerError& e)
-			{
-				if (application->bundleIdentifier().find("science.xnu.undecimus") != std::string::npos)
-				{
-					auto userInfo = e.userInfo();
-					userInfo["NSLocalizedRecoverySuggestion"] = "Make sure Windows real-time protection is disabled on your computer then try again.";
+		if (service)
+		{
+			lockdownd_service_descriptor_free(service);
+			service = NULL;
+		}
 
-					throw ServerError((ServerErrorCode)e.code(), userInfo);
-				}	
-				else
-				{
-					throw;
-				}				
-			}
-			catch (std::exception& exception)
+		/* Provisioning Profiles */			
+		bool shouldManageProfiles = (activeProfiles.has_value() || (application->provisioningProfile() != NULL && application->provisioningProfile()->isFreeProvisioningProfile()));
+		if (shouldManageProfiles)
+		{				
+			// Free developer account was used to sign this app, so we need to remove all
+			// provisioning profiles in order to remain under sideloaded app limit.
+
+			auto removedProfiles = this->RemoveAllFreeProvisioningProfilesExcludingBundleIdentifiers({}, mis);
+			for (auto& pair : removedProfiles)
 			{
-				if (application->bundleIdentifier().find("science.xnu.undecimus") != std::string::npos)
+				if (activeProfiles.has_value())
 				{
-					std::map<std::string, std::string> userInfo = {
-						{ "NSLocalizedDescription", exception.what() },
-						{ "NSLocalizedRecoverySuggestion", "Make sure Windows real-time protection is disabled on your computer then try again." }
-					};
-
-					if (std::string(exception.what()) == std::string("vector<T> too long"))
-					{
-						userInfo["NSLocalizedFailureReason"] = "Windows Defender Blocked Installation";
-					}
-					else
+					if (activeProfiles->count(pair.first) > 0)
 					{
-						userInfo["NSLocalizedFailureReason"] = exception.what();
+						// Only cache active profiles to reinstall afterwards.
+						(*cachedProfiles)[pair.first] = pair.second;
 					}
-
-					throw ServerError(ServerErrorCode::Unknown, userInfo);
 				}
 				else
 				{
-					throw;
+					// Cache all profiles to reinstall afterwards if we didn't provide activeProfiles.
+					(*cachedProfiles)[pair.first] = pair.second;
 				}
-			}
+			}				
+		}
 
-			std::cout << "Finished writing to device." << std::endl;
+		lockdownd_client_free(client);
+		client = NULL;
 
+		std::mutex waitingMutex;
+		std::condition_variable cv;
 
-			if (service)
-			{
-				lockdownd_service_descriptor_free(service);
-				service = NULL;
-			}
+		std::optional<ServerError> serverError = std::nullopt;
+		std::optional<LocalizedError> localizedError = std::nullopt;
+
+		bool didBeginInstalling = false;
+		bool didFinishInstalling = false;
 
-			/* Provisioning Profiles */			
-			bool shouldManageProfiles = (activeProfiles.has_value() || (application->provisioningProfile() != NULL && application->provisioningProfile()->isFreeProvisioningProfile()));
-			if (shouldManageProfiles)
-			{				
-				// Free developer account was used to sign this app, so we need to remove all
-				// provisioning profiles in order to remain under sideloaded app limit.
+		std::unique_lock<std::mutex> handlersLock(this->_handlersMutex);
+		this->_installationProgressHandlers[UUID] = [device, client, ipc, afc, mis, service, finish, progressCompletionHandler, 
+			&waitingMutex, &cv, &didBeginInstalling, &didFinishInstalling, &serverError, &localizedError](double progress, int resultCode, char *name, char *description) {
+			double weightedProgress = progress * 0.25;
+			double adjustedProgress = weightedProgress + 0.75;
 
-				auto removedProfiles = this->RemoveAllFreeProvisioningProfilesExcludingBundleIdentifiers({}, mis);
-				for (auto& pair : removedProfiles)
+			if (progress == 0 && didBeginInstalling)
+			{
+				if (resultCode != 0 || name != NULL)
 				{
-					if (activeProfiles.has_value())
+					if (resultCode == -402620383)
 					{
-						if (activeProfiles->count(pair.first) > 0)
-						{
-							// Only cache active profiles to reinstall afterwards.
-							(*cachedProfiles)[pair.first] = pair.second;
-						}
+						std::map<std::string, std::string> userInfo = {
+							{ "NSLocalizedRecoverySuggestion", "Make sure 'Offload Unused Apps' is disabled in Settings > iTunes & App Stores, then install or delete all offloaded apps." }
+						};
+						serverError = std::make_optional<ServerError>(ServerErrorCode::MaximumFreeAppLimitReached, userInfo);
 					}
 					else
 					{
-						// Cache all profiles to reinstall afterwards if we didn't provide activeProfiles.
-						(*cachedProfiles)[pair.first] = pair.second;
-					}
-				}				
-			}
-
-			lockdownd_client_free(client);
-			client = NULL;
-
-			std::mutex waitingMutex;
-			std::condition_variable cv;
-
-			std::optional<ServerError> serverError = std::nullopt;
-			std::optional<LocalizedError> localizedError = std::nullopt;
+						std::string errorName(name);
 
-			bool didBeginInstalling = false;
-			bool didFinishInstalling = false;
-
-			this->_installationProgressHandlers[UUID] = [device, client, ipc, afc, mis, service, finish, progressCompletionHandler, 
-				&waitingMutex, &cv, &didBeginInstalling, &didFinishInstalling, &serverError, &localizedError](double progress, int resultCode, char *name, char *description) {
-				double weightedProgress = progress * 0.25;
-				double adjustedProgress = weightedProgress + 0.75;
-
-				if (progress == 0 && didBeginInstalling)
-				{
-					if (resultCode != 0 || name != NULL)
-					{
-						if (resultCode == -402620383)
+						if (errorName == "DeviceOSVersionTooLow")
 						{
-							std::map<std::string, std::string> userInfo = {
-								{ "NSLocalizedRecoverySuggestion", "Make sure 'Offload Unused Apps' is disabled in Settings > iTunes & App Stores, then install or delete all offloaded apps." }
-							};
-							serverError = std::make_optional<ServerError>(ServerErrorCode::MaximumFreeAppLimitReached, userInfo);
+							serverError = std::make_optional<ServerError>(ServerErrorCode::UnsupportediOSVersion);
 						}
 						else
 						{
-							std::string errorName(name);
-
-							if (errorName == "DeviceOSVersionTooLow")
-							{
-								serverError = std::make_optional<ServerError>(ServerErrorCode::UnsupportediOSVersion);
-							}
-							else
-							{
-								localizedError = std::make_optional<LocalizedError>(resultCode, description);
-							}
+							localizedError = std::make_optional<LocalizedError>(resultCode, description);
 						}
 					}
-
-					std::lock_guard<std::mutex> lock(waitingMutex);
-					didFinishInstalling = true;
-					cv.notify_all();
-				}
-				else
-				{
-					progressCompletionHandler(adjustedProgress);
 				}
 
+				std::lock_guard<std::mutex> lock(waitingMutex);
+				didFinishInstalling = true;
+				cv.notify_all();
+			}
+			else
+			{
+				progressCompletionHandler(adjustedProgress);
 				didBeginInstalling = true;
-			};
+			}
+		};
+		handlersLock.unlock();
 
-			auto narrowDestinationPath = StringFromWideString(destinationPath.c_str());
-			std::replace(narrowDestinationPath.begin(), narrowDestinationPath.end(), '\\', '/');
+		auto narrowDestinationPath = StringFromWideString(destinationPath.c_str());
+		std::replace(narrowDestinationPath.begin(), narrowDestinationPath.end(), '\\', '/');
 
-			instproxy_install(ipc, narrowDestinationPath.c_str(), options, DeviceManagerUpdateStatus, uuidString);
-			instproxy_client_options_free(options);
+		instproxy_install(ipc, narrowDestinationPath.c_str(), options, DeviceManagerUpdateStatus, uuidString);
+		instproxy_client_options_free(options);
 
-			// Wait until we're finished installing;
-			std::unique_lock<std::mutex> lock(waitingMutex);
-			cv.wait(lock, [&didFinishInstalling] { return didFinishInstalling; });
+		// Wait until we're finished installing;
+		std::unique_lock<std::mutex> lock(waitingMutex);
+		cv.wait(lock, [&didFinishInstalling] { return didFinishInstalling; });
 
-			lock.unlock();
+		lock.unlock();
 
-			if (serverError.has_value())
-			{
-				throw serverError.value();
-			}
+		handlersLock.lock();
+		this->_installationProgressHandlers.erase(UUID);
+		handlersLock.unlock();
 
-			if (localizedError.has_value())
-			{
-				throw localizedError.value();
-			}			
-		}
-		catch (std::exception& exception)
+		if (serverError.has_value())
 		{
-			try
-			{
-				// MUST finish so we restore provisioning profiles.
-				finish(device, client, ipc, afc, mis, service);
-			}
-			catch (std::exception& e)
-			{
-				// Ignore since we already caught an exception during installation.
-			}
+			throw serverError.value();
+		}
 
-			throw;
+		if (localizedError.has_value())
+		{
+			throw localizedError.value();
+		}			
+	}
+	catch (std::exception& exception)
+	{
+		try
+		{
+			// MUST finish so we restore provisioning profiles.
+			finish(device, client, ipc, afc, mis, service);
+		}
+		catch (std::exception& e)
+		{
+			// Ignore since we already caught an exception during installation.
 		}
 
-		// Call finish outside try-block so if an exception is thrown, we don't
-		// catch it ourselves and "finish" again.
-		finish(device, client, ipc, afc, mis, service);
-	});
+		throw;
+	}
+
+	// Call finish outside try-block so if an exception is thrown, we don't
+	// catch it ourselves and "finish" again.
+	finish(device, client, ipc, afc, mis, service);
 }
 
 void DeviceManager::WriteDirectory(afc_client_t client, std::string directoryPath, std::string destinationPath, std::function<void(std::string)> wroteFileCallback)
@@ -533,33 +569,47 @@ void DeviceManager::WriteFile(afc_client_t client, std::string filepath, std::st
 	odslog("Writing File: " << filepath.c_str() << " to: " << destinationPath.c_str());
     
     auto data = readFile(filepath.c_str());
-    
-    uint64_t af = 0;
-    if ((afc_file_open(client, destinationPath.c_str(), AFC_FOPEN_WRONLY, &af) != AFC_E_SUCCESS) || af == 0)
-    {
-        throw ServerError(ServerErrorCode::DeviceWriteFailed);
-    }
-    
-    uint32_t bytesWritten = 0;
-    
-    while (bytesWritten < data.size())
+
+    // Devices take turns uploading one file at a time, in the order they asked, so a large
+    // app on one device can't hold up uploads to the rest of the devices sharing the bus.
+    this->_uploadSemaphore.wait();
+
+    try
     {
-        uint32_t count = 0;
-        
-        if (afc_file_write(client, af, (const char *)data.data() + bytesWritten, (uint32_t)data.size() - bytesWritten, &count) != AFC_E_SUCCESS)
+        uint64_t af = 0;
+        if ((afc_file_open(client, destinationPath.c_str(), AFC_FOPEN_WRONLY, &af) != AFC_E_SUCCESS) || af == 0)
         {
             throw ServerError(ServerErrorCode::DeviceWriteFailed);
         }
-        
-        bytesWritten += count;
+
+        uint32_t bytesWritten = 0;
+
+        while (bytesWritten < data.size())
+        {
+            uint32_t count = 0;
+
+            if (afc_file_write(client, af, (const char *)data.data() + bytesWritten, (uint32_t)data.size() - bytesWritten, &count) != AFC_E_SUCCESS)
+            {
+                throw ServerError(ServerErrorCode::DeviceWriteFailed);
+            }
+
+            bytesWritten += count;
+        }
+
+        if (bytesWritten != data.size())
+        {
+            throw ServerError(ServerErrorCode::DeviceWriteFailed);
+        }
+
+        afc_file_close(client, af);
     }
-    
-    if (bytesWritten != data.size())
+    catch (std::exception& exception)
     {
-        throw ServerError(ServerErrorCode::DeviceWriteFailed);
+        this->_uploadSemaphore.notify();
+        throw;
     }
-    
-    afc_file_close(client, af);
+
+    this->_uploadSemaphore.notify();
 
 	wroteFileCallback(filepath);
 }
@@ -634,6 +684,7 @@ pplx::task<void> DeviceManager::RemoveApp(std::string bundleIdentifier, std::str
 
 			bool didFinishInstalling = false;
 
+			std::unique_lock<std::mutex> handlersLock(this->_handlersMutex);
 			this->_deletionCompletionHandlers[UUID] = [this, &waitingMutex, &cv, &didFinishInstalling, &serverError, &uuidString]
 			(bool success, int errorCode, char* errorName, char* errorDescription) {
 				if (!success)
@@ -651,6 +702,7 @@ pplx::task<void> DeviceManager::RemoveApp(std::string bundleIdentifier, std::str
 
 				free(uuidString);
 			};
+			handlersLock.unlock();
 
 			instproxy_uninstall(ipc, bundleIdentifier.c_str(), NULL, DeviceManagerUpdateAppDeletionStatus, uuidString);
 
@@ -703,8 +755,9 @@ pplx::task<std::shared_ptr<WiredConnection>> DeviceManager::StartWiredConnection
 pplx::task<void> DeviceManager::InstallProvisioningProfiles(std::vector<std::shared_ptr<ProvisioningProfile>> provisioningProfiles, std::string deviceUDID, std::optional<std::set<std::string>> activeProfiles)
 {
 	return pplx::task<void>([=] {
-		// Enforce only one installation at a time.
-		this->_mutex.lock();
+		// Enforce only one installation per device at a time.
+		auto deviceMutex = this->mutexForDevice(deviceUDID);
+		deviceMutex->lock();
 
 		idevice_t device = NULL;
 		lockdownd_client_t client = NULL;
@@ -733,7 +786,7 @@ pplx::task<void> DeviceManager::InstallProvisioningProfiles(std::vector<std::sha
 				idevice_free(device);
 			}
 
-			this->_mutex.unlock();
+			deviceMutex->unlock();
 		};
 
 		try
@@ -805,8 +858,9 @@ pplx::task<void> DeviceManager::InstallProvisioningProfiles(std::vector<std::sha
 pplx::task<void> DeviceManager::RemoveProvisioningProfiles(std::set<std::string> bundleIdentifiers, std::string deviceUDID)
 {
 	return pplx::task<void>([=] {
-		// Enforce only one removal at a time.
-		this->_mutex.lock();
+		// Enforce only one removal per device at a time.
+		auto deviceMutex = this->mutexForDevice(deviceUDID);
+		deviceMutex->lock();
 
 		idevice_t device = NULL;
 		lockdownd_client_t client = NULL;
@@ -835,7 +889,7 @@ pplx::task<void> DeviceManager::RemoveProvisioningProfiles(std::set<std::string>
 				idevice_free(device);
 			}
 
-			this->_mutex.unlock();
+			deviceMutex->unlock();
 		};
 
 		try
@@ -875,6 +929,106 @@ pplx::task<void> DeviceManager::RemoveProvisioningProfiles(std::set<std::string>
 	});
 }
 
+pplx::task<std::vector<DeviceOperationResult>> DeviceManager::InstallAppOnDevices(std::string appFilepath, std::vector<std::string> deviceUDIDs, std::optional<std::set<std::string>> activeProfiles, std::function<void(std::string, double)> progressCompletionHandler)
+{
+	return pplx::create_task([=] {
+		fs::path temporaryDirectory(temporary_directory());
+		temporaryDirectory.append(make_uuid());
+
+		fs::create_directory(temporaryDirectory);
+
+		std::shared_ptr<Application> application = nullptr;
+
+		try
+		{
+			// Unpack the signed app once, then upload that same bundle to every device.
+			application = this->UnpackApp(appFilepath, temporaryDirectory.string());
+		}
+		catch (std::exception& exception)
+		{
+			fs::remove_all(temporaryDirectory);
+			throw;
+		}
+
+		return this->PerformOperationOnDevices(deviceUDIDs, [=](std::string deviceUDID) {
+			this->InstallApp(application, deviceUDID, activeProfiles, [=](double progress) {
+				progressCompletionHandler(deviceUDID, progress);
+			});
+		})
+		.then([temporaryDirectory](std::vector<DeviceOperationResult> results) {
+			fs::remove_all(temporaryDirectory);
+			return results;
+		});
+	});
+}
+
+pplx::task<std::vector<DeviceOperationResult>> DeviceManager::RemoveAppFromDevices(std::string bundleIdentifier, std::vector<std::string> deviceUDIDs)
+{
+	return this->PerformOperationOnDevices(deviceUDIDs, [=](std::string deviceUDID) {
+		this->RemoveApp(bundleIdentifier, deviceUDID).get();
+	});
+}
+
+pplx::task<std::vector<DeviceOperationResult>> DeviceManager::RemoveProvisioningProfilesFromDevices(std::set<std::string> bundleIdentifiers, std::vector<std::string> deviceUDIDs)
+{
+	return this->PerformOperationOnDevices(deviceUDIDs, [=](std::string deviceUDID) {
+		this->RemoveProvisioningProfiles(bundleIdentifiers, deviceUDID).get();
+	});
+}
+
+pplx::task<std::vector<DeviceOperationResult>> DeviceManager::PerformOperationOnDevices(std::vector<std::string> deviceUDIDs, std::function<void(std::string)> operation)
+{
+	if (deviceUDIDs.empty())
+	{
+		return pplx::task_from_result(std::vector<DeviceOperationResult>());
+	}
+
+	auto results = std::make_shared<std::vector<DeviceOperationResult>>(deviceUDIDs.size());
+	auto nextIndex = std::make_shared<std::atomic<size_t>>(0);
+
+	auto startDate = std::chrono::steady_clock::now();
+
+	// Each worker keeps taking the next waiting device until there are none left,
+	// so no more than MAX_CONCURRENT_DEVICE_OPERATIONS devices are busy at once.
+	size_t workerCount = std::min(deviceUDIDs.size(), (size_t)MAX_CONCURRENT_DEVICE_OPERATIONS);
+
+	std::vector<pplx::task<void>> workers;
+
+	for (size_t i = 0; i < workerCount; i++)
+	{
+		auto worker = pplx::create_task([=] {
+			for (size_t index = (*nextIndex)++; index < deviceUDIDs.size(); index = (*nextIndex)++)
+			{
+				auto& result = (*results)[index];
+				result.deviceUDID = deviceUDIDs[index];
+
+				auto operationStartDate = std::chrono::steady_clock::now();
+				result.queuedDuration = std::chrono::duration_cast<std::chrono::milliseconds>(operationStartDate - startDate);
+
+				try
+				{
+					operation(result.deviceUDID);
+				}
+				catch (...)
+				{
+					// Record error and move on, so one failing device doesn't stop the rest.
+					result.error = std::current_exception();
+				}
+
+				result.duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - operationStartDate);
+
+				odslog("Finished operation on " << WideStringFromString(result.deviceUDID) << " in " << result.duration.count() << "ms (queued for " << result.queuedDuration.count() << "ms)" << (result.error ? " with error." : "."));
+			}
+		});
+
+		workers.push_back(worker);
+	}
+
+	return pplx::when_all(workers.begin(), workers.end()).then([results] {
+		return *results;
+	});
+}
+
 std::map<std::string, std::shared_ptr<ProvisioningProfile>> DeviceManager::RemoveProvisioningProfiles(std::set<std::string> bundleIdentifiers, misagent_client_t mis)
 {
 	return this->RemoveAllProvisioningProfiles(bundleIdentifiers, std::nullopt, false, mis);
@@ -1312,14 +1466,51 @@ std::map<std::string, std::shared_ptr<Device>>& DeviceManager::cachedDevices()
 	return _cachedDevices;
 }
 
+std::shared_ptr<std::mutex> DeviceManager::mutexForDevice(std::string deviceUDID)
+{
+	std::lock_guard<std::mutex> lock(_deviceMutexesMutex);
+
+	auto& mutex = _deviceMutexes[deviceUDID];
+	if (mutex == nullptr)
+	{
+		mutex = std::make_shared<std::mutex>();
+	}
+
+	return mutex;
+}
+
+void DeviceManager::removeMutexForDevice(std::string deviceUDID)
+{
+	std::lock_guard<std::mutex> lock(_deviceMutexesMutex);
+
+	auto iterator = _deviceMutexes.find(deviceUDID);
+	if (iterator == _deviceMutexes.end())
+	{
+		return;
+	}
+
+	// Keep the mutex while an operation still holds it, so a device reconnecting in the meantime
+	// doesn't get a second one. The next disconnect removes it instead.
+	if (iterator->second.use_count() == 1)
+	{
+		_deviceMutexes.erase(iterator);
+	}
+}
+
 #pragma mark - Callbacks -
 
 void DeviceManagerUpdateStatus(plist_t command, plist_t status, void *uuid)
 {
+	std::unique_lock<std::mutex> handlersLock(DeviceManager::instance()->_handlersMutex);
+
 	if (DeviceManager::instance()->_installationProgressHandlers.count((char*)uuid) == 0)
 	{
 		return;
 	}
+
+	// Copy handler so installations on other devices can update the map while we report progress.
+	auto progressHandler = DeviceManager::instance()->_installationProgressHandlers[(char*)uuid];
+	handlersLock.unlock();
     
     int percent = 0;
     instproxy_status_get_percent_complete(status, &percent);
@@ -1331,7 +1522,6 @@ void DeviceManagerUpdateStatus(plist_t command, plist_t status, void *uuid)
 
 	double progress = ((double)percent / 100.0);
 
-	auto progressHandler = DeviceManager::instance()->_installationProgressHandlers[(char*)uuid];
 	progressHandler(progress, code, name, description);
 }
 
@@ -1347,7 +1537,13 @@ void DeviceManagerUpdateAppDeletionStatus(plist_t command, plist_t status, void*
 
 	if (std::string(statusName) == std::string("Complete") || errorCode != 0 || errorName != NULL)
 	{
+		std::unique_lock<std::mutex> handlersLock(DeviceManager::instance()->_handlersMutex);
+
 		auto completionHandler = DeviceManager::instance()->_deletionCompletionHandlers[(char*)uuid];
+		DeviceManager::instance()->_deletionCompletionHandlers.erase((char*)uuid);
+
+		handlersLock.unlock();
+
 		if (completionHandler != NULL)
 		{
 			if (errorName == NULL)
@@ -1370,8 +1566,6 @@ void DeviceManagerUpdateAppDeletionStatus(plist_t command, plist_t status, void*
 				odslog("Finished removing app!");
 				completionHandler(true, 0, errorName, errorDescription);
 			}
-
-			DeviceManager::instance()->_deletionCompletionHandlers.erase((char*)uuid);
 		}
 	}
 }
@@ -1426,6 +1620,7 @@ void DeviceDidChangeConnectionStatus(const idevice_event_t* event, void* user_da
 		}
 
 		DeviceManager::instance()->cachedDevices().erase(device->identifier());
+		DeviceManager::instance()->removeMutexForDevice(device->identifier());
 
 		if (DeviceManager::instance()->disconnectedDeviceCallback() != NULL)
 		{
@@ -16,6 +16,8 @@
 #include <map>
 #include <set>
 #include <mutex>
+#include <chrono>
+#include <exception>
 
 #include <pplx/pplxtasks.h>
 #include <libimobiledevice/afc.h>
@@ -23,6 +25,22 @@
 
 #include "WiredConnection.h"
 #include "NotificationConnection.h"
+#include "Semaphore.h"
+
+class Application;
+
+// Outcome of a fleet operation on a single device.
+struct DeviceOperationResult
+{
+	std::string deviceUDID;
+
+	// Time spent waiting for a free worker, then time spent working on the device.
+	std::chrono::milliseconds queuedDuration;
+	std::chrono::milliseconds duration;
+
+	// Set if the operation failed on this device. Rethrow with std::rethrow_exception().
+	std::exception_ptr error;
+};
 
 class DeviceManager
 {
@@ -39,6 +57,12 @@ public:
 	pplx::task<void> InstallApp(std::string filepath, std::string deviceUDID, std::optional<std::set<std::string>> activeProvisioningProfiles, std::function<void(double)> progressCompletionHandler);
 	pplx::task<void> RemoveApp(std::string bundleIdentifier, std::string deviceUDID);
 
+	// Fleet operations run on a bounded pool of workers and never fail as a whole;
+	// check each DeviceOperationResult instead.
+	pplx::task<std::vector<DeviceOperationResult>> InstallAppOnDevices(std::string filepath, std::vector<std::string> deviceUDIDs, std::optional<std::set<std::string>> activeProvisioningProfiles, std::function<void(std::string, double)> progressCompletionHandler);
+	pplx::task<std::vector<DeviceOperationResult>> RemoveAppFromDevices(std::string bundleIdentifier, std::vector<std::string> deviceUDIDs);
+	pplx::task<std::vector<DeviceOperationResult>> RemoveProvisioningProfilesFromDevices(std::set<std::string> bundleIdentifiers, std::vector<std::string> deviceUDIDs);
+
 	pplx::task<std::shared_ptr<WiredConnection>> StartWiredConnection(std::shared_ptr<Device> device);
 	pplx::task<std::shared_ptr<NotificationConnection>> StartNotificationConnection(std::shared_ptr<Device> device);
 
@@ -60,10 +84,17 @@ private:
     
     static DeviceManager *_instance;
 
-	std::mutex _mutex;
+	// Serializes installs and profile changes per device, so different devices can be worked on in parallel.
+	std::map<std::string, std::shared_ptr<std::mutex>> _deviceMutexes;
+	std::mutex _deviceMutexesMutex;
+	std::shared_ptr<std::mutex> mutexForDevice(std::string deviceUDID);
+	void removeMutexForDevice(std::string deviceUDID);
+
+	Semaphore _uploadSemaphore;
 
 	std::map<std::string, std::function<void(double, int, char *, char *)>> _installationProgressHandlers;
 	std::map<std::string, std::function<void(bool, int, char*, char*)>> _deletionCompletionHandlers;
+	std::mutex _handlersMutex;
 
 	std::function<void(std::shared_ptr<Device>)> _connectedDeviceCallback;
 	std::function<void(std::shared_ptr<Device>)> _disconnectedDeviceCallback;
@@ -72,6 +103,11 @@ private:
 	std::map<std::string, std::shared_ptr<Device>>& cachedDevices();
     
     std::vector<std::shared_ptr<Device>> availableDevices(bool includeNetworkDevices) const;
+
+	std::shared_ptr<Application> UnpackApp(std::string filepath, std::string temporaryDirectory);
+	void InstallApp(std::shared_ptr<Application> application, std::string deviceUDID, std::optional<std::set<std::string>> activeProvisioningProfiles, std::function<void(double)> progressCompletionHandler);
+
+	pplx::task<std::vector<DeviceOperationResult>> PerformOperationOnDevices(std::vector<std::string> deviceUDIDs, std::function<void(std::string)> operation);
     
     void WriteDirectory(afc_client_t client, std::string directoryPath, std::string destinationPath, std::function<void(std::string)> wroteFileCallback);
     void WriteFile(afc_client_t client, std::string filepath, std::string destinationPath, std::function<void(std::string)> wroteFileCallback);
@@ -18,6 +18,7 @@ enum class InstallErrorCode
     MissingPrivateKey,
     MissingCertificate,
     MissingInfoPlist,
+    DevicesFailed,
 };
 
 class InstallError: public Error
@@ -26,6 +27,10 @@ public:
     InstallError(InstallErrorCode code) : Error((int)code)
     {
     }
+
+	InstallError(InstallErrorCode code, std::map<std::string, std::string> userInfo) : Error((int)code, userInfo)
+	{
+	}
     
     virtual std::string domain() const
     {
@@ -50,6 +55,20 @@ public:
 
 		case InstallErrorCode::MissingInfoPlist:
 			return "The app's Info.plist could not be found.";
+
+		case InstallErrorCode::DevicesFailed:
+		{
+			std::string description = "The app could not be installed on every device.";
+
+			auto userInfo = this->userInfo();
+			auto failureReason = userInfo.find("NSLocalizedFailureReason");
+			if (failureReason != userInfo.end())
+			{
+				description += "\n\n" + failureReason->second;
+			}
+
+			return description;
+		}
 		}
     }
 };
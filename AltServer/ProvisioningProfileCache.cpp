@@ -0,0 +1,236 @@
+//
+//  ProvisioningProfileCache.cpp
+//  AltServer-Windows
+//
+
+#include "ProvisioningProfileCache.hpp"
+
+#include <WinSock2.h>
+
+#include <fstream>
+#include <vector>
+#include <sstream>
+#include <ctime>
+
+#define odslog(msg) { std::stringstream ss; ss << msg << std::endl; OutputDebugStringA(ss.str().c_str()); }
+
+namespace fs = std::filesystem;
+
+// Profiles are only reused for a day after Apple issued them, so apps installed
+// from the cache still get (almost) the full lifetime of a freshly fetched profile.
+const time_t ProvisioningProfileReuseInterval = 24 * 60 * 60;
+
+// Never hand out a profile that expires before the app could even be installed.
+const time_t ProvisioningProfileMinimumLifetime = 60 * 60;
+
+const std::string ProvisioningProfileExtension = ".mobileprovision";
+
+// Team and bundle identifiers come from the app being installed, so only accept
+// characters they can legitimately contain before using them as directory names.
+static bool IsValidPathComponent(const std::string& component)
+{
+	if (component.empty() || component == "." || component == "..")
+	{
+		return false;
+	}
+
+	for (auto character : component)
+	{
+		if (!isalnum((unsigned char)character) && character != '.' && character != '-')
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+ProvisioningProfileCache::ProvisioningProfileCache(fs::path directoryPath) : _directoryPath(directoryPath)
+{
+}
+
+ProvisioningProfileCache::~ProvisioningProfileCache()
+{
+}
+
+// Cached profiles are stored as <team>/<bundle identifier>/<device UDID>_<certificate serial number>_<expiration date>.mobileprovision
+std::shared_ptr<ProvisioningProfile> ProvisioningProfileCache::CachedProfile(std::string teamIdentifier,
+	std::string bundleIdentifier,
+	std::string deviceIdentifier,
+	std::string certificateSerialNumber)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto bundleDirectoryPath = this->BundleDirectoryPath(teamIdentifier, bundleIdentifier);
+	if (!bundleDirectoryPath.has_value() || !IsValidPathComponent(deviceIdentifier) || !IsValidPathComponent(certificateSerialNumber))
+	{
+		return nullptr;
+	}
+
+	auto directoryPath = *bundleDirectoryPath;
+
+	std::error_code error;
+	if (!fs::is_directory(directoryPath, error))
+	{
+		return nullptr;
+	}
+
+	std::string prefix = deviceIdentifier + "_";
+	std::string expectedPrefix = prefix + certificateSerialNumber + "_";
+
+	std::shared_ptr<ProvisioningProfile> cachedProfile = nullptr;
+	std::vector<fs::path> staleProfilePaths;
+
+	for (auto& entry : fs::directory_iterator(directoryPath, error))
+	{
+		auto filename = entry.path().filename().string();
+		if (filename.compare(0, prefix.size(), prefix) != 0)
+		{
+			// Cached for a different device.
+			continue;
+		}
+
+		if (cachedProfile != nullptr || filename.compare(0, expectedPrefix.size(), expectedPrefix) != 0 || entry.path().extension() != ProvisioningProfileExtension)
+		{
+			// Signed for a certificate we no longer use.
+			staleProfilePaths.push_back(entry.path());
+			continue;
+		}
+
+		// Check the expiration date in the file name before parsing the profile itself.
+		auto expirationDate = (time_t)std::strtoll(filename.c_str() + expectedPrefix.size(), nullptr, 10);
+		if (expirationDate - time(nullptr) <= ProvisioningProfileMinimumLifetime)
+		{
+			staleProfilePaths.push_back(entry.path());
+			continue;
+		}
+
+		try
+		{
+			auto profile = std::make_shared<ProvisioningProfile>(entry.path().string());
+			if (profile->teamIdentifier() == teamIdentifier && profile->bundleIdentifier() == bundleIdentifier && this->IsUsable(profile))
+			{
+				cachedProfile = profile;
+				continue;
+			}
+		}
+		catch (std::exception& e)
+		{
+			odslog("Failed to load cached provisioning profile: " << entry.path() << ". " << e.what());
+		}
+
+		staleProfilePaths.push_back(entry.path());
+	}
+
+	for (auto& path : staleProfilePaths)
+	{
+		fs::remove(path, error);
+	}
+
+	return cachedProfile;
+}
+
+void ProvisioningProfileCache::CacheProfile(std::shared_ptr<ProvisioningProfile> profile,
+	std::string deviceIdentifier,
+	std::string certificateSerialNumber)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto bundleDirectoryPath = this->BundleDirectoryPath(profile->teamIdentifier(), profile->bundleIdentifier());
+	if (!bundleDirectoryPath.has_value() || !IsValidPathComponent(deviceIdentifier) || !IsValidPathComponent(certificateSerialNumber))
+	{
+		odslog("Not caching provisioning profile with invalid identifiers: " << profile->bundleIdentifier());
+		return;
+	}
+
+	auto directoryPath = *bundleDirectoryPath;
+
+	std::error_code error;
+	fs::create_directories(directoryPath, error);
+
+	std::string prefix = deviceIdentifier + "_";
+	std::vector<fs::path> previousProfilePaths;
+
+	for (auto& entry : fs::directory_iterator(directoryPath, error))
+	{
+		auto filename = entry.path().filename().string();
+		if (filename.compare(0, prefix.size(), prefix) == 0)
+		{
+			previousProfilePaths.push_back(entry.path());
+		}
+	}
+
+	for (auto& path : previousProfilePaths)
+	{
+		fs::remove(path, error);
+	}
+
+	std::stringstream ss;
+	ss << prefix << certificateSerialNumber << "_" << profile->expirationDate().tv_sec << ProvisioningProfileExtension;
+
+	auto profilePath = directoryPath;
+	profilePath.append(ss.str());
+
+	auto temporaryPath = profilePath;
+	temporaryPath.replace_extension(".tmp");
+
+	try
+	{
+		auto data = profile->data();
+
+		std::ofstream fout(temporaryPath.string(), std::ios::out | std::ios::binary);
+		fout.write((const char*)data.data(), data.size());
+		fout.close();
+
+		if (!fout)
+		{
+			throw std::runtime_error("Could not write profile.");
+		}
+
+		// Only move complete profiles into place, in case we're interrupted while writing.
+		fs::rename(temporaryPath, profilePath);
+	}
+	catch (std::exception& e)
+	{
+		// Ignore caching errors, the profile will simply be fetched again next time.
+		odslog("Failed to cache provisioning profile: " << profilePath << ". " << e.what());
+		fs::remove(temporaryPath, error);
+	}
+}
+
+bool ProvisioningProfileCache::IsUsable(std::shared_ptr<ProvisioningProfile> profile) const
+{
+	auto now = time(nullptr);
+
+	if (now - profile->creationDate().tv_sec > ProvisioningProfileReuseInterval)
+	{
+		return false;
+	}
+
+	if (profile->expirationDate().tv_sec - now <= ProvisioningProfileMinimumLifetime)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+std::optional<fs::path> ProvisioningProfileCache::BundleDirectoryPath(std::string teamIdentifier, std::string bundleIdentifier) const
+{
+	if (!IsValidPathComponent(teamIdentifier) || !IsValidPathComponent(bundleIdentifier))
+	{
+		return std::nullopt;
+	}
+
+	auto directoryPath = this->directoryPath();
+	directoryPath.append(teamIdentifier);
+	directoryPath.append(bundleIdentifier);
+	return directoryPath;
+}
+
+#pragma mark - Getters -
+
+fs::path ProvisioningProfileCache::directoryPath() const
+{
+	return _directoryPath;
+}
@@ -0,0 +1,48 @@
+//
+//  ProvisioningProfileCache.hpp
+//  AltServer-Windows
+//
+//  Caches fetched provisioning profiles on disk so repeated installs
+//  don't have to go through the developer services API again.
+//
+
+#ifndef ProvisioningProfileCache_hpp
+#define ProvisioningProfileCache_hpp
+
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <filesystem>
+
+#include "ProvisioningProfile.hpp"
+
+class ProvisioningProfileCache
+{
+public:
+	ProvisioningProfileCache(std::filesystem::path directoryPath);
+	~ProvisioningProfileCache();
+
+	// Returns nullptr if there is no cached profile that can still be used.
+	std::shared_ptr<ProvisioningProfile> CachedProfile(std::string teamIdentifier,
+		std::string bundleIdentifier,
+		std::string deviceIdentifier,
+		std::string certificateSerialNumber);
+
+	// Replaces any profile previously cached for the same team, bundle identifier and device.
+	void CacheProfile(std::shared_ptr<ProvisioningProfile> profile,
+		std::string deviceIdentifier,
+		std::string certificateSerialNumber);
+
+	std::filesystem::path directoryPath() const;
+
+private:
+	std::filesystem::path _directoryPath;
+	std::mutex _mutex;
+
+	// Returns std::nullopt if either identifier is not safe to use as a directory name.
+	std::optional<std::filesystem::path> BundleDirectoryPath(std::string teamIdentifier, std::string bundleIdentifier) const;
+	bool IsUsable(std::shared_ptr<ProvisioningProfile> profile) const;
+};
+
+#endif /* ProvisioningProfileCache_hpp */
@@ -3,7 +3,8 @@
 //  AltServer-Windows
 //
 //  Created by Riley Testut on 10/7/20.
-//  Copied from https://stackoverflow.com/a/19659736
+//  Based on https://stackoverflow.com/a/19659736
+//  Waiters are served in the order they called wait().
 //
 
 #pragma once
@@ -20,21 +21,28 @@ public:
 	{
 		std::unique_lock<std::mutex> lock(mtx);
 		count++;
-		cv.notify_one();
+		cv.notify_all();
 	}
 
 	inline void wait()
 	{
 		std::unique_lock<std::mutex> lock(mtx);
 
-		while (count <= 0) {
+		unsigned long long ticket = nextTicket++;
+		while (count <= 0 || ticket != nowServing) {
 			cv.wait(lock);
 		}
 		count--;
+		nowServing++;
+
+		// The next waiter in line may be able to proceed as well.
+		cv.notify_all();
 	}
 
 private:
 	std::mutex mtx;
 	std::condition_variable cv;
 	int count;
+	unsigned long long nextTicket = 0;
+	unsigned long long nowServing = 0;
 };
\ No newline at end of file
@@ -0,0 +1,252 @@
+//
+//  SignedAppCache.cpp
+//  AltServer-Windows
+//
+
+#include "SignedAppCache.hpp"
+
+#include <WinSock2.h>
+#include <windows.h>
+#include <bcrypt.h>
+
+#pragma comment( lib, "bcrypt.lib" )
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#define odslog(msg) { std::stringstream ss; ss << msg << std::endl; OutputDebugStringA(ss.str().c_str()); }
+
+namespace fs = std::filesystem;
+
+extern std::string make_uuid();
+
+// Each signed app is a full copy of the bundle, so only keep the most recently used ones.
+const size_t MaximumCachedAppCount = 4;
+
+const std::string AppBundleExtension = ".app";
+
+// Hashes everything left in stream with SHA-256 using Windows' CNG, so we don't need another crypto dependency.
+static std::string SHA256HexDigest(std::istream& stream)
+{
+	BCRYPT_ALG_HANDLE algorithm = NULL;
+	BCRYPT_HASH_HANDLE hash = NULL;
+
+	if (!BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(&algorithm, BCRYPT_SHA256_ALGORITHM, NULL, 0)))
+	{
+		throw std::runtime_error("Could not open SHA-256 algorithm provider.");
+	}
+
+	if (!BCRYPT_SUCCESS(BCryptCreateHash(algorithm, &hash, NULL, 0, NULL, 0, 0)))
+	{
+		BCryptCloseAlgorithmProvider(algorithm, 0);
+		throw std::runtime_error("Could not create SHA-256 hash.");
+	}
+
+	std::vector<char> buffer(1024 * 1024);
+	while (stream)
+	{
+		stream.read(buffer.data(), buffer.size());
+
+		auto count = stream.gcount();
+		if (count > 0)
+		{
+			BCryptHashData(hash, (PUCHAR)buffer.data(), (ULONG)count, 0);
+		}
+	}
+
+	unsigned char digest[32];
+	NTSTATUS status = BCryptFinishHash(hash, digest, sizeof(digest), 0);
+
+	BCryptDestroyHash(hash);
+	BCryptCloseAlgorithmProvider(algorithm, 0);
+
+	if (!BCRYPT_SUCCESS(status))
+	{
+		throw std::runtime_error("Could not finish SHA-256 hash.");
+	}
+
+	static const char* hexDigits = "0123456789abcdef";
+
+	std::string hexDigest;
+	hexDigest.reserve(sizeof(digest) * 2);
+
+	for (auto byte : digest)
+	{
+		hexDigest.push_back(hexDigits[byte >> 4]);
+		hexDigest.push_back(hexDigits[byte & 0xF]);
+	}
+
+	return hexDigest;
+}
+
+SignedAppCache::SignedAppCache(fs::path directoryPath) : _directoryPath(directoryPath)
+{
+}
+
+SignedAppCache::~SignedAppCache()
+{
+}
+
+// Signed apps are stored as <key>/<app name>.app
+std::optional<std::pair<fs::path, SignedAppCache::Pin>> SignedAppCache::CachedAppPath(std::string key)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto directoryPath = this->directoryPath();
+	directoryPath.append(key);
+
+	std::error_code error;
+	if (!fs::is_directory(directoryPath, error))
+	{
+		return std::nullopt;
+	}
+
+	for (auto& entry : fs::directory_iterator(directoryPath, error))
+	{
+		if (entry.path().extension() == AppBundleExtension && entry.is_directory(error))
+		{
+			// Mark as recently used so it's the last to be removed.
+			fs::last_write_time(directoryPath, fs::file_time_type::clock::now(), error);
+
+			_pinCounts[key]++;
+
+			// The cache lives as long as AltServerApp, so it outlives every pin.
+			Pin pin(nullptr, [this, key](void*) {
+				std::lock_guard<std::mutex> lock(_mutex);
+
+				if (--_pinCounts[key] == 0)
+				{
+					_pinCounts.erase(key);
+				}
+			});
+
+			return std::make_pair(entry.path(), pin);
+		}
+	}
+
+	return std::nullopt;
+}
+
+void SignedAppCache::CacheApp(fs::path appPath, std::string key)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto directoryPath = this->directoryPath();
+	directoryPath.append(key);
+
+	auto temporaryDirectoryPath = this->directoryPath();
+	temporaryDirectoryPath.append(key + "_" + make_uuid() + ".tmp");
+
+	std::error_code error;
+
+	try
+	{
+		auto temporaryAppPath = temporaryDirectoryPath;
+		temporaryAppPath.append(appPath.filename().string());
+
+		fs::create_directories(temporaryDirectoryPath);
+		fs::copy(appPath, temporaryAppPath, fs::copy_options::recursive);
+
+		// Only move complete bundles into place, in case we're interrupted while copying.
+		fs::rename(temporaryDirectoryPath, directoryPath, error);
+		if (error)
+		{
+			// Another install cached this app first, so keep theirs.
+			fs::remove_all(temporaryDirectoryPath, error);
+		}
+	}
+	catch (std::exception& e)
+	{
+		// Ignore caching errors, the app will simply be signed again next time.
+		odslog("Failed to cache signed app: " << appPath << ". " << e.what());
+		fs::remove_all(temporaryDirectoryPath, error);
+	}
+
+	this->RemoveOldestApps();
+}
+
+void SignedAppCache::RemoveOldestApps()
+{
+	std::error_code error;
+	std::vector<std::pair<fs::file_time_type, fs::path>> cachedApps;
+
+	for (auto& entry : fs::directory_iterator(this->directoryPath(), error))
+	{
+		if (entry.path().extension() == ".tmp" || !entry.is_directory(error))
+		{
+			continue;
+		}
+
+		cachedApps.push_back(std::make_pair(fs::last_write_time(entry.path(), error), entry.path()));
+	}
+
+	if (cachedApps.size() <= MaximumCachedAppCount)
+	{
+		return;
+	}
+
+	// Newest first.
+	std::sort(cachedApps.begin(), cachedApps.end(), [](auto& a, auto& b) {
+		return a.first > b.first;
+	});
+
+	for (size_t i = MaximumCachedAppCount; i < cachedApps.size(); i++)
+	{
+		// Apps being installed are removed by a later call instead.
+		if (_pinCounts.count(cachedApps[i].second.filename().string()) > 0)
+		{
+			continue;
+		}
+
+		fs::remove_all(cachedApps[i].second, error);
+	}
+}
+
+std::string SignedAppCache::Key(std::string ipaHash,
+	std::vector<std::shared_ptr<ProvisioningProfile>> profiles,
+	std::string certificateSerialNumber,
+	std::optional<std::string> deviceIdentifier)
+{
+	std::vector<std::string> profileUUIDs;
+	for (auto& profile : profiles)
+	{
+		profileUUIDs.push_back(profile->uuid());
+	}
+
+	// Profiles come from a map keyed by bundle identifier, but don't rely on that order.
+	std::sort(profileUUIDs.begin(), profileUUIDs.end());
+
+	std::stringstream ss;
+	ss << ipaHash << "\n" << certificateSerialNumber << "\n";
+
+	for (auto& uuid : profileUUIDs)
+	{
+		ss << uuid << "\n";
+	}
+
+	if (deviceIdentifier.has_value())
+	{
+		ss << *deviceIdentifier << "\n";
+	}
+
+	return SHA256HexDigest(ss);
+}
+
+std::string SignedAppCache::FileHash(fs::path filepath)
+{
+	std::ifstream fin(filepath.string(), std::ios::in | std::ios::binary);
+	if (!fin)
+	{
+		throw std::runtime_error("Could not open file.");
+	}
+
+	return SHA256HexDigest(fin);
+}
+
+#pragma mark - Getters -
+
+fs::path SignedAppCache::directoryPath() const
+{
+	return _directoryPath;
+}
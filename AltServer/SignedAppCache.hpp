@@ -0,0 +1,58 @@
+//
+//  SignedAppCache.hpp
+//  AltServer-Windows
+//
+//  Keeps signed app bundles on disk so the same build is only signed once,
+//  no matter how many devices it is installed on.
+//
+
+#ifndef SignedAppCache_hpp
+#define SignedAppCache_hpp
+
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <map>
+
+#include "ProvisioningProfile.hpp"
+
+class SignedAppCache
+{
+public:
+	SignedAppCache(std::filesystem::path directoryPath);
+	~SignedAppCache();
+
+	// Keeps a cached app bundle from being removed for as long as it is held.
+	using Pin = std::shared_ptr<void>;
+
+	// Returns std::nullopt if no app bundle has been signed for this key yet.
+	// Otherwise the bundle is pinned until the returned pin is released, so hold on to it while installing.
+	std::optional<std::pair<std::filesystem::path, Pin>> CachedAppPath(std::string key);
+
+	// Copies the signed app bundle into the cache. Keeps the existing copy if another install cached one first.
+	void CacheApp(std::filesystem::path appPath, std::string key);
+
+	// Identifies a signed bundle by the original .ipa, every profile embedded in it and the signing certificate.
+	// Apps that embed the device they are installed on (AltStore) also need that device's identifier.
+	static std::string Key(std::string ipaHash,
+		std::vector<std::shared_ptr<ProvisioningProfile>> profiles,
+		std::string certificateSerialNumber,
+		std::optional<std::string> deviceIdentifier);
+
+	// SHA-256 of the file's contents as a lowercase hex string.
+	static std::string FileHash(std::filesystem::path filepath);
+
+	std::filesystem::path directoryPath() const;
+
+private:
+	std::filesystem::path _directoryPath;
+	std::mutex _mutex;
+	std::map<std::string, int> _pinCounts;
+
+	void RemoveOldestApps();
+};
+
+#endif /* SignedAppCache_hpp */
@@ -762,8 +762,8 @@ pplx::task<bool> AppleAPI::RequestTwoFactorCode(
 
 	std::string identityToken = dsid + ":" + idmsToken;
 
-	std::vector<unsigned char> identityTokenData(identityToken.begin(), identityToken.end());
-	auto encodedIdentityToken = utility::conversions::to_base64(identityTokenData);
+	std::string encodedIdentityToken(((identityToken.size() + 2) / 3) * 4 + 1, '\0');
+	encodedIdentityToken.resize(plist_base64_encode(&encodedIdentityToken[0], identityToken.data(), identityToken.size()));
 
 	std::map<utility::string_t, utility::string_t> headers = {
 		{L"Content-Type", L"text/x-xml-plist"},
@@ -773,7 +773,7 @@ pplx::task<bool> AppleAPI::RequestTwoFactorCode(
 		{L"X-Apple-App-Info", L"com.apple.gs.xcode.auth"},
 		{L"X-Xcode-Version", L"11.2 (11B41)"},
 
-		{L"X-Apple-Identity-Token", encodedIdentityToken},
+		{L"X-Apple-Identity-Token", WideStringFromString(encodedIdentityToken)},
 		{L"X-Apple-I-MD-M", WideStringFromString(anisetteData->machineID()) },
 		{L"X-Apple-I-MD", WideStringFromString(anisetteData->oneTimePassword()) },
 		{L"X-Apple-I-MD-LU", WideStringFromString(anisetteData->localUserID()) },
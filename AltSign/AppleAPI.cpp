@@ -8,6 +8,7 @@
 
 #include <iostream>
 #include <bitset>
+#include <algorithm>
 
 /* The classes below are exported */
 
@@ -97,6 +98,118 @@ bool decompress(const uint8_t* input, size_t input_size, std::vector<uint8_t>& o
     return true;
 }
 
+// Inflates a response body chunk by chunk as it arrives, so the payload is only ever held once.
+class ResponseBodyReader
+{
+public:
+    ResponseBodyReader(http_response response) : _body(response.body()), _length(0), _done(false), _chunk(16 * 1024)
+    {
+        auto& headers = response.headers();
+
+        auto iterator = headers.find(header_names::content_encoding);
+        if (iterator != headers.end() && IsGzipEncoding(StringFromWideString(iterator->second)))
+        {
+            _decompressor = web::http::compression::builtin::make_decompressor(web::http::compression::builtin::algorithm::GZIP);
+        }
+    }
+
+    pplx::task<std::vector<uint8_t>> Read(std::shared_ptr<ResponseBodyReader> self)
+    {
+        return _body.streambuf().getn(_chunk.data(), _chunk.size()).then([self](size_t size) -> pplx::task<std::vector<uint8_t>>
+            {
+                if (size == 0 || self->_done)
+                {
+                    if (self->_decompressor != nullptr && !self->_done)
+                    {
+                        // Flush whatever zlib still holds back, then make sure the stream really ended.
+                        self->Inflate(nullptr, 0, web::http::compression::operation_hint::is_last);
+
+                        if (!self->_done)
+                        {
+                            odslog("Compressed response ended early.");
+                            throw APIError(APIErrorCode::InvalidResponse);
+                        }
+                    }
+
+                    self->_data.resize(self->_length);
+                    return pplx::task_from_result(std::move(self->_data));
+                }
+
+                self->Append(self->_chunk.data(), size);
+                return self->Read(self);
+            });
+    }
+
+private:
+    concurrency::streams::istream _body;
+    std::unique_ptr<web::http::compression::decompress_provider> _decompressor;
+
+    std::vector<uint8_t> _data;
+    size_t _length;
+    bool _done;
+
+    std::vector<uint8_t> _chunk;
+
+    static bool IsGzipEncoding(std::string contentEncoding)
+    {
+        std::transform(contentEncoding.begin(), contentEncoding.end(), contentEncoding.begin(), [](unsigned char c) { return (char)tolower(c); });
+        return contentEncoding.find("gzip") != std::string::npos;
+    }
+
+    void Append(const uint8_t* bytes, size_t size)
+    {
+        if (_decompressor == nullptr)
+        {
+            _data.resize(_length + size);
+            memcpy(_data.data() + _length, bytes, size);
+            _length += size;
+            return;
+        }
+
+        this->Inflate(bytes, size, web::http::compression::operation_hint::has_more);
+    }
+
+    void Inflate(const uint8_t* bytes, size_t size, web::http::compression::operation_hint hint)
+    {
+        size_t inbytes = 0;
+        while (!_done)
+        {
+            if (_length == _data.size())
+            {
+                _data.resize(_data.size() + (std::max)(size * 3, _chunk.size()));
+            }
+
+            size_t available = _data.size() - _length;
+            size_t processed = 0;
+            size_t got = 0;
+
+            try
+            {
+                got = _decompressor->decompress(bytes + inbytes, size - inbytes, _data.data() + _length, available, hint, processed, _done);
+            }
+            catch (std::exception& e)
+            {
+                odslog("Failed to decompress response: " << e.what());
+                throw APIError(APIErrorCode::InvalidResponse);
+            }
+
+            inbytes += processed;
+            _length += got;
+
+            // zlib may still hold output back while it filled the buffer, so only stop once it had room to spare.
+            if (inbytes == size && got < available)
+            {
+                break;
+            }
+
+            if (processed == 0 && got == 0)
+            {
+                break;
+            }
+        }
+    }
+};
+
 AppleAPI* AppleAPI::instance_ = nullptr;
 
 AppleAPI* AppleAPI::getInstance()
@@ -109,32 +222,18 @@ AppleAPI* AppleAPI::getInstance()
     return instance_;
 }
 
-AppleAPI::AppleAPI() : _servicesClient(U("https://developerservices2.apple.com/services/v1")), _client(U("https://developerservices2.apple.com/services/QH65B2")), _gsaClient(U("https://gsa.apple.com"))
+static http_client_config GSAClientConfig()
 {
 	http_client_config config;
 	config.set_validate_certificates(false);
+	return config;
+}
 
-	_gsaClient = web::http::client::http_client(U("https://gsa.apple.com"), config);
-
-//    volatile long response_counter = 0;
-//    auto response_count_handler =
-//    [&response_counter](http_request request, std::shared_ptr<http_pipeline_stage> next_stage) -> pplx::task<http_response>
-//    {
-//        return next_stage->propagate(request)
-//        .then([&response_counter](http_response resp)
-//              {
-//                  return resp.content_ready();
-//              })
-//        .then([&response_counter](http_response resp) -> http_response
-//                                                   {
-//                                                       // Use synchronization primitives to access data from within the handlers.
-//                                                       resp.headers().add("ResponseHeader", "App");
-//                                                       return resp;
-//                                                   });
-//    };
-//
-//    _client.add_handler(response_count_handler);
-
+AppleAPI::AppleAPI() : _clientCounters(std::make_shared<HTTPConnectionCounters>()),
+	_client(MakeClient("https://developerservices2.apple.com/services", http_client_config(), _clientCounters)),
+	_gsaClientCounters(std::make_shared<HTTPConnectionCounters>()),
+	_gsaClient(MakeClient("https://gsa.apple.com", GSAClientConfig(), _gsaClientCounters))
+{
 	OpenSSL_add_all_algorithms();
 }
 
@@ -786,8 +885,7 @@ pplx::task<plist_t> AppleAPI::SendRequest(std::string uri,
 	uint32_t length = 0;
 	plist_to_xml(plist, &plistXML, &length);
 
-	auto wideURI = WideStringFromString(uri);
-	auto wideClientID = WideStringFromString(kClientID);
+	auto wideURI = WideStringFromString(kProtocolVersion + "/" + uri);
 
 	auto encodedURI = web::uri::encode_uri(wideURI);
 	uri_builder builder(encodedURI);
@@ -796,75 +894,33 @@ pplx::task<plist_t> AppleAPI::SendRequest(std::string uri,
 	request.set_request_uri(builder.to_string());
 	request.set_body(plistXML);
 
-	time_t time;
-	struct tm* tm;
-	char dateString[64];
-
-	time = session->anisetteData()->date().tv_sec;
-	tm = localtime(&time);
-
-	strftime(dateString, sizeof dateString, "%FT%T%z", tm);
-
-	std::map<utility::string_t, utility::string_t> headers = {
-		{L"Content-Type", L"text/x-xml-plist"},
-		{L"User-Agent", L"Xcode"},
-		{L"Accept", L"text/x-xml-plist"},
-		{L"Accept-Language", L"en-us"},
-		{L"X-Apple-App-Info", L"com.apple.gs.xcode.auth"},
-		{L"X-Xcode-Version", L"11.2 (11B41)"},
-
-		{L"X-Apple-I-Identity-Id", WideStringFromString(session->dsid()) },
-		{L"X-Apple-GS-Token", WideStringFromString(session->authToken()) },
-		{L"X-Apple-I-MD-M", WideStringFromString(session->anisetteData()->machineID()) },
-		{L"X-Apple-I-MD", WideStringFromString(session->anisetteData()->oneTimePassword()) },
-		{L"X-Apple-I-MD-LU", WideStringFromString(session->anisetteData()->localUserID()) },
-		{L"X-Apple-I-MD-RINFO", WideStringFromString(std::to_string(session->anisetteData()->routingInfo())) },
-		{L"X-Mme-Device-Id", WideStringFromString(session->anisetteData()->deviceUniqueIdentifier()) },
-		{L"X-Mme-Client-Info", WideStringFromString(session->anisetteData()->deviceDescription()) },
-		{L"X-Apple-I-Client-Time", WideStringFromString(dateString) },
-		{L"X-Apple-Locale", WideStringFromString(session->anisetteData()->locale()) },
-		{L"X-Apple-I-TimeZone", WideStringFromString(session->anisetteData()->timeZone()) },
-	};
-
-	for (auto& pair : headers)
+	for (auto& header : this->HeadersForSession(session))
 	{
-		if (request.headers().has(pair.first))
-		{
-			request.headers().remove(pair.first);
-		}
-
-		request.headers().add(pair.first, pair.second);
+		request.headers().add(header.first, header.second);
 	}
 
+	request.headers().set_content_type(L"text/x-xml-plist");
+	request.headers().add(L"Accept", L"text/x-xml-plist");
+
 	auto task = this->client().request(request)
-		.then([=](http_response response)
-			{
-				return response.content_ready();
-			})
 		.then([=](http_response response)
 			{
 				odslog("Received response status code: " << response.status_code());
-				return response.extract_vector();
+
+				auto reader = std::make_shared<ResponseBodyReader>(response);
+				return reader->Read(reader);
 			})
-				.then([=](std::vector<unsigned char> compressedData)
+				.then([=](std::vector<uint8_t> decompressedData)
 					{
-						std::vector<uint8_t> decompressedData;
-						odslog("received size: " << compressedData.size() << "\n");
-						if (compressedData.size() > 2 && compressedData[0] == '<' && compressedData[1] == '?')
-						{
-							// Already decompressed
-							decompressedData = compressedData;
-						}
-						else
+						odslog("received size: " << decompressedData.size() << "\n");
+
+						if (this->logsResponses())
 						{
-							decompress((const uint8_t*)compressedData.data(), (size_t)compressedData.size(), decompressedData);
+							odslog("response data: " << std::string(decompressedData.begin(), decompressedData.end()) << "\n");
 						}
 
-						std::string decompressedXML = std::string(decompressedData.begin(), decompressedData.end());
-						odslog("response data: " << decompressedXML << "\n");
-
 						plist_t plist = nullptr;
-						plist_from_xml(decompressedXML.c_str(), (int)decompressedXML.size(), &plist);
+						plist_from_xml((const char *)decompressedData.data(), (uint32_t)decompressedData.size(), &plist);
 
 						if (plist == nullptr)
 						{
@@ -905,7 +961,7 @@ pplx::task<json::value> AppleAPI::SendServicesRequest(std::string uri,
 
 	auto jsonString = StringFromWideString(stream.str());
 
-	auto wideURI = WideStringFromString(uri);
+	auto wideURI = WideStringFromString("v1/" + uri);
 	auto encodedURI = web::uri::encode_uri(wideURI);
 	uri_builder builder(encodedURI);
 
@@ -913,48 +969,16 @@ pplx::task<json::value> AppleAPI::SendServicesRequest(std::string uri,
 	request.set_request_uri(builder.to_string());
 	request.set_body(jsonString);
 
-	time_t time;
-	struct tm* tm;
-	char dateString[64];
-
-	time = session->anisetteData()->date().tv_sec;
-	tm = localtime(&time);
-
-	strftime(dateString, sizeof dateString, "%FT%T%z", tm);
-
-	std::map<utility::string_t, utility::string_t> headers = {
-		{L"Content-Type", L"application/vnd.api+json"},
-		{L"User-Agent", L"Xcode"},
-		{L"Accept", L"application/vnd.api+json"},
-		{L"Accept-Language", L"en-us"},
-		{L"X-Apple-App-Info", L"com.apple.gs.xcode.auth"},
-		{L"X-Xcode-Version", L"11.2 (11B41)"},
-		{L"X-HTTP-Method-Override", WideStringFromString(method) },
-
-		{L"X-Apple-I-Identity-Id", WideStringFromString(session->dsid()) },
-		{L"X-Apple-GS-Token", WideStringFromString(session->authToken()) },
-		{L"X-Apple-I-MD-M", WideStringFromString(session->anisetteData()->machineID()) },
-		{L"X-Apple-I-MD", WideStringFromString(session->anisetteData()->oneTimePassword()) },
-		{L"X-Apple-I-MD-LU", WideStringFromString(session->anisetteData()->localUserID()) },
-		{L"X-Apple-I-MD-RINFO", WideStringFromString(std::to_string(session->anisetteData()->routingInfo())) },
-		{L"X-Mme-Device-Id", WideStringFromString(session->anisetteData()->deviceUniqueIdentifier()) },
-		{L"X-Mme-Client-Info", WideStringFromString(session->anisetteData()->deviceDescription()) },
-		{L"X-Apple-I-Client-Time", WideStringFromString(dateString) },
-		{L"X-Apple-Locale", WideStringFromString(session->anisetteData()->locale()) },
-		{L"X-Apple-I-TimeZone", WideStringFromString(session->anisetteData()->timeZone()) },
-	};
-
-	for (auto& pair : headers)
+	for (auto& header : this->HeadersForSession(session))
 	{
-		if (request.headers().has(pair.first))
-		{
-			request.headers().remove(pair.first);
-		}
-
-		request.headers().add(pair.first, pair.second);
+		request.headers().add(header.first, header.second);
 	}
 
-	auto task = this->servicesClient().request(request)
+	request.headers().set_content_type(L"application/vnd.api+json");
+	request.headers().add(L"Accept", L"application/vnd.api+json");
+	request.headers().add(L"X-HTTP-Method-Override", WideStringFromString(method));
+
+	auto task = this->client().request(request)
 		.then([=](http_response response)
 			{
 				return response.content_ready();
@@ -983,17 +1007,128 @@ pplx::task<json::value> AppleAPI::SendServicesRequest(std::string uri,
 			return task;
 }
 
-web::http::client::http_client AppleAPI::servicesClient()
+web::http::http_headers AppleAPI::HeadersForSession(std::shared_ptr<AppleAPISession> session)
+{
+	std::lock_guard<std::mutex> lock(_sessionHeadersMutex);
+
+	for (auto& sessionHeaders : _sessionHeaders)
+	{
+		if (sessionHeaders.anisetteData == session->anisetteData() && sessionHeaders.dsid == session->dsid() && sessionHeaders.authToken == session->authToken())
+		{
+			return sessionHeaders.headers;
+		}
+	}
+
+	time_t time;
+	struct tm* tm;
+	char dateString[64];
+
+	time = session->anisetteData()->date().tv_sec;
+	tm = localtime(&time);
+
+	strftime(dateString, sizeof dateString, "%FT%T%z", tm);
+
+	// Everything except the content type depends only on the session, so build it once per session.
+	web::http::http_headers headers;
+	headers.add(L"User-Agent", L"Xcode");
+	headers.add(L"Accept-Language", L"en-us");
+	headers.add(L"X-Apple-App-Info", L"com.apple.gs.xcode.auth");
+	headers.add(L"X-Xcode-Version", L"11.2 (11B41)");
+
+	headers.add(L"X-Apple-I-Identity-Id", WideStringFromString(session->dsid()));
+	headers.add(L"X-Apple-GS-Token", WideStringFromString(session->authToken()));
+	headers.add(L"X-Apple-I-MD-M", WideStringFromString(session->anisetteData()->machineID()));
+	headers.add(L"X-Apple-I-MD", WideStringFromString(session->anisetteData()->oneTimePassword()));
+	headers.add(L"X-Apple-I-MD-LU", WideStringFromString(session->anisetteData()->localUserID()));
+	headers.add(L"X-Apple-I-MD-RINFO", WideStringFromString(std::to_string(session->anisetteData()->routingInfo())));
+	headers.add(L"X-Mme-Device-Id", WideStringFromString(session->anisetteData()->deviceUniqueIdentifier()));
+	headers.add(L"X-Mme-Client-Info", WideStringFromString(session->anisetteData()->deviceDescription()));
+	headers.add(L"X-Apple-I-Client-Time", WideStringFromString(dateString));
+	headers.add(L"X-Apple-Locale", WideStringFromString(session->anisetteData()->locale()));
+	headers.add(L"X-Apple-I-TimeZone", WideStringFromString(session->anisetteData()->timeZone()));
+
+	SessionHeaders sessionHeaders;
+	sessionHeaders.dsid = session->dsid();
+	sessionHeaders.authToken = session->authToken();
+	sessionHeaders.anisetteData = session->anisetteData();
+	sessionHeaders.headers = headers;
+
+	// Sessions are few and replaced rarely, so a short list is enough.
+	if (_sessionHeaders.size() >= 8)
+	{
+		_sessionHeaders.erase(_sessionHeaders.begin());
+	}
+
+	_sessionHeaders.push_back(sessionHeaders);
+
+	return headers;
+}
+
+web::http::client::http_client AppleAPI::MakeClient(std::string url, http_client_config config, std::shared_ptr<HTTPConnectionCounters> counters)
+{
+	http_client client(WideStringFromString(url), config);
+
+	client.add_handler([counters](http_request request, std::shared_ptr<http_pipeline_stage> nextStage) -> pplx::task<http_response>
+	{
+		counters->requests++;
+
+		size_t activeRequests = ++counters->activeRequests;
+		size_t peakActiveRequests = counters->peakActiveRequests;
+		while (activeRequests > peakActiveRequests && !counters->peakActiveRequests.compare_exchange_weak(peakActiveRequests, activeRequests))
+		{
+		}
+
+		// Bodies are streamed to the caller, so a request counts as finished once its response headers arrive.
+		return nextStage->propagate(request)
+			.then([counters](pplx::task<http_response> task)
+				{
+					counters->activeRequests--;
+					return task.get();
+				});
+	});
+
+	return client;
+}
+
+void AppleAPI::setDeveloperServicesURL(std::string developerServicesURL)
+{
+	_client = this->MakeClient(developerServicesURL + "/services", http_client_config(), _clientCounters);
+}
+
+HTTPConnectionStatistics AppleAPI::developerServicesStatistics() const
+{
+	HTTPConnectionStatistics statistics;
+	statistics.requests = _clientCounters->requests;
+	statistics.activeRequests = _clientCounters->activeRequests;
+	statistics.peakActiveRequests = _clientCounters->peakActiveRequests;
+	return statistics;
+}
+
+HTTPConnectionStatistics AppleAPI::gsaStatistics() const
+{
+	HTTPConnectionStatistics statistics;
+	statistics.requests = _gsaClientCounters->requests;
+	statistics.activeRequests = _gsaClientCounters->activeRequests;
+	statistics.peakActiveRequests = _gsaClientCounters->peakActiveRequests;
+	return statistics;
+}
+
+bool AppleAPI::logsResponses() const
+{
+	return _logsResponses;
+}
+
+void AppleAPI::setLogsResponses(bool logsResponses)
 {
-    return this->_servicesClient;
+	_logsResponses = logsResponses;
 }
 
-web::http::client::http_client AppleAPI::client()
+web::http::client::http_client& AppleAPI::client()
 {
     return this->_client;
 }
 
-web::http::client::http_client AppleAPI::gsaClient()
+web::http::client::http_client& AppleAPI::gsaClient()
 {
 	return this->_gsaClient;
 }
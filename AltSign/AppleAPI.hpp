@@ -15,6 +15,9 @@
 #include <cpprest/http_client.h>
 #include <cpprest/json.h>
 
+#include <atomic>
+#include <mutex>
+
 #include "Account.hpp"
 #include "AppID.hpp"
 #include "AppGroup.hpp"
@@ -28,6 +31,16 @@
 
 extern std::string StringFromWideString(std::wstring wideString);
 
+class AnisetteData;
+
+// Requests sent to one host. Connections are kept alive and reused; peakActiveRequests is the most that waited on a response at once.
+struct HTTPConnectionStatistics
+{
+	size_t requests;
+	size_t activeRequests;
+	size_t peakActiveRequests;
+};
+
 class AppleAPI
 {
 public:
@@ -64,20 +77,54 @@ public:
     // Provisioning Profiles
     pplx::task<std::shared_ptr<ProvisioningProfile>> FetchProvisioningProfile(std::shared_ptr<AppID> appID, Device::Type deviceType, std::shared_ptr<Team> team, std::shared_ptr<AppleAPISession> session);
     pplx::task<bool> DeleteProvisioningProfile(std::shared_ptr<ProvisioningProfile> profile, std::shared_ptr<Team> team, std::shared_ptr<AppleAPISession> session);
+
+    // Points developer services requests at another server, such as a local mock used for benchmarking.
+    void setDeveloperServicesURL(std::string developerServicesURL);
+
+	HTTPConnectionStatistics developerServicesStatistics() const;
+	HTTPConnectionStatistics gsaStatistics() const;
+
+	// Logs each developer services response body. Off by default, since profile responses are large.
+	bool logsResponses() const;
+	void setLogsResponses(bool logsResponses);
     
 private:
     AppleAPI();
     
     static AppleAPI *instance_;
-    
-    web::http::client::http_client _servicesClient;
-    web::http::client::http_client servicesClient();
 
+	struct HTTPConnectionCounters
+	{
+		std::atomic<size_t> requests{ 0 };
+		std::atomic<size_t> activeRequests{ 0 };
+		std::atomic<size_t> peakActiveRequests{ 0 };
+	};
+
+	struct SessionHeaders
+	{
+		std::string dsid;
+		std::string authToken;
+		std::shared_ptr<AnisetteData> anisetteData;
+		web::http::http_headers headers;
+	};
+
+	// Legacy (QH65B2) and services (v1) endpoints share a host, so they share one client and its keep-alive connections.
+	// Counters are declared before the clients, whose handlers are built from them.
+	std::shared_ptr<HTTPConnectionCounters> _clientCounters;
+	web::http::client::http_client _client;
+	web::http::client::http_client& client();
+
+	std::shared_ptr<HTTPConnectionCounters> _gsaClientCounters;
 	web::http::client::http_client _gsaClient;
-	web::http::client::http_client gsaClient();
-    
-    web::http::client::http_client _client;
-    web::http::client::http_client client();
+	web::http::client::http_client& gsaClient();
+
+	std::atomic<bool> _logsResponses{ false };
+
+	std::mutex _sessionHeadersMutex;
+	std::vector<SessionHeaders> _sessionHeaders;
+
+	web::http::client::http_client MakeClient(std::string url, web::http::client::http_client_config config, std::shared_ptr<HTTPConnectionCounters> counters);
+	web::http::http_headers HeadersForSession(std::shared_ptr<AppleAPISession> session);
     
 	pplx::task<plist_t> SendRequest(std::string uri,
 		std::map<std::string, std::string> additionalParameters,
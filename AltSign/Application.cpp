@@ -67,35 +67,30 @@ Application::Application(std::string appBundlePath)
 
 	auto plistData = readFile(path.string().c_str());
 
+    // plistData outlives plist, so a binary Info.plist is parsed in place.
     plist_t plist = nullptr;
-    plist_from_memory((const char *)plistData.data(), (int)plistData.size(), &plist);
+    plist_from_memory_nocopy((const char *)plistData.data(), (int)plistData.size(), &plist);
     if (plist == nullptr)
     {
         throw SignError(SignErrorCode::InvalidApp);
     }
     
-    auto nameNode = plist_dict_get_item(plist, "CFBundleName");
-    auto bundleIdentifierNode = plist_dict_get_item(plist, "CFBundleIdentifier");
-    auto versionNode = plist_dict_get_item(plist, "CFBundleShortVersionString");
+    auto name = plist_get_string_ptr(plist_dict_get_item(plist, "CFBundleName"), nullptr);
+    auto bundleIdentifier = plist_get_string_ptr(plist_dict_get_item(plist, "CFBundleIdentifier"), nullptr);
+    auto version = plist_get_string_ptr(plist_dict_get_item(plist, "CFBundleShortVersionString"), nullptr);
 
-    if (nameNode == nullptr || bundleIdentifierNode == nullptr || versionNode == nullptr)
+    if (name == nullptr || bundleIdentifier == nullptr || version == nullptr)
     {
+        plist_free(plist);
         throw SignError(SignErrorCode::InvalidApp);
     }
-    
-    char *name = nullptr;
-    plist_get_string_val(nameNode, &name);
-
-    char *bundleIdentifier = nullptr;
-    plist_get_string_val(bundleIdentifierNode, &bundleIdentifier);
-    
-    char *version = nullptr;
-    plist_get_string_val(versionNode, &version);
 
     _name = name;
     _bundleIdentifier = bundleIdentifier;
     _version = version;
     _path = appBundlePath;
+
+    plist_free(plist);
 }
 
 
@@ -20,62 +20,6 @@ extern std::wstring WideStringFromString(std::string string);
 std::string kCertificatePEMPrefix = "-----BEGIN CERTIFICATE-----";
 std::string kCertificatePEMSuffix = "-----END CERTIFICATE-----";
 
-static const std::string base64_chars =
-"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-"abcdefghijklmnopqrstuvwxyz"
-"0123456789+/";
-
-static inline bool is_base64(unsigned char c) {
-	return (isalnum(c) || (c == '+') || (c == '/'));
-}
-
-std::vector<unsigned char> base64_decode(std::string const& encoded_string) {
-	int in_len = encoded_string.size();
-	int i = 0;
-	int j = 0;
-	int in_ = 0;
-	unsigned char char_array_4[4], char_array_3[3];
-	std::vector<unsigned char> ret;
-
-	while (in_len-- && (encoded_string[in_] != '=') && is_base64(encoded_string[in_])) {
-		char_array_4[i++] = encoded_string[in_]; in_++;
-		if (i == 4) {
-			for (i = 0; i < 4; i++)
-				char_array_4[i] = base64_chars.find(char_array_4[i]);
-
-			char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-			char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-			char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
-
-			for (i = 0; (i < 3); i++)
-			{
-				ret.push_back(char_array_3[i]);
-			}
-				
-			i = 0;
-		}
-	}
-
-	if (i) {
-		for (j = i; j < 4; j++)
-			char_array_4[j] = 0;
-
-		for (j = 0; j < 4; j++)
-			char_array_4[j] = base64_chars.find(char_array_4[j]);
-
-		char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-		char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-		char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
-
-		for (j = 0; (j < i - 1); j++)
-		{
-			ret.push_back(char_array_3[j]);
-		}
-	}
-
-	return ret;
-}
-
 Certificate::Certificate()
 {
 }
@@ -90,17 +34,10 @@ Certificate::Certificate(plist_t plist)
 
     if (dataNode != nullptr)
     {
-        char *bytes = nullptr;
         uint64_t size = 0;
-        plist_get_data_val(dataNode, &bytes, &size);
+        auto bytes = (const unsigned char *)plist_get_data_ptr(dataNode, &size);
         
-        std::vector<unsigned char> data;
-		data.reserve(size);
-
-        for (int i = 0; i < size; i++)
-        {
-            data.push_back(bytes[i]);
-        }
+        std::vector<unsigned char> data(bytes, bytes + size);
         
         this->ParseData(data);
     }
@@ -156,8 +93,15 @@ Certificate::Certificate(web::json::value json)
 	std::vector<unsigned char> data;
 	if (attributes.has_field(L"certificateContent"))
 	{
-		auto encodedData = attributes[L"certificateContent"].as_string();
-		data = base64_decode(StringFromWideString(encodedData));
+		auto encodedData = StringFromWideString(attributes[L"certificateContent"].as_string());
+
+		size_t size = encodedData.size();
+		unsigned char *bytes = (unsigned char *)plist_base64_decode(encodedData.c_str(), &size);
+		if (bytes != nullptr)
+		{
+			data.assign(bytes, bytes + size);
+			free(bytes);
+		}
 	}
 
 	auto machineName = attributes[L"machineName"].as_string();
@@ -245,10 +189,11 @@ void Certificate::ParseData(std::vector<unsigned char>& data)
     if (prefix != kCertificatePEMPrefix)
     {
         // Convert to proper PEM format before storing.
-        utility::string_t base64Data = utility::conversions::to_base64(data);
+        std::string base64Data(((data.size() + 2) / 3) * 4 + 1, '\0');
+        base64Data.resize(plist_base64_encode(&base64Data[0], data.data(), data.size()));
         
         std::stringstream ss;
-        ss << kCertificatePEMPrefix << std::endl << StringFromWideString(base64Data) << std::endl << kCertificatePEMSuffix;
+        ss << kCertificatePEMPrefix << std::endl << base64Data << std::endl << kCertificatePEMSuffix;
         
         auto content = ss.str();
         pemData = std::vector<unsigned char>(content.begin(), content.end());
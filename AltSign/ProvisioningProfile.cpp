@@ -64,16 +64,10 @@ ProvisioningProfile::ProvisioningProfile(plist_t plist)
         throw APIError(APIErrorCode::InvalidResponse);
     }
 
-    char *bytes = nullptr;
     uint64_t length = 0;
-    plist_get_data_val(dataNode, &bytes, &length);
+    auto bytes = (const unsigned char *)plist_get_data_ptr(dataNode, &length);
 
-    std::vector<unsigned char> data;
-	data.reserve(length);
-    for (int i = 0; i < length; i++)
-    {
-        data.push_back(bytes[i]);
-    }
+    std::vector<unsigned char> data(bytes, bytes + length);
     
     try
     {
@@ -233,8 +227,9 @@ void ProvisioningProfile::ParseData(std::vector<unsigned char> &encodedData)
     size_t length = itemSize(pointer);
     pointer = advanceToNextItem(pointer);
     
+    // encodedData outlives parsedPlist, so its payloads can be borrowed instead of copied.
     plist_t parsedPlist = nullptr;
-    plist_from_memory((const char *)pointer, (unsigned int)length, &parsedPlist);
+    plist_from_memory_nocopy((const char *)pointer, (unsigned int)length, &parsedPlist);
     
     if (parsedPlist == nullptr)
     {
@@ -250,12 +245,14 @@ void ProvisioningProfile::ParseData(std::vector<unsigned char> &encodedData)
     
     if (nameNode == nullptr || uuidNode == nullptr || teamIdentifiersNode == nullptr || creationDateNode == nullptr || expirationDateNode == nullptr || entitlementsNode == nullptr)
     {
+        plist_free(parsedPlist);
         throw SignError(SignErrorCode::InvalidProvisioningProfile);
     }
     
     auto teamIdentifierNode = plist_array_get_item(teamIdentifiersNode, 0);
     if (teamIdentifierNode == nullptr)
     {
+        plist_free(parsedPlist);
         throw SignError(SignErrorCode::InvalidProvisioningProfile);
     }
 
@@ -272,14 +269,15 @@ void ProvisioningProfile::ParseData(std::vector<unsigned char> &encodedData)
 		_isFreeProvisioningProfile = 0;
 	}
     
-    char *name = nullptr;
-    plist_get_string_val(nameNode, &name);
-    
-    char *uuid = nullptr;
-    plist_get_string_val(uuidNode, &uuid);
+    auto name = plist_get_string_ptr(nameNode, nullptr);
+    auto uuid = plist_get_string_ptr(uuidNode, nullptr);
+    auto teamIdentifier = plist_get_string_ptr(teamIdentifierNode, nullptr);
     
-    char *teamIdentifier = nullptr;
-    plist_get_string_val(teamIdentifierNode, &teamIdentifier);
+    if (name == nullptr || uuid == nullptr || teamIdentifier == nullptr)
+    {
+        plist_free(parsedPlist);
+        throw SignError(SignErrorCode::InvalidProvisioningProfile);
+    }
     
     int32_t create_sec = 0;
     int32_t create_usec = 0;
@@ -292,21 +290,40 @@ void ProvisioningProfile::ParseData(std::vector<unsigned char> &encodedData)
     plist_t bundleIdentifierNode = plist_dict_get_item(entitlementsNode, "application-identifier");
     if (bundleIdentifierNode == nullptr)
     {
+        plist_free(parsedPlist);
         throw SignError(SignErrorCode::InvalidProvisioningProfile);
     }
     
-    char *rawApplicationIdentifier = nullptr;
-    plist_get_string_val(bundleIdentifierNode, &rawApplicationIdentifier);
+    auto rawApplicationIdentifier = plist_get_string_ptr(bundleIdentifierNode, nullptr);
+    if (rawApplicationIdentifier == nullptr)
+    {
+        plist_free(parsedPlist);
+        throw SignError(SignErrorCode::InvalidProvisioningProfile);
+    }
     
     std::string applicationIdentifier(rawApplicationIdentifier);
     
     size_t location = applicationIdentifier.find(".");
     if (location == std::string::npos)
     {
+        plist_free(parsedPlist);
         throw SignError(SignErrorCode::InvalidProvisioningProfile);
     }
     
     std::string bundleIdentifier(applicationIdentifier.begin() + location + 1, applicationIdentifier.end());
+
+    // Team profiles list every registered device they can be installed on.
+    std::vector<std::string> provisionedDevices;
+
+    auto provisionedDevicesNode = plist_dict_get_item(parsedPlist, "ProvisionedDevices");
+    for (uint32_t i = 0; i < plist_array_get_size(provisionedDevicesNode); i++)
+    {
+        auto udid = plist_get_string_ptr(plist_array_get_item(provisionedDevicesNode, i), nullptr);
+        if (udid != nullptr)
+        {
+            provisionedDevices.push_back(udid);
+        }
+    }
     
     _name = name;
     _uuid = uuid;
@@ -320,6 +337,8 @@ void ProvisioningProfile::ParseData(std::vector<unsigned char> &encodedData)
 	_expirationDateMicroseconds = expiration_usec;
 
     _entitlements = plist_copy(entitlementsNode);
+    _provisionedDevices = provisionedDevices;
+    plist_free(parsedPlist);
     
     _data = encodedData;
 }
@@ -373,6 +392,11 @@ plist_t ProvisioningProfile::entitlements() const
 	return _entitlements;
 }
 
+std::vector<std::string> ProvisioningProfile::provisionedDevices() const
+{
+	return _provisionedDevices;
+}
+
 bool ProvisioningProfile::isFreeProvisioningProfile() const
 {
 	return _isFreeProvisioningProfile;
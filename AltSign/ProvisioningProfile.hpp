@@ -41,6 +41,7 @@ public:
 	timeval expirationDate() const;
     
     plist_t entitlements() const;
+    std::vector<std::string> provisionedDevices() const;
 
 	bool isFreeProvisioningProfile() const;
     
@@ -63,6 +64,7 @@ private:
 	long _expirationDateMicroseconds;
     
     plist_t _entitlements;
+    std::vector<std::string> _provisionedDevices;
 	bool _isFreeProvisioningProfile;
     
     std::vector<unsigned char> _data;
@@ -18,6 +18,8 @@
 #include <openssl/applink.c>
 
 #include <filesystem>
+#include <map>
+#include <mutex>
 
 #include <thread>         // std::this_thread::sleep_for
 #include <chrono>         // std::chrono::seconds
@@ -115,8 +117,43 @@ extern std::string make_uuid();
 
 #define odslog(msg) { std::stringstream ss; ss << msg << std::endl; OutputDebugStringA(ss.str().c_str()); }
 
+struct SigningIdentity
+{
+    std::shared_ptr<X509> certificate;
+    std::string key;
+};
+
+// Signing identities are kept per certificate serial number, so the .p12 is only parsed and rebuilt once per certificate.
+static std::map<std::string, SigningIdentity> cachedSigningIdentities;
+static std::mutex cachedSigningIdentitiesMutex;
+
+static X509* ReadCertificate(const char* pemData)
+{
+    BIO* certificateBuffer = BIO_new_mem_buf(pemData, (int)strlen(pemData));
+    X509* certificate = PEM_read_bio_X509(certificateBuffer, NULL, NULL, NULL);
+    BIO_free(certificateBuffer);
+
+    return certificate;
+}
+
 std::string CertificatesContent(std::shared_ptr<Certificate> altCertificate)
 {
+    {
+        std::lock_guard<std::mutex> lock(cachedSigningIdentitiesMutex);
+
+        auto identity = cachedSigningIdentities.find(altCertificate->serialNumber());
+        if (identity != cachedSigningIdentities.end())
+        {
+            if (X509_cmp_current_time(X509_get_notAfter(identity->second.certificate.get())) > 0)
+            {
+                return identity->second.key;
+            }
+
+            // Certificate has expired, so drop it and rebuild below.
+            cachedSigningIdentities.erase(identity);
+        }
+    }
+
     auto altCertificateP12Data = altCertificate->p12Data();
     if (!altCertificateP12Data.has_value())
     {
@@ -132,35 +169,46 @@ std::string CertificatesContent(std::shared_ptr<Certificate> altCertificate)
     EVP_PKEY *key = nullptr;
     X509 *certificate = nullptr;
     PKCS12_parse(inputP12, "", &key, &certificate, NULL);
+
+    if (key == nullptr || certificate == nullptr)
+    {
+        EVP_PKEY_free(key);
+        X509_free(certificate);
+
+        PKCS12_free(inputP12);
+        BIO_free(inputP12Buffer);
+
+        throw SignError(SignErrorCode::InvalidCertificate);
+    }
     
-	// Prepare certificate chain of trust.
+	// Prepare certificate chain of trust. Apple's certificates never change, so only parse them once.
+	static X509* rootCertificate = ReadCertificate(AppleRootCertificateData);
+	static X509* wwdrCertificate = ReadCertificate(AppleWWDRCertificateData);
+	static X509* legacyWWDRCertificate = ReadCertificate(LegacyAppleWWDRCertificateData);
+
 	auto* certificates = sk_X509_new(NULL);
 
-	BIO* rootCertificateBuffer = BIO_new_mem_buf(AppleRootCertificateData, (int)strlen(AppleRootCertificateData));
-	BIO* wwdrCertificateBuffer = NULL;
+	if (rootCertificate != NULL)
+	{
+		sk_X509_push(certificates, rootCertificate);
+	}
 
 	unsigned long issuerHash = X509_issuer_name_hash(certificate);
 	if (issuerHash == 0x817d2f7a)
 	{
 		// Use legacy WWDR certificate.
-		wwdrCertificateBuffer = BIO_new_mem_buf(LegacyAppleWWDRCertificateData, (int)strlen(LegacyAppleWWDRCertificateData));
+		if (legacyWWDRCertificate != NULL)
+		{
+			sk_X509_push(certificates, legacyWWDRCertificate);
+		}
 	}
 	else
 	{
 		// Use latest WWDR certificate.
-		wwdrCertificateBuffer = BIO_new_mem_buf(AppleWWDRCertificateData, (int)strlen(AppleWWDRCertificateData));
-	}
-
-	auto rootCertificate = PEM_read_bio_X509(rootCertificateBuffer, NULL, NULL, NULL);
-	if (rootCertificate != NULL)
-	{
-		sk_X509_push(certificates, rootCertificate);
-	}
-
-	auto wwdrCertificate = PEM_read_bio_X509(wwdrCertificateBuffer, NULL, NULL, NULL);
-	if (wwdrCertificate != NULL)
-	{
-		sk_X509_push(certificates, wwdrCertificate);
+		if (wwdrCertificate != NULL)
+		{
+			sk_X509_push(certificates, wwdrCertificate);
+		}
 	}
     
     // Create new .p12 in memory with private key and certificate chain.
@@ -180,11 +228,19 @@ std::string CertificatesContent(std::shared_ptr<Certificate> altCertificate)
     PKCS12_free(inputP12);
     PKCS12_free(outputP12);
 
-	BIO_free(wwdrCertificateBuffer);
-	BIO_free(rootCertificateBuffer);
+	// Chain certificates are shared, so only free the stack itself.
+	sk_X509_free(certificates);
+	EVP_PKEY_free(key);
     
     BIO_free(inputP12Buffer);
     BIO_free(outputP12Buffer);
+
+	SigningIdentity identity;
+	identity.certificate = std::shared_ptr<X509>(certificate, X509_free);
+	identity.key = output;
+
+	std::lock_guard<std::mutex> lock(cachedSigningIdentitiesMutex);
+	cachedSigningIdentities[altCertificate->serialNumber()] = identity;
     
     return output;
 }
@@ -198,7 +254,7 @@ Signer::~Signer()
 	int i = 0;
 }
 
-void Signer::SignApp(std::string path, std::vector<std::shared_ptr<ProvisioningProfile>> profiles)
+void Signer::SignApp(std::string path, std::vector<std::shared_ptr<ProvisioningProfile>> profiles, std::function<void(std::string)> signingHandler)
 {   
     fs::path appPath = fs::path(path);
 
@@ -295,6 +351,11 @@ void Signer::SignApp(std::string path, std::vector<std::shared_ptr<ProvisioningP
         }),
                    ldid::fun([&](const std::string &string) {
 			odslog("Signing: " << string);
+
+			if (signingHandler)
+			{
+				signingHandler(string);
+			}
 //            progress.completedUnitCount += 1;
         }),
                    ldid::fun([&](const double signingProgress) {
@@ -329,6 +390,12 @@ void Signer::SignApp(std::string path, std::vector<std::shared_ptr<ProvisioningP
     }
 }
 
+void Signer::InvalidateCachedIdentity(std::string serialNumber)
+{
+	std::lock_guard<std::mutex> lock(cachedSigningIdentitiesMutex);
+	cachedSigningIdentities.erase(serialNumber);
+}
+
 std::shared_ptr<Team> Signer::team() const
 {
     return _team;
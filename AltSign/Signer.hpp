@@ -14,6 +14,7 @@
 
 #include <string>
 #include <vector>
+#include <functional>
 
 #include "Team.hpp"
 #include "Certificate.hpp"
@@ -28,7 +29,11 @@ public:
     std::shared_ptr<Team> team() const;
     std::shared_ptr<Certificate> certificate() const;
     
-    void SignApp(std::string appPath, std::vector<std::shared_ptr<ProvisioningProfile>> profiles);
+    // signingHandler, if set, is called as ldid starts signing each file in the bundle.
+    void SignApp(std::string appPath, std::vector<std::shared_ptr<ProvisioningProfile>> profiles, std::function<void(std::string)> signingHandler = nullptr);
+
+    // Drops the signing identity built for a certificate, such as after it has been revoked.
+    static void InvalidateCachedIdentity(std::string serialNumber);
     
 private:
     std::shared_ptr<Team> _team;
@@ -0,0 +1,282 @@
+// AppleAPIBenchmark.cpp : Drives AppleAPI install-preparation flows against a local mock of developer services.
+//
+// Usage: AppleAPIBenchmark.exe [--iterations N] [--concurrency N] [--latency MS] [--gzip] [--responses DIRECTORY] [--test]
+//
+// With --test, runs the tests that need the mock server instead of the benchmark and exits non-zero if any fail.
+//
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <chrono>
+#include <codecvt>
+#include <algorithm>
+#include <numeric>
+#include <mutex>
+#include <thread>
+#include <combaseapi.h>
+
+#include "MockDeveloperServicesServer.hpp"
+#include "ProvisioningProfileCacheTests.hpp"
+
+#include "AppleAPI.hpp"
+#include "AnisetteData.h"
+
+std::string make_uuid()
+{
+	GUID guid;
+	CoCreateGuid(&guid);
+
+	std::ostringstream os;
+	os << std::hex << std::setw(8) << std::setfill('0') << guid.Data1;
+	os << '-';
+	os << std::hex << std::setw(4) << std::setfill('0') << guid.Data2;
+	os << '-';
+	os << std::hex << std::setw(4) << std::setfill('0') << guid.Data3;
+	os << '-';
+	os << std::hex << std::setw(2) << std::setfill('0') << static_cast<short>(guid.Data4[0]);
+	os << std::hex << std::setw(2) << std::setfill('0') << static_cast<short>(guid.Data4[1]);
+	os << '-';
+	os << std::hex << std::setw(2) << std::setfill('0') << static_cast<short>(guid.Data4[2]);
+	os << std::hex << std::setw(2) << std::setfill('0') << static_cast<short>(guid.Data4[3]);
+	os << std::hex << std::setw(2) << std::setfill('0') << static_cast<short>(guid.Data4[4]);
+	os << std::hex << std::setw(2) << std::setfill('0') << static_cast<short>(guid.Data4[5]);
+	os << std::hex << std::setw(2) << std::setfill('0') << static_cast<short>(guid.Data4[6]);
+	os << std::hex << std::setw(2) << std::setfill('0') << static_cast<short>(guid.Data4[7]);
+
+	std::string s(os.str());
+	return s;
+}
+
+std::string StringFromWideString(std::wstring wideString)
+{
+	std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+
+	std::string string = converter.to_bytes(wideString);
+	return string;
+}
+
+std::wstring WideStringFromString(std::string string)
+{
+	std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+
+	std::wstring wideString = converter.from_bytes(string);
+	return wideString;
+}
+
+int iterations = 50;
+int concurrency = 1;
+bool runsTests = false;
+
+std::mutex timingsMutex;
+std::map<std::string, std::vector<double>> timings;
+
+template<typename T>
+T Measure(std::string name, std::function<pplx::task<T>(void)> request)
+{
+	auto start = std::chrono::steady_clock::now();
+	T value = request().get();
+	auto end = std::chrono::steady_clock::now();
+
+	std::lock_guard<std::mutex> lock(timingsMutex);
+	timings[name].push_back(std::chrono::duration<double, std::milli>(end - start).count());
+
+	return value;
+}
+
+// Mirrors the developer services calls AltServer makes before signing an app.
+void PrepareInstallation(std::shared_ptr<Account> account, std::shared_ptr<AppleAPISession> session)
+{
+	auto api = AppleAPI::getInstance();
+	auto start = std::chrono::steady_clock::now();
+
+	auto teams = Measure<std::vector<std::shared_ptr<Team>>>("FetchTeams", [=]() { return api->FetchTeams(account, session); });
+	auto team = teams[0];
+
+	auto devices = Measure<std::vector<std::shared_ptr<Device>>>("FetchDevices", [=]() { return api->FetchDevices(team, Device::Type::All, session); });
+	auto device = Measure<std::shared_ptr<Device>>("RegisterDevice", [=]() { return api->RegisterDevice("Mock iPhone", make_uuid(), Device::Type::iPhone, team, session); });
+
+	auto certificates = Measure<std::vector<std::shared_ptr<Certificate>>>("FetchCertificates", [=]() { return api->FetchCertificates(team, session); });
+
+	auto appIDs = Measure<std::vector<std::shared_ptr<AppID>>>("FetchAppIDs", [=]() { return api->FetchAppIDs(team, session); });
+	auto appID = Measure<std::shared_ptr<AppID>>("AddAppID", [=]() { return api->AddAppID("AltStore", "com.rileytestut.AltStore", team, session); });
+	appID = Measure<std::shared_ptr<AppID>>("UpdateAppID", [=]() { return api->UpdateAppID(appID, team, session); });
+
+	auto groups = Measure<std::vector<std::shared_ptr<AppGroup>>>("FetchAppGroups", [=]() { return api->FetchAppGroups(team, session); });
+	Measure<bool>("AssignAppIDToGroups", [=]() { return api->AssignAppIDToGroups(appID, groups, team, session); });
+
+	Measure<std::shared_ptr<ProvisioningProfile>>("FetchProvisioningProfile", [=]() { return api->FetchProvisioningProfile(appID, Device::Type::iPhone, team, session); });
+
+	auto end = std::chrono::steady_clock::now();
+
+	std::lock_guard<std::mutex> lock(timingsMutex);
+	timings["(install preparation)"].push_back(std::chrono::duration<double, std::milli>(end - start).count());
+}
+
+void PrintTimings(double elapsedTime, size_t requestCount)
+{
+	std::cout << std::left << std::setw(28) << "Call" << std::right
+		<< std::setw(8) << "count"
+		<< std::setw(10) << "mean ms"
+		<< std::setw(10) << "p50 ms"
+		<< std::setw(10) << "p95 ms"
+		<< std::setw(10) << "max ms" << std::endl;
+
+	for (auto& pair : timings)
+	{
+		auto values = pair.second;
+		std::sort(values.begin(), values.end());
+
+		double mean = std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+		double p50 = values[values.size() / 2];
+		double p95 = values[std::min(values.size() - 1, (values.size() * 95) / 100)];
+
+		std::cout << std::left << std::setw(28) << pair.first << std::right << std::fixed << std::setprecision(2)
+			<< std::setw(8) << values.size()
+			<< std::setw(10) << mean
+			<< std::setw(10) << p50
+			<< std::setw(10) << p95
+			<< std::setw(10) << values.back() << std::endl;
+	}
+
+	std::cout << std::endl;
+	std::cout << iterations << " flows, " << requestCount << " requests in " << elapsedTime << " ms ("
+		<< (iterations * 1000.0 / elapsedTime) << " flows/s)" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	MockDeveloperServicesServer server;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string argument = argv[i];
+
+		if (argument == "--iterations" && i + 1 < argc)
+		{
+			iterations = std::max(1, atoi(argv[++i]));
+		}
+		else if (argument == "--concurrency" && i + 1 < argc)
+		{
+			concurrency = std::max(1, atoi(argv[++i]));
+		}
+		else if (argument == "--latency" && i + 1 < argc)
+		{
+			server.setLatency(atoi(argv[++i]));
+		}
+		else if (argument == "--gzip")
+		{
+			server.setCompressesResponses(true);
+		}
+		else if (argument == "--responses" && i + 1 < argc)
+		{
+			server.LoadResponses(argv[++i]);
+		}
+		else if (argument == "--test")
+		{
+			runsTests = true;
+		}
+		else
+		{
+			std::cout << "Usage: AppleAPIBenchmark.exe [--iterations N] [--concurrency N] [--latency MS] [--gzip] [--responses DIRECTORY] [--test]" << std::endl;
+			return 1;
+		}
+	}
+
+	WSADATA wsaData;
+	WSAStartup(MAKEWORD(2, 2), &wsaData);
+
+	try
+	{
+		server.Start();
+	}
+	catch (std::exception& exception)
+	{
+		std::cout << exception.what() << std::endl;
+		return 1;
+	}
+
+	AppleAPI::getInstance()->setDeveloperServicesURL(server.baseURL());
+
+	struct timeval date;
+	date.tv_sec = (long)time(NULL);
+	date.tv_usec = 0;
+
+	auto anisetteData = std::make_shared<AnisetteData>("MOCK-MACHINE-ID", "MOCK-OTP", "MOCK-LOCAL-USER", 17106176, make_uuid(),
+		"C02MOCKSERIAL", "<MacBookPro15,1> <Mac OS X;10.15.2;19C57> <com.apple.AuthKit/1 (com.apple.dt.Xcode/3594.4.19)>",
+		date, "en_US", "PST");
+	auto session = std::make_shared<AppleAPISession>("1234567890", "MOCK-AUTH-TOKEN", anisetteData);
+	auto account = std::make_shared<Account>();
+
+	if (runsTests)
+	{
+		bool passed = true;
+
+		try
+		{
+			passed = TestProvisioningProfileCache(server, account, session) && passed;
+		}
+		catch (std::exception& exception)
+		{
+			std::cout << "Tests failed: " << exception.what() << std::endl;
+			passed = false;
+		}
+
+		server.Stop();
+		WSACleanup();
+
+		return passed ? 0 : 1;
+	}
+
+	// Warm up the connection and one-time initialization outside the measurements.
+	try
+	{
+		PrepareInstallation(account, session);
+	}
+	catch (std::exception& exception)
+	{
+		std::cout << "Mock install preparation failed: " << exception.what() << std::endl;
+		return 1;
+	}
+
+	timings.clear();
+
+	size_t initialRequestCount = server.requestCount();
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> workers;
+	for (int worker = 0; worker < concurrency; worker++)
+	{
+		workers.push_back(std::thread([=]() {
+			for (int i = worker; i < iterations; i += concurrency)
+			{
+				try
+				{
+					PrepareInstallation(account, session);
+				}
+				catch (std::exception& exception)
+				{
+					std::lock_guard<std::mutex> lock(timingsMutex);
+					std::cout << "Install preparation failed: " << exception.what() << std::endl;
+				}
+			}
+		}));
+	}
+
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+
+	auto end = std::chrono::steady_clock::now();
+
+	PrintTimings(std::chrono::duration<double, std::milli>(end - start).count(), server.requestCount() - initialRequestCount);
+
+	auto statistics = AppleAPI::getInstance()->developerServicesStatistics();
+	std::cout << std::endl << "developerservices2: " << statistics.requests << " requests, at most " << statistics.peakActiveRequests << " in flight at once" << std::endl;
+
+	server.Stop();
+	WSACleanup();
+
+	return 0;
+}
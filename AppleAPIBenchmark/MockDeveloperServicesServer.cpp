@@ -0,0 +1,639 @@
+//
+//  MockDeveloperServicesServer.cpp
+//  AppleAPIBenchmark
+//
+
+#include "MockDeveloperServicesServer.hpp"
+
+#include <WS2tcpip.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include <ctime>
+#include <stdexcept>
+
+#include <cpprest/http_compression.h>
+
+#include <plist/plist.h>
+
+#include <openssl/pem.h>
+#include <openssl/pkcs7.h>
+
+#define odslog(msg) { std::stringstream ss; ss << msg << std::endl; OutputDebugStringA(ss.str().c_str()); }
+
+#define SECONDS_FROM_1970_TO_APPLE_REFERENCE_DATE 978307200
+
+extern std::string make_uuid();
+
+namespace fs = std::filesystem;
+
+const char* MockTeamIdentifier = "MOCKTEAM01";
+const char* MockBundleIdentifier = "com.rileytestut.AltStore";
+
+const int MockDeviceCount = 100;
+const int MockAppIDCount = 10;
+
+bool compress(const uint8_t* input, size_t input_size, std::vector<uint8_t>& output)
+{
+	auto compressor = web::http::compression::builtin::make_compressor(web::http::compression::builtin::algorithm::GZIP);
+
+	size_t processed = 0;
+	size_t inbytes = 0;
+	size_t outbytes = 0;
+	bool done = false;
+
+	try
+	{
+		output.resize(input_size + 1024);
+		do
+		{
+			if (outbytes == output.size())
+			{
+				output.resize(output.size() * 2);
+			}
+
+			outbytes += compressor->compress(input + inbytes,
+				input_size - inbytes,
+				output.data() + outbytes,
+				output.size() - outbytes,
+				web::http::compression::operation_hint::is_last,
+				processed,
+				done);
+			inbytes += processed;
+		} while (!done);
+		output.resize(outbytes);
+	}
+	catch (...)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+std::string XMLStringFromPlist(plist_t plist)
+{
+	char* plistXML = nullptr;
+	uint32_t length = 0;
+	plist_to_xml(plist, &plistXML, &length);
+
+	std::string xml(plistXML, length);
+	free(plistXML);
+	plist_free(plist);
+
+	return xml;
+}
+
+plist_t MockTeam()
+{
+	plist_t membership = plist_new_dict();
+	plist_dict_set_item(membership, "name", plist_new_string("Apple Developer Program"));
+
+	plist_t memberships = plist_new_array();
+	plist_array_append_item(memberships, membership);
+
+	plist_t team = plist_new_dict();
+	plist_dict_set_item(team, "name", plist_new_string("Mock Team"));
+	plist_dict_set_item(team, "teamId", plist_new_string(MockTeamIdentifier));
+	plist_dict_set_item(team, "type", plist_new_string("Individual"));
+	plist_dict_set_item(team, "memberships", memberships);
+	return team;
+}
+
+plist_t MockDevice(int index)
+{
+	std::ostringstream name;
+	name << "Mock iPhone " << index;
+
+	char identifier[41];
+	snprintf(identifier, sizeof(identifier), "%040x", index);
+
+	plist_t device = plist_new_dict();
+	plist_dict_set_item(device, "name", plist_new_string(name.str().c_str()));
+	plist_dict_set_item(device, "deviceNumber", plist_new_string(identifier));
+	plist_dict_set_item(device, "deviceClass", plist_new_string("iphone"));
+	return device;
+}
+
+plist_t MockAppID(std::string bundleIdentifier)
+{
+	plist_t features = plist_new_dict();
+	plist_dict_set_item(features, "APG3427HIY", plist_new_bool(1));
+	plist_dict_set_item(features, "push", plist_new_bool(0));
+
+	plist_t enabledFeatures = plist_new_array();
+	plist_array_append_item(enabledFeatures, plist_new_string("APG3427HIY"));
+
+	plist_t appID = plist_new_dict();
+	plist_dict_set_item(appID, "name", plist_new_string(bundleIdentifier.c_str()));
+	plist_dict_set_item(appID, "appIdId", plist_new_string(make_uuid().c_str()));
+	plist_dict_set_item(appID, "identifier", plist_new_string(bundleIdentifier.c_str()));
+	plist_dict_set_item(appID, "features", features);
+	plist_dict_set_item(appID, "enabledFeatures", enabledFeatures);
+	return appID;
+}
+
+plist_t MockAppGroup()
+{
+	std::string groupIdentifier = std::string("group.") + MockBundleIdentifier + "." + MockTeamIdentifier;
+
+	plist_t group = plist_new_dict();
+	plist_dict_set_item(group, "name", plist_new_string("AltStore App Group"));
+	plist_dict_set_item(group, "applicationGroup", plist_new_string(make_uuid().c_str()));
+	plist_dict_set_item(group, "identifier", plist_new_string(groupIdentifier.c_str()));
+	return group;
+}
+
+plist_t MockResponse(const char* key, plist_t value)
+{
+	plist_t response = plist_new_dict();
+	plist_dict_set_item(response, "resultCode", plist_new_uint(0));
+	plist_dict_set_item(response, "protocolVersion", plist_new_string("QH65B2"));
+
+	if (key != nullptr)
+	{
+		plist_dict_set_item(response, key, value);
+	}
+
+	return response;
+}
+
+// Self-signed stand-in for a development certificate, used to sign the mock provisioning profile.
+bool MakeSigningIdentity(EVP_PKEY** outKey, X509** outCertificate)
+{
+	EVP_PKEY* key = EVP_PKEY_new();
+	RSA* rsa = RSA_new();
+	BIGNUM* bignum = BN_new();
+
+	BN_set_word(bignum, RSA_F4);
+	if (RSA_generate_key_ex(rsa, 2048, bignum, NULL) != 1)
+	{
+		BN_free(bignum);
+		RSA_free(rsa);
+		EVP_PKEY_free(key);
+		return false;
+	}
+
+	BN_free(bignum);
+	EVP_PKEY_assign_RSA(key, rsa);
+
+	X509* certificate = X509_new();
+	X509_set_version(certificate, 2);
+	ASN1_INTEGER_set(X509_get_serialNumber(certificate), (long)time(NULL));
+	X509_gmtime_adj(X509_get_notBefore(certificate), 0);
+	X509_gmtime_adj(X509_get_notAfter(certificate), 365L * 24 * 60 * 60);
+	X509_set_pubkey(certificate, key);
+
+	X509_NAME* subject = X509_get_subject_name(certificate);
+	X509_NAME_add_entry_by_txt(subject, "O", MBSTRING_ASC, (const unsigned char*)"AltSign", -1, -1, 0);
+	X509_NAME_add_entry_by_txt(subject, "CN", MBSTRING_ASC, (const unsigned char*)"iPhone Developer: Mock Team", -1, -1, 0);
+	X509_set_issuer_name(certificate, subject);
+
+	if (X509_sign(certificate, key, EVP_sha256()) <= 0)
+	{
+		X509_free(certificate);
+		EVP_PKEY_free(key);
+		return false;
+	}
+
+	*outKey = key;
+	*outCertificate = certificate;
+	return true;
+}
+
+std::vector<unsigned char> MockProvisioningProfileData(EVP_PKEY* key, X509* certificate)
+{
+	time_t now = time(NULL);
+
+	std::string applicationIdentifier = std::string(MockTeamIdentifier) + "." + MockBundleIdentifier;
+
+	plist_t entitlements = plist_new_dict();
+	plist_dict_set_item(entitlements, "application-identifier", plist_new_string(applicationIdentifier.c_str()));
+	plist_dict_set_item(entitlements, "com.apple.developer.team-identifier", plist_new_string(MockTeamIdentifier));
+	plist_dict_set_item(entitlements, "get-task-allow", plist_new_bool(1));
+
+	plist_t teamIdentifiers = plist_new_array();
+	plist_array_append_item(teamIdentifiers, plist_new_string(MockTeamIdentifier));
+
+	std::string name = std::string("iOS Team Provisioning Profile: ") + MockBundleIdentifier;
+
+	plist_t profile = plist_new_dict();
+	plist_dict_set_item(profile, "Name", plist_new_string(name.c_str()));
+	plist_dict_set_item(profile, "UUID", plist_new_string(make_uuid().c_str()));
+	plist_dict_set_item(profile, "TeamIdentifier", teamIdentifiers);
+	plist_dict_set_item(profile, "CreationDate", plist_new_date((int32_t)(now - SECONDS_FROM_1970_TO_APPLE_REFERENCE_DATE), 0));
+	plist_dict_set_item(profile, "ExpirationDate", plist_new_date((int32_t)(now + 7 * 24 * 60 * 60 - SECONDS_FROM_1970_TO_APPLE_REFERENCE_DATE), 0));
+	plist_dict_set_item(profile, "Entitlements", entitlements);
+	plist_dict_set_item(profile, "LocalProvision", plist_new_bool(1));
+
+	std::string xml = XMLStringFromPlist(profile);
+
+	BIO* content = BIO_new_mem_buf(xml.data(), (int)xml.size());
+	PKCS7* pkcs7 = PKCS7_sign(certificate, key, NULL, content, PKCS7_BINARY);
+
+	std::vector<unsigned char> data;
+
+	int length = (pkcs7 != nullptr) ? i2d_PKCS7(pkcs7, NULL) : 0;
+	if (length > 0)
+	{
+		data.resize(length);
+
+		unsigned char* pointer = data.data();
+		i2d_PKCS7(pkcs7, &pointer);
+	}
+
+	PKCS7_free(pkcs7);
+	BIO_free(content);
+
+	return data;
+}
+
+MockDeveloperServicesServer::MockDeveloperServicesServer() : _listeningSocket(INVALID_SOCKET), _port(0), _running(false), _requestCount(0), _compressesResponses(false), _latency(0)
+{
+	this->PrepareDefaultResponses();
+}
+
+MockDeveloperServicesServer::~MockDeveloperServicesServer()
+{
+	this->Stop();
+}
+
+void MockDeveloperServicesServer::PrepareDefaultResponses()
+{
+	plist_t teams = plist_new_array();
+	plist_array_append_item(teams, MockTeam());
+	this->SetResponse("listTeams.action", XMLStringFromPlist(MockResponse("teams", teams)));
+
+	plist_t devices = plist_new_array();
+	for (int i = 0; i < MockDeviceCount; i++)
+	{
+		plist_array_append_item(devices, MockDevice(i));
+	}
+	this->SetResponse("ios/listDevices.action", XMLStringFromPlist(MockResponse("devices", devices)));
+	this->SetResponse("ios/addDevice.action", XMLStringFromPlist(MockResponse("device", MockDevice(MockDeviceCount))));
+
+	plist_t appIDs = plist_new_array();
+	for (int i = 0; i < MockAppIDCount; i++)
+	{
+		std::ostringstream bundleIdentifier;
+		bundleIdentifier << MockBundleIdentifier << ".app" << i;
+
+		plist_array_append_item(appIDs, MockAppID(bundleIdentifier.str()));
+	}
+	this->SetResponse("ios/listAppIds.action", XMLStringFromPlist(MockResponse("appIds", appIDs)));
+	this->SetResponse("ios/addAppId.action", XMLStringFromPlist(MockResponse("appId", MockAppID(MockBundleIdentifier))));
+	this->SetResponse("ios/updateAppId.action", XMLStringFromPlist(MockResponse("appId", MockAppID(MockBundleIdentifier))));
+
+	plist_t groups = plist_new_array();
+	plist_array_append_item(groups, MockAppGroup());
+	this->SetResponse("ios/listApplicationGroups.action", XMLStringFromPlist(MockResponse("applicationGroupList", groups)));
+	this->SetResponse("ios/addApplicationGroup.action", XMLStringFromPlist(MockResponse("applicationGroup", MockAppGroup())));
+	this->SetResponse("ios/assignApplicationGroupToAppId.action", XMLStringFromPlist(MockResponse(nullptr, nullptr)));
+	this->SetResponse("ios/deleteProvisioningProfile.action", XMLStringFromPlist(MockResponse(nullptr, nullptr)));
+
+	EVP_PKEY* key = nullptr;
+	X509* certificate = nullptr;
+	if (!MakeSigningIdentity(&key, &certificate))
+	{
+		odslog("Failed to create mock signing identity.");
+		return;
+	}
+
+	auto profileData = MockProvisioningProfileData(key, certificate);
+
+	plist_t profile = plist_new_dict();
+	plist_dict_set_item(profile, "provisioningProfileId", plist_new_string(make_uuid().c_str()));
+	plist_dict_set_item(profile, "encodedProfile", plist_new_data((const char*)profileData.data(), profileData.size()));
+	this->SetResponse("ios/downloadTeamProvisioningProfile.action", XMLStringFromPlist(MockResponse("provisioningProfile", profile)));
+
+	int certificateLength = i2d_X509(certificate, NULL);
+	std::vector<unsigned char> certificateData(certificateLength);
+
+	unsigned char* pointer = certificateData.data();
+	i2d_X509(certificate, &pointer);
+
+	std::string encodedCertificate(((certificateData.size() + 2) / 3) * 4 + 1, '\0');
+	encodedCertificate.resize(plist_base64_encode(&encodedCertificate[0], certificateData.data(), certificateData.size()));
+
+	std::ostringstream certificates;
+	certificates << "{\"data\":[{\"id\":\"" << make_uuid() << "\",\"type\":\"certificates\",\"attributes\":{"
+		<< "\"certificateContent\":\"" << encodedCertificate << "\","
+		<< "\"machineName\":\"AltServer\","
+		<< "\"machineId\":\"" << make_uuid() << "\","
+		<< "\"name\":\"iPhone Developer: Mock Team\","
+		<< "\"serialNumber\":\"" << std::hex << (long)time(NULL) << "\"}}]}";
+	this->SetResponse("certificates", certificates.str());
+
+	X509_free(certificate);
+	EVP_PKEY_free(key);
+}
+
+void MockDeveloperServicesServer::SetResponse(std::string action, std::string body)
+{
+	std::vector<unsigned char> compressedBody;
+	compress((const uint8_t*)body.data(), body.size(), compressedBody);
+
+	std::lock_guard<std::mutex> lock(_responsesMutex);
+	_responses[action] = body;
+	_compressedResponses[action] = compressedBody;
+}
+
+void MockDeveloperServicesServer::LoadResponses(fs::path directoryPath)
+{
+	for (auto& entry : fs::directory_iterator(directoryPath))
+	{
+		if (!entry.is_regular_file())
+		{
+			continue;
+		}
+
+		std::ifstream file(entry.path(), std::ios::binary);
+		std::string body((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+		std::string action = entry.path().filename().string();
+		std::replace(action.begin(), action.end(), '_', '/');
+
+		this->SetResponse(action, body);
+	}
+}
+
+void MockDeveloperServicesServer::Start()
+{
+	_listeningSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (_listeningSocket == INVALID_SOCKET)
+	{
+		throw std::runtime_error("Could not create mock server socket.");
+	}
+
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = 0;
+
+	if (bind(_listeningSocket, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(_listeningSocket, SOMAXCONN) != 0)
+	{
+		closesocket(_listeningSocket);
+		_listeningSocket = INVALID_SOCKET;
+
+		throw std::runtime_error("Could not start mock server.");
+	}
+
+	int addressLength = sizeof(address);
+	getsockname(_listeningSocket, (struct sockaddr*)&address, &addressLength);
+	_port = ntohs(address.sin_port);
+
+	_running = true;
+	_acceptThread = std::thread(&MockDeveloperServicesServer::AcceptConnections, this);
+
+	odslog("Mock developer services listening on " << this->baseURL());
+}
+
+void MockDeveloperServicesServer::Stop()
+{
+	if (!_running)
+	{
+		return;
+	}
+
+	_running = false;
+
+	closesocket(_listeningSocket);
+	_listeningSocket = INVALID_SOCKET;
+
+	if (_acceptThread.joinable())
+	{
+		_acceptThread.join();
+	}
+
+	std::vector<std::thread> connectionThreads;
+
+	{
+		std::lock_guard<std::mutex> lock(_connectionsMutex);
+
+		for (auto& clientSocket : _connectionSockets)
+		{
+			shutdown(clientSocket, SD_BOTH);
+		}
+
+		connectionThreads.swap(_connectionThreads);
+	}
+
+	for (auto& thread : connectionThreads)
+	{
+		thread.join();
+	}
+}
+
+void MockDeveloperServicesServer::AcceptConnections()
+{
+	while (_running)
+	{
+		SOCKET clientSocket = accept(_listeningSocket, NULL, NULL);
+		if (clientSocket == INVALID_SOCKET)
+		{
+			continue;
+		}
+
+		int noDelay = 1;
+		setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+
+		std::lock_guard<std::mutex> lock(_connectionsMutex);
+		_connectionSockets.insert(clientSocket);
+		_connectionThreads.push_back(std::thread(&MockDeveloperServicesServer::HandleConnection, this, clientSocket));
+	}
+}
+
+void MockDeveloperServicesServer::HandleConnection(SOCKET clientSocket)
+{
+	std::string buffer;
+	char bytes[16384];
+
+	auto receive = [&]() -> bool {
+		int receivedBytes = recv(clientSocket, bytes, sizeof(bytes), 0);
+		if (receivedBytes <= 0)
+		{
+			return false;
+		}
+
+		buffer.append(bytes, receivedBytes);
+		return true;
+	};
+
+	while (_running)
+	{
+		size_t headerLength = 0;
+		while ((headerLength = buffer.find("\r\n\r\n")) == std::string::npos)
+		{
+			if (!receive())
+			{
+				headerLength = std::string::npos;
+				break;
+			}
+		}
+
+		if (headerLength == std::string::npos)
+		{
+			break;
+		}
+
+		std::string header = buffer.substr(0, headerLength);
+		std::transform(header.begin(), header.end(), header.begin(), ::tolower);
+
+		size_t contentLength = 0;
+		size_t contentLengthLocation = header.find("\r\ncontent-length:");
+		if (contentLengthLocation != std::string::npos)
+		{
+			contentLength = strtoul(header.c_str() + contentLengthLocation + strlen("\r\ncontent-length:"), NULL, 10);
+		}
+
+		bool closesConnection = (header.find("\r\nconnection: close") != std::string::npos);
+
+		// Request line is "METHOD /path HTTP/1.1"; the body itself is not needed to pick a response.
+		size_t pathStart = buffer.find(' ') + 1;
+		size_t pathEnd = buffer.find_first_of(" ?", pathStart);
+		std::string path = buffer.substr(pathStart, pathEnd - pathStart);
+
+		size_t requestLength = headerLength + 4 + contentLength;
+		while (buffer.size() < requestLength)
+		{
+			if (!receive())
+			{
+				break;
+			}
+		}
+
+		if (buffer.size() < requestLength)
+		{
+			break;
+		}
+
+		buffer.erase(0, requestLength);
+
+		if (_latency > 0)
+		{
+			Sleep(_latency);
+		}
+
+		if (!this->SendResponse(clientSocket, path) || closesConnection)
+		{
+			break;
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_connectionsMutex);
+		_connectionSockets.erase(clientSocket);
+	}
+
+	closesocket(clientSocket);
+}
+
+bool MockDeveloperServicesServer::SendResponse(SOCKET clientSocket, std::string path)
+{
+	// Strip "/services/<version>/" to get the action.
+	std::string action = path;
+
+	size_t servicesLocation = action.find("/services/");
+	if (servicesLocation != std::string::npos)
+	{
+		size_t versionEnd = action.find('/', servicesLocation + strlen("/services/"));
+		action = (versionEnd == std::string::npos) ? "" : action.substr(versionEnd + 1);
+	}
+
+	bool isServicesRequest = (path.find("/services/v1/") != std::string::npos);
+
+	std::string status = "200 OK";
+	std::string contentType = isServicesRequest ? "application/vnd.api+json" : "text/x-xml-plist";
+	std::string contentEncoding;
+	std::vector<unsigned char> body;
+
+	{
+		std::lock_guard<std::mutex> lock(_responsesMutex);
+
+		auto response = _responses.find(action);
+		if (response == _responses.end())
+		{
+			status = "404 Not Found";
+		}
+		else if (_compressesResponses && !isServicesRequest)
+		{
+			// SendRequest inflates plist bodies itself, SendServicesRequest does not.
+			body = _compressedResponses[action];
+			contentEncoding = "gzip";
+		}
+		else
+		{
+			body.assign(response->second.begin(), response->second.end());
+		}
+	}
+
+	std::ostringstream header;
+	header << "HTTP/1.1 " << status << "\r\n";
+	header << "Content-Type: " << contentType << "\r\n";
+	header << "Content-Length: " << body.size() << "\r\n";
+
+	if (!contentEncoding.empty())
+	{
+		header << "Content-Encoding: " << contentEncoding << "\r\n";
+	}
+
+	header << "\r\n";
+
+	std::string headerString = header.str();
+
+	std::vector<unsigned char> response(headerString.begin(), headerString.end());
+	response.insert(response.end(), body.begin(), body.end());
+
+	size_t sentBytes = 0;
+	while (sentBytes < response.size())
+	{
+		int result = send(clientSocket, (const char*)response.data() + sentBytes, (int)(response.size() - sentBytes), 0);
+		if (result <= 0)
+		{
+			return false;
+		}
+
+		sentBytes += result;
+	}
+
+	_requestCount++;
+
+	return true;
+}
+
+#pragma mark - Getters -
+
+std::string MockDeveloperServicesServer::baseURL() const
+{
+	std::ostringstream url;
+	url << "http://127.0.0.1:" << _port;
+	return url.str();
+}
+
+size_t MockDeveloperServicesServer::requestCount() const
+{
+	return _requestCount;
+}
+
+bool MockDeveloperServicesServer::compressesResponses() const
+{
+	return _compressesResponses;
+}
+
+void MockDeveloperServicesServer::setCompressesResponses(bool compressesResponses)
+{
+	_compressesResponses = compressesResponses;
+}
+
+int MockDeveloperServicesServer::latency() const
+{
+	return _latency;
+}
+
+void MockDeveloperServicesServer::setLatency(int latency)
+{
+	_latency = latency;
+}
@@ -0,0 +1,71 @@
+//
+//  MockDeveloperServicesServer.hpp
+//  AppleAPIBenchmark
+//
+//  Serves canned developer services responses over plain HTTP so AppleAPI
+//  can be measured without talking to Apple.
+//
+
+#pragma once
+
+#include <WinSock2.h>
+
+#include <atomic>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+class MockDeveloperServicesServer
+{
+public:
+	MockDeveloperServicesServer();
+	~MockDeveloperServicesServer();
+
+	void Start();
+	void Stop();
+
+	// action is the path below the protocol version, e.g. "ios/listDevices.action" or "certificates".
+	void SetResponse(std::string action, std::string body);
+
+	// Loads recorded bodies, one file per action with '/' replaced by '_' (e.g. "ios_listDevices.action").
+	void LoadResponses(std::filesystem::path directoryPath);
+
+	std::string baseURL() const;
+	size_t requestCount() const;
+
+	bool compressesResponses() const;
+	void setCompressesResponses(bool compressesResponses);
+
+	int latency() const;
+	void setLatency(int latency);
+
+private:
+	SOCKET _listeningSocket;
+	int _port;
+
+	std::atomic<bool> _running;
+	std::atomic<size_t> _requestCount;
+
+	bool _compressesResponses;
+	int _latency;
+
+	std::thread _acceptThread;
+
+	std::mutex _connectionsMutex;
+	std::vector<std::thread> _connectionThreads;
+	std::set<SOCKET> _connectionSockets;
+
+	std::mutex _responsesMutex;
+	std::map<std::string, std::string> _responses;
+	std::map<std::string, std::vector<unsigned char>> _compressedResponses;
+
+	void PrepareDefaultResponses();
+
+	void AcceptConnections();
+	void HandleConnection(SOCKET clientSocket);
+	bool SendResponse(SOCKET clientSocket, std::string path);
+};
@@ -0,0 +1,72 @@
+//
+//  ProvisioningProfileCacheTests.cpp
+//  AppleAPIBenchmark
+//
+//  Checks ProvisioningProfileCache against profiles served by the mock developer services server.
+//
+
+#include "ProvisioningProfileCacheTests.hpp"
+
+#include <iostream>
+#include <filesystem>
+
+#include "ProvisioningProfileCache.hpp"
+
+namespace fs = std::filesystem;
+
+extern std::string make_uuid();
+
+#define EXPECT(condition) if (!(condition)) { std::cout << "FAILED: " << #condition << " (" << __FILE__ << ":" << __LINE__ << ")" << std::endl; passed = false; }
+
+bool TestProvisioningProfileCache(MockDeveloperServicesServer& server, std::shared_ptr<Account> account, std::shared_ptr<AppleAPISession> session)
+{
+	bool passed = true;
+
+	auto api = AppleAPI::getInstance();
+
+	auto team = api->FetchTeams(account, session).get()[0];
+	auto appID = api->AddAppID("AltStore", "com.rileytestut.AltStore", team, session).get();
+	auto profile = api->FetchProvisioningProfile(appID, Device::Type::iPhone, team, session).get();
+
+	auto directoryPath = fs::temp_directory_path();
+	directoryPath.append("ProvisioningProfileCacheTests-" + make_uuid());
+
+	std::string deviceIdentifier = "00008030-0000000000000001";
+	std::string serialNumber = "5E2D7A0C1B3F4D6E";
+
+	{
+		ProvisioningProfileCache cache(directoryPath);
+
+		EXPECT(cache.CachedProfile(profile->teamIdentifier(), profile->bundleIdentifier(), deviceIdentifier, serialNumber) == nullptr);
+
+		cache.CacheProfile(profile, deviceIdentifier, serialNumber);
+
+		// Cache hits must not talk to developer services.
+		size_t requestCount = server.requestCount();
+
+		auto cachedProfile = cache.CachedProfile(profile->teamIdentifier(), profile->bundleIdentifier(), deviceIdentifier, serialNumber);
+		EXPECT(cachedProfile != nullptr);
+		EXPECT(cachedProfile != nullptr && cachedProfile->uuid() == profile->uuid());
+		EXPECT(server.requestCount() == requestCount);
+
+		EXPECT(cache.CachedProfile(profile->teamIdentifier(), profile->bundleIdentifier(), "00008030-0000000000000002", serialNumber) == nullptr);
+
+		// Identifiers that would resolve to the cached profile's directory through '..' must be rejected.
+		std::string escapingBundleIdentifier = "..\\" + profile->bundleIdentifier();
+		EXPECT(cache.CachedProfile(profile->teamIdentifier(), "..", deviceIdentifier, serialNumber) == nullptr);
+		EXPECT(cache.CachedProfile("..\\" + profile->teamIdentifier(), profile->bundleIdentifier(), deviceIdentifier, serialNumber) == nullptr);
+		EXPECT(cache.CachedProfile(profile->teamIdentifier(), "x\\..\\" + profile->bundleIdentifier(), deviceIdentifier, serialNumber) == nullptr);
+		EXPECT(cache.CachedProfile(profile->teamIdentifier(), "x/../" + profile->bundleIdentifier(), deviceIdentifier, serialNumber) == nullptr);
+		EXPECT(cache.CachedProfile(profile->teamIdentifier(), profile->bundleIdentifier(), "..\\" + deviceIdentifier, serialNumber) == nullptr);
+
+		// A different certificate makes the cached profile stale, so it is removed.
+		EXPECT(cache.CachedProfile(profile->teamIdentifier(), profile->bundleIdentifier(), deviceIdentifier, "0123456789ABCDEF") == nullptr);
+		EXPECT(cache.CachedProfile(profile->teamIdentifier(), profile->bundleIdentifier(), deviceIdentifier, serialNumber) == nullptr);
+	}
+
+	std::error_code error;
+	fs::remove_all(directoryPath, error);
+
+	std::cout << "ProvisioningProfileCache: " << (passed ? "passed" : "FAILED") << std::endl;
+	return passed;
+}
@@ -0,0 +1,15 @@
+//
+//  ProvisioningProfileCacheTests.hpp
+//  AppleAPIBenchmark
+//
+
+#pragma once
+
+#include <memory>
+
+#include "MockDeveloperServicesServer.hpp"
+
+#include "AppleAPI.hpp"
+
+// Returns false and prints the failed expectations if the cache misbehaves.
+bool TestProvisioningProfileCache(MockDeveloperServicesServer& server, std::shared_ptr<Account> account, std::shared_ptr<AppleAPISession> session);
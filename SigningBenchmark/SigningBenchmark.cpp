@@ -0,0 +1,244 @@
+// SigningBenchmark.cpp : Signs a sample app bundle repeatedly and reports how long each binary in it takes to sign.
+//
+// Usage: SigningBenchmark.exe --app PATH --certificate P12 [--password PASSWORD] --profile PATH [--profile PATH ...] [--iterations N]
+//
+// The bundle is copied before every run, so the sample itself is never modified.
+//
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <fstream>
+#include <iterator>
+#include <chrono>
+#include <codecvt>
+#include <algorithm>
+#include <numeric>
+#include <map>
+#include <filesystem>
+#include <combaseapi.h>
+
+#include "Signer.hpp"
+
+namespace fs = std::filesystem;
+
+std::string make_uuid()
+{
+	GUID guid;
+	CoCreateGuid(&guid);
+
+	std::ostringstream os;
+	os << std::hex << std::setw(8) << std::setfill('0') << guid.Data1;
+	os << '-';
+	os << std::hex << std::setw(4) << std::setfill('0') << guid.Data2;
+	os << '-';
+	os << std::hex << std::setw(4) << std::setfill('0') << guid.Data3;
+	os << '-';
+	os << std::hex << std::setw(2) << std::setfill('0') << static_cast<short>(guid.Data4[0]);
+	os << std::hex << std::setw(2) << std::setfill('0') << static_cast<short>(guid.Data4[1]);
+	os << '-';
+	os << std::hex << std::setw(2) << std::setfill('0') << static_cast<short>(guid.Data4[2]);
+	os << std::hex << std::setw(2) << std::setfill('0') << static_cast<short>(guid.Data4[3]);
+	os << std::hex << std::setw(2) << std::setfill('0') << static_cast<short>(guid.Data4[4]);
+	os << std::hex << std::setw(2) << std::setfill('0') << static_cast<short>(guid.Data4[5]);
+	os << std::hex << std::setw(2) << std::setfill('0') << static_cast<short>(guid.Data4[6]);
+	os << std::hex << std::setw(2) << std::setfill('0') << static_cast<short>(guid.Data4[7]);
+
+	std::string s(os.str());
+	return s;
+}
+
+std::string StringFromWideString(std::wstring wideString)
+{
+	std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+
+	std::string string = converter.to_bytes(wideString);
+	return string;
+}
+
+std::wstring WideStringFromString(std::string string)
+{
+	std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+
+	std::wstring wideString = converter.from_bytes(string);
+	return wideString;
+}
+
+std::vector<unsigned char> readFile(const char* filename)
+{
+	std::ifstream file(filename, std::ios::binary);
+	file.unsetf(std::ios::skipws);
+
+	file.seekg(0, std::ios::end);
+	std::streampos fileSize = file.tellg();
+	file.seekg(0, std::ios::beg);
+
+	std::vector<unsigned char> vec;
+	vec.reserve(fileSize);
+	vec.insert(vec.begin(), std::istream_iterator<unsigned char>(file), std::istream_iterator<unsigned char>());
+
+	return vec;
+}
+
+std::string replace_all(const std::string& str, const std::string& find, const std::string& replace)
+{
+	std::string result;
+	size_t pos, from = 0;
+	while (std::string::npos != (pos = str.find(find, from)))
+	{
+		result.append(str, from, pos - from);
+		result.append(replace);
+		from = pos + find.size();
+	}
+	result.append(str, from, std::string::npos);
+	return result;
+}
+
+int iterations = 10;
+
+std::map<std::string, std::vector<double>> timings;
+
+// Signs a fresh copy of the bundle, timing each file from when ldid starts it until it starts the next one.
+void SignCopy(Signer& signer, fs::path appPath, std::vector<std::shared_ptr<ProvisioningProfile>> profiles)
+{
+	auto copyPath = fs::temp_directory_path().append(make_uuid()).append(appPath.filename().string());
+	fs::create_directories(copyPath);
+	fs::copy(appPath, copyPath, fs::copy_options::recursive);
+
+	std::string currentFile = "(preparation)";
+	auto start = std::chrono::steady_clock::now();
+	auto fileStart = start;
+
+	auto finishFile = [&](std::string nextFile) {
+		auto now = std::chrono::steady_clock::now();
+		timings[currentFile].push_back(std::chrono::duration<double, std::milli>(now - fileStart).count());
+
+		currentFile = nextFile.empty() ? "(main executable)" : nextFile;
+		fileStart = now;
+	};
+
+	try
+	{
+		signer.SignApp(copyPath.string(), profiles, finishFile);
+		finishFile("");
+
+		auto end = std::chrono::steady_clock::now();
+		timings["(app)"].push_back(std::chrono::duration<double, std::milli>(end - start).count());
+	}
+	catch (...)
+	{
+		fs::remove_all(copyPath.parent_path());
+		throw;
+	}
+
+	fs::remove_all(copyPath.parent_path());
+}
+
+void PrintTimings()
+{
+	std::cout << std::left << std::setw(48) << "File" << std::right
+		<< std::setw(8) << "count"
+		<< std::setw(10) << "mean ms"
+		<< std::setw(10) << "p50 ms"
+		<< std::setw(10) << "max ms" << std::endl;
+
+	for (auto& pair : timings)
+	{
+		auto values = pair.second;
+		std::sort(values.begin(), values.end());
+
+		double mean = std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+		double p50 = values[values.size() / 2];
+
+		std::cout << std::left << std::setw(48) << pair.first << std::right << std::fixed << std::setprecision(2)
+			<< std::setw(8) << values.size()
+			<< std::setw(10) << mean
+			<< std::setw(10) << p50
+			<< std::setw(10) << values.back() << std::endl;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	std::string appPath;
+	std::string certificatePath;
+	std::string password;
+	std::vector<std::string> profilePaths;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string argument = argv[i];
+
+		if (argument == "--app" && i + 1 < argc)
+		{
+			appPath = argv[++i];
+		}
+		else if (argument == "--certificate" && i + 1 < argc)
+		{
+			certificatePath = argv[++i];
+		}
+		else if (argument == "--password" && i + 1 < argc)
+		{
+			password = argv[++i];
+		}
+		else if (argument == "--profile" && i + 1 < argc)
+		{
+			profilePaths.push_back(argv[++i]);
+		}
+		else if (argument == "--iterations" && i + 1 < argc)
+		{
+			iterations = std::max(1, atoi(argv[++i]));
+		}
+		else
+		{
+			appPath.clear();
+			break;
+		}
+	}
+
+	if (appPath.empty() || certificatePath.empty() || profilePaths.empty())
+	{
+		std::cout << "Usage: SigningBenchmark.exe --app PATH --certificate P12 [--password PASSWORD] --profile PATH [--profile PATH ...] [--iterations N]" << std::endl;
+		return 1;
+	}
+
+	try
+	{
+		auto p12Data = readFile(certificatePath.c_str());
+		auto certificate = std::make_shared<Certificate>(p12Data, password);
+
+		std::vector<std::shared_ptr<ProvisioningProfile>> profiles;
+		for (auto& profilePath : profilePaths)
+		{
+			profiles.push_back(std::make_shared<ProvisioningProfile>(profilePath));
+		}
+
+		Signer signer(std::make_shared<Team>(), certificate);
+
+		// Warm up the signing identity caches outside the measurements.
+		SignCopy(signer, appPath, profiles);
+		timings.clear();
+
+		auto start = std::chrono::steady_clock::now();
+
+		for (int i = 0; i < iterations; i++)
+		{
+			SignCopy(signer, appPath, profiles);
+		}
+
+		auto end = std::chrono::steady_clock::now();
+		double elapsedTime = std::chrono::duration<double, std::milli>(end - start).count();
+
+		PrintTimings();
+
+		std::cout << std::endl;
+		std::cout << iterations << " signings in " << elapsedTime << " ms (" << (elapsedTime / iterations) << " ms per app)" << std::endl;
+	}
+	catch (std::exception& exception)
+	{
+		std::cout << "Signing failed: " << exception.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -36,9 +36,12 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
 #include <fstream>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <sstream>
 #include <string>
@@ -887,183 +890,6 @@ struct SuperBlob {
 	struct BlobIndex index[];
 } _packed;
 
-struct EntitlementValue
-{
-	enum struct Type : uint8_t
-	{
-		Boolean = 0x01,
-		String = 0x0c,
-	};
-
-	Type type;
-	uint8_t length; // Excludes .type and .length
-	std::string value;
-
-	EntitlementValue(Type type, std::string value) : type(type), length(value.length()), value(value)
-	{
-	}
-
-	uint8_t totalLength()
-	{
-		return this->length + 2;
-	}
-
-	std::string data()
-	{
-		std::stringbuf data;
-
-		put(data, (char*)& this->type, 1);
-		put(data, (char*)& this->length, 1);
-		put(data, this->value.c_str(), this->value.length());
-
-		return data.str();
-	}
-};
-
-struct EntitlementBlob
-{
-	uint8_t padding = 0x30;
-	uint8_t length; // Excludes .padding and .length
-
-	EntitlementValue key;
-	std::vector<EntitlementValue> values = {};
-
-	EntitlementBlob(std::string key, std::string v) : key(EntitlementValue::Type::String, key)
-	{
-		EntitlementValue value(EntitlementValue::Type::String, v);
-		this->values.push_back(value);
-
-		this->length = this->key.totalLength() + value.totalLength();
-	}
-
-	EntitlementBlob(std::string key, bool v) : key(EntitlementValue::Type::String, key)
-	{
-		EntitlementValue value(EntitlementValue::Type::Boolean, v ? "\1" : "\0");
-		this->values.push_back(value);
-
-		this->length = this->key.totalLength() + value.totalLength();
-	}
-
-	EntitlementBlob(std::string key, std::vector<std::string> values) : key(EntitlementValue::Type::String, key), isArray(true)
-	{
-		int8_t valuesLength = 0;
-		for (auto& value : values)
-		{
-			EntitlementValue entitlementValue(EntitlementValue::Type::String, value);
-			this->values.push_back(entitlementValue);
-
-			valuesLength += entitlementValue.totalLength();
-		}
-
-		this->length = this->key.totalLength() + valuesLength + 2; // Arrays require 2 extra bytes.
-	}
-
-	uint8_t totalLength()
-	{
-		return this->length + 2;
-	}
-
-	std::string data()
-	{
-		std::stringbuf data;
-		put(data, (char*)& this->padding, 1);
-		put(data, (char*)& this->length, 1);
-		put(data, this->key.data().data(), this->key.totalLength());
-
-		if (this->isArray)
-		{
-			// Arrays need 2 extra bytes:
-			// - 0x30
-			// - Total length of all values in array (including their 2 byte headers)
-
-			int8_t padding = 0x30;
-			int8_t length = 0;
-
-			for (auto& value : this->values)
-			{
-				length += value.totalLength();
-			}
-
-			put(data, (char*)& padding, 1);
-			put(data, (char*)& length, 1);
-		}
-
-		for (auto& value : this->values)
-		{
-			put(data, value.data().data(), value.totalLength());
-		}
-
-		return data.str();
-	}
-
-private:
-	bool isArray = false;
-};
-
-struct EntitlementsSuperBlob
-{
-	uint32_t magic = CSMAGIC_EMBEDDED_RAW_ENTITLEMENTS;
-	uint32_t length; // Total length, _including_ .magic and .length
-
-	uint8_t byte1 = 0x31;
-	uint8_t byte2;
-
-	uint16_t blobsLength;
-	std::vector<EntitlementBlob> blobs;
-
-	EntitlementsSuperBlob(std::vector<EntitlementBlob> blobs) : blobs(blobs)
-	{
-		uint32_t blobsLength = 0;
-		for (auto& blob : blobs)
-		{
-			blobsLength += blob.totalLength();
-		}
-
-		this->blobsLength = blobsLength;
-
-		if (this->blobsLength > UCHAR_MAX)
-		{
-			this->length = blobsLength + 10 + 2; // blobsLength is > 255, so we need 2 bytes to encode it.
-			this->byte2 = 0x82;
-		}
-		else
-		{
-			this->length = blobsLength + 10 + 1; // blobsLength is <= 255, so we only need 1 byte to encode it.
-			this->byte2 = 0x81;
-		}
-	}
-
-	std::string data()
-	{
-		std::stringbuf data;
-
-		uint32_t swappedMagic = Swap(this->magic);
-		uint32_t swappedLength = Swap(this->length);
-
-		put(data, (char*)& swappedMagic, 4);
-		put(data, (char*)& swappedLength, 4);
-		put(data, (char*)& this->byte1, 1);
-		put(data, (char*)& this->byte2, 1);
-
-		if (this->blobsLength > UCHAR_MAX)
-		{
-			uint32_t swappedBlobsLength = Swap(this->blobsLength);
-			put(data, (char*)& swappedBlobsLength, 2);
-		}
-		else
-		{
-			put(data, (char*)& this->blobsLength, 1);
-		}
-
-		for (auto& blob : this->blobs)
-		{
-			put(data, blob.data().data(), blob.totalLength());
-		}
-
-		return data.str();
-	}
-};
-
 struct CodeDirectory {
 	uint32_t version;
 	uint32_t flags;
@@ -1699,6 +1525,55 @@ public:
 		return value_;
 	}
 };
+
+// An app signs every framework and plug-in binary with the same key, and parsing the
+// .p12 (whose key derivation is deliberately slow) dominated signing small binaries.
+class Identity {
+public:
+	Stuff stuff_;
+	std::string team_;
+	size_t signature_;
+
+	Identity(const std::string& key) :
+		stuff_(key)
+	{
+		// the signature is detached, so its size does not depend on what is signed
+		Signature signature(stuff_, Buffer(std::string()));
+		Buffer result(signature);
+		signature_ = std::string(result).size();
+
+		auto name(X509_get_subject_name(stuff_));
+		_assert(name != NULL);
+		auto index(X509_NAME_get_index_by_NID(name, NID_organizationalUnitName, -1));
+		_assert(index >= 0);
+		auto next(X509_NAME_get_index_by_NID(name, NID_organizationalUnitName, index));
+		_assert(next == -1);
+		auto entry(X509_NAME_get_entry(name, index));
+		_assert(entry != NULL);
+		auto asn(X509_NAME_ENTRY_get_data(entry));
+		_assert(asn != NULL);
+		team_.assign(reinterpret_cast<char*>(ASN1_STRING_data(asn)), ASN1_STRING_length(asn));
+	}
+};
+
+static std::shared_ptr<Identity> LoadIdentity(const std::string& key) {
+	static std::mutex mutex;
+	static std::map<std::string, std::shared_ptr<Identity>> identities;
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto existing(identities.find(key));
+	if (existing != identities.end())
+		return existing->second;
+
+	// only a handful of keys are ever live, so drop stale ones rather than track use
+	if (identities.size() >= 4)
+		identities.clear();
+
+	auto identity(std::make_shared<Identity>(key));
+	identities[key] = identity;
+	return identity;
+}
 #endif
 
 class NullBuffer :
@@ -1841,6 +1716,196 @@ static void Commit(const std::string& path, const std::string& temp) {
 }
 #endif
 
+#define DER_BOOLEAN          uint8_t(0x01)
+#define DER_INTEGER          uint8_t(0x02)
+#define DER_OCTET_STRING     uint8_t(0x04)
+#define DER_UTF8_STRING      uint8_t(0x0c)
+#define DER_GENERALIZED_TIME uint8_t(0x18)
+#define DER_SEQUENCE         uint8_t(0x30)
+#define DER_DICTIONARY       uint8_t(0xb0) // [CONTEXT 16], constructed
+#define DER_ENTITLEMENTS     uint8_t(0x70) // [APPLICATION 16], constructed
+
+static void der(std::streambuf& buffer, uint8_t tag, const std::string& value) {
+	put(buffer, &tag, 1);
+
+	size_t size(value.size());
+	if (size < 0x80) {
+		uint8_t length(size);
+		put(buffer, &length, 1);
+	}
+	else {
+		uint8_t bytes[sizeof(size)];
+		uint8_t count(0);
+		for (size_t rest(size); rest != 0; rest >>= 8)
+			bytes[count++] = uint8_t(rest & 0xff);
+
+		uint8_t prefix(0x80 | count);
+		put(buffer, &prefix, 1);
+		while (count != 0)
+			put(buffer, &bytes[--count], 1);
+	}
+
+	put(buffer, value.data(), value.size());
+}
+
+static bool der(std::streambuf& buffer, plist_t node) {
+	auto type(plist_get_node_type(node));
+	switch (type) {
+	case PLIST_BOOLEAN: {
+		uint8_t value(0);
+		plist_get_bool_val(node, &value);
+		der(buffer, DER_BOOLEAN, std::string(1, value != 0 ? '\xff' : '\x00'));
+	} return true;
+
+	case PLIST_UINT: {
+		uint64_t value(0);
+		plist_get_uint_val(node, &value);
+
+		// libplist keeps negative integers as their two's complement, which is also what DER wants
+		std::string bytes;
+		for (unsigned i(0); i != sizeof(value); ++i)
+			bytes.insert(bytes.begin(), char(value >> (i * 8)));
+		while (bytes.size() > 1 && ((bytes[0] == '\x00' && (bytes[1] & 0x80) == 0) || (bytes[0] == '\xff' && (bytes[1] & 0x80) != 0)))
+			bytes.erase(bytes.begin());
+
+		der(buffer, DER_INTEGER, bytes);
+	} return true;
+
+	case PLIST_STRING: {
+		char* value(NULL);
+		plist_get_string_val(node, &value);
+		der(buffer, DER_UTF8_STRING, value);
+		free(value);
+	} return true;
+
+	case PLIST_DATA: {
+		char* value(NULL);
+		uint64_t length(0);
+		plist_get_data_val(node, &value, &length);
+		der(buffer, DER_OCTET_STRING, std::string(value, length));
+		free(value);
+	} return true;
+
+	case PLIST_DATE: {
+		int32_t seconds(0), useconds(0);
+		plist_get_date_val(node, &seconds, &useconds);
+
+		// plist dates count from 2001-01-01
+		time_t time(time_t(seconds) + 978307200);
+		char value[16];
+		struct tm components;
+#ifdef _WIN32
+		gmtime_s(&components, &time);
+#else
+		gmtime_r(&time, &components);
+#endif
+		strftime(value, sizeof(value), "%Y%m%d%H%M%SZ", &components);
+		der(buffer, DER_GENERALIZED_TIME, value);
+	} return true;
+
+	case PLIST_ARRAY: {
+		std::stringbuf data;
+		for (uint32_t i(0), e(plist_array_get_size(node)); i != e; ++i)
+			der(data, plist_array_get_item(node, i));
+		der(buffer, DER_SEQUENCE, data.str());
+	} return true;
+
+	case PLIST_DICT: {
+		// DER wants the entries ordered by key
+		std::map<std::string, plist_t> entries;
+
+		plist_dict_iter it(NULL);
+		plist_dict_new_iter(node, &it);
+		for (;;) {
+			char* key(NULL);
+			plist_t value(NULL);
+			plist_dict_next_item(node, it, &key, &value);
+			if (value == NULL)
+				break;
+			entries[key] = value;
+			free(key);
+		}
+		free(it);
+
+		std::stringbuf data;
+		for (const auto& entry : entries) {
+			std::stringbuf pair;
+			der(pair, DER_UTF8_STRING, entry.first);
+			if (der(pair, entry.second))
+				der(data, DER_SEQUENCE, pair.str());
+		}
+		der(buffer, DER_DICTIONARY, data.str());
+	} return true;
+
+	default:
+		printf("[ldid] Unsupported entitlement type: %d\n", type);
+		return false;
+	}
+}
+
+// Entitlements are parsed once and shared by every slice of a binary, and by every binary
+// in the bundle that has the same entitlements; both blobs are generated from the parse.
+class Entitlements {
+public:
+	std::string xml_;
+	std::string der_;
+	bool debuggable_;
+
+	Entitlements(const std::string& xml) :
+		debuggable_(false)
+	{
+		plist_t plist(NULL);
+		plist_from_xml(xml.data(), uint32_t(xml.size()), &plist);
+
+		if (plist == NULL || plist_get_node_type(plist) != PLIST_DICT) {
+			xml_ = xml;
+			plist_free(plist);
+			return;
+		}
+
+		char* data(NULL);
+		uint32_t size(0);
+		plist_to_xml(plist, &data, &size);
+		xml_.assign(data, size);
+		free(data);
+
+		std::stringbuf body;
+		der(body, DER_INTEGER, std::string(1, '\x01'));
+		der(body, plist);
+
+		std::stringbuf value;
+		der(value, DER_ENTITLEMENTS, body.str());
+		der_ = value.str();
+
+		auto allow(plist_dict_get_item(plist, "get-task-allow"));
+		if (allow != NULL && plist_get_node_type(allow) == PLIST_BOOLEAN) {
+			uint8_t value(0);
+			plist_get_bool_val(allow, &value);
+			debuggable_ = value != 0;
+		}
+
+		plist_free(plist);
+	}
+};
+
+static std::shared_ptr<Entitlements> LoadEntitlements(const std::string& xml) {
+	static std::mutex mutex;
+	static std::map<std::string, std::shared_ptr<Entitlements>> cache;
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto existing(cache.find(xml));
+	if (existing != cache.end())
+		return existing->second;
+
+	if (cache.size() >= 16)
+		cache.clear();
+
+	auto entitlements(std::make_shared<Entitlements>(xml));
+	cache[xml] = entitlements;
+	return entitlements;
+}
+
 namespace ldid {
 
 	Hash Sign(const void* idata, size_t isize, std::streambuf& output, const std::string& identifier, const std::string& entitlements, const std::string& requirement, const std::string& key, const Slots& slots, const Functor<void(double)>& percent) {
@@ -1849,24 +1914,23 @@ namespace ldid {
 		std::string team;
 
 #ifndef LDID_NOSMIME
+		std::shared_ptr<Identity> identity;
 		if (!key.empty()) {
-			Stuff stuff(key);
-			auto name(X509_get_subject_name(stuff));
-			_assert(name != NULL);
-			auto index(X509_NAME_get_index_by_NID(name, NID_organizationalUnitName, -1));
-			_assert(index >= 0);
-			auto next(X509_NAME_get_index_by_NID(name, NID_organizationalUnitName, index));
-			_assert(next == -1);
-			auto entry(X509_NAME_get_entry(name, index));
-			_assert(entry != NULL);
-			auto asn(X509_NAME_ENTRY_get_data(entry));
-			_assert(asn != NULL);
-			team.assign(reinterpret_cast<char*>(ASN1_STRING_data(asn)), ASN1_STRING_length(asn));
+			identity = LoadIdentity(key);
+			team = identity->team_;
 		}
 #endif
 
-		// XXX: this is just a "sufficiently large number"
-		size_t certificate(0x3000);
+		// a detached CMS signature is the same size for every binary signed with a key
+		size_t certificate(0);
+#ifndef LDID_NOSMIME
+		if (identity != NULL)
+			certificate = identity->signature_;
+#endif
+
+		std::shared_ptr<Entitlements> parsed;
+		if (!entitlements.empty())
+			parsed = LoadEntitlements(entitlements);
 
 		Allocate(idata, isize, output, fun([&](const MachHeader& mach_header, size_t size) -> size_t {
 			size_t alloc(sizeof(struct SuperBlob));
@@ -1890,17 +1954,18 @@ namespace ldid {
 			else
 				alloc += requirement.size();
 
-			if (!entitlements.empty()) {
+			if (parsed != NULL) {
 				special = std::max(special, CSSLOT_ENTITLEMENTS);
 				alloc += sizeof(struct BlobIndex);
 				alloc += sizeof(struct Blob);
-				alloc += entitlements.size();
+				alloc += parsed->xml_.size();
 			}
 
-			if (!entitlements.empty())
-			{
-				// TODO: Calculate exact amount necessary to embed raw entitlements.
-				alloc += entitlements.length(); // Overestimate
+			if (parsed != NULL && !parsed->der_.empty()) {
+				special = std::max(special, CSSLOT_RAW_ENTITLEMENTS);
+				alloc += sizeof(struct BlobIndex);
+				alloc += sizeof(struct Blob);
+				alloc += parsed->der_.size();
 			}
 
 			size_t directory(0);
@@ -1941,102 +2006,18 @@ namespace ldid {
 					insert(blobs, CSSLOT_REQUIREMENTS, data);
 				}
 
-				if (!entitlements.empty()) {
+				if (parsed != NULL) {
 					std::stringbuf data;
-					put(data, entitlements.data(), entitlements.size());
+					put(data, parsed->xml_.data(), parsed->xml_.size());
 					insert(blobs, CSSLOT_ENTITLEMENTS, CSMAGIC_EMBEDDED_ENTITLEMENTS, data);
-					if (entitlements.find("<key>get-task-allow</key>") != std::string::npos) {
-						// TODO: parse entitlements, avoid cases where `get-task-allow` is false or appears elsewhere
+					if (parsed->debuggable_)
 						execSegFlags = CS_EXECSEG_MAIN_BINARY | CS_EXECSEG_ALLOW_UNSIGNED;
-					}
 				}
 
-				if (!entitlements.empty())
-				{
-					std::vector<EntitlementBlob> entitlementBlobs;
-
-					plist_t plist = NULL;
-					plist_from_xml(entitlements.data(), (uint32_t)entitlements.length(), &plist);
-
-					plist_dict_iter it = NULL;
-					plist_dict_new_iter(plist, &it);
-
-					char* key = NULL;
-					plist_t node = NULL;
-					plist_dict_next_item(plist, it, &key, &node);
-
-					while (node)
-					{
-						plist_type type = plist_get_node_type(node);
-						switch (type)
-						{
-						case PLIST_STRING:
-						{
-							char* value = NULL;
-							plist_get_string_val(node, &value);
-
-							EntitlementBlob blob(key, std::string(value)); // Explicitly cast value to std::string or else it will (annoyingly) call bool constructor.
-							entitlementBlobs.push_back(blob);
-
-							free(value);
-
-							break;
-						}
-
-						case PLIST_BOOLEAN:
-						{
-							uint8_t value = 0;
-							plist_get_bool_val(node, &value);
-
-							EntitlementBlob blob(key, value != 0);
-							entitlementBlobs.push_back(blob);
-							break;
-						}
-
-						case PLIST_ARRAY:
-						{
-							std::vector<std::string> values;
-
-							int size = plist_array_get_size(node);
-							for (int i = 0; i < size; i++)
-							{
-								plist_t subnode = plist_array_get_item(node, i);
-
-								char* value = NULL;
-								plist_get_string_val(subnode, &value);
-
-								values.push_back(value);
-
-								free(value);
-							}
-
-							EntitlementBlob blob(key, values);
-							entitlementBlobs.push_back(blob);
-							break;
-						}
-
-						default:
-						{
-							printf("[ldid] Unsupported entitlement type: %d\n", type);
-							break;
-						}
-						}
-
-						free(key);
-						key = NULL;
-
-						plist_dict_next_item(plist, it, &key, &node);
-					}
-
-					free(it);
-					plist_free(plist);
-
+				if (parsed != NULL && !parsed->der_.empty()) {
 					std::stringbuf data;
-
-					EntitlementsSuperBlob superBlob(entitlementBlobs);
-					put(data, superBlob.data().data(), superBlob.length);
-
-					insert(blobs, CSSLOT_RAW_ENTITLEMENTS, data);
+					put(data, parsed->der_.data(), parsed->der_.size());
+					insert(blobs, CSSLOT_RAW_ENTITLEMENTS, CSMAGIC_EMBEDDED_RAW_ENTITLEMENTS, data);
 				}
 
 				Slots posts(slots);
@@ -2138,16 +2119,15 @@ namespace ldid {
 					std::stringbuf data;
 					const std::string& sign(blobs[CSSLOT_CODEDIRECTORY]);
 
-					Stuff stuff(key);
 					Buffer bio(sign);
 
-					Signature signature(stuff, sign);
+					Signature signature(identity->stuff_, sign);
 					Buffer result(signature);
 					std::string value(result);
 					put(data, value.data(), value.size());
 
 					const auto& save(insert(blobs, CSSLOT_SIGNATURESLOT, CSMAGIC_BLOBWRAPPER, data));
-					_assert(save.size() <= certificate);
+					_assert(save.size() <= sizeof(struct Blob) + certificate);
 				}
 #endif
 
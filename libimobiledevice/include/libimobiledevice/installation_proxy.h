@@ -110,6 +110,12 @@ typedef enum {
 typedef struct instproxy_client_private instproxy_client_private;
 typedef instproxy_client_private *instproxy_client_t; /**< The client handle. */
 
+typedef struct instproxy_status_queue_private instproxy_status_queue_private;
+typedef instproxy_status_queue_private *instproxy_status_queue_t; /**< Completion queue collecting status updates of several clients. */
+
+typedef struct instproxy_browse_iter_private instproxy_browse_iter_private;
+typedef instproxy_browse_iter_private *instproxy_browse_iter_t; /**< Iterator over the chunks of a browse. */
+
 /** Reports the status response of the given command */
 typedef void (*instproxy_status_cb_t) (plist_t command, plist_t status, void *user_data);
 
@@ -154,6 +160,96 @@ instproxy_error_t instproxy_client_start_service(idevice_t device, instproxy_cli
  */
 instproxy_error_t instproxy_client_free(instproxy_client_t client);
 
+/**
+ * Gets the socket of an installation_proxy client, which becomes readable
+ * when status updates arrive. Use it to drive instproxy_status_queue_next()
+ * from an existing event loop.
+ *
+ * @param client The installation_proxy client.
+ * @param fd Pointer to store the socket.
+ *
+ * @return INSTPROXY_E_SUCCESS on success or INSTPROXY_E_INVALID_ARG if
+ *         client or fd is NULL.
+ */
+instproxy_error_t instproxy_client_get_fd(instproxy_client_t client, int *fd);
+
+/**
+ * Creates a completion queue for status updates. Asynchronous commands of
+ * clients added to the queue do not start a receive thread, their status
+ * updates are returned by instproxy_status_queue_next() instead. This allows
+ * a single thread to drive commands on many devices at once.
+ *
+ * @param queue Pointer that will be set to the new queue. Must be freed
+ *        using instproxy_status_queue_free() after use.
+ *
+ * @return INSTPROXY_E_SUCCESS on success, or an INSTPROXY_E_* error value
+ *         when an error occured.
+ */
+instproxy_error_t instproxy_status_queue_new(instproxy_status_queue_t *queue);
+
+/**
+ * Frees a completion queue. Clients still in the queue are removed from it
+ * and their pending commands are dropped. The clients are not freed.
+ *
+ * @param queue The queue to free.
+ *
+ * @return INSTPROXY_E_SUCCESS on success or INSTPROXY_E_INVALID_ARG if
+ *         queue is NULL.
+ */
+instproxy_error_t instproxy_status_queue_free(instproxy_status_queue_t queue);
+
+/**
+ * Adds a client to a completion queue. A client can be in one queue only
+ * and must not have an asynchronous command running.
+ *
+ * @param queue The queue to add the client to.
+ * @param client The installation_proxy client.
+ *
+ * @return INSTPROXY_E_SUCCESS on success, INSTPROXY_E_OP_IN_PROGRESS if the
+ *         client has a command running, or INSTPROXY_E_INVALID_ARG if the
+ *         client is already in a queue.
+ */
+instproxy_error_t instproxy_status_queue_add(instproxy_status_queue_t queue, instproxy_client_t client);
+
+/**
+ * Removes a client from a completion queue. A pending command of the client
+ * is dropped, and the client is left in an undefined protocol state if the
+ * command was still running.
+ *
+ * @param queue The queue to remove the client from.
+ * @param client The installation_proxy client.
+ *
+ * @return INSTPROXY_E_SUCCESS on success or INSTPROXY_E_INVALID_ARG if the
+ *         client is not in the queue.
+ */
+instproxy_error_t instproxy_status_queue_remove(instproxy_status_queue_t queue, instproxy_client_t client);
+
+/**
+ * Returns the next status update of any pending command in the queue.
+ * Status updates are handed out round-robin across clients. If a status
+ * callback was passed when starting the command, it is called before this
+ * function returns.
+ *
+ * @param queue The queue to wait on.
+ * @param timeout Maximum time in milliseconds to wait, 0 to return
+ *        immediately or -1 to wait until a status arrives.
+ * @param client Pointer to store the client the status belongs to.
+ * @param status Pointer to store the status response. The caller is
+ *        responsible for freeing it with plist_free(). Set to NULL if the
+ *        connection of the client failed.
+ *
+ * @return INSTPROXY_E_OP_IN_PROGRESS for an intermediate status update,
+ *         INSTPROXY_E_SUCCESS if the command of the client completed,
+ *         INSTPROXY_E_RECEIVE_TIMEOUT if no complete status arrived in time,
+ *         INSTPROXY_E_OP_FAILED if no command is pending on any client,
+ *         INSTPROXY_E_CONN_FAILED with client set to NULL if waiting on the
+ *         connections failed, or another INSTPROXY_E_* error value if the
+ *         command failed. The command of the client is finished for any
+ *         value other than INSTPROXY_E_OP_IN_PROGRESS and
+ *         INSTPROXY_E_RECEIVE_TIMEOUT.
+ */
+instproxy_error_t instproxy_status_queue_next(instproxy_status_queue_t queue, int timeout, instproxy_client_t *client, plist_t *status);
+
 /**
  * List installed applications. This function runs synchronously.
  *
@@ -191,6 +287,64 @@ instproxy_error_t instproxy_browse(instproxy_client_t client, plist_t client_opt
  */
 instproxy_error_t instproxy_browse_with_callback(instproxy_client_t client, plist_t client_options, instproxy_status_cb_t status_cb, void *user_data);
 
+/**
+ * Starts listing installed applications chunk by chunk, as the device
+ * sends them. Unlike instproxy_browse() no merged result is built, and
+ * only the requested attributes are transferred.
+ *
+ * No other command can be started on the client until the iterator is
+ * freed.
+ *
+ * @param client The connected installation_proxy client
+ * @param client_options The client options to use, as PLIST_DICT, or NULL.
+ *        Valid client options include:
+ *          "ApplicationType" -> "System"
+ *          "ApplicationType" -> "User"
+ *          "ApplicationType" -> "Internal"
+ *          "ApplicationType" -> "Any"
+ * @param attributes NULL terminated array of the attributes to return for
+ *        each application, for example "CFBundleIdentifier". Overrides
+ *        "ReturnAttributes" of client_options. Pass NULL to keep the
+ *        client_options.
+ * @param iter Pointer that will be set to the new iterator. Must be freed
+ *        using instproxy_browse_iter_free() after use.
+ *
+ * @return INSTPROXY_E_SUCCESS on success, INSTPROXY_E_OP_IN_PROGRESS if the
+ *         client is busy, or an INSTPROXY_E_* error value if an error
+ *         occured.
+ */
+instproxy_error_t instproxy_browse_iter_new(instproxy_client_t client, plist_t client_options, const char **attributes, instproxy_browse_iter_t *iter);
+
+/**
+ * Waits for the next chunk of applications of a browse.
+ *
+ * @param iter The browse iterator.
+ * @param apps Pointer to store the chunk, a PLIST_ARRAY of PLIST_DICT
+ *        entries. The chunk is owned by the iterator and stays valid until
+ *        the next call. Set to NULL when all applications were returned.
+ * @param total Pointer to store the total number of applications of the
+ *        browse, or NULL.
+ *
+ * @return INSTPROXY_E_SUCCESS on success, INSTPROXY_E_RECEIVE_TIMEOUT if
+ *         the device sent nothing for 10 seconds, in which case the call
+ *         can be repeated, or an INSTPROXY_E_* error value if an error
+ *         occured.
+ */
+instproxy_error_t instproxy_browse_iter_next(instproxy_browse_iter_t iter, plist_t *apps, uint64_t *total);
+
+/**
+ * Frees a browse iterator. If the browse did not finish yet, the remaining
+ * chunks are received and discarded, waiting as long as the device takes.
+ * If receiving fails, the client stays busy and every further command
+ * returns INSTPROXY_E_OP_IN_PROGRESS, so it should be freed.
+ *
+ * @param iter The browse iterator to free.
+ *
+ * @return INSTPROXY_E_SUCCESS on success, INSTPROXY_E_INVALID_ARG if iter
+ *         is NULL, or the INSTPROXY_E_* error value the browse failed with.
+ */
+instproxy_error_t instproxy_browse_iter_free(instproxy_browse_iter_t iter);
+
 /**
  * Lookup information about specific applications from the device.
  *
@@ -233,6 +233,22 @@ idevice_error_t idevice_connection_receive_timeout(idevice_connection_t connecti
  */
 idevice_error_t idevice_connection_receive(idevice_connection_t connection, char *data, uint32_t len, uint32_t *recv_bytes);
 
+/**
+ * Receive data from a device via the given connection without blocking.
+ * Only the data that is available right now is returned. Use
+ * idevice_connection_get_fd() to wait for more data.
+ *
+ * @param connection The connection to receive data from. SSL enabled
+ *   connections are not supported.
+ * @param data Buffer that will be filled with the received data.
+ * @param len Buffer size.
+ * @param recv_bytes Number of bytes actually received.
+ *
+ * @return IDEVICE_E_SUCCESS if data was received, IDEVICE_E_NOT_ENOUGH_DATA
+ *   if no data is available right now, otherwise an error code.
+ */
+idevice_error_t idevice_connection_receive_nonblocking(idevice_connection_t connection, char *data, uint32_t len, uint32_t *recv_bytes);
+
 /**
  * Enables SSL for the given connection.
  *
@@ -137,6 +137,29 @@ property_list_service_error_t property_list_service_receive_plist_with_timeout(p
  */
 property_list_service_error_t property_list_service_receive_plist(property_list_service_client_t client, plist_t *plist);
 
+/**
+ * Receives a plist using the given property list service client without
+ * blocking. Partially received messages are kept by the client until the
+ * rest of the data arrives with a later call.
+ *
+ * Do not mix this with the blocking receive functions on the same client
+ * while a message is partially received.
+ *
+ * @param client The property list service client to use for receiving
+ * @param plist pointer to a plist_t that will point to the received plist
+ *      upon successful return
+ *
+ * @return PROPERTY_LIST_SERVICE_E_SUCCESS when a complete plist was received,
+ *      PROPERTY_LIST_SERVICE_E_RECEIVE_TIMEOUT when no complete message is
+ *      available yet, PROPERTY_LIST_SERVICE_E_INVALID_ARG when client or
+ *      *plist is NULL or SSL is enabled, PROPERTY_LIST_SERVICE_E_PLIST_ERROR
+ *      when the received data cannot be converted to a plist,
+ *      PROPERTY_LIST_SERVICE_E_MUX_ERROR when a communication error occurs,
+ *      or PROPERTY_LIST_SERVICE_E_UNKNOWN_ERROR when an unspecified error
+ *      occurs.
+ */
+property_list_service_error_t property_list_service_receive_plist_nonblocking(property_list_service_client_t client, plist_t *plist);
+
 /**
  * Enable SSL for the given property list service client.
  *
@@ -138,6 +138,24 @@ service_error_t service_receive_with_timeout(service_client_t client, char *data
  */
 service_error_t service_receive(service_client_t client, char *data, uint32_t size, uint32_t *received);
 
+/**
+ * Receives the data that is available right now using the given service
+ * client, without blocking.
+ *
+ * @param client The service client to use for receiving
+ * @param data Buffer that will be filled with the data received
+ * @param size Size of the buffer
+ * @param received Number of bytes received, 0 if no data is available
+ *      (can be NULL to ignore)
+ *
+ * @return SERVICE_E_SUCCESS on success,
+ *      SERVICE_E_INVALID_ARG when one or more parameters are
+ *      invalid or SSL is enabled, SERVICE_E_MUX_ERROR when a communication
+ *      error occurs or the device closed the connection, or
+ *      SERVICE_E_UNKNOWN_ERROR when an unspecified error occurs.
+ */
+service_error_t service_receive_nonblocking(service_client_t client, char *data, uint32_t size, uint32_t *received);
+
 
 /**
  * Enable SSL for the given service client.
@@ -47,6 +47,16 @@ typedef syslog_relay_client_private *syslog_relay_client_t; /**< The client hand
 /** Receives each character received from the device. */
 typedef void (*syslog_relay_receive_cb_t)(char c, void *user_data);
 
+/**
+ * Receives a batch of complete syslog lines from the device.
+ *
+ * @param lines The lines, each terminated by a newline. Not NUL-terminated,
+ *     and only valid for the duration of the call.
+ * @param size Number of bytes in lines.
+ * @param user_data Custom pointer passed to syslog_relay_start_capture_lines().
+ */
+typedef void (*syslog_relay_receive_lines_cb_t)(const char *lines, uint32_t size, void *user_data);
+
 /* Interface */
 
 /**
@@ -106,6 +116,27 @@ syslog_relay_error_t syslog_relay_client_free(syslog_relay_client_t client);
  */
 syslog_relay_error_t syslog_relay_start_capture(syslog_relay_client_t client, syslog_relay_receive_cb_t callback, void* user_data);
 
+/**
+ * Starts capturing the syslog of the device, delivering whole lines.
+ *
+ * The syslog is read in large chunks and every complete line received is
+ * passed to the callback in a single batch, which is far cheaper than
+ * syslog_relay_start_capture() when following busy devices. A line without
+ * a newline is delivered once capturing stops.
+ *
+ * Use syslog_relay_stop_capture() to stop receiving the syslog.
+ *
+ * @param client The syslog_relay client to use
+ * @param callback Callback to receive batches of lines from the syslog.
+ * @param user_data Custom pointer passed to the callback function.
+ *
+ * @return SYSLOG_RELAY_E_SUCCESS on success,
+ *      SYSLOG_RELAY_E_INVALID_ARG when one or more parameters are
+ *      invalid or SYSLOG_RELAY_E_UNKNOWN_ERROR when an unspecified
+ *      error occurs or a syslog capture has already been started.
+ */
+syslog_relay_error_t syslog_relay_start_capture_lines(syslog_relay_client_t client, syslog_relay_receive_lines_cb_t callback, void* user_data);
+
 /**
  * Stops capturing the syslog of the device.
  *
@@ -501,6 +501,29 @@ LIBIMOBILEDEVICE_API idevice_error_t idevice_connection_receive(idevice_connecti
 	return internal_connection_receive(connection, data, len, recv_bytes);
 }
 
+LIBIMOBILEDEVICE_API idevice_error_t idevice_connection_receive_nonblocking(idevice_connection_t connection, char *data, uint32_t len, uint32_t *recv_bytes)
+{
+	if (!connection || !data || !recv_bytes || connection->ssl_data) {
+		return IDEVICE_E_INVALID_ARG;
+	}
+
+	*recv_bytes = 0;
+	if (connection->type == CONNECTION_USBMUXD) {
+		int res = usbmuxd_recv_nonblocking((int)(long)connection->data, data, len, recv_bytes);
+		if (res == -EAGAIN) {
+			return IDEVICE_E_NOT_ENOUGH_DATA;
+		}
+		if (res < 0) {
+			debug_info("ERROR: usbmuxd_recv_nonblocking returned %d (%s)", res, strerror(-res));
+			return IDEVICE_E_UNKNOWN_ERROR;
+		}
+		return IDEVICE_E_SUCCESS;
+	} else {
+		debug_info("Unknown connection type %d", connection->type);
+	}
+	return IDEVICE_E_UNKNOWN_ERROR;
+}
+
 LIBIMOBILEDEVICE_API idevice_error_t idevice_connection_get_fd(idevice_connection_t connection, int *fd)
 {
 	if (!connection || !fd) {
@@ -541,20 +564,16 @@ LIBIMOBILEDEVICE_API idevice_error_t idevice_get_udid(idevice_t device, char **u
  */
 static ssize_t internal_ssl_read(gnutls_transport_ptr_t transport, char *buffer, size_t length)
 {
-	int bytes = 0, pos_start_fill = 0;
+	uint32_t bytes = 0;
 	size_t tbytes = 0;
-	int this_len = length;
 	idevice_error_t res;
 	idevice_connection_t connection = (idevice_connection_t)transport;
-	char *recv_buffer;
 
 	debug_info("pre-read client wants %zi bytes", length);
 
-	recv_buffer = (char *)malloc(sizeof(char) * this_len);
-
-	/* repeat until we have the full data or an error occurs */
+	/* repeat until we have the full data or an error occurs, receiving straight into the caller's buffer */
 	do {
-		if ((res = internal_connection_receive(connection, recv_buffer, this_len, (uint32_t*)&bytes)) != IDEVICE_E_SUCCESS) {
+		if ((res = internal_connection_receive(connection, buffer + tbytes, (uint32_t)(length - tbytes), &bytes)) != IDEVICE_E_SUCCESS) {
 			debug_info("ERROR: idevice_connection_receive returned %d", res);
 			return res;
 		}
@@ -563,21 +582,11 @@ static ssize_t internal_ssl_read(gnutls_transport_ptr_t transport, char *buffer,
 		/* increase read count */
 		tbytes += bytes;
 
-		/* fill the buffer with what we got right now */
-		memcpy(buffer + pos_start_fill, recv_buffer, bytes);
-		pos_start_fill += bytes;
-
-		if (tbytes >= length) {
-			break;
+		if (tbytes < length) {
+			debug_info("re-read trying to read missing %zi bytes", length - tbytes);
 		}
-
-		this_len = length - tbytes;
-		debug_info("re-read trying to read missing %i bytes", this_len);
 	} while (tbytes < length);
 
-	if (recv_buffer) {
-		free(recv_buffer);
-	}
 	return tbytes;
 }
 
@@ -778,6 +787,10 @@ LIBIMOBILEDEVICE_API idevice_error_t idevice_connection_enable_ssl(idevice_conne
 	SSL_set_connect_state(ssl);
 	SSL_set_verify(ssl, 0, ssl_verify_callback);
 	SSL_set_bio(ssl, ssl_bio, ssl_bio);
+	/* let OpenSSL fill its per-connection buffer with whatever the socket has, instead of
+	 * issuing separate reads for every record header and body. Device services only answer
+	 * requests, so nothing sent after the TLS session ends can be read ahead by mistake. */
+	SSL_set_read_ahead(ssl, 1);
 
 	return_me = SSL_do_handshake(ssl);
 	if (return_me != 1) {
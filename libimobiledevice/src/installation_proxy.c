@@ -24,6 +24,14 @@
 #include <stdlib.h>
 #include <inttypes.h>
 #include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#ifdef WIN32
+#include <winsock2.h>
+#define poll WSAPoll
+#else
+#include <poll.h>
+#endif
 #include <plist/plist.h>
 
 #include "installation_proxy.h"
@@ -179,6 +187,34 @@ static instproxy_error_t instproxy_strtoerr(const char* name)
 	return err;
 }
 
+/**
+ * Checks a status response for an error or completion without copying any
+ * of its strings.
+ *
+ * @param status The status response to check.
+ *
+ * @return INSTPROXY_E_OP_IN_PROGRESS while the command is running,
+ *     INSTPROXY_E_SUCCESS once it completed, or the INSTPROXY_E_* error
+ *     reported in the status.
+ */
+static instproxy_error_t instproxy_status_check(plist_t status)
+{
+	const char *name;
+	plist_t node = plist_dict_get_item(status, "Error");
+
+	if (node) {
+		name = plist_get_string_ptr(node, NULL);
+		return (name) ? instproxy_strtoerr(name) : INSTPROXY_E_UNKNOWN_ERROR;
+	}
+
+	/* responses without a status are final */
+	name = plist_get_string_ptr(plist_dict_get_item(status, "Status"), NULL);
+	if (name && strcmp(name, "Complete") != 0) {
+		return INSTPROXY_E_OP_IN_PROGRESS;
+	}
+	return INSTPROXY_E_SUCCESS;
+}
+
 /**
  * Locks an installation_proxy client, used for thread safety.
  *
@@ -241,6 +277,11 @@ LIBIMOBILEDEVICE_API instproxy_error_t instproxy_client_new(idevice_t device, lo
 	client_loc->parent = plistclient;
 	mutex_init(&client_loc->mutex);
 	client_loc->receive_status_thread = (thread_t)NULL;
+	client_loc->queue = NULL;
+	client_loc->queued_command = NULL;
+	client_loc->queued_cb = NULL;
+	client_loc->queued_user_data = NULL;
+	client_loc->browsing = 0;
 
 	*client = client_loc;
 	return INSTPROXY_E_SUCCESS;
@@ -258,6 +299,10 @@ LIBIMOBILEDEVICE_API instproxy_error_t instproxy_client_free(instproxy_client_t
 	if (!client)
 		return INSTPROXY_E_INVALID_ARG;
 
+	if (client->queue) {
+		instproxy_status_queue_remove(client->queue, client);
+	}
+
 	property_list_service_client_free(client->parent);
 	client->parent = NULL;
 	if (client->receive_status_thread) {
@@ -318,17 +363,12 @@ static instproxy_error_t instproxy_receive_status_loop(instproxy_client_t client
 	instproxy_error_t res = INSTPROXY_E_UNKNOWN_ERROR;
 	int complete = 0;
 	plist_t node = NULL;
-	char* command_name = NULL;
-	char* status_name = NULL;
-	char* error_name = NULL;
-	char* error_description = NULL;
-	uint64_t error_code = 0;
 #ifndef STRIP_DEBUG_CODE
+	const char* command_name = plist_get_string_ptr(plist_dict_get_item(command, "Command"), NULL);
+	const char* status_name = NULL;
 	int percent_complete = 0;
 #endif
 
-	instproxy_command_get_name(command, &command_name);
-
 	do {
 		/* receive status response */
 		instproxy_lock(client);
@@ -343,38 +383,24 @@ static instproxy_error_t instproxy_receive_status_loop(instproxy_client_t client
 
 		/* parse status response */
 		if (node) {
-			/* check status for possible error to allow reporting it and aborting it gracefully */
-			res = instproxy_status_get_error(node, &error_name, &error_description, &error_code);
-			if (res != INSTPROXY_E_SUCCESS) {
-				debug_info("command: %s, error %d, code 0x%08"PRIx64", name: %s, description: \"%s\"", command_name, res, error_code, error_name, error_description ? error_description: "N/A");
+			/* check for a possible error to allow reporting it and aborting gracefully */
+			res = instproxy_status_check(node);
+			if (res != INSTPROXY_E_OP_IN_PROGRESS) {
 				complete = 1;
 			}
 
-			if (error_name) {
+#ifndef STRIP_DEBUG_CODE
+			if (res != INSTPROXY_E_SUCCESS && res != INSTPROXY_E_OP_IN_PROGRESS) {
+				char* error_name = NULL;
+				char* error_description = NULL;
+				uint64_t error_code = 0;
+				instproxy_status_get_error(node, &error_name, &error_description, &error_code);
+				debug_info("command: %s, error %d, code 0x%08"PRIx64", name: %s, description: \"%s\"", command_name, res, error_code, error_name, error_description ? error_description: "N/A");
 				free(error_name);
-				error_name = NULL;
-			}
-
-			if (error_description) {
 				free(error_description);
-				error_description = NULL;
 			}
-
-			/* check status from response */
-			instproxy_status_get_name(node, &status_name);
-			if (!status_name) {
-				debug_info("failed to retrieve name from status response with error %d.", res);
-				complete = 1;
-			}
-
+			status_name = plist_get_string_ptr(plist_dict_get_item(node, "Status"), NULL);
 			if (status_name) {
-				if (!strcmp(status_name, "Complete")) {
-					complete = 1;
-				} else {
-					res = INSTPROXY_E_OP_IN_PROGRESS;
-				}
-
-#ifndef STRIP_DEBUG_CODE
 				percent_complete = -1;
 				instproxy_status_get_percent_complete(node, &percent_complete);
 				if (percent_complete >= 0) {
@@ -382,10 +408,8 @@ static instproxy_error_t instproxy_receive_status_loop(instproxy_client_t client
 				} else {
 					debug_info("command: %s, status: %s", command_name, status_name);
 				}
-#endif
-				free(status_name);
-				status_name = NULL;
 			}
+#endif
 
 			/* invoke status callback function */
 			if (status_cb) {
@@ -397,9 +421,6 @@ static instproxy_error_t instproxy_receive_status_loop(instproxy_client_t client
 		}
 	} while (!complete && client->parent);
 
-	if (command_name)
-		free(command_name);
-
 	return res;
 }
 
@@ -510,7 +531,7 @@ static instproxy_error_t instproxy_perform_command(instproxy_client_t client, pl
 		return INSTPROXY_E_INVALID_ARG;
 	}
 
-	if (client->receive_status_thread) {
+	if (client->receive_status_thread || client->queued_command || client->browsing) {
 		return INSTPROXY_E_OP_IN_PROGRESS;
 	}
 
@@ -521,6 +542,16 @@ static instproxy_error_t instproxy_perform_command(instproxy_client_t client, pl
 	res = instproxy_send_command(client, command);
 	instproxy_unlock(client);
 
+	if (async == INSTPROXY_COMMAND_TYPE_ASYNC && client->queue) {
+		/* status updates are collected by instproxy_status_queue_next */
+		if (res == INSTPROXY_E_SUCCESS) {
+			client->queued_command = plist_copy(command);
+			client->queued_cb = status_cb;
+			client->queued_user_data = user_data;
+		}
+		return res;
+	}
+
 	/* loop until status or error is received */
 	res = instproxy_receive_status_loop_with_callback(client, command, async, status_cb, user_data);
 
@@ -529,7 +560,7 @@ static instproxy_error_t instproxy_perform_command(instproxy_client_t client, pl
 
 LIBIMOBILEDEVICE_API instproxy_error_t instproxy_browse_with_callback(instproxy_client_t client, plist_t client_options, instproxy_status_cb_t status_cb, void *user_data)
 {
-	if (!client || !client->parent || !status_cb)
+	if (!client || !client->parent || (!status_cb && !client->queue))
 		return INSTPROXY_E_INVALID_ARG;
 
 	instproxy_error_t res = INSTPROXY_E_UNKNOWN_ERROR;
@@ -549,23 +580,156 @@ LIBIMOBILEDEVICE_API instproxy_error_t instproxy_browse_with_callback(instproxy_
 static void instproxy_append_current_list_to_result_cb(plist_t command, plist_t status, void *user_data)
 {
 	plist_t *result_array = (plist_t*)user_data;
-	uint64_t current_amount = 0;
-	plist_t current_list = NULL;
-	uint64_t i;
+	plist_t current_list = plist_dict_get_item(status, "CurrentList");
+	uint32_t current_amount = 0;
+	uint32_t i;
 
-	instproxy_status_get_current_list(status, NULL, NULL, &current_amount, &current_list);
+	if (current_list && plist_get_node_type(current_list) == PLIST_ARRAY) {
+		current_amount = plist_array_get_size(current_list);
+	}
 
 	debug_info("current_amount: %d", current_amount);
 
-	if (current_amount > 0) {
-		for (i = 0; current_list && (i < current_amount); i++) {
-			plist_t item = plist_array_get_item(current_list, i);
-			plist_array_append_item(*result_array, plist_copy(item));
+	/* copy the entries straight from the status, it is freed afterwards */
+	for (i = 0; i < current_amount; i++) {
+		plist_array_append_item(*result_array, plist_copy(plist_array_get_item(current_list, i)));
+	}
+}
+
+LIBIMOBILEDEVICE_API instproxy_error_t instproxy_browse_iter_new(instproxy_client_t client, plist_t client_options, const char **attributes, instproxy_browse_iter_t *iter)
+{
+	if (!client || !client->parent || !iter)
+		return INSTPROXY_E_INVALID_ARG;
+
+	if (client->receive_status_thread || client->queued_command || client->browsing)
+		return INSTPROXY_E_OP_IN_PROGRESS;
+
+	/* allocate first, the device starts sending as soon as Browse is out */
+	instproxy_browse_iter_t iter_loc = (instproxy_browse_iter_t)calloc(1, sizeof(struct instproxy_browse_iter_private));
+	if (!iter_loc)
+		return INSTPROXY_E_UNKNOWN_ERROR;
+
+	instproxy_error_t res = INSTPROXY_E_UNKNOWN_ERROR;
+	plist_t options = (client_options) ? plist_copy(client_options) : plist_new_dict();
+
+	if (attributes) {
+		int i = 0;
+		plist_t return_attributes = plist_new_array();
+		while (attributes[i]) {
+			plist_array_append_item(return_attributes, plist_new_string(attributes[i]));
+			i++;
+		}
+		plist_dict_set_item(options, "ReturnAttributes", return_attributes);
+	}
+
+	plist_t command = plist_new_dict();
+	plist_dict_set_item(command, "Command", plist_new_string("Browse"));
+	plist_dict_set_item(command, "ClientOptions", options);
+
+	instproxy_lock(client);
+	res = instproxy_send_command(client, command);
+	instproxy_unlock(client);
+
+	plist_free(command);
+
+	if (res != INSTPROXY_E_SUCCESS) {
+		free(iter_loc);
+		return res;
+	}
+
+	iter_loc->client = client;
+	client->browsing = 1;
+
+	*iter = iter_loc;
+	return INSTPROXY_E_SUCCESS;
+}
+
+LIBIMOBILEDEVICE_API instproxy_error_t instproxy_browse_iter_next(instproxy_browse_iter_t iter, plist_t *apps, uint64_t *total)
+{
+	instproxy_error_t res = INSTPROXY_E_SUCCESS;
+
+	if (!iter || !apps)
+		return INSTPROXY_E_INVALID_ARG;
+
+	*apps = NULL;
+
+	/* the previous chunk is released here */
+	if (iter->status) {
+		plist_free(iter->status);
+		iter->status = NULL;
+	}
+
+	while (!iter->complete && iter->client->parent) {
+		plist_t node = NULL;
+
+		instproxy_lock(iter->client);
+		res = instproxy_error(property_list_service_receive_plist_with_timeout(iter->client->parent, &node, 10000));
+		instproxy_unlock(iter->client);
+
+		/* the browse stays pending, the caller may wait again */
+		if (res == INSTPROXY_E_RECEIVE_TIMEOUT)
+			return res;
+		if (res != INSTPROXY_E_SUCCESS) {
+			debug_info("could not receive plist, error %d", res);
+			iter->complete = 1;
+			iter->failed = 1;
+			return res;
 		}
+
+		res = instproxy_status_check(node);
+		if (res != INSTPROXY_E_OP_IN_PROGRESS) {
+			iter->complete = 1;
+			if (res != INSTPROXY_E_SUCCESS) {
+				plist_free(node);
+				return res;
+			}
+		}
+		res = INSTPROXY_E_SUCCESS;
+
+		plist_get_uint_val(plist_dict_get_item(node, "Total"), &iter->total);
+
+		plist_t current_list = plist_dict_get_item(node, "CurrentList");
+		if (current_list && plist_get_node_type(current_list) == PLIST_ARRAY && plist_array_get_size(current_list) > 0) {
+			iter->status = node;
+			*apps = current_list;
+			break;
+		}
+		plist_free(node);
+	}
+
+	if (total)
+		*total = iter->total;
+
+	return res;
+}
+
+LIBIMOBILEDEVICE_API instproxy_error_t instproxy_browse_iter_free(instproxy_browse_iter_t iter)
+{
+	instproxy_error_t res = INSTPROXY_E_SUCCESS;
+	plist_t apps = NULL;
+
+	if (!iter)
+		return INSTPROXY_E_INVALID_ARG;
+
+	/* drain the rest of the browse so the next command starts cleanly */
+	while (!iter->complete && iter->client->parent) {
+		res = instproxy_browse_iter_next(iter, &apps, NULL);
+		/* the device is still working on the browse */
+		if (res == INSTPROXY_E_RECEIVE_TIMEOUT)
+			continue;
+		if (res != INSTPROXY_E_SUCCESS || !apps)
+			break;
 	}
 
-	if (current_list)
-		plist_free(current_list);
+	if (iter->status)
+		plist_free(iter->status);
+	/* after a receive error the next reply might still belong to the
+	 * browse, so the client stays busy and refuses further commands */
+	if (!iter->failed)
+		iter->client->browsing = 0;
+	free(iter);
+
+	return res;
 }
 
 LIBIMOBILEDEVICE_API instproxy_error_t instproxy_browse(instproxy_client_t client, plist_t client_options, plist_t *result)
@@ -807,6 +971,231 @@ LIBIMOBILEDEVICE_API instproxy_error_t instproxy_check_capabilities_match(instpr
 	return res;
 }
 
+LIBIMOBILEDEVICE_API instproxy_error_t instproxy_client_get_fd(instproxy_client_t client, int *fd)
+{
+	if (!client || !client->parent || !fd)
+		return INSTPROXY_E_INVALID_ARG;
+
+	if (idevice_connection_get_fd(client->parent->parent->connection, fd) != IDEVICE_E_SUCCESS)
+		return INSTPROXY_E_CONN_FAILED;
+
+	return INSTPROXY_E_SUCCESS;
+}
+
+LIBIMOBILEDEVICE_API instproxy_error_t instproxy_status_queue_new(instproxy_status_queue_t *queue)
+{
+	if (!queue)
+		return INSTPROXY_E_INVALID_ARG;
+
+	*queue = (instproxy_status_queue_t)calloc(1, sizeof(struct instproxy_status_queue_private));
+	if (!*queue)
+		return INSTPROXY_E_UNKNOWN_ERROR;
+
+	return INSTPROXY_E_SUCCESS;
+}
+
+/**
+ * Drops the pending command of a queued client.
+ */
+static void instproxy_queue_finish(instproxy_client_t client)
+{
+	if (client->queued_command) {
+		plist_free(client->queued_command);
+		client->queued_command = NULL;
+	}
+	client->queued_cb = NULL;
+	client->queued_user_data = NULL;
+}
+
+LIBIMOBILEDEVICE_API instproxy_error_t instproxy_status_queue_free(instproxy_status_queue_t queue)
+{
+	int i;
+
+	if (!queue)
+		return INSTPROXY_E_INVALID_ARG;
+
+	for (i = 0; i < queue->num_clients; i++) {
+		instproxy_queue_finish(queue->clients[i]);
+		queue->clients[i]->queue = NULL;
+	}
+	free(queue->clients);
+	free(queue->pfds);
+	free(queue);
+
+	return INSTPROXY_E_SUCCESS;
+}
+
+LIBIMOBILEDEVICE_API instproxy_error_t instproxy_status_queue_add(instproxy_status_queue_t queue, instproxy_client_t client)
+{
+	if (!queue || !client || !client->parent || client->queue)
+		return INSTPROXY_E_INVALID_ARG;
+
+	if (client->receive_status_thread)
+		return INSTPROXY_E_OP_IN_PROGRESS;
+
+	if (queue->num_clients == queue->capacity) {
+		int capacity = (queue->capacity) ? queue->capacity * 2 : 8;
+		instproxy_client_t *clients = (instproxy_client_t*)realloc(queue->clients, sizeof(instproxy_client_t) * capacity);
+		struct pollfd *pfds = (struct pollfd*)realloc(queue->pfds, sizeof(struct pollfd) * capacity);
+		if (clients)
+			queue->clients = clients;
+		if (pfds)
+			queue->pfds = pfds;
+		if (!clients || !pfds)
+			return INSTPROXY_E_UNKNOWN_ERROR;
+		queue->capacity = capacity;
+	}
+
+	queue->clients[queue->num_clients++] = client;
+	client->queue = queue;
+
+	return INSTPROXY_E_SUCCESS;
+}
+
+LIBIMOBILEDEVICE_API instproxy_error_t instproxy_status_queue_remove(instproxy_status_queue_t queue, instproxy_client_t client)
+{
+	int i;
+
+	if (!queue || !client || client->queue != queue)
+		return INSTPROXY_E_INVALID_ARG;
+
+	for (i = 0; i < queue->num_clients; i++) {
+		if (queue->clients[i] == client) {
+			memmove(&queue->clients[i], &queue->clients[i+1], sizeof(instproxy_client_t) * (queue->num_clients - i - 1));
+			queue->num_clients--;
+			break;
+		}
+	}
+	if (queue->next >= queue->num_clients)
+		queue->next = 0;
+
+	instproxy_queue_finish(client);
+	client->queue = NULL;
+
+	return INSTPROXY_E_SUCCESS;
+}
+
+/**
+ * Hands out the first complete status update of any pending command,
+ * starting after the client that was served last.
+ *
+ * @return INSTPROXY_E_RECEIVE_TIMEOUT if no complete status is available.
+ */
+static instproxy_error_t instproxy_queue_collect(instproxy_status_queue_t queue, instproxy_client_t *client, plist_t *status)
+{
+	instproxy_error_t res;
+	int i;
+
+	for (i = 0; i < queue->num_clients; i++) {
+		int index = (queue->next + i) % queue->num_clients;
+		instproxy_client_t c = queue->clients[index];
+		plist_t node = NULL;
+
+		if (!c->queued_command)
+			continue;
+
+		instproxy_lock(c);
+		res = instproxy_error(property_list_service_receive_plist_nonblocking(c->parent, &node));
+		instproxy_unlock(c);
+		if (res == INSTPROXY_E_RECEIVE_TIMEOUT)
+			continue;
+
+		queue->next = (index + 1) % queue->num_clients;
+		*client = c;
+		if (res != INSTPROXY_E_SUCCESS) {
+			debug_info("could not receive plist, error %d", res);
+			instproxy_queue_finish(c);
+			return res;
+		}
+
+		res = instproxy_status_check(node);
+		if (c->queued_cb) {
+			c->queued_cb(c->queued_command, node, c->queued_user_data);
+		}
+		if (res != INSTPROXY_E_OP_IN_PROGRESS) {
+			instproxy_queue_finish(c);
+		}
+		*status = node;
+		return res;
+	}
+
+	return INSTPROXY_E_RECEIVE_TIMEOUT;
+}
+
+/**
+ * Returns a monotonic timestamp in milliseconds.
+ */
+static uint64_t instproxy_time_ms(void)
+{
+#ifdef WIN32
+	return (uint64_t)GetTickCount64();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+LIBIMOBILEDEVICE_API instproxy_error_t instproxy_status_queue_next(instproxy_status_queue_t queue, int timeout, instproxy_client_t *client, plist_t *status)
+{
+	instproxy_error_t res;
+	uint64_t deadline = 0;
+	int i;
+
+	if (!queue || !client || !status)
+		return INSTPROXY_E_INVALID_ARG;
+
+	*client = NULL;
+	*status = NULL;
+
+	if (timeout > 0)
+		deadline = instproxy_time_ms() + timeout;
+
+	while (1) {
+		int nfds = 0;
+		int wait = timeout;
+		int ret;
+
+		/* messages might be buffered already, and a readable socket might
+		 * only hold part of one, so keep waiting for the rest */
+		res = instproxy_queue_collect(queue, client, status);
+		if (res != INSTPROXY_E_RECEIVE_TIMEOUT)
+			return res;
+
+		for (i = 0; i < queue->num_clients; i++) {
+			instproxy_client_t c = queue->clients[i];
+			int fd = -1;
+			if (!c->queued_command || instproxy_client_get_fd(c, &fd) != INSTPROXY_E_SUCCESS)
+				continue;
+			queue->pfds[nfds].fd = fd;
+			queue->pfds[nfds].events = POLLIN;
+			queue->pfds[nfds].revents = 0;
+			nfds++;
+		}
+		if (nfds == 0)
+			return INSTPROXY_E_OP_FAILED;
+
+		if (timeout > 0) {
+			uint64_t now = instproxy_time_ms();
+			if (now >= deadline)
+				return INSTPROXY_E_RECEIVE_TIMEOUT;
+			wait = (int)(deadline - now);
+		}
+
+		ret = poll(queue->pfds, nfds, wait);
+		if (ret == 0)
+			return INSTPROXY_E_RECEIVE_TIMEOUT;
+		if (ret < 0) {
+#ifndef WIN32
+			if (errno == EINTR)
+				continue;
+#endif
+			debug_info("poll failed, error %d", errno);
+			return INSTPROXY_E_CONN_FAILED;
+		}
+	}
+}
+
 LIBIMOBILEDEVICE_API instproxy_error_t instproxy_status_get_error(plist_t status, char **name, char** description, uint64_t* code)
 {
 	instproxy_error_t res = INSTPROXY_E_UNKNOWN_ERROR;
@@ -31,6 +31,27 @@ struct instproxy_client_private {
 	property_list_service_client_t parent;
 	mutex_t mutex;
 	thread_t receive_status_thread;
+	instproxy_status_queue_t queue;
+	plist_t queued_command;
+	instproxy_status_cb_t queued_cb;
+	void *queued_user_data;
+	int browsing;
+};
+
+struct instproxy_browse_iter_private {
+	instproxy_client_t client;
+	plist_t status;
+	uint64_t total;
+	int complete;
+	int failed; /* replies of the browse may still be in flight */
+};
+
+struct instproxy_status_queue_private {
+	instproxy_client_t *clients;
+	int num_clients;
+	int capacity;
+	int next;
+	struct pollfd *pfds;
 };
 
 #endif
@@ -68,6 +68,9 @@ LIBIMOBILEDEVICE_API property_list_service_error_t property_list_service_client_
 	/* create client object */
 	property_list_service_client_t client_loc = (property_list_service_client_t)malloc(sizeof(struct property_list_service_client_private));
 	client_loc->parent = parent;
+	client_loc->recv_buffer = NULL;
+	client_loc->recv_length = 0;
+	client_loc->recv_capacity = 0;
 
 	/* all done, return success */
 	*client = client_loc;
@@ -81,16 +84,61 @@ LIBIMOBILEDEVICE_API property_list_service_error_t property_list_service_client_
 
 	property_list_service_error_t err = service_to_property_list_service_error(service_client_free(client->parent));
 
+	free(client->recv_buffer);
 	free(client);
 	client = NULL;
 
 	return err;
 }
 
+struct plist_send_ctx {
+	service_client_t parent;
+	uint32_t length;
+	uint32_t sent;
+	int prefix_sent;
+	int mux_error;
+};
+
+/**
+ * Write callback for the streaming plist export. Sends the big endian
+ * length prefix before the first chunk, then passes each chunk of
+ * serialized data on to the service connection.
+ */
+static int internal_plist_send_chunk(const char *data, uint32_t length, void *user_data)
+{
+	struct plist_send_ctx *ctx = (struct plist_send_ctx*)user_data;
+	uint32_t bytes = 0;
+
+	if (!ctx->prefix_sent) {
+		uint32_t nlen = htobe32(ctx->length);
+		debug_info("sending %d bytes", ctx->length);
+		service_send(ctx->parent, (const char*)&nlen, sizeof(nlen), &bytes);
+		if (bytes != sizeof(nlen)) {
+			ctx->mux_error = 1;
+			return -1;
+		}
+		ctx->prefix_sent = 1;
+	}
+
+	service_send(ctx->parent, data, length, &bytes);
+	if (bytes == 0) {
+		ctx->mux_error = 1;
+		return -1;
+	}
+	ctx->sent += bytes;
+	if (bytes != length) {
+		return -1;
+	}
+	return 0;
+}
+
 /**
  * Sends a plist using the given property list service client.
  * Internally used generic plist send function.
  *
+ * The plist is serialized straight into the connection in chunks, so no
+ * complete copy of the serialized data is held in memory.
+ *
  * @param client The property list service client to use for sending.
  * @param plist plist to send
  * @param binary 1 = send binary plist, 0 = send xml plist
@@ -105,47 +153,38 @@ LIBIMOBILEDEVICE_API property_list_service_error_t property_list_service_client_
 static property_list_service_error_t internal_plist_send(property_list_service_client_t client, plist_t plist, int binary)
 {
 	property_list_service_error_t res = PROPERTY_LIST_SERVICE_E_UNKNOWN_ERROR;
-	char *content = NULL;
-	uint32_t length = 0;
-	uint32_t nlen = 0;
-	int bytes = 0;
+	struct plist_send_ctx ctx;
+	int ret;
 
 	if (!client || (client && !client->parent) || !plist) {
 		return PROPERTY_LIST_SERVICE_E_INVALID_ARG;
 	}
 
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.parent = client->parent;
+
 	if (binary) {
-		plist_to_bin(plist, &content, &length);
+		ret = plist_to_bin_cb(plist, internal_plist_send_chunk, &ctx, &ctx.length);
 	} else {
-		plist_to_xml(plist, &content, &length);
+		ret = plist_to_xml_cb(plist, internal_plist_send_chunk, &ctx, &ctx.length);
 	}
 
-	if (!content || length == 0) {
+	if (!ctx.prefix_sent && !ctx.mux_error) {
+		/* nothing was produced */
 		return PROPERTY_LIST_SERVICE_E_PLIST_ERROR;
 	}
 
-	nlen = htobe32(length);
-	debug_info("sending %d bytes", length);
-	service_send(client->parent, (const char*)&nlen, sizeof(nlen), (uint32_t*)&bytes);
-	if (bytes == sizeof(nlen)) {
-		service_send(client->parent, content, length, (uint32_t*)&bytes);
-		if (bytes > 0) {
-			debug_info("sent %d bytes", bytes);
-			debug_plist(plist);
-			if ((uint32_t)bytes == length) {
-				res = PROPERTY_LIST_SERVICE_E_SUCCESS;
-			} else {
-				debug_info("ERROR: Could not send all data (%d of %d)!", bytes, length);
-			}
-		}
-	}
-	if (bytes <= 0) {
+	if (ctx.mux_error) {
 		debug_info("ERROR: sending to device failed.");
 		res = PROPERTY_LIST_SERVICE_E_MUX_ERROR;
+	} else if (ret == 0 && ctx.sent == ctx.length) {
+		debug_info("sent %d bytes", ctx.sent);
+		debug_plist(plist);
+		res = PROPERTY_LIST_SERVICE_E_SUCCESS;
+	} else {
+		debug_info("ERROR: Could not send all data (%d of %d)!", ctx.sent, ctx.length);
 	}
 
-	free(content);
-
 	return res;
 }
 
@@ -159,6 +198,34 @@ LIBIMOBILEDEVICE_API property_list_service_error_t property_list_service_send_bi
 	return internal_plist_send(client, plist, 1);
 }
 
+/**
+ * Converts the content of a received message to a plist.
+ * The content buffer might be modified.
+ */
+static property_list_service_error_t internal_plist_parse(char *content, uint32_t pktlen, plist_t *plist)
+{
+	uint32_t i;
+
+	if ((pktlen > 8) && !memcmp(content, "bplist00", 8)) {
+		plist_from_bin(content, pktlen, plist);
+	} else if ((pktlen > 5) && !memcmp(content, "<?xml", 5)) {
+		/* iOS 4.3+ hack: plist data might contain invalid characters, thus we convert those to spaces */
+		for (i = 0; i < pktlen-1; i++) {
+			if ((content[i] >= 0) && (content[i] < 0x20) && (content[i] != 0x09) && (content[i] != 0x0a) && (content[i] != 0x0d))
+				content[i] = 0x20;
+		}
+		plist_from_xml(content, pktlen, plist);
+	} else {
+		debug_info("WARNING: received unexpected non-plist content");
+		debug_buffer(content, pktlen);
+	}
+	if (*plist) {
+		debug_plist(*plist);
+		return PROPERTY_LIST_SERVICE_E_SUCCESS;
+	}
+	return PROPERTY_LIST_SERVICE_E_PLIST_ERROR;
+}
+
 /**
  * Receives a plist using the given property list service client.
  * Internally used generic plist receive function.
@@ -224,25 +291,7 @@ static property_list_service_error_t internal_plist_receive_timeout(property_lis
 			free(content);
 			return res;
 		}
-		if ((pktlen > 8) && !memcmp(content, "bplist00", 8)) {
-			plist_from_bin(content, pktlen, plist);
-		} else if ((pktlen > 5) && !memcmp(content, "<?xml", 5)) {
-			/* iOS 4.3+ hack: plist data might contain invalid characters, thus we convert those to spaces */
-			for (bytes = 0; bytes < pktlen-1; bytes++) {
-				if ((content[bytes] >= 0) && (content[bytes] < 0x20) && (content[bytes] != 0x09) && (content[bytes] != 0x0a) && (content[bytes] != 0x0d))
-					content[bytes] = 0x20;
-			}
-			plist_from_xml(content, pktlen, plist);
-		} else {
-			debug_info("WARNING: received unexpected non-plist content");
-			debug_buffer(content, pktlen);
-		}
-		if (*plist) {
-			debug_plist(*plist);
-			res = PROPERTY_LIST_SERVICE_E_SUCCESS;
-		} else {
-			res = PROPERTY_LIST_SERVICE_E_PLIST_ERROR;
-		}
+		res = internal_plist_parse(content, pktlen, plist);
 		free(content);
 		content = NULL;
 	}
@@ -259,6 +308,63 @@ LIBIMOBILEDEVICE_API property_list_service_error_t property_list_service_receive
 	return internal_plist_receive_timeout(client, plist, 10000);
 }
 
+LIBIMOBILEDEVICE_API property_list_service_error_t property_list_service_receive_plist_nonblocking(property_list_service_client_t client, plist_t *plist)
+{
+	property_list_service_error_t res;
+	uint32_t pktlen;
+	uint32_t bytes = 0;
+
+	if (!client || !client->parent || !plist) {
+		return PROPERTY_LIST_SERVICE_E_INVALID_ARG;
+	}
+
+	*plist = NULL;
+
+	/* read the length prefix first, then exactly the rest of the message,
+	 * so data of the next message stays in the socket */
+	while (1) {
+		uint32_t wanted = sizeof(uint32_t);
+		if (client->recv_length >= sizeof(uint32_t)) {
+			memcpy(&pktlen, client->recv_buffer, sizeof(pktlen));
+			if (be32toh(pktlen) > UINT32_MAX - sizeof(uint32_t)) {
+				client->recv_length = 0;
+				return PROPERTY_LIST_SERVICE_E_PLIST_ERROR;
+			}
+			wanted += be32toh(pktlen);
+		}
+		if (client->recv_length == wanted && wanted > sizeof(uint32_t)) {
+			break;
+		}
+		if (wanted > client->recv_capacity) {
+			char *buffer = (char*)realloc(client->recv_buffer, wanted);
+			if (!buffer) {
+				debug_info("out of memory when allocating %d bytes", wanted);
+				return PROPERTY_LIST_SERVICE_E_UNKNOWN_ERROR;
+			}
+			client->recv_buffer = buffer;
+			client->recv_capacity = wanted;
+		}
+		if (client->recv_length == wanted) {
+			/* empty message */
+			client->recv_length = 0;
+			return PROPERTY_LIST_SERVICE_E_PLIST_ERROR;
+		}
+		service_error_t serr = service_receive_nonblocking(client->parent, client->recv_buffer + client->recv_length, wanted - client->recv_length, &bytes);
+		if (serr != SERVICE_E_SUCCESS) {
+			client->recv_length = 0;
+			return service_to_property_list_service_error(serr);
+		}
+		if (bytes == 0) {
+			return PROPERTY_LIST_SERVICE_E_RECEIVE_TIMEOUT;
+		}
+		client->recv_length += bytes;
+	}
+
+	client->recv_length = 0;
+	res = internal_plist_parse(client->recv_buffer + sizeof(uint32_t), be32toh(pktlen), plist);
+	return res;
+}
+
 LIBIMOBILEDEVICE_API property_list_service_error_t property_list_service_enable_ssl(property_list_service_client_t client)
 {
 	if (!client || !client->parent)
@@ -27,6 +27,10 @@
 
 struct property_list_service_client_private {
 	service_client_t parent;
+	/* partially received message of the non-blocking receive */
+	char *recv_buffer;
+	uint32_t recv_length;
+	uint32_t recv_capacity;
 };
 
 #endif
@@ -174,6 +174,28 @@ LIBIMOBILEDEVICE_API service_error_t service_receive(service_client_t client, ch
 	return service_receive_with_timeout(client, data, size, received, 10000);
 }
 
+LIBIMOBILEDEVICE_API service_error_t service_receive_nonblocking(service_client_t client, char* data, uint32_t size, uint32_t *received)
+{
+	idevice_error_t err;
+	uint32_t bytes = 0;
+
+	if (!client || (client && !client->connection) || !data || (size == 0)) {
+		return SERVICE_E_INVALID_ARG;
+	}
+
+	err = idevice_connection_receive_nonblocking(client->connection, data, size, &bytes);
+	if (received) {
+		*received = bytes;
+	}
+	if (err == IDEVICE_E_NOT_ENOUGH_DATA) {
+		return SERVICE_E_SUCCESS;
+	}
+	if (err == IDEVICE_E_UNKNOWN_ERROR) {
+		return SERVICE_E_MUX_ERROR;
+	}
+	return idevice_to_service_error(err);
+}
+
 LIBIMOBILEDEVICE_API service_error_t service_enable_ssl(service_client_t client)
 {
 	if (!client || !client->connection)
@@ -22,6 +22,7 @@
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif
+#define _GNU_SOURCE 1
 #include <string.h>
 #include <stdlib.h>
 
@@ -29,9 +30,13 @@
 #include "lockdown.h"
 #include "common/debug.h"
 
+/* size of the chunks read from the device by the capture worker */
+#define SYSLOG_RELAY_CHUNK_SIZE 16384
+
 struct syslog_relay_worker_thread {
 	syslog_relay_client_t client;
 	syslog_relay_receive_cb_t cbfunc;
+	syslog_relay_receive_lines_cb_t linesfunc;
 	void *user_data;
 };
 
@@ -139,6 +144,82 @@ LIBIMOBILEDEVICE_API syslog_relay_error_t syslog_relay_receive_with_timeout(sysl
 	return res;
 }
 
+/**
+ * Removes the NUL separators the relay sends between messages, in place.
+ *
+ * @return The number of bytes left.
+ */
+static uint32_t syslog_relay_strip_nul(char *data, uint32_t size)
+{
+	char *end = data + size;
+	char *out = memchr(data, '\0', size);
+	if (!out) {
+		return size;
+	}
+
+	char *in = out + 1;
+	while (in < end) {
+		char *nul = memchr(in, '\0', end - in);
+		size_t length = (nul ? nul : end) - in;
+		memmove(out, in, length);
+		out += length;
+		in += length + 1;
+	}
+
+	return (uint32_t)(out - data);
+}
+
+/**
+ * Finds the last newline in data, or returns NULL if there is none.
+ */
+static char *syslog_relay_last_newline(char *data, uint32_t size)
+{
+#ifdef HAVE_MEMRCHR
+	return (char*)memrchr(data, '\n', size);
+#else
+	char *p = data + size;
+	while (p > data) {
+		if (*--p == '\n') {
+			return p;
+		}
+	}
+	return NULL;
+#endif
+}
+
+/**
+ * Hands every complete line in the buffer to the lines callback in one call
+ * and moves the incomplete remainder to the front of the buffer. The first
+ * scan_from bytes are the remainder of the previous call and hold no newline.
+ *
+ * @return The number of bytes left in the buffer.
+ */
+static uint32_t syslog_relay_deliver_lines(struct syslog_relay_worker_thread *srwt, char *buffer, uint32_t size, uint32_t scan_from, int flush)
+{
+	if (size == 0) {
+		return 0;
+	}
+
+	uint32_t complete = size;
+	if (!flush) {
+		/* the last newline ends the batch */
+		char *last = syslog_relay_last_newline(buffer + scan_from, size - scan_from);
+		complete = (last) ? (uint32_t)(last + 1 - buffer) : 0;
+
+		/* a single line filling the whole buffer is delivered as is */
+		if (complete == 0 && size == SYSLOG_RELAY_CHUNK_SIZE) {
+			complete = size;
+		}
+	}
+
+	if (complete > 0) {
+		srwt->linesfunc(buffer, complete, srwt->user_data);
+		memmove(buffer, buffer + complete, size - complete);
+	}
+
+	return size - complete;
+}
+
 void *syslog_relay_worker(void *arg)
 {
 	syslog_relay_error_t ret = SYSLOG_RELAY_E_UNKNOWN_ERROR;
@@ -147,37 +228,53 @@ void *syslog_relay_worker(void *arg)
 	if (!srwt)
 		return NULL;
 
+	char *buffer = (char*)malloc(SYSLOG_RELAY_CHUNK_SIZE);
+	if (!buffer) {
+		free(srwt);
+		return NULL;
+	}
+
 	debug_info("Running");
 
+	/* bytes of an incomplete line kept from the previous read (lines mode only) */
+	uint32_t pending = 0;
+
 	while (srwt->client->parent) {
-		char c;
 		uint32_t bytes = 0;
-		ret = syslog_relay_receive_with_timeout(srwt->client, &c, 1, &bytes, 100);
+		ret = syslog_relay_receive_with_timeout(srwt->client, buffer + pending, SYSLOG_RELAY_CHUNK_SIZE - pending, &bytes, 100);
 		if ((bytes == 0) && (ret == SYSLOG_RELAY_E_SUCCESS)) {
 			continue;
 		} else if (ret < 0) {
 			debug_info("Connection to syslog relay interrupted");
 			break;
 		}
-		if(c != 0) {
-			srwt->cbfunc(c, srwt->user_data);
+
+		bytes = syslog_relay_strip_nul(buffer + pending, bytes);
+
+		if (srwt->linesfunc) {
+			pending = syslog_relay_deliver_lines(srwt, buffer, pending + bytes, pending, 0);
+		} else {
+			uint32_t i;
+			for (i = 0; i < bytes; i++) {
+				srwt->cbfunc(buffer[i], srwt->user_data);
+			}
 		}
 	}
 
-	if (srwt) {
-		free(srwt);
+	if (srwt->linesfunc) {
+		syslog_relay_deliver_lines(srwt, buffer, pending, 0, 1);
 	}
 
+	free(buffer);
+	free(srwt);
+
 	debug_info("Exiting");
 
 	return NULL;
 }
 
-LIBIMOBILEDEVICE_API syslog_relay_error_t syslog_relay_start_capture(syslog_relay_client_t client, syslog_relay_receive_cb_t callback, void* user_data)
+static syslog_relay_error_t syslog_relay_start_worker(syslog_relay_client_t client, syslog_relay_receive_cb_t callback, syslog_relay_receive_lines_cb_t lines_callback, void* user_data)
 {
-	if (!client || !callback)
-		return SYSLOG_RELAY_E_INVALID_ARG;
-
 	syslog_relay_error_t res = SYSLOG_RELAY_E_UNKNOWN_ERROR;
 
 	if (client->worker) {
@@ -190,16 +287,35 @@ LIBIMOBILEDEVICE_API syslog_relay_error_t syslog_relay_start_capture(syslog_rela
 	if (srwt) {
 		srwt->client = client;
 		srwt->cbfunc = callback;
+		srwt->linesfunc = lines_callback;
 		srwt->user_data = user_data;
 
 		if (thread_new(&client->worker, syslog_relay_worker, srwt) == 0) {
 			res = SYSLOG_RELAY_E_SUCCESS;
+		} else {
+			free(srwt);
 		}
 	}
 
 	return res;
 }
 
+LIBIMOBILEDEVICE_API syslog_relay_error_t syslog_relay_start_capture(syslog_relay_client_t client, syslog_relay_receive_cb_t callback, void* user_data)
+{
+	if (!client || !callback)
+		return SYSLOG_RELAY_E_INVALID_ARG;
+
+	return syslog_relay_start_worker(client, callback, NULL, user_data);
+}
+
+LIBIMOBILEDEVICE_API syslog_relay_error_t syslog_relay_start_capture_lines(syslog_relay_client_t client, syslog_relay_receive_lines_cb_t callback, void* user_data)
+{
+	if (!client || !callback)
+		return SYSLOG_RELAY_E_INVALID_ARG;
+
+	return syslog_relay_start_worker(client, NULL, callback, user_data);
+}
+
 LIBIMOBILEDEVICE_API syslog_relay_error_t syslog_relay_stop_capture(syslog_relay_client_t client)
 {
 	if (client->worker) {
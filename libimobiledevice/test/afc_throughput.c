@@ -0,0 +1,164 @@
+/*
+ * afc_throughput.c
+ * AFC loopback consistency test and benchmark
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <libimobiledevice/libimobiledevice.h>
+#include <libimobiledevice/afc.h>
+
+#define TEST_LABEL "afc_throughput"
+#define TEST_FILE "afc_throughput.bin"
+#define LARGE_CHUNK (1024 * 1024)
+#define SMALL_CHUNK 4096
+
+static double elapsed_since(struct timeval *start)
+{
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+static void report(const char *what, uint64_t bytes, uint32_t chunk, struct timeval *start)
+{
+	double elapsed = elapsed_since(start);
+
+	printf("%-6s %7u byte chunks  %llu bytes in %.3f s (%.2f MB/s)\n",
+		what, chunk, (unsigned long long)bytes, elapsed,
+		(elapsed > 0) ? bytes / elapsed / 1000000.0 : 0.0);
+}
+
+static int write_file(afc_client_t afc, const char *data, uint64_t size)
+{
+	struct timeval start;
+	uint64_t handle = 0;
+	uint64_t offset = 0;
+
+	if (afc_file_open(afc, TEST_FILE, AFC_FOPEN_WRONLY, &handle) != AFC_E_SUCCESS) {
+		fprintf(stderr, "could not create %s\n", TEST_FILE);
+		return -1;
+	}
+	gettimeofday(&start, NULL);
+	while (offset < size) {
+		uint32_t length = (size - offset > LARGE_CHUNK) ? LARGE_CHUNK : (uint32_t)(size - offset);
+		uint32_t written = 0;
+		if (afc_file_write(afc, handle, data + offset, length, &written) != AFC_E_SUCCESS || written == 0) {
+			fprintf(stderr, "write failed at offset %llu\n", (unsigned long long)offset);
+			break;
+		}
+		offset += written;
+	}
+	afc_file_close(afc, handle);
+	report("write", offset, LARGE_CHUNK, &start);
+
+	return (offset == size) ? 0 : -1;
+}
+
+/* reads the file back in chunks of the given size and compares it with data */
+static int read_file(afc_client_t afc, const char *data, uint64_t size, uint32_t chunk)
+{
+	struct timeval start;
+	uint64_t handle = 0;
+	uint64_t offset = 0;
+	char *buffer;
+	int res = 0;
+
+	if (afc_file_open(afc, TEST_FILE, AFC_FOPEN_RDONLY, &handle) != AFC_E_SUCCESS) {
+		fprintf(stderr, "could not open %s\n", TEST_FILE);
+		return -1;
+	}
+	buffer = (char*)malloc(chunk);
+	gettimeofday(&start, NULL);
+	while (res == 0) {
+		uint32_t bytes_read = 0;
+		if (afc_file_read(afc, handle, buffer, chunk, &bytes_read) != AFC_E_SUCCESS) {
+			fprintf(stderr, "read failed at offset %llu\n", (unsigned long long)offset);
+			res = -1;
+		} else if (bytes_read == 0) {
+			break;
+		} else if (offset + bytes_read > size || memcmp(buffer, data + offset, bytes_read) != 0) {
+			fprintf(stderr, "data read at offset %llu differs\n", (unsigned long long)offset);
+			res = -1;
+		} else {
+			offset += bytes_read;
+		}
+	}
+	report("read", offset, chunk, &start);
+	free(buffer);
+	afc_file_close(afc, handle);
+
+	if (res == 0 && offset != size) {
+		fprintf(stderr, "read %llu of %llu bytes\n", (unsigned long long)offset, (unsigned long long)size);
+		res = -1;
+	}
+	return res;
+}
+
+int main(int argc, char *argv[])
+{
+	int megabytes = (argc > 1) ? atoi(argv[1]) : 16;
+	idevice_t device = NULL;
+	afc_client_t afc = NULL;
+	uint64_t size;
+	uint64_t i;
+	char *data;
+	int failed = 0;
+
+	if (megabytes <= 0 || megabytes > 1024) {
+		printf("Usage: %s [MEGABYTES]\n", argv[0]);
+		return 1;
+	}
+	size = (uint64_t)megabytes * 1024 * 1024;
+
+	if (idevice_new(&device, NULL) != IDEVICE_E_SUCCESS) {
+		fprintf(stderr, "no device found\n");
+		return 1;
+	}
+	if (afc_client_start_service(device, &afc, TEST_LABEL) != AFC_E_SUCCESS) {
+		fprintf(stderr, "could not start afc\n");
+		idevice_free(device);
+		return 1;
+	}
+
+	/* a pattern that does not repeat at any power of two */
+	data = (char*)malloc(size);
+	for (i = 0; i < size; i++) {
+		data[i] = (char)((i * 7 + i / 251) & 0xff);
+	}
+
+	if (write_file(afc, data, size) < 0) {
+		failed++;
+	}
+	if (!failed && read_file(afc, data, size, LARGE_CHUNK) < 0) {
+		failed++;
+	}
+	/* small reads pay the per-record cost of the connection most */
+	if (!failed && read_file(afc, data, size, SMALL_CHUNK) < 0) {
+		failed++;
+	}
+	afc_remove_path(afc, TEST_FILE);
+
+	free(data);
+	afc_client_free(afc);
+	idevice_free(device);
+
+	return (failed) ? 1 : 0;
+}
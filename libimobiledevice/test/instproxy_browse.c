@@ -0,0 +1,202 @@
+/*
+ * instproxy_browse.c
+ * Checks chunked browsing with ReturnAttributes against a simulated device
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libimobiledevice/libimobiledevice.h>
+#include <libimobiledevice/afc.h>
+#include <libimobiledevice/installation_proxy.h>
+
+#define TEST_LABEL "instproxy_browse"
+#define PACKAGE_PREFIX "com.example.browse"
+
+static int install_packages(idevice_t device, instproxy_client_t client, int count)
+{
+	afc_client_t afc = NULL;
+	instproxy_status_queue_t queue = NULL;
+	int failed = 0;
+	int i;
+
+	if (afc_client_start_service(device, &afc, TEST_LABEL) != AFC_E_SUCCESS) {
+		fprintf(stderr, "could not start afc\n");
+		return -1;
+	}
+	afc_make_directory(afc, "PublicStaging");
+
+	instproxy_status_queue_new(&queue);
+	instproxy_status_queue_add(queue, client);
+	for (i = 0; i < count && !failed; i++) {
+		char path[64];
+		uint64_t handle = 0;
+		uint32_t written = 0;
+		instproxy_client_t c = NULL;
+		plist_t status = NULL;
+		instproxy_error_t res;
+
+		snprintf(path, sizeof(path), "PublicStaging/" PACKAGE_PREFIX "%d.ipa", i);
+		if (afc_file_open(afc, path, AFC_FOPEN_WRONLY, &handle) != AFC_E_SUCCESS) {
+			fprintf(stderr, "could not create %s\n", path);
+			failed = 1;
+			break;
+		}
+		afc_file_write(afc, handle, "PK", 2, &written);
+		afc_file_close(afc, handle);
+
+		res = instproxy_install(client, path, NULL, NULL, NULL);
+		while (res == INSTPROXY_E_SUCCESS || res == INSTPROXY_E_OP_IN_PROGRESS) {
+			res = instproxy_status_queue_next(queue, 10000, &c, &status);
+			plist_free(status);
+			if (res == INSTPROXY_E_SUCCESS)
+				break;
+		}
+		if (res != INSTPROXY_E_SUCCESS) {
+			fprintf(stderr, "installing %s failed, error %d\n", path, res);
+			failed = 1;
+		}
+	}
+	instproxy_status_queue_free(queue);
+	afc_client_free(afc);
+
+	return (failed) ? -1 : 0;
+}
+
+/**
+ * Browses all applications and checks that every entry holds exactly the
+ * expected attribute. Returns the number of entries or -1 on error.
+ */
+static int browse_all(instproxy_client_t client, plist_t client_options, const char **attributes, const char *expected_key)
+{
+	instproxy_browse_iter_t iter = NULL;
+	instproxy_error_t res;
+	uint64_t total = 0;
+	int chunks = 0;
+	int count = 0;
+
+	res = instproxy_browse_iter_new(client, client_options, attributes, &iter);
+	if (res != INSTPROXY_E_SUCCESS) {
+		fprintf(stderr, "could not start browse, error %d\n", res);
+		return -1;
+	}
+	if (instproxy_browse_iter_new(client, NULL, NULL, &iter) != INSTPROXY_E_OP_IN_PROGRESS) {
+		fprintf(stderr, "second browse on a busy client was not rejected\n");
+		count = -1;
+	}
+
+	while (count >= 0) {
+		plist_t apps = NULL;
+		uint32_t i;
+
+		res = instproxy_browse_iter_next(iter, &apps, &total);
+		if (res != INSTPROXY_E_SUCCESS) {
+			fprintf(stderr, "browse failed, error %d\n", res);
+			count = -1;
+			break;
+		}
+		if (!apps)
+			break;
+		chunks++;
+		for (i = 0; i < plist_array_get_size(apps); i++) {
+			plist_t app = plist_array_get_item(apps, i);
+			if (plist_dict_get_size(app) != 1 || !plist_dict_get_item(app, expected_key)) {
+				fprintf(stderr, "entry %d does not hold only %s\n", count, expected_key);
+				count = -1;
+				break;
+			}
+			count++;
+		}
+	}
+	instproxy_browse_iter_free(iter);
+
+	if (count >= 0 && (uint64_t)count != total) {
+		fprintf(stderr, "browse returned %d of %llu applications\n", count, (unsigned long long)total);
+		count = -1;
+	}
+	printf("browsed %d applications with %s in %d chunks\n", count, expected_key, chunks);
+
+	return count;
+}
+
+int main(int argc, char *argv[])
+{
+	int num_packages = (argc > 1) ? atoi(argv[1]) : 45;
+	const char *identifier_only[] = { "CFBundleIdentifier", NULL };
+	idevice_t device = NULL;
+	instproxy_client_t client = NULL;
+	instproxy_browse_iter_t iter = NULL;
+	plist_t options;
+	plist_t apps = NULL;
+	int failed = 0;
+
+	if (num_packages <= 0) {
+		printf("Usage: %s [APPLICATIONS]\n", argv[0]);
+		return 1;
+	}
+
+	if (idevice_new(&device, NULL) != IDEVICE_E_SUCCESS) {
+		fprintf(stderr, "no device found\n");
+		return 1;
+	}
+	if (instproxy_client_start_service(device, &client, TEST_LABEL) != INSTPROXY_E_SUCCESS) {
+		fprintf(stderr, "could not start installation_proxy\n");
+		idevice_free(device);
+		return 1;
+	}
+	if (install_packages(device, client, num_packages) < 0) {
+		failed++;
+	}
+
+	/* attributes passed to the iterator */
+	if (!failed && browse_all(client, NULL, identifier_only, "CFBundleIdentifier") != num_packages) {
+		failed++;
+	}
+
+	/* attributes passed in the client options */
+	options = instproxy_client_options_new();
+	instproxy_client_options_set_return_attributes(options, "CFBundleVersion", NULL);
+	if (!failed && browse_all(client, options, NULL, "CFBundleVersion") != num_packages) {
+		failed++;
+	}
+	instproxy_client_options_free(options);
+
+	/* freeing an unfinished iterator leaves the client usable */
+	if (!failed) {
+		if (instproxy_browse_iter_new(client, NULL, identifier_only, &iter) != INSTPROXY_E_SUCCESS
+		    || instproxy_browse_iter_next(iter, &apps, NULL) != INSTPROXY_E_SUCCESS || !apps) {
+			fprintf(stderr, "could not read the first chunk\n");
+			failed++;
+		}
+		if (instproxy_browse_iter_free(iter) != INSTPROXY_E_SUCCESS) {
+			fprintf(stderr, "could not drain the unfinished browse\n");
+			failed++;
+		}
+		apps = NULL;
+		if (instproxy_browse(client, NULL, &apps) != INSTPROXY_E_SUCCESS || plist_array_get_size(apps) != (uint32_t)num_packages) {
+			fprintf(stderr, "browse after an unfinished iterator failed\n");
+			failed++;
+		}
+		plist_free(apps);
+	}
+
+	instproxy_client_free(client);
+	idevice_free(device);
+
+	return (failed) ? 1 : 0;
+}
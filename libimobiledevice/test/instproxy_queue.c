@@ -0,0 +1,204 @@
+/*
+ * instproxy_queue.c
+ * Drives back-to-back installs on all simulated devices through an
+ * installation_proxy status queue
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libimobiledevice/libimobiledevice.h>
+#include <libimobiledevice/afc.h>
+#include <libimobiledevice/installation_proxy.h>
+
+#define TEST_LABEL "instproxy_queue"
+#define PACKAGE_PREFIX "com.example.queue"
+
+struct test_device {
+	idevice_t device;
+	instproxy_client_t *clients;
+	int next_package;
+	int installed;
+};
+
+static int num_packages = 0;
+
+static int upload_packages(idevice_t device)
+{
+	afc_client_t afc = NULL;
+	int i;
+
+	if (afc_client_start_service(device, &afc, TEST_LABEL) != AFC_E_SUCCESS) {
+		fprintf(stderr, "could not start afc\n");
+		return -1;
+	}
+	afc_make_directory(afc, "PublicStaging");
+	for (i = 0; i < num_packages; i++) {
+		char path[64];
+		uint64_t handle = 0;
+		uint32_t written = 0;
+		snprintf(path, sizeof(path), "PublicStaging/" PACKAGE_PREFIX "%d.ipa", i);
+		if (afc_file_open(afc, path, AFC_FOPEN_WRONLY, &handle) != AFC_E_SUCCESS) {
+			fprintf(stderr, "could not create %s\n", path);
+			afc_client_free(afc);
+			return -1;
+		}
+		afc_file_write(afc, handle, "PK", 2, &written);
+		afc_file_close(afc, handle);
+	}
+	afc_client_free(afc);
+	return 0;
+}
+
+static instproxy_error_t start_install(struct test_device *dev, instproxy_client_t client)
+{
+	char path[64];
+
+	snprintf(path, sizeof(path), "PublicStaging/" PACKAGE_PREFIX "%d.ipa", dev->next_package++);
+	return instproxy_install(client, path, NULL, NULL, NULL);
+}
+
+static int count_installed(instproxy_client_t client)
+{
+	plist_t apps = NULL;
+	uint32_t i;
+	int count = 0;
+
+	if (instproxy_browse(client, NULL, &apps) != INSTPROXY_E_SUCCESS || !apps) {
+		return -1;
+	}
+	for (i = 0; i < plist_array_get_size(apps); i++) {
+		plist_t node = plist_dict_get_item(plist_array_get_item(apps, i), "CFBundleIdentifier");
+		const char *identifier = (node) ? plist_get_string_ptr(node, NULL) : NULL;
+		if (identifier && !strncmp(identifier, PACKAGE_PREFIX, strlen(PACKAGE_PREFIX))) {
+			count++;
+		}
+	}
+	plist_free(apps);
+	return count;
+}
+
+int main(int argc, char *argv[])
+{
+	int clients_per_device = (argc > 1) ? atoi(argv[1]) : 4;
+	char **udids = NULL;
+	int num_devices = 0;
+	struct test_device *devices;
+	instproxy_status_queue_t queue = NULL;
+	int updates = 0;
+	int running = 0;
+	int failed = 0;
+	int i, j;
+
+	num_packages = (argc > 2) ? atoi(argv[2]) : 64;
+	if (clients_per_device <= 0 || num_packages <= 0) {
+		printf("Usage: %s [CLIENTS_PER_DEVICE] [INSTALLS_PER_DEVICE]\n", argv[0]);
+		return 1;
+	}
+
+	if (idevice_get_device_list(&udids, &num_devices) != IDEVICE_E_SUCCESS || num_devices == 0) {
+		fprintf(stderr, "no devices found\n");
+		return 1;
+	}
+
+	instproxy_status_queue_new(&queue);
+	devices = (struct test_device*)calloc(num_devices, sizeof(struct test_device));
+	for (i = 0; i < num_devices; i++) {
+		struct test_device *dev = &devices[i];
+		if (idevice_new(&dev->device, udids[i]) != IDEVICE_E_SUCCESS || upload_packages(dev->device) < 0) {
+			fprintf(stderr, "could not set up device %s\n", udids[i]);
+			return 1;
+		}
+		dev->clients = (instproxy_client_t*)calloc(clients_per_device, sizeof(instproxy_client_t));
+		for (j = 0; j < clients_per_device; j++) {
+			if (instproxy_client_start_service(dev->device, &dev->clients[j], TEST_LABEL) != INSTPROXY_E_SUCCESS) {
+				fprintf(stderr, "could not start installation_proxy on %s\n", udids[i]);
+				return 1;
+			}
+			instproxy_status_queue_add(queue, dev->clients[j]);
+			if (dev->next_package < num_packages && start_install(dev, dev->clients[j]) == INSTPROXY_E_SUCCESS) {
+				running++;
+			}
+		}
+	}
+
+	while (running > 0) {
+		instproxy_client_t client = NULL;
+		plist_t status = NULL;
+		instproxy_error_t res = instproxy_status_queue_next(queue, 10000, &client, &status);
+		struct test_device *dev = NULL;
+
+		plist_free(status);
+		if (res == INSTPROXY_E_OP_IN_PROGRESS) {
+			updates++;
+			continue;
+		}
+		if (res == INSTPROXY_E_RECEIVE_TIMEOUT || !client) {
+			fprintf(stderr, "waiting for status failed, error %d\n", res);
+			failed++;
+			break;
+		}
+
+		running--;
+		for (i = 0; i < num_devices && !dev; i++) {
+			for (j = 0; j < clients_per_device; j++) {
+				if (devices[i].clients[j] == client) {
+					dev = &devices[i];
+					break;
+				}
+			}
+		}
+		if (res != INSTPROXY_E_SUCCESS) {
+			fprintf(stderr, "install failed, error %d\n", res);
+			failed++;
+			continue;
+		}
+		dev->installed++;
+		if (dev->next_package < num_packages) {
+			res = start_install(dev, client);
+			if (res != INSTPROXY_E_SUCCESS) {
+				fprintf(stderr, "could not start install, error %d\n", res);
+				failed++;
+				continue;
+			}
+			running++;
+		}
+	}
+
+	instproxy_status_queue_free(queue);
+
+	for (i = 0; i < num_devices; i++) {
+		struct test_device *dev = &devices[i];
+		int count = count_installed(dev->clients[0]);
+		printf("%s: %d of %d installs completed, %d installed\n", udids[i], dev->installed, num_packages, count);
+		if (dev->installed != num_packages || count != num_packages) {
+			failed++;
+		}
+		for (j = 0; j < clients_per_device; j++) {
+			instproxy_client_free(dev->clients[j]);
+		}
+		free(dev->clients);
+		idevice_free(dev->device);
+	}
+	printf("%d progress updates\n", updates);
+
+	free(devices);
+	idevice_device_list_free(udids);
+
+	return (failed) ? 1 : 0;
+}
@@ -0,0 +1,35 @@
+## -*- sh -*-
+# Starts idevicesimulator on a private socket for the duration of a test.
+# Usage: start_simulator [SIMULATOR OPTIONS]
+
+SIMDIR=`mktemp -d`
+SIMPID=
+
+stop_simulator()
+{
+	if [ -n "$SIMPID" ]; then
+		kill $SIMPID 2>/dev/null || true
+		wait $SIMPID 2>/dev/null || true
+		SIMPID=
+	fi
+	rm -rf $SIMDIR
+}
+
+start_simulator()
+{
+	$top_builddir/tools/idevicesimulator -s UNIX:$SIMDIR/usbmuxd.sock "$@" $SIMDIR &
+	SIMPID=$!
+	USBMUXD_SOCKET_ADDRESS=UNIX:$SIMDIR/usbmuxd.sock
+	export USBMUXD_SOCKET_ADDRESS
+	i=0
+	while [ ! -S $SIMDIR/usbmuxd.sock ]; do
+		i=`expr $i + 1`
+		if [ $i -gt 50 ]; then
+			echo "idevicesimulator did not start" >&2
+			exit 1
+		fi
+		sleep 0.1
+	done
+}
+
+trap stop_simulator EXIT
@@ -0,0 +1,179 @@
+/*
+ * syslog_relay_capture.c
+ * syslog_relay capture consistency test and benchmark
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include <libimobiledevice/libimobiledevice.h>
+#include <libimobiledevice/syslog_relay.h>
+
+#define MAX_LINE 512
+#define CAPTURE_TIMEOUT 60.0
+
+struct capture_state {
+	int expected;
+	volatile int next;	/* number of the next message, written by the capture thread */
+	int errors;
+	uint64_t bytes;
+	uint32_t callbacks;
+	char line[MAX_LINE];
+	uint32_t line_length;
+};
+
+static double elapsed_since(struct timeval *start)
+{
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+/* checks that messages arrive whole, in order and without NUL separators */
+static void check_line(struct capture_state *state, const char *line, uint32_t length)
+{
+	char copy[MAX_LINE];
+	const char *message;
+	int number = -1;
+	int total = -1;
+
+	if (length == 0 || length >= MAX_LINE || line[length - 1] != '\n' || memchr(line, '\0', length)) {
+		state->errors++;
+		return;
+	}
+	memcpy(copy, line, length);
+	copy[length] = '\0';
+	message = strstr(copy, "simulated message ");
+	if (!message || sscanf(message, "simulated message %d of %d", &number, &total) != 2 || number != state->next || total != state->expected) {
+		if (state->errors++ == 0) {
+			fprintf(stderr, "unexpected line after message %d: %s", state->next - 1, copy);
+		}
+		return;
+	}
+	state->next++;
+}
+
+static void lines_cb(const char *lines, uint32_t size, void *user_data)
+{
+	struct capture_state *state = (struct capture_state*)user_data;
+	const char *end = lines + size;
+
+	state->callbacks++;
+	state->bytes += size;
+	if (size == 0 || lines[size - 1] != '\n') {
+		state->errors++;
+		return;
+	}
+	while (lines < end) {
+		const char *newline = memchr(lines, '\n', end - lines);
+		check_line(state, lines, (uint32_t)(newline + 1 - lines));
+		lines = newline + 1;
+	}
+}
+
+static void char_cb(char c, void *user_data)
+{
+	struct capture_state *state = (struct capture_state*)user_data;
+
+	state->callbacks++;
+	state->bytes++;
+	if (state->line_length < MAX_LINE) {
+		state->line[state->line_length++] = c;
+	}
+	if (c == '\n') {
+		check_line(state, state->line, state->line_length);
+		state->line_length = 0;
+	}
+}
+
+static int capture(idevice_t device, int expected, int lines_mode)
+{
+	const char *mode = (lines_mode) ? "lines" : "characters";
+	syslog_relay_client_t client = NULL;
+	struct capture_state state;
+	struct timeval start;
+	syslog_relay_error_t res;
+	double elapsed;
+
+	memset(&state, 0, sizeof(state));
+	state.expected = expected;
+
+	if (syslog_relay_client_start_service(device, &client, "syslog_relay_capture") != SYSLOG_RELAY_E_SUCCESS) {
+		fprintf(stderr, "could not start syslog_relay\n");
+		return -1;
+	}
+
+	gettimeofday(&start, NULL);
+	if (lines_mode) {
+		res = syslog_relay_start_capture_lines(client, lines_cb, &state);
+	} else {
+		res = syslog_relay_start_capture(client, char_cb, &state);
+	}
+	if (res != SYSLOG_RELAY_E_SUCCESS) {
+		fprintf(stderr, "could not start capture, error %d\n", res);
+		syslog_relay_client_free(client);
+		return -1;
+	}
+	while (state.next < expected && elapsed_since(&start) < CAPTURE_TIMEOUT) {
+		usleep(1000);
+	}
+	elapsed = elapsed_since(&start);
+	syslog_relay_stop_capture(client);
+	syslog_relay_client_free(client);
+
+	printf("%-10s  %d of %d lines, %llu bytes in %.3f s (%.2f MB/s, %u callbacks)\n",
+		mode, state.next, expected, (unsigned long long)state.bytes, elapsed,
+		(elapsed > 0) ? state.bytes / elapsed / 1000000.0 : 0.0, state.callbacks);
+
+	if (state.next != expected || state.errors > 0) {
+		fprintf(stderr, "%s capture failed with %d bad lines\n", mode, state.errors);
+		return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int expected = (argc > 1) ? atoi(argv[1]) : 10000;
+	idevice_t device = NULL;
+	int failed = 0;
+
+	if (expected <= 0) {
+		printf("Usage: %s [LINES]\n", argv[0]);
+		printf("LINES must match the --syslog-lines option of idevicesimulator.\n");
+		return 1;
+	}
+
+	if (idevice_new(&device, NULL) != IDEVICE_E_SUCCESS) {
+		fprintf(stderr, "no device found\n");
+		return 1;
+	}
+
+	if (capture(device, expected, 0) < 0) {
+		failed++;
+	}
+	if (capture(device, expected, 1) < 0) {
+		failed++;
+	}
+
+	idevice_free(device);
+
+	return (failed) ? 1 : 0;
+}
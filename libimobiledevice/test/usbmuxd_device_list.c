@@ -0,0 +1,125 @@
+/*
+ * usbmuxd_device_list.c
+ * Checks the device table kept by an event subscription against the
+ * device list reported by usbmuxd
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <usbmuxd.h>
+
+#define MAX_DEVICES 16
+
+static void event_cb(const usbmuxd_event_t *event, void *user_data)
+{
+}
+
+/**
+ * Polls the device table until the subscription has received the initial
+ * device list. Returns the device count or a negative errno value.
+ */
+static int wait_for_table(usbmuxd_device_info_t *devices, int max_devices)
+{
+	int res = -ENODATA;
+	int i;
+
+	for (i = 0; i < 500 && res == -ENODATA; i++) {
+		res = usbmuxd_copy_device_list(devices, max_devices);
+		if (res == -ENODATA) {
+			usleep(10000);
+		}
+	}
+	return res;
+}
+
+int main(int argc, char *argv[])
+{
+	int expected = (argc > 1) ? atoi(argv[1]) : 1;
+	usbmuxd_device_info_t devices[MAX_DEVICES + 1];
+	usbmuxd_device_info_t *list = NULL;
+	usbmuxd_subscription_context_t context = NULL;
+	int count;
+	int failed = 0;
+	int i, j;
+
+	if (expected <= 1 || expected > MAX_DEVICES) {
+		printf("Usage: %s DEVICES\n", argv[0]);
+		printf("DEVICES must be between 2 and %d.\n", MAX_DEVICES);
+		return 1;
+	}
+
+	if (usbmuxd_copy_device_list(devices, MAX_DEVICES) != -ENODATA) {
+		fprintf(stderr, "device table available without a subscription\n");
+		failed++;
+	}
+
+	/* without a subscription this asks usbmuxd */
+	if (usbmuxd_get_device_list(&list) != expected) {
+		fprintf(stderr, "usbmuxd did not report %d devices\n", expected);
+		usbmuxd_device_list_free(&list);
+		return 1;
+	}
+
+	if (usbmuxd_events_subscribe(&context, event_cb, NULL) != 0) {
+		fprintf(stderr, "could not subscribe\n");
+		return 1;
+	}
+
+	count = wait_for_table(devices, MAX_DEVICES);
+	printf("device table holds %d of %d devices\n", count, expected);
+	if (count != expected) {
+		failed++;
+	}
+
+	/* the table matches what usbmuxd reported */
+	for (i = 0; i < expected && count == expected; i++) {
+		for (j = 0; j < count; j++) {
+			if (devices[j].handle == list[i].handle && !strcmp(devices[j].udid, list[i].udid)) {
+				break;
+			}
+		}
+		if (j == count) {
+			fprintf(stderr, "device %s is missing from the table\n", list[i].udid);
+			failed++;
+		}
+	}
+	usbmuxd_device_list_free(&list);
+
+	/* a short buffer gets the first entries and the full count */
+	memset(devices, 0xff, sizeof(devices));
+	count = usbmuxd_copy_device_list(devices, 1);
+	if (count != expected || devices[0].handle == 0xffffffff || devices[1].handle != 0xffffffff) {
+		fprintf(stderr, "copying into a short buffer failed\n");
+		failed++;
+	}
+	if (usbmuxd_copy_device_list(NULL, 0) != expected) {
+		fprintf(stderr, "counting the devices failed\n");
+		failed++;
+	}
+
+	usbmuxd_events_unsubscribe(context);
+	if (usbmuxd_copy_device_list(devices, MAX_DEVICES) != -ENODATA) {
+		fprintf(stderr, "device table still available after unsubscribing\n");
+		failed++;
+	}
+
+	return (failed) ? 1 : 0;
+}
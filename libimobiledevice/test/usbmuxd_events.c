@@ -0,0 +1,257 @@
+/*
+ * usbmuxd_events.c
+ * Runs device monitoring and a device connection on a usbmuxd event loop
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>
+
+#include <usbmuxd.h>
+#include <plist/plist.h>
+
+#define LOCKDOWN_PORT 62078
+#define MAX_DEVICES 16
+#define MAX_ROUNDS 100
+
+struct monitor_state {
+	usbmuxd_device_info_t devices[MAX_DEVICES];
+	int added;
+	int removed;
+};
+
+/* a QueryType exchange with lockdownd, driven by socket readiness */
+struct lockdown_query {
+	usbmuxd_event_loop_t loop;
+	int sfd;
+	char *request;
+	uint32_t request_length;
+	uint32_t sent;
+	char header[4];
+	char *reply;
+	uint32_t reply_length;
+	uint32_t received;
+	int done;
+	int failed;
+};
+
+static void monitor_cb(const usbmuxd_event_t *event, void *user_data)
+{
+	struct monitor_state *state = (struct monitor_state*)user_data;
+
+	if (event->event == UE_DEVICE_ADD) {
+		if (state->added < MAX_DEVICES) {
+			state->devices[state->added] = event->device;
+		}
+		state->added++;
+	} else if (event->event == UE_DEVICE_REMOVE) {
+		state->removed++;
+	}
+}
+
+static void query_finish(struct lockdown_query *query, int failed)
+{
+	usbmuxd_event_loop_remove(query->loop, query->sfd);
+	query->failed = failed;
+	query->done = 1;
+}
+
+static void query_send(struct lockdown_query *query)
+{
+	while (query->sent < query->request_length) {
+		uint32_t sent = 0;
+		int res = usbmuxd_send_nonblocking(query->sfd, query->request + query->sent, query->request_length - query->sent, &sent);
+		if (res == -EAGAIN) {
+			return;
+		} else if (res < 0) {
+			fprintf(stderr, "send failed: %s\n", strerror(-res));
+			query_finish(query, 1);
+			return;
+		}
+		query->sent += sent;
+	}
+	/* everything is out, wait for the reply */
+	usbmuxd_event_loop_modify(query->loop, query->sfd, USBMUXD_LOOP_READ);
+}
+
+static void query_receive(struct lockdown_query *query)
+{
+	while (!query->done) {
+		uint32_t received = 0;
+		int res;
+
+		if (query->received < sizeof(query->header)) {
+			res = usbmuxd_recv_nonblocking(query->sfd, query->header + query->received, sizeof(query->header) - query->received, &received);
+		} else {
+			res = usbmuxd_recv_nonblocking(query->sfd, query->reply + query->received - sizeof(query->header), query->reply_length - (query->received - sizeof(query->header)), &received);
+		}
+		if (res == -EAGAIN) {
+			return;
+		} else if (res < 0) {
+			fprintf(stderr, "receive failed: %s\n", strerror(-res));
+			query_finish(query, 1);
+			return;
+		}
+		query->received += received;
+
+		if (query->received == sizeof(query->header) && !query->reply) {
+			uint32_t length;
+			memcpy(&length, query->header, sizeof(length));
+			query->reply_length = ntohl(length);
+			query->reply = (char*)malloc(query->reply_length);
+		}
+		if (query->reply && query->received == sizeof(query->header) + query->reply_length) {
+			query_finish(query, 0);
+		}
+	}
+}
+
+static void query_cb(int sfd, int events, void *user_data)
+{
+	struct lockdown_query *query = (struct lockdown_query*)user_data;
+
+	if (events & USBMUXD_LOOP_WRITE) {
+		query_send(query);
+	}
+	if (!query->done && (events & (USBMUXD_LOOP_READ | USBMUXD_LOOP_ERROR))) {
+		query_receive(query);
+	}
+}
+
+/**
+ * Sends QueryType to lockdownd of a device and checks the reply, using
+ * nothing but nonblocking calls from loop callbacks.
+ */
+static int query_lockdown(usbmuxd_event_loop_t loop, const usbmuxd_device_info_t *device)
+{
+	struct lockdown_query query;
+	plist_t request = plist_new_dict();
+	plist_t reply = NULL;
+	char *xml = NULL;
+	uint32_t length = 0;
+	uint32_t nlength;
+	int rounds = 0;
+	int result = -1;
+
+	memset(&query, 0, sizeof(query));
+	query.loop = loop;
+	query.sfd = usbmuxd_connect(device->handle, LOCKDOWN_PORT);
+	if (query.sfd < 0) {
+		fprintf(stderr, "could not connect to lockdownd of %s\n", device->udid);
+		plist_free(request);
+		return -1;
+	}
+
+	plist_dict_set_item(request, "Label", plist_new_string("usbmuxd_events"));
+	plist_dict_set_item(request, "Request", plist_new_string("QueryType"));
+	plist_to_xml(request, &xml, &length);
+	plist_free(request);
+	nlength = htonl(length);
+	query.request_length = sizeof(nlength) + length;
+	query.request = (char*)malloc(query.request_length);
+	memcpy(query.request, &nlength, sizeof(nlength));
+	memcpy(query.request + sizeof(nlength), xml, length);
+	free(xml);
+
+	usbmuxd_event_loop_add(loop, query.sfd, USBMUXD_LOOP_WRITE, query_cb, &query);
+	while (!query.done && rounds++ < MAX_ROUNDS) {
+		if (usbmuxd_event_loop_run_once(loop, 100) < 0) {
+			break;
+		}
+	}
+	if (!query.done) {
+		fprintf(stderr, "no reply from lockdownd of %s\n", device->udid);
+		usbmuxd_event_loop_remove(loop, query.sfd);
+	} else if (!query.failed) {
+		plist_from_xml(query.reply, query.reply_length, &reply);
+		plist_t type = plist_dict_get_item(reply, "Type");
+		const char *value = (type) ? plist_get_string_ptr(type, NULL) : NULL;
+		if (value && !strcmp(value, "com.apple.mobile.lockdown")) {
+			result = 0;
+		} else {
+			fprintf(stderr, "unexpected QueryType reply from %s\n", device->udid);
+		}
+		plist_free(reply);
+	}
+	usbmuxd_disconnect(query.sfd);
+	free(query.request);
+	free(query.reply);
+
+	return result;
+}
+
+int main(int argc, char *argv[])
+{
+	int expected = (argc > 1) ? atoi(argv[1]) : 1;
+	struct monitor_state state;
+	usbmuxd_event_loop_t loop;
+	int rounds = 0;
+	int answered = 0;
+	int failed = 0;
+	int i;
+
+	if (expected <= 0 || expected > MAX_DEVICES) {
+		printf("Usage: %s [DEVICES]\n", argv[0]);
+		return 1;
+	}
+
+	memset(&state, 0, sizeof(state));
+	loop = usbmuxd_event_loop_new();
+	if (!loop) {
+		fprintf(stderr, "could not create event loop\n");
+		return 1;
+	}
+	if (usbmuxd_event_loop_subscribe(loop, monitor_cb, &state) < 0) {
+		fprintf(stderr, "could not subscribe\n");
+		usbmuxd_event_loop_free(loop);
+		return 1;
+	}
+	if (usbmuxd_event_loop_subscribe(loop, monitor_cb, &state) != -EBUSY) {
+		fprintf(stderr, "second subscription was not rejected\n");
+		failed++;
+	}
+
+	while (state.added < expected && rounds++ < MAX_ROUNDS) {
+		if (usbmuxd_event_loop_run_once(loop, 100) < 0) {
+			break;
+		}
+	}
+	printf("%d of %d devices added\n", state.added, expected);
+	if (state.added != expected) {
+		failed++;
+	}
+	for (i = 0; i < state.added && i < MAX_DEVICES; i++) {
+		if (query_lockdown(loop, &state.devices[i]) == 0) {
+			answered++;
+		} else {
+			failed++;
+		}
+	}
+	printf("QueryType answered by %d devices\n", answered);
+
+	/* devices are not reported as removed when unsubscribing */
+	usbmuxd_event_loop_unsubscribe(loop);
+	if (state.removed != 0) {
+		fprintf(stderr, "%d devices reported as removed\n", state.removed);
+		failed++;
+	}
+	usbmuxd_event_loop_free(loop);
+
+	return (failed) ? 1 : 0;
+}
@@ -29,6 +29,15 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <signal.h>
+#ifdef HAVE_OPENSSL
+#include <openssl/evp.h>
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+#define EVP_MD_CTX_new EVP_MD_CTX_create
+#define EVP_MD_CTX_free EVP_MD_CTX_destroy
+#endif
+#else
+#include <gcrypt.h>
+#endif
 #include <unistd.h>
 #include <dirent.h>
 #include <libgen.h>
@@ -43,6 +52,7 @@
 #include <libimobiledevice/installation_proxy.h>
 #include <libimobiledevice/sbservices.h>
 #include "common/utils.h"
+#include "common/thread.h"
 
 #include <endianness.h>
 
@@ -742,31 +752,428 @@ static int errno_to_device_error(int errno_value)
 	}
 }
 
-static int mb2_handle_send_file(mobilebackup2_client_t mobilebackup2, const char *backup_dir, const char *path, plist_t *errplist)
+/* File data is moved through a ring of large chunks, so that disk I/O on a
+ * worker thread overlaps the transfer on the main thread. When backing up,
+ * the main thread receives into the ring and a writer thread (plus a hasher
+ * thread with --checksums) consumes it. When restoring, a reader thread
+ * fills the ring ahead of the main thread sending it. */
+#define MB2_CHUNK_SIZE (1024 * 1024)
+#define MB2_CHUNK_COUNT 8
+/* leaves room for the length and code in front of the data, and keeps the data page aligned */
+#define MB2_CHUNK_HEADER_SIZE 4096
+
+#define MB2_CONSUMER_TRANSFER 0
+#define MB2_CONSUMER_CHECKSUM 1
+#define MB2_MAX_CONSUMERS 2
+
+enum mb2_chunk_type {
+	MB2_CHUNK_BEGIN,	/* start of a file, carries path, name and size */
+	MB2_CHUNK_DATA,
+	MB2_CHUNK_END		/* end of a file, carries the errno if reading failed */
+};
+
+struct mb2_chunk {
+	enum mb2_chunk_type type;
+	char *path;
+	char *name;
+	uint64_t size;
+	int error;
+	char *buffer;
+	char *data;
+	uint32_t length;
+};
+
+struct mb2_ring {
+	struct mb2_chunk chunks[MB2_CHUNK_COUNT];
+	uint64_t produced;
+	uint64_t consumed[MB2_MAX_CONSUMERS];
+	int consumers;
+	int closed;
+	int aborted;
+	mutex_t mutex;
+	cond_t cond;
+};
+
+static struct mb2_ring transfer_ring;
+static unsigned int transfer_file_count = 0;
+static plist_t checksums = NULL;
+
+static char *mb2_aligned_alloc(size_t size)
 {
-	uint32_t nlen = 0;
-	uint32_t pathlen = strlen(path);
-	uint32_t bytes = 0;
-	char *localfile = string_build_path(backup_dir, path, NULL);
-	char buf[32768];
 #ifdef WIN32
-	struct _stati64 fst;
+	return (char*)_aligned_malloc(size, MB2_CHUNK_HEADER_SIZE);
 #else
-	struct stat fst;
+	void *ptr = NULL;
+	if (posix_memalign(&ptr, MB2_CHUNK_HEADER_SIZE, size) != 0) {
+		return NULL;
+	}
+	return (char*)ptr;
+#endif
+}
+
+static void mb2_aligned_free(char *ptr)
+{
+#ifdef WIN32
+	_aligned_free(ptr);
+#else
+	free(ptr);
 #endif
+}
+
+static int mb2_ring_init(struct mb2_ring *ring)
+{
+	int i;
+
+	memset(ring, 0, sizeof(struct mb2_ring));
+	mutex_init(&ring->mutex);
+	cond_init(&ring->cond);
+	for (i = 0; i < MB2_CHUNK_COUNT; i++) {
+		ring->chunks[i].buffer = mb2_aligned_alloc(MB2_CHUNK_HEADER_SIZE + MB2_CHUNK_SIZE);
+		if (!ring->chunks[i].buffer) {
+			return -1;
+		}
+		ring->chunks[i].data = ring->chunks[i].buffer + MB2_CHUNK_HEADER_SIZE;
+	}
+
+	return 0;
+}
+
+static void mb2_ring_free(struct mb2_ring *ring)
+{
+	int i;
+
+	for (i = 0; i < MB2_CHUNK_COUNT; i++) {
+		free(ring->chunks[i].path);
+		free(ring->chunks[i].name);
+		if (ring->chunks[i].buffer) {
+			mb2_aligned_free(ring->chunks[i].buffer);
+		}
+	}
+	mutex_destroy(&ring->mutex);
+	cond_destroy(&ring->cond);
+}
+
+/* Must only be called while no thread is using the ring. */
+static void mb2_ring_reset(struct mb2_ring *ring, int consumers)
+{
+	int i;
+
+	ring->produced = 0;
+	for (i = 0; i < MB2_MAX_CONSUMERS; i++) {
+		ring->consumed[i] = 0;
+	}
+	ring->consumers = consumers;
+	ring->closed = 0;
+	ring->aborted = 0;
+}
+
+static uint64_t mb2_ring_slowest_consumer(struct mb2_ring *ring)
+{
+	uint64_t consumed = ring->consumed[0];
+	int i;
+
+	for (i = 1; i < ring->consumers; i++) {
+		if (ring->consumed[i] < consumed) {
+			consumed = ring->consumed[i];
+		}
+	}
+
+	return consumed;
+}
+
+/* Returns the next free chunk, waiting while all of them are in use, or NULL if the transfer was aborted. */
+static struct mb2_chunk *mb2_ring_acquire(struct mb2_ring *ring)
+{
+	struct mb2_chunk *chunk = NULL;
+
+	mutex_lock(&ring->mutex);
+	while (!ring->aborted && (ring->produced - mb2_ring_slowest_consumer(ring) >= MB2_CHUNK_COUNT)) {
+		cond_wait(&ring->cond, &ring->mutex);
+	}
+	if (!ring->aborted) {
+		chunk = &ring->chunks[ring->produced % MB2_CHUNK_COUNT];
+	}
+	mutex_unlock(&ring->mutex);
+
+	if (chunk) {
+		free(chunk->path);
+		chunk->path = NULL;
+		free(chunk->name);
+		chunk->name = NULL;
+		chunk->size = 0;
+		chunk->error = 0;
+		chunk->length = 0;
+	}
 
+	return chunk;
+}
+
+/* Hands the chunk returned by the last mb2_ring_acquire() to the consumers. */
+static void mb2_ring_publish(struct mb2_ring *ring)
+{
+	mutex_lock(&ring->mutex);
+	ring->produced++;
+	cond_broadcast(&ring->cond);
+	mutex_unlock(&ring->mutex);
+}
+
+/* Returns the next chunk for the consumer, or NULL once the ring was closed and drained, or the transfer was aborted. */
+static struct mb2_chunk *mb2_ring_peek(struct mb2_ring *ring, int consumer)
+{
+	struct mb2_chunk *chunk = NULL;
+
+	mutex_lock(&ring->mutex);
+	while (!ring->aborted && !ring->closed && (ring->consumed[consumer] == ring->produced)) {
+		cond_wait(&ring->cond, &ring->mutex);
+	}
+	if (!ring->aborted && (ring->consumed[consumer] < ring->produced)) {
+		chunk = &ring->chunks[ring->consumed[consumer] % MB2_CHUNK_COUNT];
+	}
+	mutex_unlock(&ring->mutex);
+
+	return chunk;
+}
+
+/* Marks the chunk returned by the last mb2_ring_peek() as done for the consumer. */
+static void mb2_ring_release(struct mb2_ring *ring, int consumer)
+{
+	mutex_lock(&ring->mutex);
+	ring->consumed[consumer]++;
+	cond_broadcast(&ring->cond);
+	mutex_unlock(&ring->mutex);
+}
+
+/* No more chunks will be published, consumers finish the remaining ones. */
+static void mb2_ring_close(struct mb2_ring *ring)
+{
+	mutex_lock(&ring->mutex);
+	ring->closed = 1;
+	cond_broadcast(&ring->cond);
+	mutex_unlock(&ring->mutex);
+}
+
+/* Wakes up and stops both the producer and the consumers. */
+static void mb2_ring_abort(struct mb2_ring *ring)
+{
+	mutex_lock(&ring->mutex);
+	ring->aborted = 1;
+	cond_broadcast(&ring->cond);
+	mutex_unlock(&ring->mutex);
+}
+
+static void* mb2_writer_thread(void *data)
+{
+	struct mb2_ring *ring = (struct mb2_ring*)data;
+	struct mb2_chunk *chunk = NULL;
+	char *path = NULL;
 	FILE *f = NULL;
+
+	while ((chunk = mb2_ring_peek(ring, MB2_CONSUMER_TRANSFER)) != NULL) {
+		if (chunk->type == MB2_CHUNK_BEGIN) {
+			free(path);
+			path = strdup(chunk->path);
+			remove_file(chunk->path);
+			f = fopen(chunk->path, "wb");
+			if (f) {
+				/* chunks are large already, don't copy them through the stdio buffer */
+				setvbuf(f, NULL, _IONBF, 0);
+				transfer_file_count++;
+			} else {
+				printf("Error opening '%s' for writing: %s\n", chunk->path, strerror(errno));
+			}
+		} else if (chunk->type == MB2_CHUNK_DATA) {
+			/* data for a file that could not be opened is discarded */
+			if (f && (fwrite(chunk->data, 1, chunk->length, f) != chunk->length)) {
+				printf("Error writing to '%s': %s\n", path, strerror(errno));
+				fclose(f);
+				f = NULL;
+			}
+		} else if (f) {
+			fclose(f);
+			f = NULL;
+		}
+		mb2_ring_release(ring, MB2_CONSUMER_TRANSFER);
+	}
+	if (f) {
+		fclose(f);
+	}
+	free(path);
+
+	return NULL;
+}
+
+static void* mb2_hasher_thread(void *data)
+{
+	struct mb2_ring *ring = (struct mb2_ring*)data;
+	struct mb2_chunk *chunk = NULL;
+	char *name = NULL;
+	unsigned char digest[20];
+#ifdef HAVE_OPENSSL
+	EVP_MD_CTX *sha1 = EVP_MD_CTX_new();
+	if (!sha1) {
+#else
+	gcry_md_hd_t hd = NULL;
+	gcry_md_open(&hd, GCRY_MD_SHA1, 0);
+	if (!hd) {
+#endif
+		printf("ERROR: Could not initialize SHA1\n");
+		/* keep consuming, the writer must not stall */
+		while (mb2_ring_peek(ring, MB2_CONSUMER_CHECKSUM)) {
+			mb2_ring_release(ring, MB2_CONSUMER_CHECKSUM);
+		}
+		return NULL;
+	}
+
+	while ((chunk = mb2_ring_peek(ring, MB2_CONSUMER_CHECKSUM)) != NULL) {
+		if (chunk->type == MB2_CHUNK_BEGIN) {
+			free(name);
+			name = strdup(chunk->name);
+#ifdef HAVE_OPENSSL
+			EVP_DigestInit_ex(sha1, EVP_sha1(), NULL);
+#else
+			gcry_md_reset(hd);
+#endif
+		} else if (chunk->type == MB2_CHUNK_DATA) {
+#ifdef HAVE_OPENSSL
+			EVP_DigestUpdate(sha1, chunk->data, chunk->length);
+#else
+			gcry_md_write(hd, chunk->data, chunk->length);
+#endif
+		} else if (name) {
+#ifdef HAVE_OPENSSL
+			EVP_DigestFinal_ex(sha1, digest, NULL);
+#else
+			memcpy(digest, gcry_md_read(hd, GCRY_MD_SHA1), sizeof(digest));
+#endif
+			plist_dict_set_item(checksums, name, plist_new_data((const char*)digest, sizeof(digest)));
+			free(name);
+			name = NULL;
+		}
+		mb2_ring_release(ring, MB2_CONSUMER_CHECKSUM);
+	}
+	free(name);
+#ifdef HAVE_OPENSSL
+	EVP_MD_CTX_free(sha1);
+#else
+	gcry_md_close(hd);
+#endif
+
+	return NULL;
+}
+
+struct mb2_reader {
+	struct mb2_ring *ring;
+	plist_t files;
+	const char *backup_dir;
+};
+
+static void* mb2_reader_thread(void *data)
+{
+	struct mb2_reader *reader = (struct mb2_reader*)data;
+	struct mb2_ring *ring = reader->ring;
+	struct mb2_chunk *chunk = NULL;
+	uint32_t cnt = plist_array_get_size(reader->files);
+	uint32_t i;
+
+	for (i = 0; i < cnt; i++) {
+		plist_t val = plist_array_get_item(reader->files, i);
+		/* must skip the same entries as mb2_handle_send_files() */
+		if (plist_get_node_type(val) != PLIST_STRING) {
+			continue;
+		}
+		const char *path = plist_get_string_ptr(val, NULL);
+		char *localfile = string_build_path(reader->backup_dir, path, NULL);
+#ifdef WIN32
+		struct _stati64 fst;
+#else
+		struct stat fst;
+#endif
+		FILE *f = NULL;
+		uint64_t total = 0;
+		uint64_t done = 0;
+		int errcode = 0;
+
+		chunk = mb2_ring_acquire(ring);
+		if (!chunk) {
+			free(localfile);
+			break;
+		}
+		chunk->type = MB2_CHUNK_BEGIN;
+#ifdef WIN32
+		if (_stati64(localfile, &fst) < 0)
+#else
+		if (stat(localfile, &fst) < 0)
+#endif
+		{
+			if (errno != ENOENT)
+				printf("%s: stat failed on '%s': %d\n", __func__, localfile, errno);
+			chunk->error = errno;
+		} else {
+			total = fst.st_size;
+			chunk->size = total;
+			if (total > 0) {
+				f = fopen(localfile, "rb");
+				if (!f) {
+					printf("%s: Error opening local file '%s': %d\n", __func__, localfile, errno);
+					chunk->error = errno;
+				} else {
+					setvbuf(f, NULL, _IONBF, 0);
+				}
+			}
+		}
+		chunk->path = localfile;
+		mb2_ring_publish(ring);
+
+		while (f && (done < total)) {
+			chunk = mb2_ring_acquire(ring);
+			if (!chunk) {
+				break;
+			}
+			chunk->type = MB2_CHUNK_DATA;
+			size_t r = fread(chunk->data, 1, ((total - done) < MB2_CHUNK_SIZE) ? (size_t)(total - done) : MB2_CHUNK_SIZE, f);
+			if (r == 0) {
+				printf("%s: read error\n", __func__);
+				errcode = (errno) ? errno : EIO;
+				break;
+			}
+			chunk->length = (uint32_t)r;
+			mb2_ring_publish(ring);
+			done += r;
+		}
+		if (f) {
+			fclose(f);
+		}
+		if (!chunk) {
+			break;
+		}
+		/* reuses the chunk a failed read was attempted into */
+		if (errcode == 0) {
+			chunk = mb2_ring_acquire(ring);
+			if (!chunk) {
+				break;
+			}
+		}
+		chunk->type = MB2_CHUNK_END;
+		chunk->error = errcode;
+		chunk->length = 0;
+		mb2_ring_publish(ring);
+	}
+	mb2_ring_close(ring);
+
+	return NULL;
+}
+
+static int mb2_handle_send_file(mobilebackup2_client_t mobilebackup2, const char *path, plist_t *errplist)
+{
+	uint32_t nlen = 0;
+	uint32_t pathlen = strlen(path);
+	uint32_t bytes = 0;
+	char buf[1024];
+	struct mb2_chunk *chunk = NULL;
 	uint32_t slen = 0;
 	int errcode = -1;
 	int result = -1;
 	uint32_t length;
-#ifdef WIN32
-	uint64_t total;
-	uint64_t sent;
-#else
-	off_t total;
-	off_t sent;
-#endif
 
 	mobilebackup2_error_t err;
 
@@ -791,73 +1198,48 @@ static int mb2_handle_send_file(mobilebackup2_client_t mobilebackup2, const char
 		goto leave_proto_err;
 	}
 
-#ifdef WIN32
-	if (_stati64(localfile, &fst) < 0)
-#else
-	if (stat(localfile, &fst) < 0)
-#endif
-	{
-		if (errno != ENOENT)
-			printf("%s: stat failed on '%s': %d\n", __func__, localfile, errno);
-		errcode = errno;
-		goto leave;
-	}
-
-	total = fst.st_size;
-
-	char *format_size = string_format_size(total);
-	PRINT_VERBOSE(1, "Sending '%s' (%s)\n", path, format_size);
-	free(format_size);
-
-	if (total == 0) {
-		errcode = 0;
-		goto leave;
+	/* the reader thread has opened the file already */
+	chunk = mb2_ring_peek(&transfer_ring, MB2_CONSUMER_TRANSFER);
+	if (!chunk || (chunk->type != MB2_CHUNK_BEGIN)) {
+		goto leave_proto_err;
 	}
-
-	f = fopen(localfile, "rb");
-	if (!f) {
-		printf("%s: Error opening local file '%s': %d\n", __func__, localfile, errno);
-		errcode = errno;
-		goto leave;
+	errcode = chunk->error;
+	if (errcode == 0) {
+		char *format_size = string_format_size(chunk->size);
+		PRINT_VERBOSE(1, "Sending '%s' (%s)\n", path, format_size);
+		free(format_size);
 	}
+	mb2_ring_release(&transfer_ring, MB2_CONSUMER_TRANSFER);
 
-	sent = 0;
-	do {
-		length = ((total-sent) < (long long)sizeof(buf)) ? (uint32_t)total-sent : (uint32_t)sizeof(buf);
-		/* send data size (file size + 1) */
-		nlen = htobe32(length+1);
-		memcpy(buf, &nlen, sizeof(nlen));
-		buf[4] = CODE_FILE_DATA;
-		err = mobilebackup2_send_raw(mobilebackup2, (const char*)buf, 5, &bytes);
-		if (err != MOBILEBACKUP2_E_SUCCESS) {
-			goto leave_proto_err;
-		}
-		if (bytes != 5) {
-			goto leave_proto_err;
+	while ((chunk = mb2_ring_peek(&transfer_ring, MB2_CONSUMER_TRANSFER)) != NULL) {
+		if (chunk->type == MB2_CHUNK_END) {
+			if (chunk->error != 0) {
+				errcode = chunk->error;
+			}
+			mb2_ring_release(&transfer_ring, MB2_CONSUMER_TRANSFER);
+			break;
 		}
 
-		/* send file contents */
-		size_t r = fread(buf, 1, sizeof(buf), f);
-		if (r <= 0) {
-			printf("%s: read error\n", __func__);
-			errcode = errno;
-			goto leave;
-		}
-		err = mobilebackup2_send_raw(mobilebackup2, buf, r, &bytes);
+		/* send data size (file size + 1) and code right in front of the data, all in one go */
+		char *hunk = chunk->data - 5;
+		length = chunk->length + 5;
+		nlen = htobe32(chunk->length+1);
+		memcpy(hunk, &nlen, sizeof(nlen));
+		hunk[4] = CODE_FILE_DATA;
+		err = mobilebackup2_send_raw(mobilebackup2, hunk, length, &bytes);
+		mb2_ring_release(&transfer_ring, MB2_CONSUMER_TRANSFER);
 		if (err != MOBILEBACKUP2_E_SUCCESS) {
 			goto leave_proto_err;
 		}
-		if (bytes != (uint32_t)r) {
-			printf("Error: sent only %d of %d bytes\n", bytes, (int)r);
+		if (bytes != length) {
+			printf("Error: sent only %d of %d bytes\n", bytes, length);
 			goto leave_proto_err;
 		}
-		sent += r;
-	} while (sent < total);
-	fclose(f);
-	f = NULL;
-	errcode = 0;
+	}
+	if (!chunk) {
+		goto leave_proto_err;
+	}
 
-leave:
 	if (errcode == 0) {
 		result = 0;
 		nlen = 1;
@@ -873,6 +1255,9 @@ leave:
 		mb2_multi_status_add_file_error(*errplist, path, errno_to_device_error(errcode), errdesc);
 
 		length = strlen(errdesc);
+		if (length > sizeof(buf) - 5) {
+			length = sizeof(buf) - 5;
+		}
 		nlen = htobe32(length+1);
 		memcpy(buf, &nlen, 4);
 		buf[4] = CODE_ERROR_LOCAL;
@@ -889,9 +1274,6 @@ leave:
 	}
 
 leave_proto_err:
-	if (f)
-		fclose(f);
-	free(localfile);
 	return result;
 }
 
@@ -901,13 +1283,25 @@ static void mb2_handle_send_files(mobilebackup2_client_t mobilebackup2, plist_t
 	uint32_t i = 0;
 	uint32_t sent;
 	plist_t errplist = NULL;
+	struct mb2_reader reader;
+	thread_t reader_thread;
+	int reading = 0;
 
 	if (!message || (plist_get_node_type(message) != PLIST_ARRAY) || (plist_array_get_size(message) < 2) || !backup_dir) return;
 
 	plist_t files = plist_array_get_item(message, 1);
 	cnt = plist_array_get_size(files);
 
-	for (i = 0; i < cnt; i++) {
+	reader.ring = &transfer_ring;
+	reader.files = files;
+	reader.backup_dir = backup_dir;
+	mb2_ring_reset(&transfer_ring, 1);
+	reading = (thread_new(&reader_thread, mb2_reader_thread, &reader) == 0);
+	if (!reading) {
+		printf("ERROR: Could not start reader thread\n");
+	}
+
+	for (i = 0; reading && i < cnt; i++) {
 		plist_t val = plist_array_get_item(files, i);
 		if (plist_get_node_type(val) != PLIST_STRING) {
 			continue;
@@ -917,7 +1311,7 @@ static void mb2_handle_send_files(mobilebackup2_client_t mobilebackup2, plist_t
 		if (!str)
 			continue;
 
-		if (mb2_handle_send_file(mobilebackup2, backup_dir, str, &errplist) < 0) {
+		if (mb2_handle_send_file(mobilebackup2, str, &errplist) < 0) {
 			free(str);
 			//printf("Error when sending file '%s' to device\n", str);
 			// TODO: perhaps we can continue, we've got a multi status response?!
@@ -926,6 +1320,13 @@ static void mb2_handle_send_files(mobilebackup2_client_t mobilebackup2, plist_t
 		free(str);
 	}
 
+	if (reading) {
+		/* stops the reader if we gave up early, otherwise it is done already */
+		mb2_ring_abort(&transfer_ring);
+		thread_join(reader_thread);
+		thread_free(reader_thread);
+	}
+
 	/* send terminating 0 dword */
 	uint32_t zero = 0;
 	mobilebackup2_send_raw(mobilebackup2, (char*)&zero, 4, &sent);
@@ -995,15 +1396,16 @@ static int mb2_handle_receive_files(mobilebackup2_client_t mobilebackup2, plist_
 	uint32_t rlen;
 	uint32_t nlen = 0;
 	uint32_t r;
-	char buf[32768];
 	char *fname = NULL;
 	char *dname = NULL;
 	char *bname = NULL;
 	char code = 0;
 	char last_code = 0;
 	plist_t node = NULL;
-	FILE *f = NULL;
-	unsigned int file_count = 0;
+	struct mb2_chunk *chunk = NULL;
+	thread_t writer_thread;
+	thread_t hasher_thread;
+	int consumers = 0;
 
 	if (!message || (plist_get_node_type(message) != PLIST_ARRAY) || plist_array_get_size(message) < 4 || !backup_dir) return 0;
 
@@ -1015,6 +1417,23 @@ static int mb2_handle_receive_files(mobilebackup2_client_t mobilebackup2, plist_
 		PRINT_VERBOSE(1, "Receiving files\n");
 	}
 
+	transfer_file_count = 0;
+	mb2_ring_reset(&transfer_ring, (checksums) ? 2 : 1);
+	if (thread_new(&writer_thread, mb2_writer_thread, &transfer_ring) == 0) {
+		consumers++;
+		if (checksums) {
+			if (thread_new(&hasher_thread, mb2_hasher_thread, &transfer_ring) == 0) {
+				consumers++;
+			} else {
+				printf("ERROR: Could not start checksum thread\n");
+				transfer_ring.consumers = 1;
+			}
+		}
+	} else {
+		printf("ERROR: Could not start writer thread\n");
+		mb2_ring_abort(&transfer_ring);
+	}
+
 	do {
 		if (quit_flag)
 			break;
@@ -1036,11 +1455,6 @@ static int mb2_handle_receive_files(mobilebackup2_client_t mobilebackup2, plist_
 
 		bname = string_build_path(backup_dir, fname, NULL);
 
-		if (fname != NULL) {
-			free(fname);
-			fname = NULL;
-		}
-
 		r = 0;
 		nlen = 0;
 		mobilebackup2_receive_raw(mobilebackup2, (char*)&nlen, 4, &r);
@@ -1064,24 +1478,44 @@ static int mb2_handle_receive_files(mobilebackup2_client_t mobilebackup2, plist_
 			PRINT_VERBOSE(1, "Found new flag %02x\n", code);
 		}
 
-		remove_file(bname);
-		f = fopen(bname, "wb");
-		while (f && (code == CODE_FILE_DATA)) {
+		chunk = mb2_ring_acquire(&transfer_ring);
+		if (!chunk) {
+			break;
+		}
+		chunk->type = MB2_CHUNK_BEGIN;
+		chunk->path = strdup(bname);
+		chunk->name = fname;
+		fname = NULL;
+		mb2_ring_publish(&transfer_ring);
+		chunk = NULL;
+
+		while (code == CODE_FILE_DATA) {
 			blocksize = nlen-1;
 			bdone = 0;
 			rlen = 0;
 			while (bdone < blocksize) {
-				if ((blocksize - bdone) < sizeof(buf)) {
+				if (!chunk) {
+					chunk = mb2_ring_acquire(&transfer_ring);
+					if (!chunk) {
+						break;
+					}
+					chunk->type = MB2_CHUNK_DATA;
+				}
+				/* fill chunks across the device's small data blocks */
+				rlen = MB2_CHUNK_SIZE - chunk->length;
+				if ((blocksize - bdone) < rlen) {
 					rlen = blocksize - bdone;
-				} else {
-					rlen = sizeof(buf);
 				}
-				mobilebackup2_receive_raw(mobilebackup2, buf, rlen, &r);
+				mobilebackup2_receive_raw(mobilebackup2, chunk->data + chunk->length, rlen, &r);
 				if ((int)r <= 0) {
 					break;
 				}
-				fwrite(buf, 1, r, f);
+				chunk->length += r;
 				bdone += r;
+				if (chunk->length == MB2_CHUNK_SIZE) {
+					mb2_ring_publish(&transfer_ring);
+					chunk = NULL;
+				}
 			}
 			if (bdone == blocksize) {
 				backup_real_size += blocksize;
@@ -1101,11 +1535,14 @@ static int mb2_handle_receive_files(mobilebackup2_client_t mobilebackup2, plist_
 				break;
 			}
 		}
-		if (f) {
-			fclose(f);
-			file_count++;
-		} else {
-			printf("Error opening '%s' for writing: %s\n", bname, strerror(errno));
+		if (chunk) {
+			mb2_ring_publish(&transfer_ring);
+		}
+		chunk = mb2_ring_acquire(&transfer_ring);
+		if (chunk) {
+			chunk->type = MB2_CHUNK_END;
+			mb2_ring_publish(&transfer_ring);
+			chunk = NULL;
 		}
 		if (nlen == 0) {
 			break;
@@ -1125,6 +1562,17 @@ static int mb2_handle_receive_files(mobilebackup2_client_t mobilebackup2, plist_
 		}
 	} while (1);
 
+	/* let the writer store everything before answering the device */
+	mb2_ring_close(&transfer_ring);
+	if (consumers > 0) {
+		thread_join(writer_thread);
+		thread_free(writer_thread);
+	}
+	if (consumers > 1) {
+		thread_join(hasher_thread);
+		thread_free(hasher_thread);
+	}
+
 	if (fname != NULL)
 		free(fname);
 
@@ -1149,7 +1597,7 @@ static int mb2_handle_receive_files(mobilebackup2_client_t mobilebackup2, plist_
 	mobilebackup2_send_status_response(mobilebackup2, 0, NULL, empty_plist);
 	plist_free(empty_plist);
 
-	return file_count;
+	return transfer_file_count;
 }
 
 static void mb2_handle_list_directory(mobilebackup2_client_t mobilebackup2, plist_t message, const char *backup_dir)
@@ -1402,6 +1850,7 @@ static void print_usage(int argc, char **argv)
 	printf("commands:\n");
 	printf("  backup\tcreate backup for the device\n");
 	printf("    --full\t\tforce full backup from device.\n");
+	printf("    --checksums FILE\twrite SHA-1 of every received file to FILE as plist\n");
 	printf("  restore\trestore last backup to the device\n");
 	printf("    --system\t\trestore system files, too.\n");
 	printf("    --no-reboot\t\tdo NOT reboot the system when done (default: yes).\n");
@@ -1445,6 +1894,7 @@ int main(int argc, char *argv[])
 	int interactive_mode = 0;
 	char* backup_password = NULL;
 	char* newpw = NULL;
+	char* checksums_path = NULL;
 	struct stat st;
 	plist_t node_tmp = NULL;
 	plist_t info_plist = NULL;
@@ -1549,6 +1999,15 @@ int main(int argc, char *argv[])
 		else if (!strcmp(argv[i], "--full")) {
 			cmd_flags |= CMD_FLAG_FORCE_FULL_BACKUP;
 		}
+		else if (!strcmp(argv[i], "--checksums")) {
+			i++;
+			if (!argv[i] || !*argv[i]) {
+				print_usage(argc, argv);
+				return -1;
+			}
+			checksums_path = argv[i];
+			continue;
+		}
 		else if (!strcmp(argv[i], "info")) {
 			cmd = CMD_INFO;
 			verbose = 0;
@@ -1651,6 +2110,16 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	if (mb2_ring_init(&transfer_ring) < 0) {
+		printf("ERROR: Could not allocate transfer buffers\n");
+		mb2_ring_free(&transfer_ring);
+		return -1;
+	}
+
+	if (checksums_path && (cmd == CMD_BACKUP)) {
+		checksums = plist_new_dict();
+	}
+
 	idevice_t device = NULL;
 	if (udid) {
 		ret = idevice_new(&device, udid);
@@ -2403,6 +2872,13 @@ files_out:
 				break;
 				case CMD_BACKUP:
 					PRINT_VERBOSE(1, "Received %d files from device.\n", file_count);
+					if (checksums) {
+						if (plist_write_to_filename(checksums, checksums_path, PLIST_FORMAT_XML)) {
+							PRINT_VERBOSE(1, "Checksums written to %s\n", checksums_path);
+						} else {
+							printf("ERROR: Could not write checksums to %s\n", checksums_path);
+						}
+					}
 					if (operation_ok && mb2_status_check_snapshot_state(backup_directory, udid, "finished")) {
 						PRINT_VERBOSE(1, "Backup Successful.\n");
 					} else {
@@ -2514,6 +2990,13 @@ files_out:
 		source_udid = NULL;
 	}
 
+	if (checksums) {
+		plist_free(checksums);
+		checksums = NULL;
+	}
+
+	mb2_ring_free(&transfer_ring);
+
 	return result_code;
 }
 
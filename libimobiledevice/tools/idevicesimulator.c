@@ -0,0 +1,2243 @@
+/*
+ * idevicesimulator.c
+ * Simulate usbmuxd and attached devices for testing without hardware
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include <plist/plist.h>
+#ifdef HAVE_OPENSSL
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <openssl/evp.h>
+#include <openssl/rsa.h>
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+#define SIM_SSL 1
+#endif
+#endif
+
+#include "common/socket.h"
+#include "common/thread.h"
+#include "common/utils.h"
+#include "endianness.h"
+
+/* usbmuxd protocol */
+#define MUX_MESSAGE_RESULT 1
+#define MUX_MESSAGE_PLIST 8
+
+#define MUX_RESULT_OK 0
+#define MUX_RESULT_BADCOMMAND 1
+#define MUX_RESULT_BADDEV 2
+#define MUX_RESULT_CONNREFUSED 3
+#define MUX_RESULT_BADVERSION 6
+
+struct mux_header {
+	uint32_t length;
+	uint32_t version;
+	uint32_t message;
+	uint32_t tag;
+};
+
+#define LOCKDOWN_PORT 62078
+#define FIRST_SERVICE_PORT 49152
+#define MAX_SERVICE_PORTS 64
+
+/* AFC protocol */
+#define AFC_MAGIC "CFA6LPAA"
+#define AFC_MAGIC_LEN 8
+#define AFC_MAX_FILES 32
+
+struct afc_header {
+	char magic[AFC_MAGIC_LEN];
+	uint64_t entire_length, this_length, packet_num, operation;
+};
+
+enum {
+	AFC_OP_STATUS = 0x01,
+	AFC_OP_DATA = 0x02,
+	AFC_OP_READ_DIR = 0x03,
+	AFC_OP_TRUNCATE = 0x07,
+	AFC_OP_REMOVE_PATH = 0x08,
+	AFC_OP_MAKE_DIR = 0x09,
+	AFC_OP_GET_FILE_INFO = 0x0A,
+	AFC_OP_GET_DEVINFO = 0x0B,
+	AFC_OP_FILE_OPEN = 0x0D,
+	AFC_OP_FILE_OPEN_RES = 0x0E,
+	AFC_OP_FILE_READ = 0x0F,
+	AFC_OP_FILE_WRITE = 0x10,
+	AFC_OP_FILE_SEEK = 0x11,
+	AFC_OP_FILE_TELL = 0x12,
+	AFC_OP_FILE_TELL_RES = 0x13,
+	AFC_OP_FILE_CLOSE = 0x14,
+	AFC_OP_FILE_SET_SIZE = 0x15,
+	AFC_OP_RENAME_PATH = 0x18,
+	AFC_OP_FILE_LOCK = 0x1B,
+	AFC_OP_REMOVE_PATH_AND_CONTENTS = 0x22
+};
+
+enum {
+	AFC_E_SUCCESS = 0,
+	AFC_E_UNKNOWN_ERROR = 1,
+	AFC_E_INVALID_ARG = 7,
+	AFC_E_OBJECT_NOT_FOUND = 8,
+	AFC_E_OBJECT_IS_DIR = 9,
+	AFC_E_PERM_DENIED = 10,
+	AFC_E_OP_NOT_SUPPORTED = 15,
+	AFC_E_OBJECT_EXISTS = 16,
+	AFC_E_NO_SPACE_LEFT = 18,
+	AFC_E_OP_WOULD_BLOCK = 19,
+	AFC_E_IO_ERROR = 20,
+	AFC_E_DIR_NOT_EMPTY = 33
+};
+
+enum service_type {
+	SERVICE_NONE = 0,
+	SERVICE_AFC,
+	SERVICE_INSTPROXY,
+	SERVICE_MISAGENT,
+	SERVICE_NP,
+	SERVICE_MOBILEBACKUP2,
+	SERVICE_SYSLOG_RELAY
+};
+
+static const struct {
+	const char *name;
+	enum service_type type;
+} services[] = {
+	{ "com.apple.afc", SERVICE_AFC },
+	{ "com.apple.mobile.installation_proxy", SERVICE_INSTPROXY },
+	{ "com.apple.misagent", SERVICE_MISAGENT },
+	{ "com.apple.mobile.notification_proxy", SERVICE_NP },
+	{ "com.apple.mobilebackup2", SERVICE_MOBILEBACKUP2 },
+	{ "com.apple.syslog_relay", SERVICE_SYSLOG_RELAY },
+	{ NULL, SERVICE_NONE }
+};
+
+struct sim_device {
+	uint32_t id;
+	char udid[41];
+	char *root;
+	mutex_t mutex;
+	enum service_type ports[MAX_SERVICE_PORTS];
+	int next_port;
+	plist_t apps;		/* CFBundleIdentifier -> app info */
+	plist_t profiles;	/* UUID -> profile data */
+};
+
+struct sim_conn {
+	int fd;
+	struct sim_device *device;
+	struct timeval start;
+	uint64_t bytes_in;
+	uint64_t bytes_out;
+#ifdef SIM_SSL
+	SSL *ssl;
+#endif
+};
+
+static struct sim_device *devices = NULL;
+static int num_devices = 1;
+static char *system_buid = NULL;
+static const char *product_version = "13.5";
+static unsigned int latency_ms = 0;
+static uint64_t bandwidth = 0;	/* bytes per second, 0 is unlimited */
+static int install_steps = 10;
+static int backup_files = 64;
+static uint64_t backup_file_size = 4 * 1024 * 1024;
+static int syslog_lines = 10000;
+static int service_ssl = 0;
+#ifdef SIM_SSL
+static SSL_CTX *ssl_ctx = NULL;
+#endif
+static int verbose = 0;
+static int quit_flag = 0;
+
+#define SIM_LOG(...) if (verbose) { fprintf(stderr, __VA_ARGS__); fflush(stderr); }
+
+static double elapsed_since(struct timeval *start)
+{
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+static void sleep_ms(unsigned int ms)
+{
+	if (ms > 0) {
+		usleep(ms * 1000);
+	}
+}
+
+static int mkdir_with_parents(const char *dir, int mode)
+{
+	if (!dir) return -1;
+	if (mkdir(dir, mode) == 0) {
+		return 0;
+	} else {
+		if (errno == EEXIST) return 0;
+	}
+	int res;
+	char *parent = strdup(dir);
+	char *parentdir = dirname(parent);
+	if (parentdir) {
+		res = mkdir_with_parents(parentdir, mode);
+	} else {
+		res = -1;
+	}
+	free(parent);
+	if (res == 0) {
+		res = mkdir(dir, mode);
+	}
+	return res;
+}
+
+/**
+ * Delays the connection until the bytes transferred so far fit into the
+ * configured bandwidth.
+ */
+static void sim_throttle(struct sim_conn *conn)
+{
+	double due;
+	double elapsed;
+
+	if (bandwidth == 0) {
+		return;
+	}
+	due = (double)(conn->bytes_in + conn->bytes_out) / (double)bandwidth;
+	elapsed = elapsed_since(&conn->start);
+	if (due > elapsed) {
+		usleep((useconds_t)((due - elapsed) * 1000000));
+	}
+}
+
+static int sim_write(struct sim_conn *conn, const char *data, uint32_t length)
+{
+#ifdef SIM_SSL
+	if (conn->ssl) {
+		return SSL_write(conn->ssl, data, (int)length);
+	}
+#endif
+	return socket_send(conn->fd, (void*)data, length);
+}
+
+static int sim_read(struct sim_conn *conn, char *data, uint32_t length)
+{
+#ifdef SIM_SSL
+	if (conn->ssl) {
+		return SSL_read(conn->ssl, data, (int)length);
+	}
+#endif
+	return socket_receive_timeout(conn->fd, data, length, 0, 0);
+}
+
+static int sim_send(struct sim_conn *conn, const void *data, uint32_t length)
+{
+	uint32_t sent = 0;
+	while (sent < length) {
+		int res = sim_write(conn, (const char*)data + sent, length - sent);
+		if (res <= 0) {
+			return -1;
+		}
+		sent += res;
+	}
+	conn->bytes_out += length;
+	sim_throttle(conn);
+	return 0;
+}
+
+static int sim_recv(struct sim_conn *conn, void *data, uint32_t length)
+{
+	uint32_t received = 0;
+	while (received < length) {
+		int res = sim_read(conn, (char*)data + received, length - received);
+		if (res <= 0) {
+			return -1;
+		}
+		received += res;
+	}
+	conn->bytes_in += length;
+	sim_throttle(conn);
+	return 0;
+}
+
+static void sim_conn_report(struct sim_conn *conn, const char *what)
+{
+	double elapsed = elapsed_since(&conn->start);
+	SIM_LOG("[%s] %s: %llu bytes in, %llu bytes out in %.3f s (%.2f MB/s)\n",
+		conn->device ? conn->device->udid : "usbmuxd", what,
+		(unsigned long long)conn->bytes_in, (unsigned long long)conn->bytes_out, elapsed,
+		(elapsed > 0) ? (conn->bytes_in + conn->bytes_out) / elapsed / 1000000.0 : 0.0);
+}
+
+/* property list services: 32 bit big endian length followed by the plist */
+
+static int plist_service_send(struct sim_conn *conn, plist_t plist)
+{
+	char *xml = NULL;
+	uint32_t length = 0;
+	uint32_t nlen;
+	int res;
+
+	sleep_ms(latency_ms);
+
+	plist_to_xml(plist, &xml, &length);
+	if (!xml) {
+		return -1;
+	}
+	nlen = htobe32(length);
+	res = sim_send(conn, &nlen, sizeof(nlen));
+	if (res == 0) {
+		res = sim_send(conn, xml, length);
+	}
+	free(xml);
+	return res;
+}
+
+static int plist_service_receive(struct sim_conn *conn, plist_t *plist)
+{
+	uint32_t length = 0;
+	char *buffer;
+
+	*plist = NULL;
+	if (sim_recv(conn, &length, sizeof(length)) < 0) {
+		return -1;
+	}
+	length = be32toh(length);
+	buffer = (char*)malloc(length);
+	if (!buffer || sim_recv(conn, buffer, length) < 0) {
+		free(buffer);
+		return -1;
+	}
+	plist_from_memory(buffer, length, plist);
+	free(buffer);
+	return (*plist) ? 0 : -1;
+}
+
+static char *dict_get_string(plist_t dict, const char *key)
+{
+	char *value = NULL;
+	plist_t node = plist_dict_get_item(dict, key);
+	if (node && plist_get_node_type(node) == PLIST_STRING) {
+		plist_get_string_val(node, &value);
+	}
+	return value;
+}
+
+static int dict_string_equals(plist_t dict, const char *key, const char *value)
+{
+	plist_t node = plist_dict_get_item(dict, key);
+	const char *str = plist_get_string_ptr(node, NULL);
+	return (str && strcmp(str, value) == 0);
+}
+
+/* lockdownd */
+
+static plist_t lockdown_get_value(struct sim_device *device, const char *key)
+{
+	if (!key) {
+		plist_t values = plist_new_dict();
+		plist_dict_set_item(values, "UniqueDeviceID", plist_new_string(device->udid));
+		plist_dict_set_item(values, "ProductVersion", plist_new_string(product_version));
+		plist_dict_set_item(values, "ProductType", plist_new_string("iPhone12,1"));
+		plist_dict_set_item(values, "DeviceClass", plist_new_string("iPhone"));
+		plist_dict_set_item(values, "DeviceName", plist_new_string("Simulated iPhone"));
+		plist_dict_set_item(values, "BuildVersion", plist_new_string("17F75"));
+		plist_dict_set_item(values, "CPUArchitecture", plist_new_string("arm64e"));
+		plist_dict_set_item(values, "SerialNumber", plist_new_string(device->udid + 9));
+		return values;
+	} else if (!strcmp(key, "UniqueDeviceID")) {
+		return plist_new_string(device->udid);
+	} else if (!strcmp(key, "ProductVersion")) {
+		return plist_new_string(product_version);
+	} else if (!strcmp(key, "ProductType")) {
+		return plist_new_string("iPhone12,1");
+	} else if (!strcmp(key, "DeviceClass")) {
+		return plist_new_string("iPhone");
+	} else if (!strcmp(key, "DeviceName")) {
+		return plist_new_string("Simulated iPhone");
+	} else if (!strcmp(key, "BuildVersion")) {
+		return plist_new_string("17F75");
+	} else if (!strcmp(key, "CPUArchitecture")) {
+		return plist_new_string("arm64e");
+	} else if (!strcmp(key, "SerialNumber")) {
+		return plist_new_string(device->udid + 9);
+	}
+	return NULL;
+}
+
+static int lockdown_start_service(struct sim_device *device, const char *name)
+{
+	int i;
+	int port = -1;
+
+	for (i = 0; services[i].name; i++) {
+		if (!strcmp(services[i].name, name)) {
+			break;
+		}
+	}
+	if (!services[i].name) {
+		return -1;
+	}
+
+	mutex_lock(&device->mutex);
+	port = FIRST_SERVICE_PORT + device->next_port;
+	device->ports[device->next_port] = services[i].type;
+	device->next_port = (device->next_port + 1) % MAX_SERVICE_PORTS;
+	mutex_unlock(&device->mutex);
+
+	return port;
+}
+
+static void lockdown_session(struct sim_conn *conn)
+{
+	plist_t request = NULL;
+
+	while (!quit_flag && plist_service_receive(conn, &request) == 0) {
+		char *name = dict_get_string(request, "Request");
+		plist_t reply = plist_new_dict();
+		int done = 0;
+
+		if (!name) {
+			plist_dict_set_item(reply, "Error", plist_new_string("MissingRequest"));
+			plist_service_send(conn, reply);
+			plist_free(reply);
+			plist_free(request);
+			break;
+		}
+		plist_dict_set_item(reply, "Request", plist_new_string(name));
+
+		if (!strcmp(name, "QueryType")) {
+			plist_dict_set_item(reply, "Type", plist_new_string("com.apple.mobile.lockdown"));
+		} else if (!strcmp(name, "GetValue")) {
+			char *key = dict_get_string(request, "Key");
+			plist_t value = lockdown_get_value(conn->device, key);
+			if (value) {
+				if (key) {
+					plist_dict_set_item(reply, "Key", plist_new_string(key));
+				}
+				plist_dict_set_item(reply, "Value", value);
+			} else {
+				plist_dict_set_item(reply, "Error", plist_new_string("MissingValue"));
+			}
+			free(key);
+		} else if (!strcmp(name, "StartSession")) {
+			char *session_id = generate_uuid();
+			plist_dict_set_item(reply, "SessionID", plist_new_string(session_id));
+			plist_dict_set_item(reply, "EnableSessionSSL", plist_new_bool(0));
+			free(session_id);
+		} else if (!strcmp(name, "StartService")) {
+			char *service = dict_get_string(request, "Service");
+			int port = (service) ? lockdown_start_service(conn->device, service) : -1;
+			if (port > 0) {
+				plist_dict_set_item(reply, "Service", plist_new_string(service));
+				plist_dict_set_item(reply, "Port", plist_new_uint(port));
+				plist_dict_set_item(reply, "EnableServiceSSL", plist_new_bool(service_ssl));
+			} else {
+				plist_dict_set_item(reply, "Error", plist_new_string("InvalidService"));
+			}
+			free(service);
+		} else if (!strcmp(name, "Goodbye")) {
+			done = 1;
+		} else if (strcmp(name, "StopSession") && strcmp(name, "SetValue") && strcmp(name, "RemoveValue")
+				&& strcmp(name, "Pair") && strcmp(name, "ValidatePair") && strcmp(name, "Unpair")) {
+			plist_dict_set_item(reply, "Error", plist_new_string("InvalidRequest"));
+		}
+
+		plist_service_send(conn, reply);
+		plist_free(reply);
+		plist_free(request);
+		free(name);
+		if (done) {
+			break;
+		}
+	}
+}
+
+/* AFC, backed by a host directory */
+
+struct afc_session {
+	struct sim_conn *conn;
+	int files[AFC_MAX_FILES];
+	uint64_t packet_num;
+};
+
+static int afc_error_from_errno(int err)
+{
+	switch (err) {
+	case ENOENT:
+	case ENOTDIR:
+		return AFC_E_OBJECT_NOT_FOUND;
+	case EISDIR:
+		return AFC_E_OBJECT_IS_DIR;
+	case EACCES:
+	case EPERM:
+		return AFC_E_PERM_DENIED;
+	case EEXIST:
+		return AFC_E_OBJECT_EXISTS;
+	case ENOTEMPTY:
+		return AFC_E_DIR_NOT_EMPTY;
+	case ENOSPC:
+		return AFC_E_NO_SPACE_LEFT;
+	case EWOULDBLOCK:
+		return AFC_E_OP_WOULD_BLOCK;
+	case EINVAL:
+		return AFC_E_INVALID_ARG;
+	default:
+		return AFC_E_IO_ERROR;
+	}
+}
+
+/**
+ * Maps a device path to the backing directory of the device. Paths that
+ * would leave the backing directory are rejected.
+ */
+static char *afc_host_path(struct sim_device *device, const char *path, uint32_t length)
+{
+	char *copy;
+	char *result;
+
+	if (length == 0 || memchr(path, '\0', length) == NULL) {
+		return NULL;
+	}
+	copy = strdup(path);
+	if (!strcmp(copy, "..") || !strncmp(copy, "../", 3) || strstr(copy, "/../") || (strlen(copy) >= 3 && !strcmp(copy + strlen(copy) - 3, "/.."))) {
+		free(copy);
+		return NULL;
+	}
+	result = string_build_path(device->root, (copy[0] == '/') ? copy + 1 : copy, NULL);
+	free(copy);
+	return result;
+}
+
+static int afc_send_packet(struct afc_session *session, uint64_t operation, const char *params, uint32_t params_length, const char *data, uint32_t data_length)
+{
+	struct afc_header header;
+
+	memcpy(header.magic, AFC_MAGIC, AFC_MAGIC_LEN);
+	header.entire_length = htole64(sizeof(header) + params_length + data_length);
+	header.this_length = htole64(sizeof(header) + params_length);
+	header.packet_num = htole64(session->packet_num);
+	header.operation = htole64(operation);
+
+	sleep_ms(latency_ms);
+
+	if (sim_send(session->conn, &header, sizeof(header)) < 0) {
+		return -1;
+	}
+	if (params_length > 0 && sim_send(session->conn, params, params_length) < 0) {
+		return -1;
+	}
+	if (data_length > 0 && sim_send(session->conn, data, data_length) < 0) {
+		return -1;
+	}
+	return 0;
+}
+
+static int afc_send_status(struct afc_session *session, uint64_t status)
+{
+	uint64_t value = htole64(status);
+	return afc_send_packet(session, AFC_OP_STATUS, (const char*)&value, sizeof(value), NULL, 0);
+}
+
+static int afc_send_u64(struct afc_session *session, uint64_t operation, uint64_t number)
+{
+	uint64_t value = htole64(number);
+	return afc_send_packet(session, operation, (const char*)&value, sizeof(value), NULL, 0);
+}
+
+/* appends a "key\0value\0" pair to a dictionary style AFC reply */
+static void afc_append_pair(char **buffer, uint32_t *length, const char *key, const char *value)
+{
+	size_t klen = strlen(key) + 1;
+	size_t vlen = strlen(value) + 1;
+	*buffer = (char*)realloc(*buffer, *length + klen + vlen);
+	memcpy(*buffer + *length, key, klen);
+	memcpy(*buffer + *length + klen, value, vlen);
+	*length += klen + vlen;
+}
+
+static int afc_remove_recursive(const char *path)
+{
+	struct stat st;
+
+	if (lstat(path, &st) < 0) {
+		return -1;
+	}
+	if (S_ISDIR(st.st_mode)) {
+		DIR *dir = opendir(path);
+		struct dirent *ep;
+		if (!dir) {
+			return -1;
+		}
+		while ((ep = readdir(dir))) {
+			if (!strcmp(ep->d_name, ".") || !strcmp(ep->d_name, "..")) {
+				continue;
+			}
+			char *child = string_build_path(path, ep->d_name, NULL);
+			afc_remove_recursive(child);
+			free(child);
+		}
+		closedir(dir);
+		return rmdir(path);
+	}
+	return unlink(path);
+}
+
+static int afc_file_slot(struct afc_session *session, uint64_t handle)
+{
+	if (handle == 0 || handle > AFC_MAX_FILES || session->files[handle - 1] < 0) {
+		return -1;
+	}
+	return (int)handle - 1;
+}
+
+static int afc_handle_request(struct afc_session *session, uint64_t operation, char *params, uint32_t params_length, char *data, uint32_t data_length)
+{
+	struct sim_device *device = session->conn->device;
+	char *path = NULL;
+	int res = 0;
+
+	switch (operation) {
+	case AFC_OP_GET_DEVINFO: {
+		char *reply = NULL;
+		uint32_t length = 0;
+		afc_append_pair(&reply, &length, "Model", "iPhone12,1");
+		afc_append_pair(&reply, &length, "FSTotalBytes", "64000000000");
+		afc_append_pair(&reply, &length, "FSFreeBytes", "32000000000");
+		afc_append_pair(&reply, &length, "FSBlockSize", "4096");
+		res = afc_send_packet(session, AFC_OP_DATA, NULL, 0, reply, length);
+		free(reply);
+		return res;
+	}
+	case AFC_OP_READ_DIR: {
+		DIR *dir;
+		struct dirent *ep;
+		char *reply = NULL;
+		uint32_t length = 0;
+
+		path = afc_host_path(device, params, params_length);
+		if (!path) {
+			return afc_send_status(session, AFC_E_INVALID_ARG);
+		}
+		dir = opendir(path);
+		free(path);
+		if (!dir) {
+			return afc_send_status(session, afc_error_from_errno(errno));
+		}
+		while ((ep = readdir(dir))) {
+			size_t nlen = strlen(ep->d_name) + 1;
+			reply = (char*)realloc(reply, length + nlen);
+			memcpy(reply + length, ep->d_name, nlen);
+			length += nlen;
+		}
+		closedir(dir);
+		res = afc_send_packet(session, AFC_OP_DATA, NULL, 0, reply, length);
+		free(reply);
+		return res;
+	}
+	case AFC_OP_GET_FILE_INFO: {
+		struct stat st;
+		char *reply = NULL;
+		uint32_t length = 0;
+		char value[32];
+
+		path = afc_host_path(device, params, params_length);
+		if (!path) {
+			return afc_send_status(session, AFC_E_INVALID_ARG);
+		}
+		if (stat(path, &st) < 0) {
+			free(path);
+			return afc_send_status(session, afc_error_from_errno(errno));
+		}
+		free(path);
+		snprintf(value, sizeof(value), "%llu", (unsigned long long)st.st_size);
+		afc_append_pair(&reply, &length, "st_size", value);
+		snprintf(value, sizeof(value), "%llu", (unsigned long long)st.st_blocks);
+		afc_append_pair(&reply, &length, "st_blocks", value);
+		snprintf(value, sizeof(value), "%llu", (unsigned long long)st.st_nlink);
+		afc_append_pair(&reply, &length, "st_nlink", value);
+		afc_append_pair(&reply, &length, "st_ifmt", S_ISDIR(st.st_mode) ? "S_IFDIR" : "S_IFREG");
+		snprintf(value, sizeof(value), "%llu", (unsigned long long)st.st_mtime * 1000000000ULL);
+		afc_append_pair(&reply, &length, "st_mtime", value);
+		afc_append_pair(&reply, &length, "st_birthtime", value);
+		res = afc_send_packet(session, AFC_OP_DATA, NULL, 0, reply, length);
+		free(reply);
+		return res;
+	}
+	case AFC_OP_MAKE_DIR:
+		path = afc_host_path(device, params, params_length);
+		if (!path) {
+			return afc_send_status(session, AFC_E_INVALID_ARG);
+		}
+		res = (mkdir_with_parents(path, 0755) < 0) ? afc_error_from_errno(errno) : AFC_E_SUCCESS;
+		free(path);
+		return afc_send_status(session, res);
+	case AFC_OP_REMOVE_PATH:
+	case AFC_OP_REMOVE_PATH_AND_CONTENTS:
+		path = afc_host_path(device, params, params_length);
+		if (!path) {
+			return afc_send_status(session, AFC_E_INVALID_ARG);
+		}
+		if (operation == AFC_OP_REMOVE_PATH_AND_CONTENTS) {
+			res = afc_remove_recursive(path);
+		} else {
+			res = remove(path);
+		}
+		res = (res < 0) ? afc_error_from_errno(errno) : AFC_E_SUCCESS;
+		free(path);
+		return afc_send_status(session, res);
+	case AFC_OP_RENAME_PATH: {
+		size_t from_length = strnlen(params, params_length) + 1;
+		char *to;
+		if (from_length >= params_length) {
+			return afc_send_status(session, AFC_E_INVALID_ARG);
+		}
+		path = afc_host_path(device, params, from_length);
+		to = afc_host_path(device, params + from_length, params_length - from_length);
+		if (!path || !to) {
+			res = AFC_E_INVALID_ARG;
+		} else {
+			res = (rename(path, to) < 0) ? afc_error_from_errno(errno) : AFC_E_SUCCESS;
+		}
+		free(path);
+		free(to);
+		return afc_send_status(session, res);
+	}
+	case AFC_OP_TRUNCATE: {
+		uint64_t size;
+		if (params_length < sizeof(uint64_t)) {
+			return afc_send_status(session, AFC_E_INVALID_ARG);
+		}
+		memcpy(&size, params, sizeof(size));
+		path = afc_host_path(device, params + sizeof(uint64_t), params_length - sizeof(uint64_t));
+		if (!path) {
+			return afc_send_status(session, AFC_E_INVALID_ARG);
+		}
+		res = (truncate(path, (off_t)le64toh(size)) < 0) ? afc_error_from_errno(errno) : AFC_E_SUCCESS;
+		free(path);
+		return afc_send_status(session, res);
+	}
+	case AFC_OP_FILE_OPEN: {
+		static const int open_flags[] = {
+			0,
+			O_RDONLY,			/* AFC_FOPEN_RDONLY */
+			O_RDWR | O_CREAT,		/* AFC_FOPEN_RW */
+			O_WRONLY | O_CREAT | O_TRUNC,	/* AFC_FOPEN_WRONLY */
+			O_RDWR | O_CREAT | O_TRUNC,	/* AFC_FOPEN_WR */
+			O_WRONLY | O_CREAT | O_APPEND,	/* AFC_FOPEN_APPEND */
+			O_RDWR | O_CREAT | O_APPEND	/* AFC_FOPEN_RDAPPEND */
+		};
+		uint64_t mode;
+		int slot;
+		int fd;
+
+		if (params_length < sizeof(uint64_t)) {
+			return afc_send_status(session, AFC_E_INVALID_ARG);
+		}
+		memcpy(&mode, params, sizeof(mode));
+		mode = le64toh(mode);
+		if (mode < 1 || mode > 6) {
+			return afc_send_status(session, AFC_E_INVALID_ARG);
+		}
+		for (slot = 0; slot < AFC_MAX_FILES; slot++) {
+			if (session->files[slot] < 0) {
+				break;
+			}
+		}
+		if (slot == AFC_MAX_FILES) {
+			return afc_send_status(session, AFC_E_UNKNOWN_ERROR);
+		}
+		path = afc_host_path(device, params + sizeof(uint64_t), params_length - sizeof(uint64_t));
+		if (!path) {
+			return afc_send_status(session, AFC_E_INVALID_ARG);
+		}
+		fd = open(path, open_flags[mode], 0644);
+		free(path);
+		if (fd < 0) {
+			return afc_send_status(session, afc_error_from_errno(errno));
+		}
+		session->files[slot] = fd;
+		return afc_send_u64(session, AFC_OP_FILE_OPEN_RES, slot + 1);
+	}
+	default:
+		break;
+	}
+
+	/* the remaining operations start with a file handle */
+	if (params_length < sizeof(uint64_t)) {
+		return afc_send_status(session, (operation > AFC_OP_FILE_SET_SIZE || operation < AFC_OP_FILE_READ) ? AFC_E_OP_NOT_SUPPORTED : AFC_E_INVALID_ARG);
+	}
+
+	uint64_t handle;
+	int slot;
+	memcpy(&handle, params, sizeof(handle));
+	slot = afc_file_slot(session, le64toh(handle));
+
+	switch (operation) {
+	case AFC_OP_FILE_READ: {
+		uint64_t length;
+		char *buffer;
+		ssize_t count;
+
+		if (slot < 0 || params_length < 2 * sizeof(uint64_t)) {
+			return afc_send_status(session, AFC_E_INVALID_ARG);
+		}
+		memcpy(&length, params + sizeof(uint64_t), sizeof(length));
+		length = le64toh(length);
+		buffer = (char*)malloc(length);
+		if (!buffer) {
+			return afc_send_status(session, AFC_E_UNKNOWN_ERROR);
+		}
+		count = read(session->files[slot], buffer, length);
+		if (count < 0) {
+			res = afc_send_status(session, afc_error_from_errno(errno));
+		} else {
+			res = afc_send_packet(session, AFC_OP_DATA, NULL, 0, buffer, (uint32_t)count);
+		}
+		free(buffer);
+		return res;
+	}
+	case AFC_OP_FILE_WRITE: {
+		uint32_t written = 0;
+		if (slot < 0) {
+			return afc_send_status(session, AFC_E_INVALID_ARG);
+		}
+		while (written < data_length) {
+			ssize_t count = write(session->files[slot], data + written, data_length - written);
+			if (count < 0) {
+				return afc_send_status(session, afc_error_from_errno(errno));
+			}
+			written += count;
+		}
+		return afc_send_status(session, AFC_E_SUCCESS);
+	}
+	case AFC_OP_FILE_SEEK: {
+		uint64_t whence;
+		int64_t offset;
+		if (slot < 0 || params_length < 3 * sizeof(uint64_t)) {
+			return afc_send_status(session, AFC_E_INVALID_ARG);
+		}
+		memcpy(&whence, params + sizeof(uint64_t), sizeof(whence));
+		memcpy(&offset, params + 2 * sizeof(uint64_t), sizeof(offset));
+		if (lseek(session->files[slot], (off_t)(int64_t)le64toh(offset), (int)le64toh(whence)) < 0) {
+			return afc_send_status(session, afc_error_from_errno(errno));
+		}
+		return afc_send_status(session, AFC_E_SUCCESS);
+	}
+	case AFC_OP_FILE_TELL: {
+		off_t offset;
+		if (slot < 0) {
+			return afc_send_status(session, AFC_E_INVALID_ARG);
+		}
+		offset = lseek(session->files[slot], 0, SEEK_CUR);
+		if (offset < 0) {
+			return afc_send_status(session, afc_error_from_errno(errno));
+		}
+		return afc_send_u64(session, AFC_OP_FILE_TELL_RES, (uint64_t)offset);
+	}
+	case AFC_OP_FILE_SET_SIZE: {
+		uint64_t size;
+		if (slot < 0 || params_length < 2 * sizeof(uint64_t)) {
+			return afc_send_status(session, AFC_E_INVALID_ARG);
+		}
+		memcpy(&size, params + sizeof(uint64_t), sizeof(size));
+		if (ftruncate(session->files[slot], (off_t)le64toh(size)) < 0) {
+			return afc_send_status(session, afc_error_from_errno(errno));
+		}
+		return afc_send_status(session, AFC_E_SUCCESS);
+	}
+	case AFC_OP_FILE_CLOSE:
+		if (slot < 0) {
+			return afc_send_status(session, AFC_E_INVALID_ARG);
+		}
+		close(session->files[slot]);
+		session->files[slot] = -1;
+		return afc_send_status(session, AFC_E_SUCCESS);
+	case AFC_OP_FILE_LOCK: {
+		uint64_t lock_op;
+		int op;
+		if (slot < 0 || params_length < 2 * sizeof(uint64_t)) {
+			return afc_send_status(session, AFC_E_INVALID_ARG);
+		}
+		memcpy(&lock_op, params + sizeof(uint64_t), sizeof(lock_op));
+		lock_op = le64toh(lock_op);
+		/* AFC_LOCK_SH, AFC_LOCK_EX and AFC_LOCK_UN all have the non-blocking bit (4) set */
+		if (lock_op & 8) {
+			op = LOCK_UN;
+		} else if (lock_op & 2) {
+			op = LOCK_EX;
+		} else {
+			op = LOCK_SH;
+		}
+		if (flock(session->files[slot], op | LOCK_NB) < 0) {
+			return afc_send_status(session, afc_error_from_errno(errno));
+		}
+		return afc_send_status(session, AFC_E_SUCCESS);
+	}
+	default:
+		SIM_LOG("[%s] AFC operation 0x%llx is not supported\n", device->udid, (unsigned long long)operation);
+		return afc_send_status(session, AFC_E_OP_NOT_SUPPORTED);
+	}
+}
+
+static void afc_session(struct sim_conn *conn)
+{
+	struct afc_session session;
+	struct afc_header header;
+	char *buffer = NULL;
+	uint32_t capacity = 0;
+	int i;
+
+	session.conn = conn;
+	session.packet_num = 0;
+	for (i = 0; i < AFC_MAX_FILES; i++) {
+		session.files[i] = -1;
+	}
+
+	while (!quit_flag && sim_recv(conn, &header, sizeof(header)) == 0) {
+		uint64_t entire_length = le64toh(header.entire_length);
+		uint64_t this_length = le64toh(header.this_length);
+		uint32_t payload_length;
+
+		if (memcmp(header.magic, AFC_MAGIC, AFC_MAGIC_LEN) || this_length < sizeof(header)
+				|| entire_length < this_length || entire_length - sizeof(header) > 0x10000000) {
+			SIM_LOG("[%s] Invalid AFC packet\n", conn->device->udid);
+			break;
+		}
+		payload_length = (uint32_t)(entire_length - sizeof(header));
+		/* keep room for a terminating NUL so paths can be treated as strings */
+		if (payload_length + 1 > capacity) {
+			capacity = payload_length + 1;
+			buffer = (char*)realloc(buffer, capacity);
+		}
+		if (payload_length > 0 && sim_recv(conn, buffer, payload_length) < 0) {
+			break;
+		}
+		buffer[payload_length] = '\0';
+
+		session.packet_num = le64toh(header.packet_num);
+		if (afc_handle_request(&session, le64toh(header.operation), buffer, (uint32_t)(this_length - sizeof(header)) + ((this_length == entire_length) ? 1 : 0),
+				buffer + (this_length - sizeof(header)), (uint32_t)(entire_length - this_length)) < 0) {
+			break;
+		}
+	}
+
+	for (i = 0; i < AFC_MAX_FILES; i++) {
+		if (session.files[i] >= 0) {
+			close(session.files[i]);
+		}
+	}
+	free(buffer);
+	sim_conn_report(conn, "afc");
+}
+
+/* installation_proxy */
+
+static const struct {
+	const char *status;
+	int percent;
+} install_phases[] = {
+	{ "CreatingStagingDirectory", 5 },
+	{ "ExtractingPackage", 15 },
+	{ "InspectingPackage", 20 },
+	{ "TakingInstallLock", 20 },
+	{ "PreflightingApplication", 30 },
+	{ "InstallingEmbeddedProfile", 30 },
+	{ "VerifyingApplication", 40 },
+	{ "CreatingContainer", 50 },
+	{ "InstallingApplication", 60 },
+	{ "PostflightingApplication", 70 },
+	{ "SandboxingApplication", 80 },
+	{ "GeneratingApplicationMap", 90 },
+	{ NULL, 0 }
+};
+
+static int instproxy_send_status(struct sim_conn *conn, const char *status, int percent)
+{
+	int res;
+	plist_t reply = plist_new_dict();
+	plist_dict_set_item(reply, "Status", plist_new_string(status));
+	if (percent >= 0) {
+		plist_dict_set_item(reply, "PercentComplete", plist_new_uint(percent));
+	}
+	res = plist_service_send(conn, reply);
+	plist_free(reply);
+	return res;
+}
+
+static int instproxy_send_error(struct sim_conn *conn, const char *error, const char *description)
+{
+	int res;
+	plist_t reply = plist_new_dict();
+	plist_dict_set_item(reply, "Error", plist_new_string(error));
+	plist_dict_set_item(reply, "ErrorDescription", plist_new_string(description));
+	res = plist_service_send(conn, reply);
+	plist_free(reply);
+	return res;
+}
+
+/* streams the configured number of progress updates, then Complete */
+static int instproxy_send_progress(struct sim_conn *conn, int uninstall)
+{
+	int num_phases = 0;
+	int i;
+
+	while (install_phases[num_phases].status) {
+		num_phases++;
+	}
+	for (i = 0; i < install_steps; i++) {
+		int phase = (install_steps > 1) ? i * (num_phases - 1) / (install_steps - 1) : 0;
+		const char *status = (uninstall) ? "RemovingApplication" : install_phases[phase].status;
+		int percent = (uninstall) ? 50 : install_phases[phase].percent;
+		if (instproxy_send_status(conn, status, percent) < 0) {
+			return -1;
+		}
+	}
+	return instproxy_send_status(conn, "Complete", -1);
+}
+
+/**
+ * Reads Info.plist of an uploaded application directory, or falls back to
+ * the file name of the package when it is an archive. Returns NULL if the
+ * package is missing or its CFBundleIdentifier is not a string.
+ */
+static plist_t instproxy_read_app_info(struct sim_device *device, const char *package_path)
+{
+	plist_t info = NULL;
+	char *host_path = afc_host_path(device, package_path, strlen(package_path) + 1);
+	struct stat st;
+
+	if (!host_path || stat(host_path, &st) < 0) {
+		free(host_path);
+		return NULL;
+	}
+	if (S_ISDIR(st.st_mode)) {
+		char *info_path = string_build_path(host_path, "Info.plist", NULL);
+		plist_read_from_filename(&info, info_path);
+		free(info_path);
+	}
+	free(host_path);
+
+	if (info && plist_dict_get_item(info, "CFBundleIdentifier")) {
+		plist_t node = plist_dict_get_item(info, "CFBundleIdentifier");
+		const char *value = (plist_get_node_type(node) == PLIST_STRING) ? plist_get_string_ptr(node, NULL) : NULL;
+		if (!value || !*value) {
+			plist_free(info);
+			return NULL;
+		}
+	} else {
+		char *identifier = strdup(package_path);
+		char *name = strrchr(identifier, '/');
+		char *ext;
+		if (name) {
+			memmove(identifier, name + 1, strlen(name + 1) + 1);
+		}
+		ext = strrchr(identifier, '.');
+		if (ext) {
+			*ext = '\0';
+		}
+		plist_free(info);
+		info = plist_new_dict();
+		plist_dict_set_item(info, "CFBundleIdentifier", plist_new_string(identifier));
+		plist_dict_set_item(info, "CFBundleVersion", plist_new_string("1"));
+		free(identifier);
+	}
+	plist_dict_set_item(info, "ApplicationType", plist_new_string("User"));
+	return info;
+}
+
+/* applies the ReturnAttributes client option to an application entry */
+static plist_t instproxy_project_app(plist_t app, plist_t request)
+{
+	plist_t attributes = plist_access_path(request, 2, "ClientOptions", "ReturnAttributes");
+	plist_t result;
+	uint32_t i;
+
+	if (!attributes || plist_get_node_type(attributes) != PLIST_ARRAY) {
+		return plist_copy(app);
+	}
+	result = plist_new_dict();
+	for (i = 0; i < plist_array_get_size(attributes); i++) {
+		const char *key = plist_get_string_ptr(plist_array_get_item(attributes, i), NULL);
+		plist_t value = (key) ? plist_dict_get_item(app, key) : NULL;
+		if (value) {
+			plist_dict_set_item(result, key, plist_copy(value));
+		}
+	}
+	return result;
+}
+
+static void instproxy_session(struct sim_conn *conn)
+{
+	struct sim_device *device = conn->device;
+	plist_t request = NULL;
+
+	while (!quit_flag && plist_service_receive(conn, &request) == 0) {
+		char *command = dict_get_string(request, "Command");
+		int res = 0;
+
+		if (!command) {
+			res = instproxy_send_error(conn, "MissingCommand", "Request has no Command");
+		} else if (!strcmp(command, "Install") || !strcmp(command, "Upgrade")) {
+			struct timeval start;
+			char *package_path = dict_get_string(request, "PackagePath");
+			plist_t info = (package_path) ? instproxy_read_app_info(device, package_path) : NULL;
+
+			gettimeofday(&start, NULL);
+			if (!info) {
+				res = instproxy_send_error(conn, "PackageInspectionFailed", "Failed to find the package");
+			} else {
+				char *identifier = dict_get_string(info, "CFBundleIdentifier");
+				/* the app must be listed once the client sees Complete */
+				mutex_lock(&device->mutex);
+				plist_dict_set_item(device->apps, identifier, info);
+				mutex_unlock(&device->mutex);
+				res = instproxy_send_progress(conn, 0);
+				SIM_LOG("[%s] Installed %s in %.3f s\n", device->udid, identifier, elapsed_since(&start));
+				free(identifier);
+			}
+			free(package_path);
+		} else if (!strcmp(command, "Uninstall")) {
+			char *identifier = dict_get_string(request, "ApplicationIdentifier");
+			mutex_lock(&device->mutex);
+			int found = (identifier && plist_dict_get_item(device->apps, identifier));
+			if (found) {
+				plist_dict_remove_item(device->apps, identifier);
+			}
+			mutex_unlock(&device->mutex);
+			if (found) {
+				res = instproxy_send_progress(conn, 1);
+			} else {
+				res = instproxy_send_error(conn, "LookupFailed", "Application is not installed");
+			}
+			free(identifier);
+		} else if (!strcmp(command, "Browse") || !strcmp(command, "Lookup")) {
+			plist_t apps;
+			mutex_lock(&device->mutex);
+			apps = plist_copy(device->apps);
+			mutex_unlock(&device->mutex);
+
+			if (!strcmp(command, "Lookup")) {
+				plist_t reply = plist_new_dict();
+				plist_dict_set_item(reply, "LookupResult", apps);
+				plist_dict_set_item(reply, "Status", plist_new_string("Complete"));
+				res = plist_service_send(conn, reply);
+				plist_free(reply);
+			} else {
+				plist_dict_iter iter = NULL;
+				plist_t app = NULL;
+				uint32_t total = plist_dict_get_size(apps);
+				uint32_t index = 0;
+
+				plist_dict_new_iter(apps, &iter);
+				do {
+					plist_t list = plist_new_array();
+					uint32_t amount = 0;
+					plist_t reply;
+
+					for (amount = 0; amount < 20; amount++) {
+						plist_dict_next_item(apps, iter, NULL, &app);
+						if (!app) {
+							break;
+						}
+						plist_array_append_item(list, instproxy_project_app(app, request));
+					}
+					if (amount == 0 && index > 0) {
+						plist_free(list);
+						break;
+					}
+					reply = plist_new_dict();
+					plist_dict_set_item(reply, "CurrentIndex", plist_new_uint(index));
+					plist_dict_set_item(reply, "CurrentAmount", plist_new_uint(amount));
+					plist_dict_set_item(reply, "Total", plist_new_uint(total));
+					plist_dict_set_item(reply, "CurrentList", list);
+					plist_dict_set_item(reply, "Status", plist_new_string("BrowsingApplications"));
+					res = plist_service_send(conn, reply);
+					plist_free(reply);
+					index += amount;
+				} while (res == 0 && app);
+				free(iter);
+				plist_free(apps);
+				if (res == 0) {
+					res = instproxy_send_status(conn, "Complete", -1);
+				}
+			}
+		} else {
+			res = instproxy_send_error(conn, "UnknownCommand", "The command is not supported by the simulator");
+		}
+
+		free(command);
+		plist_free(request);
+		if (res < 0) {
+			break;
+		}
+	}
+	sim_conn_report(conn, "installation_proxy");
+}
+
+/* misagent */
+
+/**
+ * Extracts the UUID from the plist embedded in a signed provisioning profile.
+ */
+static char *misagent_profile_uuid(const char *data, uint64_t length)
+{
+	const char *start = NULL;
+	const char *end = NULL;
+	uint64_t i;
+	plist_t plist = NULL;
+	char *uuid = NULL;
+
+	for (i = 0; i + 5 <= length; i++) {
+		if (!start && !memcmp(data + i, "<?xml", 5)) {
+			start = data + i;
+		} else if (start && i + 8 <= length && !memcmp(data + i, "</plist>", 8)) {
+			end = data + i + 8;
+			break;
+		}
+	}
+	if (!start || !end) {
+		return NULL;
+	}
+	plist_from_xml(start, (uint32_t)(end - start), &plist);
+	if (plist) {
+		uuid = dict_get_string(plist, "UUID");
+		plist_free(plist);
+	}
+	return uuid;
+}
+
+static void misagent_session(struct sim_conn *conn)
+{
+	struct sim_device *device = conn->device;
+	plist_t request = NULL;
+
+	while (!quit_flag && plist_service_receive(conn, &request) == 0) {
+		plist_t reply = plist_new_dict();
+		int status = 0;
+		int res;
+
+		if (dict_string_equals(request, "MessageType", "Install")) {
+			plist_t profile = plist_dict_get_item(request, "Profile");
+			uint64_t length = 0;
+			const char *data = plist_get_data_ptr(profile, &length);
+			char *uuid = (data) ? misagent_profile_uuid(data, length) : NULL;
+			if (uuid) {
+				mutex_lock(&device->mutex);
+				plist_dict_set_item(device->profiles, uuid, plist_copy(profile));
+				mutex_unlock(&device->mutex);
+				free(uuid);
+			} else {
+				status = 0xe800000c;
+			}
+		} else if (dict_string_equals(request, "MessageType", "Remove")) {
+			char *uuid = dict_get_string(request, "ProfileID");
+			mutex_lock(&device->mutex);
+			if (uuid && plist_dict_get_item(device->profiles, uuid)) {
+				plist_dict_remove_item(device->profiles, uuid);
+			}
+			mutex_unlock(&device->mutex);
+			free(uuid);
+		} else if (dict_string_equals(request, "MessageType", "Copy") || dict_string_equals(request, "MessageType", "CopyAll")) {
+			plist_t payload = plist_new_array();
+			plist_dict_iter iter = NULL;
+			plist_t profile = NULL;
+
+			mutex_lock(&device->mutex);
+			plist_dict_new_iter(device->profiles, &iter);
+			do {
+				plist_dict_next_item(device->profiles, iter, NULL, &profile);
+				if (profile) {
+					plist_array_append_item(payload, plist_copy(profile));
+				}
+			} while (profile);
+			mutex_unlock(&device->mutex);
+			free(iter);
+			plist_dict_set_item(reply, "Payload", payload);
+		} else {
+			status = -1;
+		}
+
+		plist_dict_set_item(reply, "Status", plist_new_uint((uint64_t)(uint32_t)status));
+		res = plist_service_send(conn, reply);
+		plist_free(reply);
+		plist_free(request);
+		if (res < 0) {
+			break;
+		}
+	}
+}
+
+/* notification_proxy, accepts observers but never posts anything */
+
+static void np_session(struct sim_conn *conn)
+{
+	plist_t request = NULL;
+
+	while (!quit_flag && plist_service_receive(conn, &request) == 0) {
+		int shutdown = dict_string_equals(request, "Command", "Shutdown");
+		plist_free(request);
+		if (shutdown) {
+			plist_t reply = plist_new_dict();
+			plist_dict_set_item(reply, "Command", plist_new_string("ProxyDeath"));
+			plist_service_send(conn, reply);
+			plist_free(reply);
+			break;
+		}
+	}
+}
+
+/* syslog_relay, sends --syslog-lines generated messages and hangs up */
+
+#define SYSLOG_BATCH_SIZE 65536
+
+static void syslog_session(struct sim_conn *conn)
+{
+	static const char padding[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_";
+	char *batch = (char*)malloc(SYSLOG_BATCH_SIZE);
+	uint32_t used = 0;
+	int i;
+
+	if (!batch) {
+		return;
+	}
+	for (i = 0; i < syslog_lines && !quit_flag; i++) {
+		char line[256];
+		/* vary the length so lines straddle the reads of the client */
+		int length = snprintf(line, sizeof(line), "Jun  1 12:%02d:%02d iPhone installd[%d] <Notice>: simulated message %d of %d %.*s\n",
+			(i / 60) % 60, i % 60, 100 + conn->device->id, i, syslog_lines, i % 64, padding);
+		/* the relay terminates every message with a NUL */
+		if (used + length + 1 > SYSLOG_BATCH_SIZE) {
+			if (sim_send(conn, batch, used) < 0) {
+				used = 0;
+				break;
+			}
+			used = 0;
+		}
+		memcpy(batch + used, line, length + 1);
+		used += length + 1;
+	}
+	if (used > 0) {
+		sim_send(conn, batch, used);
+	}
+	free(batch);
+	sim_conn_report(conn, "syslog_relay");
+}
+
+/* mobilebackup2, backs up and restores --backup-files synthetic files */
+
+#define MB2_CODE_SUCCESS 0x00
+#define MB2_CODE_ERROR_LOCAL 0x06
+#define MB2_CODE_FILE_DATA 0x0c
+
+#define MB2_BLOCK_SIZE 65536		/* file data is sent in blocks of this size */
+#define MB2_FILES_PER_MESSAGE 32
+#define MB2_DIRECTORIES 16
+#define MB2_PATTERN_SIZE (1024 * 1024)
+
+/* MB2_PATTERN_SIZE + MB2_BLOCK_SIZE bytes, so every block can be taken from it in one piece */
+static char *backup_pattern = NULL;
+
+static const char *mb2_file_data(int index, uint64_t offset)
+{
+	return backup_pattern + ((uint64_t)index * 4099 + offset) % MB2_PATTERN_SIZE;
+}
+
+static char *mb2_file_path(const char *udid, int index)
+{
+	char path[128];
+	snprintf(path, sizeof(path), "%s/%02x/simulated-%06d", udid, index % MB2_DIRECTORIES, index);
+	return strdup(path);
+}
+
+static char *dl_receive_message(struct sim_conn *conn, plist_t *message)
+{
+	char *name = NULL;
+
+	if (plist_service_receive(conn, message) < 0) {
+		return NULL;
+	}
+	if (plist_get_node_type(*message) == PLIST_ARRAY) {
+		plist_t node = plist_array_get_item(*message, 0);
+		if (node && plist_get_node_type(node) == PLIST_STRING) {
+			plist_get_string_val(node, &name);
+		}
+	}
+	if (!name) {
+		plist_free(*message);
+		*message = NULL;
+	}
+	return name;
+}
+
+static int dl_send_process_message(struct sim_conn *conn, plist_t dict)
+{
+	int res;
+	plist_t message = plist_new_array();
+	plist_array_append_item(message, plist_new_string("DLMessageProcessMessage"));
+	plist_array_append_item(message, dict);
+	res = plist_service_send(conn, message);
+	plist_free(message);
+	return res;
+}
+
+static int dl_receive_status_response(struct sim_conn *conn)
+{
+	plist_t message = NULL;
+	char *name = dl_receive_message(conn, &message);
+	int res = (name && !strcmp(name, "DLMessageStatusResponse")) ? 0 : -1;
+	free(name);
+	plist_free(message);
+	return res;
+}
+
+static int mb2_send_string(struct sim_conn *conn, const char *str)
+{
+	uint32_t length = (uint32_t)strlen(str);
+	uint32_t nlen = htobe32(length);
+	if (sim_send(conn, &nlen, sizeof(nlen)) < 0) {
+		return -1;
+	}
+	return sim_send(conn, str, length);
+}
+
+static int mb2_send_code(struct sim_conn *conn, uint32_t length, char code)
+{
+	char header[5];
+	uint32_t nlen = htobe32(length + 1);
+	memcpy(header, &nlen, sizeof(nlen));
+	header[4] = code;
+	return sim_send(conn, header, sizeof(header));
+}
+
+/**
+ * Streams a file like the device does for DLMessageUploadFiles: device path,
+ * backup path, blocks of file data, then CODE_SUCCESS. With data NULL the
+ * contents are generated from the pattern for index.
+ */
+static int mb2_upload_file(struct sim_conn *conn, const char *path, const char *data, uint64_t size, int index)
+{
+	uint64_t offset = 0;
+
+	if (mb2_send_string(conn, path) < 0 || mb2_send_string(conn, path) < 0) {
+		return -1;
+	}
+	while (offset < size) {
+		uint32_t length = (size - offset < MB2_BLOCK_SIZE) ? (uint32_t)(size - offset) : MB2_BLOCK_SIZE;
+		if (mb2_send_code(conn, length, MB2_CODE_FILE_DATA) < 0
+				|| sim_send(conn, data ? data + offset : mb2_file_data(index, offset), length) < 0) {
+			return -1;
+		}
+		offset += length;
+	}
+	return mb2_send_code(conn, 0, MB2_CODE_SUCCESS);
+}
+
+static int mb2_upload_files_message(struct sim_conn *conn, double progress, uint64_t total)
+{
+	int res;
+	plist_t message = plist_new_array();
+	plist_array_append_item(message, plist_new_string("DLMessageUploadFiles"));
+	plist_array_append_item(message, plist_new_dict());
+	plist_array_append_item(message, plist_new_real(progress));
+	plist_array_append_item(message, plist_new_uint(total));
+	res = plist_service_send(conn, message);
+	plist_free(message);
+	return res;
+}
+
+static int mb2_upload_plist(struct sim_conn *conn, const char *udid, const char *name, plist_t plist)
+{
+	char *path = string_build_path(udid, name, NULL);
+	char *xml = NULL;
+	uint32_t length = 0;
+	int res;
+
+	plist_to_xml(plist, &xml, &length);
+	res = mb2_upload_file(conn, path, xml, length, 0);
+	free(xml);
+	free(path);
+	return res;
+}
+
+static int mb2_backup(struct sim_conn *conn, const char *udid)
+{
+	uint64_t total = (uint64_t)backup_files * backup_file_size;
+	uint32_t zero = 0;
+	struct timeval start;
+	double elapsed;
+	int i;
+	int j;
+
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < MB2_DIRECTORIES && i < backup_files; i++) {
+		char path[64];
+		plist_t message = plist_new_array();
+		snprintf(path, sizeof(path), "%s/%02x", udid, i);
+		plist_array_append_item(message, plist_new_string("DLMessageCreateDirectory"));
+		plist_array_append_item(message, plist_new_string(path));
+		if (plist_service_send(conn, message) < 0 || dl_receive_status_response(conn) < 0) {
+			plist_free(message);
+			return -1;
+		}
+		plist_free(message);
+	}
+
+	for (i = 0; i < backup_files; i += MB2_FILES_PER_MESSAGE) {
+		if (mb2_upload_files_message(conn, 100.0 * i / backup_files, total) < 0) {
+			return -1;
+		}
+		for (j = i; j < i + MB2_FILES_PER_MESSAGE && j < backup_files; j++) {
+			char *path = mb2_file_path(udid, j);
+			int res = mb2_upload_file(conn, path, NULL, backup_file_size, j);
+			free(path);
+			if (res < 0) {
+				return -1;
+			}
+		}
+		if (sim_send(conn, &zero, sizeof(zero)) < 0 || dl_receive_status_response(conn) < 0) {
+			return -1;
+		}
+	}
+
+	/* the device finishes every backup with its manifest and status */
+	plist_t manifest = plist_new_dict();
+	plist_dict_set_item(manifest, "IsEncrypted", plist_new_bool(0));
+	plist_dict_set_item(manifest, "Version", plist_new_string("10.0"));
+	plist_t status = plist_new_dict();
+	plist_dict_set_item(status, "IsFullBackup", plist_new_bool(1));
+	plist_dict_set_item(status, "SnapshotState", plist_new_string("finished"));
+	plist_dict_set_item(status, "Version", plist_new_string("3.3"));
+
+	int res = mb2_upload_files_message(conn, 100.0, total);
+	if (res == 0) res = mb2_upload_plist(conn, udid, "Manifest.plist", manifest);
+	if (res == 0) res = mb2_upload_plist(conn, udid, "Status.plist", status);
+	if (res == 0) res = sim_send(conn, &zero, sizeof(zero));
+	if (res == 0) res = dl_receive_status_response(conn);
+	plist_free(manifest);
+	plist_free(status);
+	if (res < 0) {
+		return -1;
+	}
+
+	elapsed = elapsed_since(&start);
+	SIM_LOG("[%s] Backup of %d files (%llu bytes) took %.3f s (%.2f MB/s)\n", conn->device->udid, backup_files,
+		(unsigned long long)total, elapsed, (elapsed > 0) ? total / elapsed / 1000000.0 : 0.0);
+	return 0;
+}
+
+/**
+ * Receives one file sent for DLMessageDownloadFiles and compares it with the
+ * pattern the backup was created from. Returns the number of mismatches,
+ * -2 if the host ended the batch early, or -1 on a protocol error.
+ */
+static int mb2_download_file(struct sim_conn *conn, const char *expected_path, int index, char **buffer, uint32_t *capacity)
+{
+	uint32_t nlen = 0;
+	uint64_t offset = 0;
+	int mismatches = 0;
+	char code = 0;
+
+	if (sim_recv(conn, &nlen, sizeof(nlen)) < 0) {
+		return -1;
+	}
+	nlen = be32toh(nlen);
+	if (nlen == 0) {
+		/* the host gives up on the rest of the batch after a failed file */
+		return -2;
+	}
+	if (nlen > 4096) {
+		return -1;
+	}
+	if (nlen + 1 > *capacity) {
+		*capacity = nlen + 1;
+		*buffer = (char*)realloc(*buffer, *capacity);
+	}
+	if (sim_recv(conn, *buffer, nlen) < 0) {
+		return -1;
+	}
+	(*buffer)[nlen] = '\0';
+	if (strcmp(*buffer, expected_path) != 0) {
+		SIM_LOG("[%s] Expected '%s' but got '%s'\n", conn->device->udid, expected_path, *buffer);
+		mismatches++;
+	}
+
+	while (1) {
+		if (sim_recv(conn, &nlen, sizeof(nlen)) < 0 || sim_recv(conn, &code, 1) < 0) {
+			return -1;
+		}
+		nlen = be32toh(nlen);
+		if (nlen == 0) {
+			return -1;
+		}
+		if (nlen > *capacity) {
+			*capacity = nlen;
+			*buffer = (char*)realloc(*buffer, *capacity);
+		}
+		if (nlen > 1 && sim_recv(conn, *buffer, nlen - 1) < 0) {
+			return -1;
+		}
+		if (code != MB2_CODE_FILE_DATA) {
+			break;
+		}
+		uint32_t checked = 0;
+		while (checked < nlen - 1) {
+			uint32_t length = (nlen - 1 - checked < MB2_BLOCK_SIZE) ? nlen - 1 - checked : MB2_BLOCK_SIZE;
+			if (offset + checked + length > backup_file_size || memcmp(*buffer + checked, mb2_file_data(index, offset + checked), length) != 0) {
+				mismatches++;
+				break;
+			}
+			checked += length;
+		}
+		offset += nlen - 1;
+	}
+
+	if (code != MB2_CODE_SUCCESS || offset != backup_file_size) {
+		SIM_LOG("[%s] '%s' was not restored completely (code %d, %llu bytes)\n", conn->device->udid, expected_path, code, (unsigned long long)offset);
+		mismatches++;
+	}
+	return mismatches;
+}
+
+static int mb2_restore(struct sim_conn *conn, const char *udid)
+{
+	uint64_t total = (uint64_t)backup_files * backup_file_size;
+	char *buffer = NULL;
+	uint32_t capacity = 0;
+	int mismatches = 0;
+	struct timeval start;
+	double elapsed;
+	int i;
+	int j;
+
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < backup_files; i += MB2_FILES_PER_MESSAGE) {
+		plist_t message = plist_new_array();
+		plist_t paths = plist_new_array();
+		uint32_t zero = 0;
+		int ended = 0;
+		int res = 0;
+
+		for (j = i; j < i + MB2_FILES_PER_MESSAGE && j < backup_files; j++) {
+			char *path = mb2_file_path(udid, j);
+			plist_array_append_item(paths, plist_new_string(path));
+			free(path);
+		}
+		plist_array_append_item(message, plist_new_string("DLMessageDownloadFiles"));
+		plist_array_append_item(message, paths);
+		plist_array_append_item(message, plist_new_dict());
+		plist_array_append_item(message, plist_new_real(100.0 * i / backup_files));
+		res = plist_service_send(conn, message);
+		plist_free(message);
+
+		for (j = i; res == 0 && j < i + MB2_FILES_PER_MESSAGE && j < backup_files; j++) {
+			char *path = mb2_file_path(udid, j);
+			int count = (ended) ? 1 : mb2_download_file(conn, path, j, &buffer, &capacity);
+			free(path);
+			if (count == -2) {
+				ended = 1;
+				count = 1;
+			}
+			if (count < 0) {
+				res = -1;
+			} else {
+				mismatches += count;
+			}
+		}
+		if (res < 0 || (!ended && (sim_recv(conn, &zero, sizeof(zero)) < 0 || zero != 0)) || dl_receive_status_response(conn) < 0) {
+			free(buffer);
+			return -1;
+		}
+	}
+	free(buffer);
+
+	elapsed = elapsed_since(&start);
+	SIM_LOG("[%s] Restore of %d files (%llu bytes) took %.3f s (%.2f MB/s), %d mismatches\n", conn->device->udid, backup_files,
+		(unsigned long long)total, elapsed, (elapsed > 0) ? total / elapsed / 1000000.0 : 0.0, mismatches);
+	return mismatches;
+}
+
+static void mobilebackup2_session(struct sim_conn *conn)
+{
+	plist_t message = plist_new_array();
+	char *name = NULL;
+
+	plist_array_append_item(message, plist_new_string("DLMessageVersionExchange"));
+	plist_array_append_item(message, plist_new_uint(300));
+	plist_array_append_item(message, plist_new_uint(0));
+	plist_service_send(conn, message);
+	plist_free(message);
+
+	name = dl_receive_message(conn, &message);
+	if (!name || strcmp(name, "DLMessageVersionExchange") || !plist_array_get_item(message, 1)
+			|| strcmp(plist_get_string_ptr(plist_array_get_item(message, 1), NULL), "DLVersionsOk")) {
+		SIM_LOG("[%s] mobilebackup2 version exchange failed\n", conn->device->udid);
+		free(name);
+		plist_free(message);
+		return;
+	}
+	free(name);
+	plist_free(message);
+
+	message = plist_new_array();
+	plist_array_append_item(message, plist_new_string("DLMessageDeviceReady"));
+	plist_service_send(conn, message);
+	plist_free(message);
+
+	while (!quit_flag && (name = dl_receive_message(conn, &message)) != NULL) {
+		plist_t request = plist_array_get_item(message, 1);
+		plist_t reply = plist_new_dict();
+		int done = !strcmp(name, "DLMessageDisconnect");
+
+		if (!done && !strcmp(name, "DLMessageProcessMessage") && plist_get_node_type(request) == PLIST_DICT) {
+			char *udid = dict_get_string(request, "SourceIdentifier");
+			if (!udid) {
+				udid = dict_get_string(request, "TargetIdentifier");
+			}
+			if (dict_string_equals(request, "MessageName", "Hello")) {
+				plist_dict_set_item(reply, "MessageName", plist_new_string("Response"));
+				plist_dict_set_item(reply, "ErrorCode", plist_new_uint(0));
+				plist_dict_set_item(reply, "ProtocolVersion", plist_new_real(2.1));
+			} else if (udid && dict_string_equals(request, "MessageName", "Backup")) {
+				done = (mb2_backup(conn, udid) < 0);
+				plist_dict_set_item(reply, "ErrorCode", plist_new_uint(0));
+			} else if (udid && dict_string_equals(request, "MessageName", "Restore")) {
+				int res = mb2_restore(conn, udid);
+				done = (res < 0);
+				plist_dict_set_item(reply, "ErrorCode", plist_new_uint((res == 0) ? 0 : 1));
+				if (res > 0) {
+					plist_dict_set_item(reply, "ErrorDescription", plist_new_string("Restored files do not match the backup"));
+				}
+			} else {
+				plist_dict_set_item(reply, "ErrorCode", plist_new_uint(0));
+			}
+			free(udid);
+			if (!done) {
+				dl_send_process_message(conn, reply);
+				reply = NULL;
+			}
+		}
+
+		plist_free(reply);
+		plist_free(message);
+		free(name);
+		if (done) {
+			break;
+		}
+	}
+	sim_conn_report(conn, "mobilebackup2");
+}
+
+/* usbmuxd */
+
+static int mux_send_plist(struct sim_conn *conn, uint32_t tag, plist_t plist)
+{
+	struct mux_header header;
+	char *xml = NULL;
+	uint32_t length = 0;
+	int res;
+
+	plist_to_xml(plist, &xml, &length);
+	if (!xml) {
+		return -1;
+	}
+	header.length = sizeof(header) + length;
+	header.version = 1;
+	header.message = MUX_MESSAGE_PLIST;
+	header.tag = tag;
+	res = socket_send(conn->fd, &header, sizeof(header)) == sizeof(header) && socket_send(conn->fd, xml, length) == (int)length ? 0 : -1;
+	free(xml);
+	return res;
+}
+
+static int mux_send_result(struct sim_conn *conn, uint32_t tag, uint32_t result)
+{
+	int res;
+	plist_t reply = plist_new_dict();
+	plist_dict_set_item(reply, "MessageType", plist_new_string("Result"));
+	plist_dict_set_item(reply, "Number", plist_new_uint(result));
+	res = mux_send_plist(conn, tag, reply);
+	plist_free(reply);
+	return res;
+}
+
+static plist_t mux_device_attached(struct sim_device *device)
+{
+	plist_t message = plist_new_dict();
+	plist_t props = plist_new_dict();
+
+	plist_dict_set_item(props, "ConnectionSpeed", plist_new_uint(480000000));
+	plist_dict_set_item(props, "ConnectionType", plist_new_string("USB"));
+	plist_dict_set_item(props, "DeviceID", plist_new_uint(device->id));
+	plist_dict_set_item(props, "LocationID", plist_new_uint(device->id << 16));
+	plist_dict_set_item(props, "ProductID", plist_new_uint(0x12a8));
+	plist_dict_set_item(props, "SerialNumber", plist_new_string(device->udid));
+
+	plist_dict_set_item(message, "MessageType", plist_new_string("Attached"));
+	plist_dict_set_item(message, "DeviceID", plist_new_uint(device->id));
+	plist_dict_set_item(message, "Properties", props);
+	return message;
+}
+
+static struct sim_device *mux_find_device(plist_t request)
+{
+	uint64_t id = 0;
+	char *udid = NULL;
+	struct sim_device *found = NULL;
+	int i;
+
+	plist_get_uint_val(plist_dict_get_item(request, "DeviceID"), &id);
+	udid = dict_get_string(request, "PairRecordID");
+	for (i = 0; i < num_devices; i++) {
+		if ((id && devices[i].id == id) || (udid && !strcmp(devices[i].udid, udid))) {
+			found = &devices[i];
+			break;
+		}
+	}
+	free(udid);
+	return found;
+}
+
+static plist_t mux_pair_record(struct sim_device *device)
+{
+	plist_t record = plist_new_dict();
+	char *host_id = generate_uuid();
+
+	plist_dict_set_item(record, "HostID", plist_new_string(host_id));
+	plist_dict_set_item(record, "SystemBUID", plist_new_string(system_buid));
+	plist_dict_set_item(record, "WiFiMACAddress", plist_new_string("00:00:00:00:00:00"));
+	/* lockdownd_start_service_with_escrow_bag() needs one, the content is never checked */
+	plist_dict_set_item(record, "EscrowBag", plist_new_data(host_id, strlen(host_id)));
+	free(host_id);
+	return record;
+}
+
+/**
+ * Serves one usbmuxd client connection. Returns the service a Connect
+ * request switched the connection to, SERVICE_NONE otherwise.
+ */
+static int mux_session(struct sim_conn *conn, int *port)
+{
+	struct mux_header header;
+	char *payload = NULL;
+	int listening = 0;
+
+	while (!quit_flag && socket_receive_timeout(conn->fd, &header, sizeof(header), MSG_WAITALL, 0) == sizeof(header)) {
+		plist_t request = NULL;
+		int res = 0;
+
+		if (header.length < sizeof(header) || header.length > 0x100000) {
+			break;
+		}
+		payload = (char*)realloc(payload, header.length - sizeof(header) + 1);
+		if (header.length > sizeof(header) && socket_receive_timeout(conn->fd, payload, header.length - sizeof(header), MSG_WAITALL, 5000) != (int)(header.length - sizeof(header))) {
+			break;
+		}
+		if (header.version != 1 || header.message != MUX_MESSAGE_PLIST) {
+			struct mux_header reply = { sizeof(reply) + sizeof(uint32_t), 0, MUX_MESSAGE_RESULT, header.tag };
+			uint32_t result = MUX_RESULT_BADVERSION;
+			socket_send(conn->fd, &reply, sizeof(reply));
+			socket_send(conn->fd, &result, sizeof(result));
+			continue;
+		}
+
+		plist_from_xml(payload, header.length - sizeof(header), &request);
+		if (!request) {
+			break;
+		}
+
+		if (dict_string_equals(request, "MessageType", "ListDevices")) {
+			plist_t reply = plist_new_dict();
+			plist_t list = plist_new_array();
+			int i;
+			for (i = 0; i < num_devices; i++) {
+				plist_array_append_item(list, mux_device_attached(&devices[i]));
+			}
+			plist_dict_set_item(reply, "DeviceList", list);
+			res = mux_send_plist(conn, header.tag, reply);
+			plist_free(reply);
+		} else if (dict_string_equals(request, "MessageType", "Listen")) {
+			int i;
+			res = mux_send_result(conn, header.tag, MUX_RESULT_OK);
+			for (i = 0; res == 0 && i < num_devices; i++) {
+				plist_t attached = mux_device_attached(&devices[i]);
+				res = mux_send_plist(conn, 0, attached);
+				plist_free(attached);
+			}
+			listening = 1;
+		} else if (dict_string_equals(request, "MessageType", "ReadBUID")) {
+			plist_t reply = plist_new_dict();
+			plist_dict_set_item(reply, "BUID", plist_new_string(system_buid));
+			res = mux_send_plist(conn, header.tag, reply);
+			plist_free(reply);
+		} else if (dict_string_equals(request, "MessageType", "ReadPairRecord")) {
+			struct sim_device *device = mux_find_device(request);
+			if (device) {
+				plist_t reply = plist_new_dict();
+				plist_t record = mux_pair_record(device);
+				char *xml = NULL;
+				uint32_t length = 0;
+				plist_to_xml(record, &xml, &length);
+				plist_dict_set_item(reply, "PairRecordData", plist_new_data(xml, length));
+				res = mux_send_plist(conn, header.tag, reply);
+				plist_free(reply);
+				plist_free(record);
+				free(xml);
+			} else {
+				res = mux_send_result(conn, header.tag, MUX_RESULT_BADDEV);
+			}
+		} else if (dict_string_equals(request, "MessageType", "SavePairRecord") || dict_string_equals(request, "MessageType", "DeletePairRecord")) {
+			res = mux_send_result(conn, header.tag, MUX_RESULT_OK);
+		} else if (dict_string_equals(request, "MessageType", "Connect")) {
+			struct sim_device *device = mux_find_device(request);
+			uint64_t nport = 0;
+			int service = SERVICE_NONE;
+
+			plist_get_uint_val(plist_dict_get_item(request, "PortNumber"), &nport);
+			*port = ntohs((uint16_t)nport);
+			if (device && *port == LOCKDOWN_PORT) {
+				service = -1;
+			} else if (device && *port >= FIRST_SERVICE_PORT && *port < FIRST_SERVICE_PORT + MAX_SERVICE_PORTS) {
+				mutex_lock(&device->mutex);
+				service = device->ports[*port - FIRST_SERVICE_PORT];
+				mutex_unlock(&device->mutex);
+			}
+			if (service == SERVICE_NONE) {
+				res = mux_send_result(conn, header.tag, device ? MUX_RESULT_CONNREFUSED : MUX_RESULT_BADDEV);
+			} else {
+				res = mux_send_result(conn, header.tag, MUX_RESULT_OK);
+				conn->device = device;
+				plist_free(request);
+				free(payload);
+				return (res == 0) ? service : SERVICE_NONE;
+			}
+		} else {
+			res = mux_send_result(conn, header.tag, MUX_RESULT_BADCOMMAND);
+		}
+		plist_free(request);
+		if (res < 0) {
+			break;
+		}
+	}
+	free(payload);
+	if (listening) {
+		SIM_LOG("Listener disconnected\n");
+	}
+	return SERVICE_NONE;
+}
+
+#ifdef SIM_SSL
+/**
+ * Creates a server context with a throwaway self-signed identity. Clients
+ * do not verify it, but they speak TLSv1 only and offer RSA key exchange,
+ * which current OpenSSL only accepts at security level 0.
+ */
+static SSL_CTX *sim_ssl_ctx_new(void)
+{
+	EVP_PKEY_CTX *key_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, NULL);
+	EVP_PKEY *key = NULL;
+	X509 *cert = NULL;
+	SSL_CTX *ctx = NULL;
+
+	if (!key_ctx || EVP_PKEY_keygen_init(key_ctx) <= 0 || EVP_PKEY_CTX_set_rsa_keygen_bits(key_ctx, 2048) <= 0
+	    || EVP_PKEY_keygen(key_ctx, &key) <= 0) {
+		goto leave;
+	}
+	cert = X509_new();
+	if (!cert) {
+		goto leave;
+	}
+	X509_set_version(cert, 2);
+	ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+	X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+	X509_gmtime_adj(X509_getm_notAfter(cert), 60 * 60 * 24 * 365);
+	X509_set_pubkey(cert, key);
+	X509_NAME_add_entry_by_txt(X509_get_subject_name(cert), "CN", MBSTRING_ASC, (const unsigned char*)"idevicesimulator", -1, -1, 0);
+	X509_set_issuer_name(cert, X509_get_subject_name(cert));
+	if (!X509_sign(cert, key, EVP_sha256())) {
+		goto leave;
+	}
+
+	ctx = SSL_CTX_new(TLS_server_method());
+	if (!ctx || !SSL_CTX_set_min_proto_version(ctx, TLS1_VERSION)
+	    || !SSL_CTX_set_cipher_list(ctx, "AES128-SHA:AES256-SHA:@SECLEVEL=0")
+	    || SSL_CTX_use_certificate(ctx, cert) != 1 || SSL_CTX_use_PrivateKey(ctx, key) != 1) {
+		SSL_CTX_free(ctx);
+		ctx = NULL;
+	}
+
+leave:
+	X509_free(cert);
+	EVP_PKEY_free(key);
+	EVP_PKEY_CTX_free(key_ctx);
+	return ctx;
+}
+
+static int sim_conn_start_ssl(struct sim_conn *conn)
+{
+	conn->ssl = SSL_new(ssl_ctx);
+	if (!conn->ssl || SSL_set_fd(conn->ssl, conn->fd) != 1 || SSL_accept(conn->ssl) != 1) {
+		SIM_LOG("[%s] SSL handshake failed\n", conn->device->udid);
+		return -1;
+	}
+	return 0;
+}
+#endif
+
+static void *client_thread(void *data)
+{
+	struct sim_conn *conn = (struct sim_conn*)data;
+	int port = 0;
+	int service = mux_session(conn, &port);
+
+#ifdef SIM_SSL
+	if (ssl_ctx && service > SERVICE_NONE && sim_conn_start_ssl(conn) < 0) {
+		service = SERVICE_NONE;
+	}
+#endif
+	gettimeofday(&conn->start, NULL);
+	switch (service) {
+	case -1:
+		lockdown_session(conn);
+		break;
+	case SERVICE_AFC:
+		afc_session(conn);
+		break;
+	case SERVICE_INSTPROXY:
+		instproxy_session(conn);
+		break;
+	case SERVICE_MISAGENT:
+		misagent_session(conn);
+		break;
+	case SERVICE_NP:
+		np_session(conn);
+		break;
+	case SERVICE_MOBILEBACKUP2:
+		mobilebackup2_session(conn);
+		break;
+	case SERVICE_SYSLOG_RELAY:
+		syslog_session(conn);
+		break;
+	default:
+		break;
+	}
+
+#ifdef SIM_SSL
+	if (conn->ssl) {
+		SSL_shutdown(conn->ssl);
+		SSL_free(conn->ssl);
+	}
+#endif
+	socket_close(conn->fd);
+	free(conn);
+	return NULL;
+}
+
+static void clean_exit(int sig)
+{
+	fprintf(stderr, "Exiting...\n");
+	quit_flag++;
+}
+
+static void print_usage(int argc, char **argv)
+{
+	char *name = NULL;
+
+	name = strrchr(argv[0], '/');
+	printf("Usage: %s [OPTIONS] DIRECTORY\n", (name ? name + 1: argv[0]));
+	printf("Simulate usbmuxd with attached devices for testing without hardware.\n");
+	printf("Each device stores its AFC media in DIRECTORY/UDID.\n\n");
+	printf("  -s, --socket ADDR\tlisten on ADDR, either UNIX:PATH or a TCP port number\n");
+	printf("\t\t\t(default: UNIX:/tmp/idevicesimulator.sock)\n");
+	printf("  -n, --devices N\tnumber of simulated devices (default: 1)\n");
+	printf("  -l, --latency MS\tdelay every reply by MS milliseconds\n");
+	printf("  -b, --bandwidth KB\tlimit each service connection to KB kilobytes per second\n");
+	printf("  -i, --install-steps N\tprogress updates sent per install (default: 10)\n");
+	printf("  -f, --backup-files N\tfiles in a simulated backup (default: 64)\n");
+	printf("  -z, --backup-file-size KB\tsize of each backup file (default: 4096)\n");
+	printf("  -y, --syslog-lines N\tmessages sent per syslog_relay connection (default: 10000)\n");
+	printf("  -p, --product-version V\treport iOS version V (default: 13.5)\n");
+#ifdef SIM_SSL
+	printf("  -t, --ssl\t\tenable SSL on service connections\n");
+#endif
+	printf("  -v, --verbose\t\tprint connection statistics\n");
+	printf("  -h, --help\t\tprints usage information\n");
+	printf("\n");
+	printf("Point clients to the simulator with USBMUXD_SOCKET_ADDRESS=ADDR.\n");
+	printf("\n");
+	printf("Homepage: <" PACKAGE_URL ">\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *address = "UNIX:/tmp/idevicesimulator.sock";
+	const char *directory = NULL;
+	int server_fd;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if ((!strcmp(argv[i], "-s") || !strcmp(argv[i], "--socket")) && i + 1 < argc) {
+			address = argv[++i];
+		} else if ((!strcmp(argv[i], "-n") || !strcmp(argv[i], "--devices")) && i + 1 < argc) {
+			num_devices = atoi(argv[++i]);
+		} else if ((!strcmp(argv[i], "-l") || !strcmp(argv[i], "--latency")) && i + 1 < argc) {
+			latency_ms = (unsigned int)atoi(argv[++i]);
+		} else if ((!strcmp(argv[i], "-b") || !strcmp(argv[i], "--bandwidth")) && i + 1 < argc) {
+			bandwidth = (uint64_t)strtoull(argv[++i], NULL, 10) * 1000;
+		} else if ((!strcmp(argv[i], "-i") || !strcmp(argv[i], "--install-steps")) && i + 1 < argc) {
+			install_steps = atoi(argv[++i]);
+		} else if ((!strcmp(argv[i], "-f") || !strcmp(argv[i], "--backup-files")) && i + 1 < argc) {
+			backup_files = atoi(argv[++i]);
+		} else if ((!strcmp(argv[i], "-z") || !strcmp(argv[i], "--backup-file-size")) && i + 1 < argc) {
+			backup_file_size = (uint64_t)strtoull(argv[++i], NULL, 10) * 1024;
+		} else if ((!strcmp(argv[i], "-y") || !strcmp(argv[i], "--syslog-lines")) && i + 1 < argc) {
+			syslog_lines = atoi(argv[++i]);
+		} else if ((!strcmp(argv[i], "-p") || !strcmp(argv[i], "--product-version")) && i + 1 < argc) {
+			product_version = argv[++i];
+		} else if (!strcmp(argv[i], "-t") || !strcmp(argv[i], "--ssl")) {
+			service_ssl = 1;
+		} else if (!strcmp(argv[i], "-v") || !strcmp(argv[i], "--verbose")) {
+			verbose = 1;
+		} else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+			print_usage(argc, argv);
+			return 0;
+		} else if (argv[i][0] != '-' && !directory) {
+			directory = argv[i];
+		} else {
+			print_usage(argc, argv);
+			return 1;
+		}
+	}
+	if (!directory || num_devices < 1 || install_steps < 0 || backup_files < 0 || syslog_lines < 0) {
+		print_usage(argc, argv);
+		return 1;
+	}
+
+	if (service_ssl) {
+#ifdef SIM_SSL
+		ssl_ctx = sim_ssl_ctx_new();
+		if (!ssl_ctx) {
+			fprintf(stderr, "ERROR: Could not create the SSL context\n");
+			return 1;
+		}
+#else
+		fprintf(stderr, "ERROR: SSL needs a build with OpenSSL 1.1 or later\n");
+		return 1;
+#endif
+	}
+
+	signal(SIGINT, clean_exit);
+	signal(SIGTERM, clean_exit);
+	signal(SIGPIPE, SIG_IGN);
+
+	system_buid = generate_uuid();
+	backup_pattern = (char*)malloc(MB2_PATTERN_SIZE + MB2_BLOCK_SIZE);
+	srand(1);
+	for (i = 0; i < MB2_PATTERN_SIZE + MB2_BLOCK_SIZE; i++) {
+		backup_pattern[i] = (char)(rand() >> 7);
+	}
+	memcpy(backup_pattern + MB2_PATTERN_SIZE, backup_pattern, MB2_BLOCK_SIZE);
+	devices = (struct sim_device*)calloc(num_devices, sizeof(struct sim_device));
+	for (i = 0; i < num_devices; i++) {
+		devices[i].id = i + 1;
+		snprintf(devices[i].udid, sizeof(devices[i].udid), "00008030-%016X", i + 1);
+		devices[i].root = string_build_path(directory, devices[i].udid, NULL);
+		if (mkdir_with_parents(devices[i].root, 0755) < 0) {
+			fprintf(stderr, "ERROR: Could not create %s: %s\n", devices[i].root, strerror(errno));
+			return 1;
+		}
+		mutex_init(&devices[i].mutex);
+		devices[i].apps = plist_new_dict();
+		devices[i].profiles = plist_new_dict();
+	}
+
+	if (!strncmp(address, "UNIX:", 5)) {
+		server_fd = socket_create_unix(address + 5);
+	} else {
+		server_fd = socket_create((uint16_t)atoi(address));
+	}
+	if (server_fd < 0) {
+		fprintf(stderr, "ERROR: Could not listen on %s\n", address);
+		return 1;
+	}
+	printf("Simulating %d device(s) on %s\n", num_devices, address);
+	fflush(stdout);
+
+	while (!quit_flag) {
+		struct sim_conn *conn;
+		thread_t thread;
+		int fd;
+
+		if (socket_check_fd(server_fd, FDM_READ, 1000) <= 0) {
+			continue;
+		}
+		fd = accept(server_fd, NULL, NULL);
+		if (fd < 0) {
+			continue;
+		}
+		conn = (struct sim_conn*)calloc(1, sizeof(struct sim_conn));
+		conn->fd = fd;
+		gettimeofday(&conn->start, NULL);
+		if (thread_new(&thread, client_thread, conn) != 0) {
+			socket_close(fd);
+			free(conn);
+			continue;
+		}
+		thread_free(thread);
+	}
+
+	socket_close(server_fd);
+	if (!strncmp(address, "UNIX:", 5)) {
+		unlink(address + 5);
+	}
+	for (i = 0; i < num_devices; i++) {
+		plist_free(devices[i].apps);
+		plist_free(devices[i].profiles);
+		mutex_destroy(&devices[i].mutex);
+		free(devices[i].root);
+	}
+	free(devices);
+	free(system_buid);
+	free(backup_pattern);
+#ifdef SIM_SSL
+	SSL_CTX_free(ssl_ctx);
+#endif
+
+	return 0;
+}
@@ -98,6 +98,17 @@ extern "C"
      */
     typedef void* plist_array_iter;
 
+    /**
+     * Callback used by the streaming export functions to hand out
+     * serialized data as it is produced.
+     *
+     * @param data the next chunk of output. Only valid during the call.
+     * @param length the size of data in bytes
+     * @param user_data the pointer that was passed to the export function
+     * @return 0 to continue, or a negative value to abort the export.
+     */
+    typedef int (*plist_write_cb_t)(const char *data, uint32_t length, void *user_data);
+
     /**
      * The enumeration of plist node types.
      */
@@ -462,6 +473,17 @@ extern "C"
      */
     void plist_get_string_val(plist_t node, char **val);
 
+    /**
+     * Get a pointer to the value of a #PLIST_STRING node without copying it.
+     *
+     * @param node the node
+     * @param length if not NULL, receives the length of the string in bytes
+     * @return the UTF-8 encoded, NUL terminated string, or NULL if node is
+     *         not of type #PLIST_STRING. It stays valid until the node is
+     *         freed or its value is changed.
+     */
+    const char* plist_get_string_ptr(plist_t node, uint64_t* length);
+
     /**
      * Get the value of a #PLIST_BOOLEAN node.
      * This function does nothing if node is not of type #PLIST_BOOLEAN
@@ -500,6 +522,17 @@ extern "C"
      */
     void plist_get_data_val(plist_t node, char **val, uint64_t * length);
 
+    /**
+     * Get a pointer to the value of a #PLIST_DATA node without copying it.
+     *
+     * @param node the node
+     * @param length receives the length of the data
+     * @return a pointer to the data, or NULL if node is not of type
+     *         #PLIST_DATA. It stays valid until the node is freed or its
+     *         value is changed.
+     */
+    const char* plist_get_data_ptr(plist_t node, uint64_t* length);
+
     /**
      * Get the value of a #PLIST_DATE node.
      * This function does nothing if node is not of type #PLIST_DATE
@@ -619,6 +652,20 @@ extern "C"
      */
     void plist_to_xml(plist_t plist, char **plist_xml, uint32_t * length);
 
+    /**
+     * Export the #plist_t structure to XML format, passing the output to
+     * a callback in chunks instead of building it in one buffer.
+     *
+     * @param plist the root node to export
+     * @param write_cb the callback that receives the XML data.
+     * @param user_data user data passed to write_cb
+     * @param length if not NULL, receives the total size of the output.
+     *            It is set before write_cb is called for the first time,
+     *            so write_cb can use it e.g. to send a length prefix.
+     * @return 0 on success, -1 if write_cb is NULL or aborted the export.
+     */
+    int plist_to_xml_cb(plist_t plist, plist_write_cb_t write_cb, void *user_data, uint32_t *length);
+
     /**
      * Export the #plist_t structure to binary format.
      *
@@ -629,6 +676,23 @@ extern "C"
      */
     void plist_to_bin(plist_t plist, char **plist_bin, uint32_t * length);
 
+    /**
+     * Export the #plist_t structure to binary format, passing the output to
+     * a callback in chunks instead of building it in one buffer. Apart from
+     * the object offset table, memory use does not depend on the size of
+     * the output.
+     *
+     * @param plist the root node to export
+     * @param write_cb the callback that receives the binary data.
+     * @param user_data user data passed to write_cb
+     * @param length if not NULL, receives the total size of the output.
+     *            It is set before write_cb is called for the first time,
+     *            so write_cb can use it e.g. to send a length prefix.
+     * @return 0 on success, -1 if plist or write_cb is NULL or write_cb
+     *            aborted the export.
+     */
+    int plist_to_bin_cb(plist_t plist, plist_write_cb_t write_cb, void *user_data, uint32_t *length);
+
     /**
      * Import the #plist_t structure from XML format.
      *
@@ -647,6 +711,23 @@ extern "C"
      */
     void plist_from_bin(const char *plist_bin, uint32_t length, plist_t * plist);
 
+    /**
+     * Import the #plist_t structure from binary format without copying
+     * string and data payloads out one by one.
+     * #PLIST_DATA nodes reference their bytes in plist_bin directly, and
+     * all strings share one allocation that is released together with the
+     * last node using it.
+     * plist_bin must stay valid and unchanged until the imported nodes
+     * have been freed. Nodes created by plist_copy() and values replaced
+     * with the plist_set_*_val() functions own their memory and do not
+     * depend on plist_bin.
+     *
+     * @param plist_bin a pointer to the binary plist buffer.
+     * @param length length of the buffer to read.
+     * @param plist a pointer to the imported plist.
+     */
+    void plist_from_bin_nocopy(const char *plist_bin, uint32_t length, plist_t * plist);
+
     /**
      * Import the #plist_t structure from memory data.
      * This method will look at the first bytes of plist_data
@@ -658,6 +739,17 @@ extern "C"
      */
     void plist_from_memory(const char *plist_data, uint32_t length, plist_t * plist);
 
+    /**
+     * Like plist_from_memory(), but binary plists are imported with
+     * plist_from_bin_nocopy(), so the same lifetime rules apply to
+     * plist_data. XML plists are imported normally.
+     *
+     * @param plist_data a pointer to the memory buffer containing plist data.
+     * @param length length of the buffer to read.
+     * @param plist a pointer to the imported plist.
+     */
+    void plist_from_memory_nocopy(const char *plist_data, uint32_t length, plist_t * plist);
+
     /**
      * Test if in-memory plist data is binary or XML
      * This method will look at the first bytes of plist_data
@@ -708,6 +800,29 @@ extern "C"
      */
     char plist_compare_node_value(plist_t node_l, plist_t node_r);
 
+    /**
+     * Base64-encode a buffer, using the same encoder as the XML export.
+     *
+     * @param outbuf buffer that receives the 0-terminated encoded string.
+     *            It must be at least ((size + 2) / 3) * 4 + 1 bytes large.
+     * @param buf the data to encode
+     * @param size the number of bytes in buf
+     * @return the length of the encoded string, without the terminator.
+     */
+    size_t plist_base64_encode(char *outbuf, const void *buf, size_t size);
+
+    /**
+     * Decode a base64 string, using the same decoder as the XML import.
+     * Whitespace and characters outside of the base64 alphabet are skipped.
+     *
+     * @param buf the string to decode
+     * @param size on input the length of buf, or 0 if buf is 0-terminated.
+     *            On output the number of decoded bytes.
+     * @return the decoded data, or NULL on error. The buffer is
+     *            0-terminated, and the caller is responsible for freeing it.
+     */
+    void* plist_base64_decode(const char *buf, size_t *size);
+
     #define _PLIST_IS_TYPE(__plist, __plist_type) (__plist && (plist_get_node_type(__plist) == PLIST_##__plist_type))
 
     /* Helper macros for the different plist types */
@@ -30,11 +30,9 @@
 
 struct node_list_t;
 
-// This class implements the abstract iterator class
 typedef struct node_t {
-	// Super class
-	struct node_t* next;
-	struct node_t* prev;
+	// Position of this node in parent->children
+	unsigned int index;
 	unsigned int count;
 
 	// Local Members
@@ -53,6 +51,7 @@ int node_insert(struct node_t* parent, unsigned int index, struct node_t* child)
 unsigned int node_n_children(struct node_t* node);
 node_t* node_nth_child(struct node_t* node, unsigned int n);
 node_t* node_first_child(struct node_t* node);
+node_t* node_last_child(struct node_t* node);
 node_t* node_prev_sibling(struct node_t* node);
 node_t* node_next_sibling(struct node_t* node);
 int node_child_position(struct node_t* parent, node_t* child);
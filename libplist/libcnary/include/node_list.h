@@ -26,15 +26,12 @@
 
 struct node_t;
 
-// This class implements the list_t abstract class
+// Contiguous vector of child nodes; each child stores its own position
+// in node_t.index so that lookups in both directions are O(1)
 typedef struct node_list_t {
-	// list_t members
-	struct node_t* begin;
-	struct node_t* end;
-
-	// node_list_t members
+	struct node_t** items;
 	unsigned int count;
-
+	unsigned int capacity;
 } node_list_t;
 
 void node_list_destroy(struct node_list_t* list);
@@ -43,5 +40,6 @@ struct node_list_t* node_list_create();
 int node_list_add(node_list_t* list, node_t* node);
 int node_list_insert(node_list_t* list, unsigned int index, node_t* node);
 int node_list_remove(node_list_t* list, node_t* node);
+int node_list_index(node_list_t* list, node_t* node);
 
 #endif /* NODE_LIST_H_ */
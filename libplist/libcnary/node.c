@@ -30,11 +30,10 @@
 void node_destroy(node_t* node) {
 	if(!node) return;
 
-	if (node->children && node->children->count > 0) {
-		node_t* ch;
-		while ((ch = node->children->begin)) {
-			node_list_remove(node->children, ch);
-			node_destroy(ch);
+	if (node->children) {
+		unsigned int i;
+		for (i = 0; i < node->children->count; i++) {
+			node_destroy(node->children->items[i]);
 		}
 	}
 	node_list_destroy(node->children);
@@ -53,8 +52,7 @@ node_t* node_create(node_t* parent, void* data) {
 	memset(node, '\0', sizeof(node_t));
 
 	node->data = data;
-	node->next = NULL;
-	node->prev = NULL;
+	node->index = 0;
 	node->count = 0;
 	node->parent = NULL;
 	node->children = NULL;
@@ -146,57 +144,41 @@ unsigned int node_n_children(struct node_t* node)
 
 node_t* node_nth_child(struct node_t* node, unsigned int n)
 {
-	if (!node || !node->children || !node->children->begin) return NULL;
-	unsigned int node_index = 0;
-	int found = 0;
-	node_t *ch;
-	for (ch = node_first_child(node); ch; ch = node_next_sibling(ch)) {
-		if (node_index++ == n) {
-			found = 1;
-			break;
-		}
-	}
-	if (!found) {
-		return NULL;
-	}
-	return ch;
+	if (!node || !node->children || n >= node->children->count) return NULL;
+	return node->children->items[n];
 }
 
 node_t* node_first_child(struct node_t* node)
 {
-	if (!node || !node->children) return NULL;
-	return node->children->begin;
+	return node_nth_child(node, 0);
+}
+
+node_t* node_last_child(struct node_t* node)
+{
+	if (!node || !node->children || node->children->count == 0) return NULL;
+	return node->children->items[node->children->count - 1];
 }
 
 node_t* node_prev_sibling(struct node_t* node)
 {
-	if (!node) return NULL;
-	return node->prev;
+	if (!node || !node->parent || node->index == 0) return NULL;
+	node_list_t* siblings = node->parent->children;
+	if (!siblings || node->index >= siblings->count || siblings->items[node->index] != node) return NULL;
+	return siblings->items[node->index - 1];
 }
 
 node_t* node_next_sibling(struct node_t* node)
 {
-	if (!node) return NULL;
-	return node->next;
+	if (!node || !node->parent) return NULL;
+	node_list_t* siblings = node->parent->children;
+	if (!siblings || node->index + 1 >= siblings->count || siblings->items[node->index] != node) return NULL;
+	return siblings->items[node->index + 1];
 }
 
 int node_child_position(struct node_t* parent, node_t* child)
 {
-	if (!parent || !parent->children || !parent->children->begin || !child) return -1;
-	int node_index = 0;
-	int found = 0;
-	node_t *ch;
-	for (ch = node_first_child(parent); ch; ch = node_next_sibling(ch)) {
-		if (ch == child) {
-			found = 1;
-			break;
-		}
-		node_index++;
-	}
-	if (!found) {
-		return -1;
-	}
-	return node_index;
+	if (!parent || !child) return -1;
+	return node_list_index(parent->children, child);
 }
 
 node_t* node_copy_deep(node_t* node, copy_func_t copy_func)
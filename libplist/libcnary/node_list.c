@@ -28,7 +28,11 @@
 #include "node.h"
 #include "node_list.h"
 
+#define NODE_LIST_INITIAL_CAPACITY 4
+
 void node_list_destroy(node_list_t* list) {
+	if (!list) return;
+	free(list->items);
 	free(list);
 }
 
@@ -40,36 +44,42 @@ node_list_t* node_list_create() {
 	memset(list, '\0', sizeof(node_list_t));
 
 	// Initialize structure
-	list->begin = NULL;
-	list->end = NULL;
+	list->items = NULL;
 	list->count = 0;
+	list->capacity = 0;
 	return list;
 }
 
-int node_list_add(node_list_t* list, node_t* node) {
-	if (!list || !node) return -1;
+static int node_list_grow(node_list_t* list) {
+	if (list->count < list->capacity) return 0;
 
-	// Find the last element in the list
-	node_t* last = list->end;
+	unsigned int capacity = (list->capacity) ? list->capacity * 2 : NODE_LIST_INITIAL_CAPACITY;
+	if (capacity <= list->capacity) return -1;
 
-	// Setup our new node as the new last element
-	node->next = NULL;
-	node->prev = last;
+	node_t** items = (node_t**) realloc(list->items, capacity * sizeof(node_t*));
+	if (items == NULL) {
+		return -1;
+	}
+	list->items = items;
+	list->capacity = capacity;
+	return 0;
+}
 
-	// Set the next element of our old "last" element
-	if (last) {
-		// but only if the node list is not empty
-		last->next = node;
-	} else {
-		// otherwise this is the start of the list
-		list->begin = node;
+// Renumber the nodes in [from, count) after they have been shifted
+static void node_list_reindex(node_list_t* list, unsigned int from) {
+	unsigned int i;
+	for (i = from; i < list->count; i++) {
+		list->items[i]->index = i;
 	}
+}
 
-	// Set the lists prev to the new last element
-	list->end = node;
+int node_list_add(node_list_t* list, node_t* node) {
+	if (!list || !node) return -1;
+	if (node_list_grow(list) < 0) return -1;
 
-	// Increment our node count for this list
-	list->count++;
+	// Append our new node as the new last element
+	node->index = list->count;
+	list->items[list->count++] = node;
 	return 0;
 }
 
@@ -78,78 +88,31 @@ int node_list_insert(node_list_t* list, unsigned int node_index, node_t* node) {
 	if (node_index >= list->count) {
 		return node_list_add(list, node);
 	}
+	if (node_list_grow(list) < 0) return -1;
 
-	// Get the first element in the list
-	node_t* cur = list->begin;
-
-	unsigned int pos = 0;
-	node_t* prev = NULL;
-
-	if (node_index > 0) {
-		while (pos < node_index) {
-			prev = cur;
-			cur = cur->next;
-			pos++;
-		}
-	}
-
-	if (prev) {
-		// Set previous node
-		node->prev = prev;
-		// Set next node of our new node to next node of the previous node
-		node->next = prev->next;
-		// Set next node of previous node to our new node
-		prev->next = node;
-	} else {
-		node->prev = NULL;
-		// get old first element in list
-		node->next = list->begin;
-		// set new node as first element in list
-		list->begin = node;
-	}
-
-	if (node->next == NULL) {
-		// Set the lists prev to the new last element
-		list->end = node;
-	} else {
-		// set prev of the new next element to our node
-		node->next->prev = node;
-	}
-
-	// Increment our node count for this list
+	// Move everything from node_index on one slot up and renumber it
+	memmove(&list->items[node_index + 1], &list->items[node_index], (list->count - node_index) * sizeof(node_t*));
+	list->items[node_index] = node;
 	list->count++;
+	node_list_reindex(list, node_index);
 	return 0;
 }
 
-int node_list_remove(node_list_t* list, node_t* node) {
+int node_list_index(node_list_t* list, node_t* node) {
 	if (!list || !node) return -1;
-	if (list->count == 0) return -1;
-
-	int node_index = 0;
-	node_t* n;
-	for (n = list->begin; n; n = n->next) {
-		if (node == n) {
-			node_t* newnode = node->next;
-			if (node->prev) {
-				node->prev->next = newnode;
-				if (newnode) {
-					newnode->prev = node->prev;
-				} else {
-					// last element in the list
-					list->end = node->prev;
-				}
-			} else {
-				// we just removed the first element
-				if (newnode) {
-					newnode->prev = NULL;
-				}
-				list->begin = newnode;
-			}
-			list->count--;
-			return node_index;
-		}
-		node_index++;
-	}	
-	return -1;
+	if (node->index >= list->count || list->items[node->index] != node) {
+		// node is not (or no longer) part of this list
+		return -1;
+	}
+	return (int)node->index;
 }
 
+int node_list_remove(node_list_t* list, node_t* node) {
+	int node_index = node_list_index(list, node);
+	if (node_index < 0) return -1;
+
+	list->count--;
+	memmove(&list->items[node_index], &list->items[node_index + 1], (list->count - node_index) * sizeof(node_t*));
+	node_list_reindex(list, node_index);
+	return node_index;
+}
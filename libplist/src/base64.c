@@ -19,6 +19,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 #include <string.h>
+#include "plist.h"
 #include "base64.h"
 
 static const char base64_str[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
@@ -43,6 +44,71 @@ static const signed char base64_table[256] = {
 	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
 };
 
+#if defined(__SSSE3__) || defined(__AVX__)
+#include <tmmintrin.h>
+#define BASE64_SSSE3
+#endif
+
+#ifdef BASE64_SSSE3
+/* SSSE3 code paths based on the algorithms described by Wojciech Muła,
+ * see http://0x80.pl/notesen/2016-01-12-sse-base64-encoding.html and
+ * http://0x80.pl/notesen/2016-01-17-sse-base64-decoding.html */
+
+/* encodes the first 12 bytes of in to 16 characters */
+static inline __m128i base64_encode12(__m128i in)
+{
+	const __m128i lut = _mm_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+	__m128i t0, t1, t2, t3, indices, mask;
+
+	/* split the 3 byte groups into 4 6-bit values, one per byte */
+	in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+	t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+	t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+	t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+	t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+	in = _mm_or_si128(t1, t3);
+
+	/* map the 6-bit values to the alphabet */
+	indices = _mm_subs_epu8(in, _mm_set1_epi8(51));
+	mask = _mm_cmpgt_epi8(in, _mm_set1_epi8(25));
+	indices = _mm_sub_epi8(indices, mask);
+	return _mm_add_epi8(in, _mm_shuffle_epi8(lut, indices));
+}
+
+/* decodes 16 characters to 12 bytes. Returns 0 without writing anything
+ * if any of the characters is not part of the alphabet. */
+static inline int base64_decode16(const unsigned char *in, unsigned char *out)
+{
+	const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+	const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i mask_2F = _mm_set1_epi8(0x2f);
+	unsigned char tmp[16];
+	__m128i str, hi_nibbles, lo_nibbles, hi, lo, roll;
+
+	str = _mm_loadu_si128((const __m128i*)in);
+	hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask_2F);
+	lo_nibbles = _mm_and_si128(str, mask_2F);
+	hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+	lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+	if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0xFFFF) {
+		return 0;
+	}
+
+	/* map the alphabet to 6-bit values */
+	roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(_mm_cmpeq_epi8(str, mask_2F), hi_nibbles));
+	str = _mm_add_epi8(str, roll);
+
+	/* pack 4 6-bit values into 3 bytes */
+	str = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+	str = _mm_madd_epi16(str, _mm_set1_epi32(0x00011000));
+	str = _mm_shuffle_epi8(str, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+	_mm_storeu_si128((__m128i*)tmp, str);
+	memcpy(out, tmp, 12);
+	return 1;
+}
+#endif
+
 size_t base64encode(char *outbuf, const unsigned char *buf, size_t size)
 {
 	if (!outbuf || !buf || (size <= 0)) {
@@ -51,21 +117,33 @@ size_t base64encode(char *outbuf, const unsigned char *buf, size_t size)
 
 	size_t n = 0;
 	size_t m = 0;
-	unsigned char input[3];
-	unsigned int output[4];
-	while (n < size) {
-		input[0] = buf[n];
-		input[1] = (n+1 < size) ? buf[n+1] : 0;
-		input[2] = (n+2 < size) ? buf[n+2] : 0;
-		output[0] = input[0] >> 2;
-		output[1] = ((input[0] & 3) << 4) + (input[1] >> 4);
-		output[2] = ((input[1] & 15) << 2) + (input[2] >> 6);
-		output[3] = input[2] & 63;
-		outbuf[m++] = base64_str[(int)output[0]];
-		outbuf[m++] = base64_str[(int)output[1]];
-		outbuf[m++] = (n+1 < size) ? base64_str[(int)output[2]] : base64_pad;
-		outbuf[m++] = (n+2 < size) ? base64_str[(int)output[3]] : base64_pad;
-		n+=3;
+	unsigned int v;
+#ifdef BASE64_SSSE3
+	/* 16 bytes are loaded, 12 are consumed */
+	while (size - n >= 16) {
+		__m128i in = _mm_loadu_si128((const __m128i*)(buf + n));
+		_mm_storeu_si128((__m128i*)(outbuf + m), base64_encode12(in));
+		n += 12;
+		m += 16;
+	}
+#endif
+	while (size - n >= 3) {
+		v = (buf[n] << 16) | (buf[n+1] << 8) | buf[n+2];
+		outbuf[m++] = base64_str[v >> 18];
+		outbuf[m++] = base64_str[(v >> 12) & 63];
+		outbuf[m++] = base64_str[(v >> 6) & 63];
+		outbuf[m++] = base64_str[v & 63];
+		n += 3;
+	}
+	if (n < size) {
+		v = buf[n] << 16;
+		if (n+1 < size) {
+			v |= buf[n+1] << 8;
+		}
+		outbuf[m++] = base64_str[v >> 18];
+		outbuf[m++] = base64_str[(v >> 12) & 63];
+		outbuf[m++] = (n+1 < size) ? base64_str[(v >> 6) & 63] : base64_pad;
+		outbuf[m++] = base64_pad;
 	}
 	outbuf[m] = 0; // 0-termination!
 	return m;
@@ -77,20 +155,50 @@ unsigned char *base64decode(const char *buf, size_t *size)
 	size_t len = (*size > 0) ? *size : strlen(buf);
 	if (len <= 0) return NULL;
 	unsigned char *outbuf = (unsigned char*)malloc((len/4)*3+3);
-	const char *ptr = buf;
-	int p = 0;
+	const unsigned char *ptr = (const unsigned char*)buf;
+	const unsigned char *end = ptr + len;
+	size_t p = 0;
 	int wv, w1, w2, w3, w4;
 	int tmpval[4];
 	int tmpcnt = 0;
 
-	do {
-		while (ptr < buf+len && (*ptr == ' ' || *ptr == '\t' || *ptr == '\n' || *ptr == '\r')) {
+	while (ptr < end) {
+		if (tmpcnt == 0) {
+			/* fast path for runs of complete 4 character groups that
+			 * only contain characters from the alphabet */
+#ifdef BASE64_SSSE3
+			while (end - ptr >= 16 && base64_decode16(ptr, outbuf + p)) {
+				ptr += 16;
+				p += 12;
+			}
+#endif
+			while (end - ptr >= 4) {
+				w1 = base64_table[ptr[0]];
+				w2 = base64_table[ptr[1]];
+				w3 = base64_table[ptr[2]];
+				w4 = base64_table[ptr[3]];
+				if ((w1 | w2 | w3 | w4) < 0) {
+					break;
+				}
+				wv = (w1 << 18) | (w2 << 12) | (w3 << 6) | w4;
+				outbuf[p++] = (unsigned char)(wv >> 16);
+				outbuf[p++] = (unsigned char)(wv >> 8);
+				outbuf[p++] = (unsigned char)wv;
+				ptr += 4;
+			}
+			if (ptr >= end) {
+				break;
+			}
+		}
+		/* whitespace, padding, invalid characters and incomplete groups */
+		if (*ptr == ' ' || *ptr == '\t' || *ptr == '\n' || *ptr == '\r') {
 			ptr++;
+			continue;
 		}
-		if (*ptr == '\0' || ptr >= buf+len) {
+		if (*ptr == '\0') {
 			break;
 		}
-		if ((wv = base64_table[(int)(unsigned char)*ptr++]) == -1) {
+		if ((wv = base64_table[*ptr++]) == -1) {
 			continue;
 		}
 		tmpval[tmpcnt++] = wv;
@@ -111,9 +219,19 @@ unsigned char *base64decode(const char *buf, size_t *size)
 				outbuf[p++] = (unsigned char)(((w3 << 6) + w4) & 0xFF);
 			}
 		}
-	} while (1);
+	}
 
 	outbuf[p] = 0;
 	*size = p;
 	return outbuf;
 }
+
+PLIST_API size_t plist_base64_encode(char *outbuf, const void *buf, size_t size)
+{
+	return base64encode(outbuf, (const unsigned char*)buf, size);
+}
+
+PLIST_API void* plist_base64_decode(const char *buf, size_t *size)
+{
+	return base64decode(buf, size);
+}
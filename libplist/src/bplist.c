@@ -202,6 +202,7 @@ struct bplist_data {
     const char* offset_table;
     uint32_t level;
     plist_t used_indexes;
+    plist_backing_t backing;
 };
 
 #ifdef DEBUG
@@ -296,12 +297,18 @@ static plist_t parse_date_node(const char **bnode, uint8_t size)
     return node;
 }
 
-static plist_t parse_string_node(const char **bnode, uint64_t size)
+static plist_t parse_string_node(struct bplist_data *bplist, const char **bnode, uint64_t size)
 {
     plist_data_t data = plist_new_plist_data();
 
     data->type = PLIST_STRING;
-    data->strval = (char *) malloc(sizeof(char) * (size + 1));
+    if (bplist->backing) {
+        data->strval = plist_backing_alloc(bplist->backing, size + 1);
+        if (data->strval)
+            data->backing = plist_backing_retain(bplist->backing);
+    } else {
+        data->strval = (char *) malloc(sizeof(char) * (size + 1));
+    }
     if (!data->strval) {
         plist_free_data(data);
         PLIST_BIN_ERR("%s: Could not allocate %" PRIu64 " bytes\n", __func__, sizeof(char) * (size + 1));
@@ -314,23 +321,17 @@ static plist_t parse_string_node(const char **bnode, uint64_t size)
     return node_create(NULL, data);
 }
 
-static char *plist_utf16be_to_utf8(uint16_t *unistr, long len, long *items_read, long *items_written)
+/* Converts len UTF-16BE code units to UTF-8 and returns the number of bytes
+ * produced. With outbuf == NULL the bytes are only counted. */
+static long utf16be_to_utf8(uint16_t *unistr, long len, char *outbuf, long *items_read)
 {
-	if (!unistr || (len <= 0)) return NULL;
-	char *outbuf;
-	int p = 0;
+	long p = 0;
 	long i = 0;
 
 	uint16_t wc;
-	uint32_t w;
+	uint32_t w = 0;
 	int read_lead_surrogate = 0;
 
-	outbuf = (char*)malloc(4*(len+1));
-	if (!outbuf) {
-		PLIST_BIN_ERR("%s: Could not allocate %" PRIu64 " bytes\n", __func__, (uint64_t)(4*(len+1)));
-		return NULL;
-	}
-
 	while (i < len) {
 		wc = be16toh(get_unaligned(unistr + i));
 		i++;
@@ -347,66 +348,90 @@ static char *plist_utf16be_to_utf8(uint16_t *unistr, long len, long *items_read,
 			if (read_lead_surrogate) {
 				read_lead_surrogate = 0;
 				w = w | (wc & 0x3FF);
-				outbuf[p++] = (char)(0xF0 + ((w >> 18) & 0x7));
-				outbuf[p++] = (char)(0x80 + ((w >> 12) & 0x3F));
-				outbuf[p++] = (char)(0x80 + ((w >> 6) & 0x3F));
-				outbuf[p++] = (char)(0x80 + (w & 0x3F));
+				if (outbuf) {
+					outbuf[p] = (char)(0xF0 + ((w >> 18) & 0x7));
+					outbuf[p+1] = (char)(0x80 + ((w >> 12) & 0x3F));
+					outbuf[p+2] = (char)(0x80 + ((w >> 6) & 0x3F));
+					outbuf[p+3] = (char)(0x80 + (w & 0x3F));
+				}
+				p += 4;
 			} else {
 				// This is invalid.  A trail surrogate should always follow a lead surrogate.
 				// Handling error by skipping
 			}
 		} else if (wc >= 0x800) {
-			outbuf[p++] = (char)(0xE0 + ((wc >> 12) & 0xF));
-			outbuf[p++] = (char)(0x80 + ((wc >> 6) & 0x3F));
-			outbuf[p++] = (char)(0x80 + (wc & 0x3F));
+			if (outbuf) {
+				outbuf[p] = (char)(0xE0 + ((wc >> 12) & 0xF));
+				outbuf[p+1] = (char)(0x80 + ((wc >> 6) & 0x3F));
+				outbuf[p+2] = (char)(0x80 + (wc & 0x3F));
+			}
+			p += 3;
 		} else if (wc >= 0x80) {
-			outbuf[p++] = (char)(0xC0 + ((wc >> 6) & 0x1F));
-			outbuf[p++] = (char)(0x80 + (wc & 0x3F));
+			if (outbuf) {
+				outbuf[p] = (char)(0xC0 + ((wc >> 6) & 0x1F));
+				outbuf[p+1] = (char)(0x80 + (wc & 0x3F));
+			}
+			p += 2;
 		} else {
-			outbuf[p++] = (char)(wc & 0x7F);
+			if (outbuf) {
+				outbuf[p] = (char)(wc & 0x7F);
+			}
+			p++;
 		}
 	}
 	if (items_read) {
 		*items_read = i;
 	}
-	if (items_written) {
-		*items_written = p;
-	}
-	outbuf[p] = 0;
 
-	return outbuf;
+	return p;
 }
 
-static plist_t parse_unicode_node(const char **bnode, uint64_t size)
+static plist_t parse_unicode_node(struct bplist_data *bplist, const char **bnode, uint64_t size)
 {
     plist_data_t data = plist_new_plist_data();
-    char *tmpstr = NULL;
-    long items_read = 0;
     long items_written = 0;
 
     data->type = PLIST_STRING;
 
-    tmpstr = plist_utf16be_to_utf8((uint16_t*)(*bnode), size, &items_read, &items_written);
-    if (!tmpstr) {
+    if (size == 0) {
         plist_free_data(data);
         return NULL;
     }
-    tmpstr[items_written] = '\0';
 
-    data->type = PLIST_STRING;
-    data->strval = realloc(tmpstr, items_written+1);
-    if (!data->strval)
-        data->strval = tmpstr;
+    /* measure first so the string can be stored with its exact length */
+    items_written = utf16be_to_utf8((uint16_t*)(*bnode), size, NULL, NULL);
+    if (bplist->backing) {
+        data->strval = plist_backing_alloc(bplist->backing, items_written + 1);
+        if (data->strval)
+            data->backing = plist_backing_retain(bplist->backing);
+    } else {
+        data->strval = (char *) malloc(items_written + 1);
+    }
+    if (!data->strval) {
+        plist_free_data(data);
+        PLIST_BIN_ERR("%s: Could not allocate %" PRIu64 " bytes\n", __func__, (uint64_t)(items_written + 1));
+        return NULL;
+    }
+    utf16be_to_utf8((uint16_t*)(*bnode), size, data->strval, NULL);
+    data->strval[items_written] = '\0';
     data->length = items_written;
+
     return node_create(NULL, data);
 }
 
-static plist_t parse_data_node(const char **bnode, uint64_t size)
+static plist_t parse_data_node(struct bplist_data *bplist, const char **bnode, uint64_t size)
 {
     plist_data_t data = plist_new_plist_data();
 
     data->type = PLIST_DATA;
     data->length = size;
+    if (bplist->backing) {
+        /* reference the bytes in the caller's buffer */
+        data->buff = (uint8_t *) *bnode;
+        data->backing = plist_backing_retain(bplist->backing);
+        return node_create(NULL, data);
+    }
+
     data->buff = (uint8_t *) malloc(sizeof(uint8_t) * size);
     if (!data->strval) {
         plist_free_data(data);
@@ -664,14 +689,14 @@ static plist_t parse_bin_node(struct bplist_data *bplist, const char** object)
             PLIST_BIN_ERR("%s: BPLIST_DATA data bytes point outside of valid range\n", __func__);
             return NULL;
         }
-        return parse_data_node(object, size);
+        return parse_data_node(bplist, object, size);
 
     case BPLIST_STRING:
         if (pobject + size < pobject || pobject + size > poffset_table) {
             PLIST_BIN_ERR("%s: BPLIST_STRING data bytes point outside of valid range\n", __func__);
             return NULL;
         }
-        return parse_string_node(object, size);
+        return parse_string_node(bplist, object, size);
 
     case BPLIST_UNICODE:
         if (size*2 < size) {
@@ -682,7 +707,7 @@ static plist_t parse_bin_node(struct bplist_data *bplist, const char** object)
             PLIST_BIN_ERR("%s: BPLIST_UNICODE data bytes point outside of valid range\n", __func__);
             return NULL;
         }
-        return parse_unicode_node(object, size);
+        return parse_unicode_node(bplist, object, size);
 
     case BPLIST_SET:
     case BPLIST_ARRAY:
@@ -767,7 +792,7 @@ static plist_t parse_bin_node_at_index(struct bplist_data *bplist, uint32_t node
     return plist;
 }
 
-PLIST_API void plist_from_bin(const char *plist_bin, uint32_t length, plist_t * plist)
+static void parse_bin(const char *plist_bin, uint32_t length, plist_t * plist, plist_backing_t backing)
 {
     bplist_trailer_t *trailer = NULL;
     uint8_t offset_size = 0;
@@ -851,6 +876,7 @@ PLIST_API void plist_from_bin(const char *plist_bin, uint32_t length, plist_t *
     bplist.offset_table = offset_table;
     bplist.level = 0;
     bplist.used_indexes = plist_new_array();
+    bplist.backing = backing;
 
     if (!bplist.used_indexes) {
         PLIST_BIN_ERR("failed to create array to hold used node indexes. Out of memory?\n");
@@ -862,6 +888,23 @@ PLIST_API void plist_from_bin(const char *plist_bin, uint32_t length, plist_t *
     plist_free(bplist.used_indexes);
 }
 
+PLIST_API void plist_from_bin(const char *plist_bin, uint32_t length, plist_t * plist)
+{
+    parse_bin(plist_bin, length, plist, NULL);
+}
+
+PLIST_API void plist_from_bin_nocopy(const char *plist_bin, uint32_t length, plist_t * plist)
+{
+    plist_backing_t backing = plist_backing_new();
+    if (!backing) {
+        PLIST_BIN_ERR("failed to allocate backing store. Out of memory?\n");
+        return;
+    }
+    parse_bin(plist_bin, length, plist, backing);
+    /* the parsed nodes hold their own references */
+    plist_backing_release(backing);
+}
+
 static unsigned int plist_data_hash(const void* key)
 {
     plist_data_t data = plist_get_data((plist_t) key);
@@ -947,7 +990,51 @@ static void serialize_plist(node_t* node, void* data)
 
 #define Log2(x) (x == 8 ? 3 : (x == 4 ? 2 : (x == 2 ? 1 : 0)))
 
-static void write_int(bytearray_t * bplist, uint64_t val)
+#define BPLIST_WRITE_CHUNK_SIZE 16384
+
+/* Output state for the binary writer. With measure set, nothing is written
+ * and only total is advanced. Without a write_cb, buf receives the whole
+ * output; with a write_cb, buf is a scratch buffer that gets flushed to the
+ * callback whenever it is full. */
+typedef struct {
+    bytearray_t *buf;
+    uint64_t total;
+    int measure;
+    plist_write_cb_t write_cb;
+    void *user_data;
+    int err;
+} bplist_writer_t;
+
+static void bplist_writer_flush(bplist_writer_t *w)
+{
+    if (w->buf->len > 0 && !w->err) {
+        if (w->write_cb((const char*)w->buf->data, (uint32_t)w->buf->len, w->user_data) < 0) {
+            w->err = 1;
+        }
+    }
+    w->buf->len = 0;
+}
+
+static void bplist_writer_append(bplist_writer_t *w, const void *data, size_t len)
+{
+    w->total += len;
+    if (w->measure) {
+        return;
+    }
+    if (w->write_cb && len > w->buf->capacity - w->buf->len) {
+        bplist_writer_flush(w);
+        if (len > w->buf->capacity) {
+            /* larger than the scratch buffer, pass it through directly */
+            if (!w->err && w->write_cb((const char*)data, (uint32_t)len, w->user_data) < 0) {
+                w->err = 1;
+            }
+            return;
+        }
+    }
+    byte_array_append(w->buf, (void*)data, len);
+}
+
+static void write_int(bplist_writer_t *bplist, uint64_t val)
 {
     int size = get_needed_bytes(val);
     uint8_t sz;
@@ -957,22 +1044,22 @@ static void write_int(bytearray_t * bplist, uint64_t val)
     sz = BPLIST_UINT | Log2(size);
 
     val = be64toh(val);
-    byte_array_append(bplist, &sz, 1);
-    byte_array_append(bplist, (uint8_t*)&val + (8-size), size);
+    bplist_writer_append(bplist, &sz, 1);
+    bplist_writer_append(bplist, (uint8_t*)&val + (8-size), size);
 }
 
-static void write_uint(bytearray_t * bplist, uint64_t val)
+static void write_uint(bplist_writer_t *bplist, uint64_t val)
 {
     uint8_t sz = BPLIST_UINT | 4;
     uint64_t zero = 0;
 
     val = be64toh(val);
-    byte_array_append(bplist, &sz, 1);
-    byte_array_append(bplist, &zero, sizeof(uint64_t));
-    byte_array_append(bplist, &val, sizeof(uint64_t));
+    bplist_writer_append(bplist, &sz, 1);
+    bplist_writer_append(bplist, &zero, sizeof(uint64_t));
+    bplist_writer_append(bplist, &val, sizeof(uint64_t));
 }
 
-static void write_real(bytearray_t * bplist, double val)
+static void write_real(bplist_writer_t *bplist, double val)
 {
     int size = get_real_bytes(val);	//cheat to know used space
     uint8_t buff[16];
@@ -983,42 +1070,41 @@ static void write_real(bytearray_t * bplist, double val)
     } else {
         *(uint64_t*)(buff+8) = float_bswap64(*(uint64_t*)&val);
     }
-    byte_array_append(bplist, buff+7, size+1);
+    bplist_writer_append(bplist, buff+7, size+1);
 }
 
-static void write_date(bytearray_t * bplist, double val)
+static void write_date(bplist_writer_t *bplist, double val)
 {
     uint8_t buff[16];
     buff[7] = BPLIST_DATE | 3;
     *(uint64_t*)(buff+8) = float_bswap64(*(uint64_t*)&val);
-    byte_array_append(bplist, buff+7, 9);
+    bplist_writer_append(bplist, buff+7, 9);
 }
 
-static void write_raw_data(bytearray_t * bplist, uint8_t mark, uint8_t * val, uint64_t size)
+static void write_raw_data(bplist_writer_t *bplist, uint8_t mark, uint8_t * val, uint64_t size)
 {
     uint8_t marker = mark | (size < 15 ? size : 0xf);
-    byte_array_append(bplist, &marker, sizeof(uint8_t));
+    bplist_writer_append(bplist, &marker, sizeof(uint8_t));
     if (size >= 15) {
         write_int(bplist, size);
     }
     if (BPLIST_UNICODE==mark) size <<= 1;
-    byte_array_append(bplist, val, size);
+    bplist_writer_append(bplist, val, size);
 }
 
-static void write_data(bytearray_t * bplist, uint8_t * val, uint64_t size)
+static void write_data(bplist_writer_t *bplist, uint8_t * val, uint64_t size)
 {
     write_raw_data(bplist, BPLIST_DATA, val, size);
 }
 
-static void write_string(bytearray_t * bplist, char *val, uint64_t size)
+static void write_string(bplist_writer_t *bplist, char *val, uint64_t size)
 {
     write_raw_data(bplist, BPLIST_STRING, (uint8_t *) val, size);
 }
 
-static uint16_t *plist_utf8_to_utf16be(char *unistr, long size, long *items_read, long *items_written)
+static long utf8_to_utf16be(const char *unistr, long size, uint16_t *outbuf, long *items_read)
 {
-	uint16_t *outbuf;
-	int p = 0;
+	long p = 0;
 	long i = 0;
 
 	unsigned char c0;
@@ -1028,12 +1114,6 @@ static uint16_t *plist_utf8_to_utf16be(char *unistr, long size, long *items_read
 
 	uint32_t w;
 
-	outbuf = (uint16_t*)malloc(((size*2)+1)*sizeof(uint16_t));
-	if (!outbuf) {
-		PLIST_BIN_ERR("%s: Could not allocate %" PRIu64 " bytes\n", __func__, (uint64_t)((size*2)+1)*sizeof(uint16_t));
-		return NULL;
-	}
-
 	while (i < size) {
 		c0 = unistr[i];
 		c1 = (i < size-1) ? unistr[i+1] : 0;
@@ -1041,21 +1121,33 @@ static uint16_t *plist_utf8_to_utf16be(char *unistr, long size, long *items_read
 		c3 = (i < size-3) ? unistr[i+3] : 0;
 		if ((c0 >= 0xF0) && (i < size-3) && (c1 >= 0x80) && (c2 >= 0x80) && (c3 >= 0x80)) {
 			// 4 byte sequence.  Need to generate UTF-16 surrogate pair
-			w = ((((c0 & 7) << 18) + ((c1 & 0x3F) << 12) + ((c2 & 0x3F) << 6) + (c3 & 0x3F)) & 0x1FFFFF) - 0x010000;
-			outbuf[p++] = be16toh(0xD800 + (w >> 10));
-			outbuf[p++] = be16toh(0xDC00 + (w & 0x3FF));
+			if (outbuf) {
+				w = ((((c0 & 7) << 18) + ((c1 & 0x3F) << 12) + ((c2 & 0x3F) << 6) + (c3 & 0x3F)) & 0x1FFFFF) - 0x010000;
+				outbuf[p] = be16toh(0xD800 + (w >> 10));
+				outbuf[p+1] = be16toh(0xDC00 + (w & 0x3FF));
+			}
+			p+=2;
 			i+=4;
 		} else if ((c0 >= 0xE0) && (i < size-2) && (c1 >= 0x80) && (c2 >= 0x80)) {
 			// 3 byte sequence
-			outbuf[p++] = be16toh(((c2 & 0x3F) + ((c1 & 3) << 6)) + (((c1 >> 2) & 15) << 8) + ((c0 & 15) << 12));
+			if (outbuf) {
+				outbuf[p] = be16toh(((c2 & 0x3F) + ((c1 & 3) << 6)) + (((c1 >> 2) & 15) << 8) + ((c0 & 15) << 12));
+			}
+			p++;
 			i+=3;
 		} else if ((c0 >= 0xC0) && (i < size-1) && (c1 >= 0x80)) {
 			// 2 byte sequence
-			outbuf[p++] = be16toh(((c1 & 0x3F) + ((c0 & 3) << 6)) + (((c0 >> 2) & 7) << 8));
+			if (outbuf) {
+				outbuf[p] = be16toh(((c1 & 0x3F) + ((c0 & 3) << 6)) + (((c0 >> 2) & 7) << 8));
+			}
+			p++;
 			i+=2;
 		} else if (c0 < 0x80) {
 			// 1 byte sequence
-			outbuf[p++] = be16toh(c0);
+			if (outbuf) {
+				outbuf[p] = be16toh(c0);
+			}
+			p++;
 			i+=1;
 		} else {
 			// invalid character
@@ -1066,6 +1158,21 @@ static uint16_t *plist_utf8_to_utf16be(char *unistr, long size, long *items_read
 	if (items_read) {
 		*items_read = i;
 	}
+	return p;
+}
+
+static uint16_t *plist_utf8_to_utf16be(char *unistr, long size, long *items_read, long *items_written)
+{
+	uint16_t *outbuf;
+	long p;
+
+	outbuf = (uint16_t*)malloc(((size*2)+1)*sizeof(uint16_t));
+	if (!outbuf) {
+		PLIST_BIN_ERR("%s: Could not allocate %" PRIu64 " bytes\n", __func__, (uint64_t)((size*2)+1)*sizeof(uint16_t));
+		return NULL;
+	}
+
+	p = utf8_to_utf16be(unistr, size, outbuf, items_read);
 	if (items_written) {
 		*items_written = p;
 	}
@@ -1074,25 +1181,32 @@ static uint16_t *plist_utf8_to_utf16be(char *unistr, long size, long *items_read
 	return outbuf;
 }
 
-static void write_unicode(bytearray_t * bplist, char *val, uint64_t size)
+static void write_unicode(bplist_writer_t *bplist, char *val, uint64_t size)
 {
     long items_read = 0;
     long items_written = 0;
     uint16_t *unicodestr = NULL;
 
+    if (bplist->measure) {
+        /* only the length matters here */
+        items_written = utf8_to_utf16be(val, size, NULL, &items_read);
+        write_raw_data(bplist, BPLIST_UNICODE, NULL, items_written);
+        return;
+    }
+
     unicodestr = plist_utf8_to_utf16be(val, size, &items_read, &items_written);
     write_raw_data(bplist, BPLIST_UNICODE, (uint8_t*)unicodestr, items_written);
     free(unicodestr);
 }
 
-static void write_array(bytearray_t * bplist, node_t* node, hashtable_t* ref_table, uint8_t ref_size)
+static void write_array(bplist_writer_t *bplist, node_t* node, hashtable_t* ref_table, uint8_t ref_size)
 {
     node_t* cur = NULL;
     uint64_t i = 0;
 
     uint64_t size = node_n_children(node);
     uint8_t marker = BPLIST_ARRAY | (size < 15 ? size : 0xf);
-    byte_array_append(bplist, &marker, sizeof(uint8_t));
+    bplist_writer_append(bplist, &marker, sizeof(uint8_t));
     if (size >= 15) {
         write_int(bplist, size);
     }
@@ -1100,18 +1214,18 @@ static void write_array(bytearray_t * bplist, node_t* node, hashtable_t* ref_tab
     for (i = 0, cur = node_first_child(node); cur && i < size; cur = node_next_sibling(cur), i++) {
         uint64_t idx = *(uint64_t *) (hash_table_lookup(ref_table, cur));
         idx = be64toh(idx);
-        byte_array_append(bplist, (uint8_t*)&idx + (sizeof(uint64_t) - ref_size), ref_size);
+        bplist_writer_append(bplist, (uint8_t*)&idx + (sizeof(uint64_t) - ref_size), ref_size);
     }
 }
 
-static void write_dict(bytearray_t * bplist, node_t* node, hashtable_t* ref_table, uint8_t ref_size)
+static void write_dict(bplist_writer_t *bplist, node_t* node, hashtable_t* ref_table, uint8_t ref_size)
 {
     node_t* cur = NULL;
     uint64_t i = 0;
 
     uint64_t size = node_n_children(node) / 2;
     uint8_t marker = BPLIST_DICT | (size < 15 ? size : 0xf);
-    byte_array_append(bplist, &marker, sizeof(uint8_t));
+    bplist_writer_append(bplist, &marker, sizeof(uint8_t));
     if (size >= 15) {
         write_int(bplist, size);
     }
@@ -1119,17 +1233,17 @@ static void write_dict(bytearray_t * bplist, node_t* node, hashtable_t* ref_tabl
     for (i = 0, cur = node_first_child(node); cur && i < size; cur = node_next_sibling(node_next_sibling(cur)), i++) {
         uint64_t idx1 = *(uint64_t *) (hash_table_lookup(ref_table, cur));
         idx1 = be64toh(idx1);
-        byte_array_append(bplist, (uint8_t*)&idx1 + (sizeof(uint64_t) - ref_size), ref_size);
+        bplist_writer_append(bplist, (uint8_t*)&idx1 + (sizeof(uint64_t) - ref_size), ref_size);
     }
 
     for (i = 0, cur = node_first_child(node); cur && i < size; cur = node_next_sibling(node_next_sibling(cur)), i++) {
-        uint64_t idx2 = *(uint64_t *) (hash_table_lookup(ref_table, cur->next));
+        uint64_t idx2 = *(uint64_t *) (hash_table_lookup(ref_table, node_next_sibling(cur)));
         idx2 = be64toh(idx2);
-        byte_array_append(bplist, (uint8_t*)&idx2 + (sizeof(uint64_t) - ref_size), ref_size);
+        bplist_writer_append(bplist, (uint8_t*)&idx2 + (sizeof(uint64_t) - ref_size), ref_size);
     }
 }
 
-static void write_uid(bytearray_t * bplist, uint64_t val)
+static void write_uid(bplist_writer_t *bplist, uint64_t val)
 {
     val = (uint32_t)val;
     int size = get_needed_bytes(val);
@@ -1140,8 +1254,8 @@ static void write_uid(bytearray_t * bplist, uint64_t val)
     sz = BPLIST_UID | (size-1); // yes, this is what Apple does...
 
     val = be64toh(val);
-    byte_array_append(bplist, &sz, 1);
-    byte_array_append(bplist, (uint8_t*)&val + (8-size), size);
+    bplist_writer_append(bplist, &sz, 1);
+    bplist_writer_append(bplist, (uint8_t*)&val + (8-size), size);
 }
 
 static int is_ascii_string(char* s, int len)
@@ -1158,207 +1272,135 @@ static int is_ascii_string(char* s, int len)
   return ret;
 }
 
-PLIST_API void plist_to_bin(plist_t plist, char **plist_bin, uint32_t * length)
+static void write_objects(bplist_writer_t *bplist, ptrarray_t *objects, hashtable_t *ref_table, uint8_t ref_size, uint64_t *offsets)
 {
-    ptrarray_t* objects = NULL;
-    hashtable_t* ref_table = NULL;
-    struct serialize_s ser_s;
-    uint8_t offset_size = 0;
-    uint8_t ref_size = 0;
-    uint64_t num_objects = 0;
-    uint64_t root_object = 0;
-    uint64_t offset_table_index = 0;
-    bytearray_t *bplist_buff = NULL;
     uint64_t i = 0;
-    uint8_t *buff = NULL;
-    uint64_t *offsets = NULL;
-    bplist_trailer_t trailer;
-    uint64_t objects_len = 0;
-    uint64_t buff_len = 0;
-
-    //check for valid input
-    if (!plist || !plist_bin || *plist_bin || !length)
-        return;
-
-    //list of objects
-    objects = ptr_array_new(4096);
-    //hashtable to write only once same nodes
-    ref_table = hash_table_new(plist_data_hash, plist_data_compare, free);
+    uint64_t num_objects = objects->len;
 
-    //serialize plist
-    ser_s.objects = objects;
-    ser_s.ref_table = ref_table;
-    serialize_plist(plist, &ser_s);
-
-    //now stream to output buffer
-    offset_size = 0;			//unknown yet
-    objects_len = objects->len;
-    ref_size = get_needed_bytes(objects_len);
-    num_objects = objects->len;
-    root_object = 0;			//root is first in list
-    offset_table_index = 0;		//unknown yet
-
-    //figure out the storage size required
-    uint64_t req = 0;
     for (i = 0; i < num_objects; i++)
     {
-        node_t* node = ptr_array_index(objects, i);
-        plist_data_t data = plist_get_data(node);
-        uint64_t size;
-        uint8_t bsize;
-        switch (data->type)
-        {
-        case PLIST_BOOLEAN:
-            req += 1;
-            break;
-        case PLIST_KEY:
-        case PLIST_STRING:
-            req += 1;
-            if (data->length >= 15) {
-                bsize = get_needed_bytes(data->length);
-                if (bsize == 3) bsize = 4;
-                req += 1;
-                req += bsize;
-            }
-            if ( is_ascii_string(data->strval, data->length) )
-            {
-                req += data->length;
-            }
-            else
-            {
-                req += data->length * 2;
-            }
-            break;
-        case PLIST_REAL:
-            size = get_real_bytes(data->realval);
-            req += 1;
-            req += size;
-            break;
-        case PLIST_DATE:
-            req += 9;
-            break;
-        case PLIST_ARRAY:
-            size = node_n_children(node);
-            req += 1;
-            if (size >= 15) {
-                bsize = get_needed_bytes(size);
-                if (bsize == 3) bsize = 4;
-                req += 1;
-                req += bsize;
-            }
-            req += size * ref_size;
-            break;
-        case PLIST_DICT:
-            size = node_n_children(node) / 2;
-            req += 1;
-            if (size >= 15) {
-                bsize = get_needed_bytes(size);
-                if (bsize == 3) bsize = 4;
-                req += 1;
-                req += bsize;
-            }
-            req += size * 2 * ref_size;
-            break;
-        default:
-            size = data->length;
-            req += 1;
-            if (size >= 15) {
-                bsize = get_needed_bytes(size);
-                if (bsize == 3) bsize = 4;
-                req += 1;
-                req += bsize;
-            }
-            req += data->length;
-            break;
-        }
-    }
-    // add size of magic
-    req += BPLIST_MAGIC_SIZE;
-    req += BPLIST_VERSION_SIZE;
-    // add size of offset table
-    req += get_needed_bytes(req) * num_objects;
-    // add size of trailer
-    req += sizeof(bplist_trailer_t);
-
-    //setup a dynamic bytes array to store bplist in
-    bplist_buff = byte_array_new(req);
-
-    //set magic number and version
-    byte_array_append(bplist_buff, BPLIST_MAGIC, BPLIST_MAGIC_SIZE);
-    byte_array_append(bplist_buff, BPLIST_VERSION, BPLIST_VERSION_SIZE);
-
-    //write objects and table
-    offsets = (uint64_t *) malloc(num_objects * sizeof(uint64_t));
-    assert(offsets != NULL);
-    for (i = 0; i < num_objects; i++)
-    {
-
         plist_data_t data = plist_get_data(ptr_array_index(objects, i));
-        offsets[i] = bplist_buff->len;
+        if (offsets) {
+            offsets[i] = bplist->total;
+        }
 
         switch (data->type)
         {
-        case PLIST_BOOLEAN:
-            buff = (uint8_t *) malloc(sizeof(uint8_t));
-            buff[0] = data->boolval ? BPLIST_TRUE : BPLIST_FALSE;
-            byte_array_append(bplist_buff, buff, sizeof(uint8_t));
-            free(buff);
+        case PLIST_BOOLEAN: {
+            uint8_t b = data->boolval ? BPLIST_TRUE : BPLIST_FALSE;
+            bplist_writer_append(bplist, &b, sizeof(uint8_t));
             break;
-
+        }
         case PLIST_UINT:
             if (data->length == 16) {
-                write_uint(bplist_buff, data->intval);
+                write_uint(bplist, data->intval);
             } else {
-                write_int(bplist_buff, data->intval);
+                write_int(bplist, data->intval);
             }
             break;
 
         case PLIST_REAL:
-            write_real(bplist_buff, data->realval);
+            write_real(bplist, data->realval);
             break;
 
         case PLIST_KEY:
         case PLIST_STRING:
             if ( is_ascii_string(data->strval, data->length) )
             {
-                write_string(bplist_buff, data->strval, data->length);
+                write_string(bplist, data->strval, data->length);
             }
             else
             {
-                write_unicode(bplist_buff, data->strval, data->length);
+                write_unicode(bplist, data->strval, data->length);
             }
             break;
         case PLIST_DATA:
-            write_data(bplist_buff, data->buff, data->length);
+            write_data(bplist, data->buff, data->length);
             break;
         case PLIST_ARRAY:
-            write_array(bplist_buff, ptr_array_index(objects, i), ref_table, ref_size);
+            write_array(bplist, ptr_array_index(objects, i), ref_table, ref_size);
             break;
         case PLIST_DICT:
-            write_dict(bplist_buff, ptr_array_index(objects, i), ref_table, ref_size);
+            write_dict(bplist, ptr_array_index(objects, i), ref_table, ref_size);
             break;
         case PLIST_DATE:
-            write_date(bplist_buff, data->realval);
+            write_date(bplist, data->realval);
             break;
         case PLIST_UID:
-            write_uid(bplist_buff, data->intval);
+            write_uid(bplist, data->intval);
             break;
         default:
             break;
         }
     }
+}
 
-    //free intermediate objects
-    ptr_array_free(objects);
-    hash_table_destroy(ref_table);
+static int plist_write_bin(plist_t plist, bplist_writer_t *w, uint32_t *length)
+{
+    ptrarray_t* objects = NULL;
+    hashtable_t* ref_table = NULL;
+    struct serialize_s ser_s;
+    uint8_t offset_size = 0;
+    uint8_t ref_size = 0;
+    uint64_t num_objects = 0;
+    uint64_t root_object = 0;
+    uint64_t offset_table_index = 0;
+    uint64_t i = 0;
+    uint64_t *offsets = NULL;
+    bplist_trailer_t trailer;
+    uint64_t total = 0;
+    int res = -1;
+
+    //list of objects
+    objects = ptr_array_new(4096);
+    //hashtable to write only once same nodes
+    ref_table = hash_table_new(plist_data_hash, plist_data_compare, free);
+
+    //serialize plist
+    ser_s.objects = objects;
+    ser_s.ref_table = ref_table;
+    serialize_plist(plist, &ser_s);
+
+    num_objects = objects->len;
+    ref_size = get_needed_bytes(num_objects);
+    root_object = 0;			//root is first in list
+
+    //figure out the exact output size
+    w->measure = 1;
+    w->total = 0;
+    bplist_writer_append(w, BPLIST_MAGIC, BPLIST_MAGIC_SIZE);
+    bplist_writer_append(w, BPLIST_VERSION, BPLIST_VERSION_SIZE);
+    write_objects(w, objects, ref_table, ref_size, NULL);
+    offset_table_index = w->total;
+    offset_size = get_needed_bytes(offset_table_index);
+    total = offset_table_index + offset_size * num_objects + sizeof(bplist_trailer_t);
+    if (total > UINT32_MAX) {
+        PLIST_BIN_ERR("%s: output size %" PRIu64 " exceeds maximum length\n", __func__, total);
+        goto leave;
+    }
+    if (length) {
+        *length = (uint32_t)total;
+    }
+
+    //now stream to output buffer
+    w->measure = 0;
+    w->total = 0;
+    w->buf = byte_array_new((w->write_cb) ? BPLIST_WRITE_CHUNK_SIZE : total);
+
+    //set magic number and version
+    bplist_writer_append(w, BPLIST_MAGIC, BPLIST_MAGIC_SIZE);
+    bplist_writer_append(w, BPLIST_VERSION, BPLIST_VERSION_SIZE);
+
+    //write objects and table
+    offsets = (uint64_t *) malloc(num_objects * sizeof(uint64_t));
+    assert(offsets != NULL);
+    write_objects(w, objects, ref_table, ref_size, offsets);
+    assert(w->total == offset_table_index);
 
     //write offsets
-    buff_len = bplist_buff->len;
-    offset_size = get_needed_bytes(buff_len);
-    offset_table_index = bplist_buff->len;
     for (i = 0; i < num_objects; i++) {
         uint64_t offset = be64toh(offsets[i]);
-        byte_array_append(bplist_buff, (uint8_t*)&offset + (sizeof(uint64_t) - offset_size), offset_size);
+        bplist_writer_append(w, (uint8_t*)&offset + (sizeof(uint64_t) - offset_size), offset_size);
     }
     free(offsets);
 
@@ -1370,12 +1412,58 @@ PLIST_API void plist_to_bin(plist_t plist, char **plist_bin, uint32_t * length)
     trailer.root_object_index = be64toh(root_object);
     trailer.offset_table_offset = be64toh(offset_table_index);
 
-    byte_array_append(bplist_buff, &trailer, sizeof(bplist_trailer_t));
+    bplist_writer_append(w, &trailer, sizeof(bplist_trailer_t));
+
+    if (w->write_cb) {
+        bplist_writer_flush(w);
+    }
+    res = (w->err) ? -1 : 0;
+
+leave:
+    //free intermediate objects
+    ptr_array_free(objects);
+    hash_table_destroy(ref_table);
+
+    return res;
+}
+
+PLIST_API void plist_to_bin(plist_t plist, char **plist_bin, uint32_t * length)
+{
+    bplist_writer_t w;
+
+    //check for valid input
+    if (!plist || !plist_bin || *plist_bin || !length)
+        return;
+
+    memset(&w, 0, sizeof(bplist_writer_t));
+    if (plist_write_bin(plist, &w, length) < 0) {
+        byte_array_free(w.buf);
+        *length = 0;
+        return;
+    }
 
     //set output buffer and size
-    *plist_bin = bplist_buff->data;
-    *length = bplist_buff->len;
+    *plist_bin = w.buf->data;
+    *length = w.buf->len;
+
+    w.buf->data = NULL; // make sure we don't free the output buffer
+    byte_array_free(w.buf);
+}
+
+PLIST_API int plist_to_bin_cb(plist_t plist, plist_write_cb_t write_cb, void *user_data, uint32_t *length)
+{
+    bplist_writer_t w;
+    int res;
+
+    if (!plist || !write_cb)
+        return -1;
+
+    memset(&w, 0, sizeof(bplist_writer_t));
+    w.write_cb = write_cb;
+    w.user_data = user_data;
+
+    res = plist_write_bin(plist, &w, length);
+    byte_array_free(w.buf);
 
-    bplist_buff->data = NULL; // make sure we don't free the output buffer
-    byte_array_free(bplist_buff);
+    return res;
 }
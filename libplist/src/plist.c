@@ -38,7 +38,6 @@
 
 #include <node.h>
 #include <hashtable.h>
-#include <ptrarray.h>
 
 extern void plist_xml_init(void);
 extern void plist_xml_deinit(void);
@@ -136,6 +135,21 @@ PLIST_API void plist_from_memory(const char *plist_data, uint32_t length, plist_
     }
 }
 
+PLIST_API void plist_from_memory_nocopy(const char *plist_data, uint32_t length, plist_t * plist)
+{
+    if (length < 8) {
+        *plist = NULL;
+        return;
+    }
+
+    if (plist_is_binary(plist_data, length)) {
+        plist_from_bin_nocopy(plist_data, length, plist);
+    } else {
+        /* XML payloads have to be decoded, so there is nothing to borrow */
+        plist_from_xml(plist_data, length, plist);
+    }
+}
+
 plist_t plist_new_node(plist_data_t data)
 {
     return (plist_t) node_create(NULL, data);
@@ -154,6 +168,113 @@ plist_data_t plist_new_plist_data(void)
     return data;
 }
 
+#define PLIST_BACKING_CHUNK_SIZE 16384
+
+struct plist_backing_chunk_s
+{
+    struct plist_backing_chunk_s *next;
+    size_t size;
+    size_t used;
+};
+
+/* nodes sharing a backing store may be freed from different threads */
+#ifdef WIN32
+typedef volatile LONG plist_refcount_t;
+#define plist_refcount_inc(x) InterlockedIncrement(x)
+#define plist_refcount_dec(x) InterlockedDecrement(x)
+#else
+typedef long plist_refcount_t;
+#define plist_refcount_inc(x) __atomic_add_fetch(x, 1, __ATOMIC_RELAXED)
+#define plist_refcount_dec(x) __atomic_sub_fetch(x, 1, __ATOMIC_ACQ_REL)
+#endif
+
+struct plist_backing_s
+{
+    plist_refcount_t refcount;
+    struct plist_backing_chunk_s *chunks;
+};
+
+plist_backing_t plist_backing_new(void)
+{
+    plist_backing_t backing = (plist_backing_t) calloc(sizeof(struct plist_backing_s), 1);
+    if (backing) {
+        backing->refcount = 1;
+    }
+    return backing;
+}
+
+plist_backing_t plist_backing_retain(plist_backing_t backing)
+{
+    if (backing) {
+        plist_refcount_inc(&backing->refcount);
+    }
+    return backing;
+}
+
+void plist_backing_release(plist_backing_t backing)
+{
+    if (!backing || plist_refcount_dec(&backing->refcount) > 0) {
+        return;
+    }
+    while (backing->chunks) {
+        struct plist_backing_chunk_s *next = backing->chunks->next;
+        free(backing->chunks);
+        backing->chunks = next;
+    }
+    free(backing);
+}
+
+char *plist_backing_alloc(plist_backing_t backing, size_t size)
+{
+    struct plist_backing_chunk_s *chunk = backing->chunks;
+    if (!chunk || chunk->size - chunk->used < size) {
+        int oversized = (size > PLIST_BACKING_CHUNK_SIZE / 4);
+        size_t chunk_size = (oversized) ? size : PLIST_BACKING_CHUNK_SIZE;
+        if (chunk_size > SIZE_MAX - sizeof(struct plist_backing_chunk_s)) {
+            return NULL;
+        }
+        chunk = (struct plist_backing_chunk_s*) malloc(sizeof(struct plist_backing_chunk_s) + chunk_size);
+        if (!chunk) {
+            return NULL;
+        }
+        chunk->size = chunk_size;
+        chunk->used = 0;
+        if (oversized && backing->chunks) {
+            /* keep filling the current chunk with the small allocations */
+            chunk->next = backing->chunks->next;
+            backing->chunks->next = chunk;
+        } else {
+            chunk->next = backing->chunks;
+            backing->chunks = chunk;
+        }
+    }
+    char *ptr = (char*)(chunk + 1) + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+static void plist_free_payload(plist_data_t data)
+{
+    switch (data->type)
+    {
+    case PLIST_KEY:
+    case PLIST_STRING:
+        if (!data->backing)
+            free(data->strval);
+        data->strval = NULL;
+        break;
+    case PLIST_DATA:
+        if (!data->backing)
+            free(data->buff);
+        data->buff = NULL;
+        break;
+    default:
+        break;
+    }
+    plist_backing_release(data->backing);
+    data->backing = NULL;
+}
+
 static unsigned int dict_key_hash(const void *data)
 {
     plist_data_t keydata = (plist_data_t)data;
@@ -185,20 +306,11 @@ void plist_free_data(plist_data_t data)
     {
         switch (data->type)
         {
-        case PLIST_KEY:
-        case PLIST_STRING:
-            free(data->strval);
-            break;
-        case PLIST_DATA:
-            free(data->buff);
-            break;
-        case PLIST_ARRAY:
-            ptr_array_free(data->hashtable);
-            break;
         case PLIST_DICT:
             hash_table_destroy(data->hashtable);
             break;
         default:
+            plist_free_payload(data);
             break;
         }
         free(data);
@@ -213,11 +325,10 @@ static int plist_free_node(node_t* node)
     plist_free_data(data);
     node->data = NULL;
 
+    /* free children back to front so that each detach is O(1) */
     node_t *ch;
-    for (ch = node_first_child(node); ch; ) {
-        node_t *next = node_next_sibling(ch);
+    while ((ch = node_last_child(node))) {
         plist_free_node(ch);
-        ch = next;
     }
 
     node_destroy(node);
@@ -332,6 +443,8 @@ static void plist_copy_node(node_t *node, void *parent_node_ptr)
     assert(newdata);
 
     memcpy(newdata, data, sizeof(struct plist_data_s));
+    /* copies always own their payload */
+    newdata->backing = NULL;
 
     node_type = plist_get_node_type(node);
     switch (node_type) {
@@ -343,20 +456,6 @@ static void plist_copy_node(node_t *node, void *parent_node_ptr)
         case PLIST_STRING:
             newdata->strval = strdup((char *) data->strval);
             break;
-        case PLIST_ARRAY:
-            if (data->hashtable) {
-                ptrarray_t* pa = ptr_array_new(((ptrarray_t*)data->hashtable)->capacity);
-                assert(pa);
-                plist_t current = NULL;
-                for (current = (plist_t)node_first_child(node);
-                     pa && current;
-                     current = (plist_t)node_next_sibling(current))
-                {
-                    ptr_array_add(pa, current);
-                }
-                newdata->hashtable = pa;
-            }
-            break;
         case PLIST_DICT:
             if (data->hashtable) {
                 hashtable_t* ht = hash_table_new(dict_key_hash, dict_key_compare, NULL);
@@ -414,12 +513,7 @@ PLIST_API plist_t plist_array_get_item(plist_t node, uint32_t n)
     plist_t ret = NULL;
     if (node && PLIST_ARRAY == plist_get_node_type(node) && n < INT_MAX)
     {
-        ptrarray_t *pa = ((plist_data_t)((node_t*)node)->data)->hashtable;
-        if (pa) {
-            ret = (plist_t)ptr_array_index(pa, n);
-        } else {
-            ret = (plist_t)node_nth_child(node, n);
-        }
+        ret = (plist_t)node_nth_child(node, n);
     }
     return ret;
 }
@@ -434,28 +528,6 @@ PLIST_API uint32_t plist_array_get_item_index(plist_t node)
     return UINT_MAX;
 }
 
-static void _plist_array_post_insert(plist_t node, plist_t item, long n)
-{
-    ptrarray_t *pa = ((plist_data_t)((node_t*)node)->data)->hashtable;
-    if (pa) {
-        /* store pointer to item in array */
-        ptr_array_insert(pa, item, n);
-    } else {
-        if (((node_t*)node)->count > 100) {
-            /* make new lookup array */
-            pa = ptr_array_new(128);
-            plist_t current = NULL;
-            for (current = (plist_t)node_first_child(node);
-                 pa && current;
-                 current = (plist_t)node_next_sibling(current))
-            {
-                ptr_array_add(pa, current);
-            }
-            ((plist_data_t)((node_t*)node)->data)->hashtable = pa;
-        }
-    }
-}
-
 PLIST_API void plist_array_set_item(plist_t node, plist_t item, uint32_t n)
 {
     if (node && PLIST_ARRAY == plist_get_node_type(node) && n < INT_MAX)
@@ -469,10 +541,6 @@ PLIST_API void plist_array_set_item(plist_t node, plist_t item, uint32_t n)
                 return;
             } else {
                 node_insert(node, idx, item);
-                ptrarray_t* pa = ((plist_data_t)((node_t*)node)->data)->hashtable;
-                if (pa) {
-                    ptr_array_set(pa, item, idx);
-                }
             }
         }
     }
@@ -484,7 +552,6 @@ PLIST_API void plist_array_append_item(plist_t node, plist_t item)
     if (node && PLIST_ARRAY == plist_get_node_type(node))
     {
         node_attach(node, item);
-        _plist_array_post_insert(node, item, -1);
     }
     return;
 }
@@ -494,7 +561,6 @@ PLIST_API void plist_array_insert_item(plist_t node, plist_t item, uint32_t n)
     if (node && PLIST_ARRAY == plist_get_node_type(node) && n < INT_MAX)
     {
         node_insert(node, n, item);
-        _plist_array_post_insert(node, item, (long)n);
     }
     return;
 }
@@ -506,10 +572,6 @@ PLIST_API void plist_array_remove_item(plist_t node, uint32_t n)
         plist_t old_item = plist_array_get_item(node, n);
         if (old_item)
         {
-            ptrarray_t* pa = ((plist_data_t)((node_t*)node)->data)->hashtable;
-            if (pa) {
-                ptr_array_remove(pa, n);
-            }
             plist_free(old_item);
         }
     }
@@ -521,12 +583,7 @@ PLIST_API void plist_array_item_remove(plist_t node)
     plist_t father = plist_get_parent(node);
     if (PLIST_ARRAY == plist_get_node_type(father))
     {
-        int n = node_child_position(father, node);
-        if (n < 0) return;
-        ptrarray_t* pa = ((plist_data_t)((node_t*)father)->data)->hashtable;
-        if (pa) {
-            ptr_array_remove(pa, n);
-        }
+        if (node_child_position(father, node) < 0) return;
         plist_free(node);
     }
 }
@@ -535,28 +592,28 @@ PLIST_API void plist_array_new_iter(plist_t node, plist_array_iter *iter)
 {
     if (iter)
     {
-        *iter = malloc(sizeof(node_t*));
-        *((node_t**)(*iter)) = node_first_child(node);
+        *iter = malloc(sizeof(uint32_t));
+        *((uint32_t*)(*iter)) = 0;
     }
     return;
 }
 
 PLIST_API void plist_array_next_item(plist_t node, plist_array_iter iter, plist_t *item)
 {
-    node_t** iter_node = (node_t**)iter;
+    uint32_t* iter_index = (uint32_t*)iter;
 
     if (item)
     {
         *item = NULL;
     }
 
-    if (node && PLIST_ARRAY == plist_get_node_type(node) && *iter_node)
+    if (node && PLIST_ARRAY == plist_get_node_type(node) && *iter_index < node_n_children(node))
     {
         if (item)
         {
-            *item = (plist_t)(*iter_node);
+            *item = (plist_t)node_nth_child(node, *iter_index);
         }
-        *iter_node = node_next_sibling(*iter_node);
+        (*iter_index)++;
     }
     return;
 }
@@ -575,15 +632,15 @@ PLIST_API void plist_dict_new_iter(plist_t node, plist_dict_iter *iter)
 {
     if (iter)
     {
-        *iter = malloc(sizeof(node_t*));
-        *((node_t**)(*iter)) = node_first_child(node);
+        *iter = malloc(sizeof(uint32_t));
+        *((uint32_t*)(*iter)) = 0;
     }
     return;
 }
 
 PLIST_API void plist_dict_next_item(plist_t node, plist_dict_iter iter, char **key, plist_t *val)
 {
-    node_t** iter_node = (node_t**)iter;
+    uint32_t* iter_index = (uint32_t*)iter;
 
     if (key)
     {
@@ -594,18 +651,17 @@ PLIST_API void plist_dict_next_item(plist_t node, plist_dict_iter iter, char **k
         *val = NULL;
     }
 
-    if (node && PLIST_DICT == plist_get_node_type(node) && *iter_node)
+    if (node && PLIST_DICT == plist_get_node_type(node) && *iter_index < node_n_children(node))
     {
         if (key)
         {
-            plist_get_key_val((plist_t)(*iter_node), key);
+            plist_get_key_val((plist_t)node_nth_child(node, *iter_index), key);
         }
-        *iter_node = node_next_sibling(*iter_node);
         if (val)
         {
-            *val = (plist_t)(*iter_node);
+            *val = (plist_t)node_nth_child(node, *iter_index + 1);
         }
-        *iter_node = node_next_sibling(*iter_node);
+        *iter_index += 2;
     }
     return;
 }
@@ -931,6 +987,31 @@ PLIST_API void plist_get_data_val(plist_t node, char **val, uint64_t * length)
     plist_get_type_and_value(node, &type, (void *) val, length);
 }
 
+PLIST_API const char* plist_get_string_ptr(plist_t node, uint64_t* length)
+{
+    if (!node)
+        return NULL;
+    plist_type type = plist_get_node_type(node);
+    if (PLIST_STRING != type)
+        return NULL;
+    plist_data_t data = plist_get_data(node);
+    if (length)
+        *length = data->length;
+    return (const char*)data->strval;
+}
+
+PLIST_API const char* plist_get_data_ptr(plist_t node, uint64_t* length)
+{
+    if (!node || !length)
+        return NULL;
+    plist_type type = plist_get_node_type(node);
+    if (PLIST_DATA != type)
+        return NULL;
+    plist_data_t data = plist_get_data(node);
+    *length = data->length;
+    return (const char*)data->buff;
+}
+
 PLIST_API void plist_get_date_val(plist_t node, int32_t * sec, int32_t * usec)
 {
     if (!node)
@@ -1018,20 +1099,7 @@ static void plist_set_element_val(plist_t node, plist_type type, const void *val
     plist_data_t data = plist_get_data(node);
     assert(data);				// a node should always have data attached
 
-    switch (data->type)
-    {
-    case PLIST_KEY:
-    case PLIST_STRING:
-        free(data->strval);
-        data->strval = NULL;
-        break;
-    case PLIST_DATA:
-        free(data->buff);
-        data->buff = NULL;
-        break;
-    default:
-        break;
-    }
+    plist_free_payload(data);
 
     //now handle value
 
@@ -30,7 +30,11 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#ifdef WIN32
+#include <winsock2.h>
+#else
 #include <sys/time.h>
+#endif
 
 #ifdef _MSC_VER
 #pragma warning(disable:4996)
@@ -60,10 +64,21 @@ struct plist_data_s
     };
     uint64_t length;
     plist_type type;
+    struct plist_backing_s *backing;
 };
 
 typedef struct plist_data_s *plist_data_t;
 
+/* Shared, reference counted storage for string and data payloads that are
+ * not owned by their node. Every node whose payload lives in (or is
+ * borrowed through) a backing store holds one reference to it. */
+typedef struct plist_backing_s *plist_backing_t;
+
+plist_backing_t plist_backing_new(void);
+plist_backing_t plist_backing_retain(plist_backing_t backing);
+void plist_backing_release(plist_backing_t backing);
+char *plist_backing_alloc(plist_backing_t backing, size_t size);
+
 plist_t plist_new_node(plist_data_t data);
 plist_data_t plist_get_data(const plist_t node);
 plist_data_t plist_new_plist_data(void);
@@ -44,7 +44,6 @@
 
 #include "plist.h"
 #include "base64.h"
-#include "strbuf.h"
 #include "time64.h"
 
 #define XPLIST_KEY	"key"
@@ -100,12 +99,146 @@ void plist_xml_deinit(void)
     /* deinit XML stuff */
 }
 
-static size_t dtostr(char *buf, size_t bufsize, double realval)
+#define XPLIST_WRITE_CHUNK_SIZE 16384
+
+static const char XML_TABS[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+#define XML_TABS_LEN (sizeof(XML_TABS)-1)
+
+static const char DIGIT_PAIRS[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/* Output state for the XML writer. With measure set, nothing is written and
+ * only total is advanced; this is used to compute the exact output size.
+ * Without a write_cb, buf is expected to be large enough for the whole
+ * document; with a write_cb, buf is a scratch buffer that gets flushed to
+ * the callback whenever it is full. */
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t capacity;
+    uint64_t total;
+    int measure;
+    plist_write_cb_t write_cb;
+    void *user_data;
+    int err;
+} xml_writer_t;
+
+static void xml_writer_flush(xml_writer_t *w)
+{
+    if (w->len > 0 && !w->err) {
+        if (w->write_cb(w->buf, (uint32_t)w->len, w->user_data) < 0) {
+            w->err = 1;
+        }
+    }
+    w->len = 0;
+}
+
+static void xml_writer_make_room(xml_writer_t *w, size_t n)
+{
+    /* the size pass is exact, so only streaming output ever runs out of room */
+    assert(w->write_cb);
+    xml_writer_flush(w);
+}
+
+/* returns a pointer to n bytes of contiguous output space */
+static char* xml_writer_reserve(xml_writer_t *w, size_t n)
+{
+    if (n > w->capacity - w->len) {
+        xml_writer_make_room(w, n);
+    }
+    return w->buf + w->len;
+}
+
+static void xml_writer_commit(xml_writer_t *w, size_t n)
+{
+    w->len += n;
+    w->total += n;
+}
+
+static void xml_writer_append(xml_writer_t *w, const char *str, size_t n)
+{
+    w->total += n;
+    if (w->measure) {
+        return;
+    }
+    if (n > w->capacity - w->len) {
+        xml_writer_make_room(w, n);
+        if (n > w->capacity - w->len) {
+            /* larger than the scratch buffer, pass it through directly */
+            if (!w->err && w->write_cb(str, (uint32_t)n, w->user_data) < 0) {
+                w->err = 1;
+            }
+            return;
+        }
+    }
+    memcpy(w->buf + w->len, str, n);
+    w->len += n;
+}
+
+static void xml_writer_indent(xml_writer_t *w, uint32_t depth)
+{
+    while (depth > 0) {
+        uint32_t n = (depth > XML_TABS_LEN) ? XML_TABS_LEN : depth;
+        xml_writer_append(w, XML_TABS, n);
+        depth -= n;
+    }
+}
+
+static void xml_writer_close_tag(xml_writer_t *w, const char *tag, size_t tag_len)
+{
+    xml_writer_append(w, "</", 2);
+    xml_writer_append(w, tag, tag_len);
+    xml_writer_append(w, ">\n", 2);
+}
+
+static size_t u64tostr(char *buf, uint64_t val)
+{
+    char tmp[20];
+    char *p = tmp + sizeof(tmp);
+    size_t len;
+    while (val >= 100) {
+        unsigned int i = (unsigned int)(val % 100) << 1;
+        val /= 100;
+        *--p = DIGIT_PAIRS[i + 1];
+        *--p = DIGIT_PAIRS[i];
+    }
+    if (val >= 10) {
+        unsigned int i = (unsigned int)val << 1;
+        *--p = DIGIT_PAIRS[i + 1];
+        *--p = DIGIT_PAIRS[i];
+    } else {
+        *--p = (char)('0' + val);
+    }
+    len = (tmp + sizeof(tmp)) - p;
+    memcpy(buf, p, len);
+    return len;
+}
+
+static size_t i64tostr(char *buf, int64_t val)
+{
+    if (val < 0) {
+        buf[0] = '-';
+        return u64tostr(buf + 1, (uint64_t)0 - (uint64_t)val) + 1;
+    }
+    return u64tostr(buf, (uint64_t)val);
+}
+
+/* buf needs to hold at least 28 bytes */
+static size_t dtostr(char *buf, double realval)
 {
     double f = realval;
     double ip = 0.0;
     int64_t v;
-    size_t len;
+    size_t len = 0;
     size_t p;
     double CORR = 0.0000005;
 
@@ -122,10 +255,10 @@ static size_t dtostr(char *buf, size_t bufsize, double realval)
             f = 0;
         }
     }
-    len = snprintf(buf, bufsize, "%s%"PRIi64, ((f < 0) && (ip >= 0)) ? "-" : "", v);
-    if (len >= bufsize) {
-        return 0;
+    if ((f < 0) && (ip >= 0)) {
+        buf[len++] = '-';
     }
+    len += i64tostr(buf + len, v);
 
     if (f < 0) {
         f *= -1;
@@ -135,29 +268,120 @@ static size_t dtostr(char *buf, size_t bufsize, double realval)
     p = len;
     buf[p++] = '.';
 
-    while (p < bufsize && (p <= len+6)) {
+    while (p <= len+6) {
         f = modf(f*10, &ip);
         v = (int)ip;
         buf[p++] = (v + 0x30);
     }
-    buf[p] = '\0';
     return p;
 }
 
-static void node_to_xml(node_t* node, bytearray_t **outbuf, uint32_t depth)
+static void put2digits(char *buf, int val)
 {
-    plist_data_t node_data = NULL;
+    unsigned int i = (unsigned int)(val % 100) << 1;
+    buf[0] = DIGIT_PAIRS[i];
+    buf[1] = DIGIT_PAIRS[i + 1];
+}
+
+/* formats as %Y-%m-%dT%H:%M:%SZ; buf needs to hold at least 32 bytes.
+ * Returns 0 if the date can't be represented. */
+static size_t datetostr(char *buf, double realval)
+{
+    Time64_T timev = (Time64_T)realval + MAC_EPOCH;
+    struct TM _btime;
+    struct TM *btime = gmtime64_r(&timev, &_btime);
+    struct tm _tmcopy;
+    size_t len;
+
+    if (!btime) {
+        return 0;
+    }
+    copy_TM64_to_tm(btime, &_tmcopy);
 
-    char isStruct = FALSE;
-    char tagOpen = FALSE;
+    len = i64tostr(buf, (int64_t)_tmcopy.tm_year + 1900);
+    if (len > 4 + 3) {
+        /* keep the same limit as the former 24 byte strftime buffer */
+        return 0;
+    }
+    buf[len] = '-';
+    put2digits(buf + len + 1, _tmcopy.tm_mon + 1);
+    buf[len + 3] = '-';
+    put2digits(buf + len + 4, _tmcopy.tm_mday);
+    buf[len + 6] = 'T';
+    put2digits(buf + len + 7, _tmcopy.tm_hour);
+    buf[len + 9] = ':';
+    put2digits(buf + len + 10, _tmcopy.tm_min);
+    buf[len + 12] = ':';
+    put2digits(buf + len + 13, _tmcopy.tm_sec);
+    buf[len + 15] = 'Z';
+    return len + 16;
+}
 
-    const char *tag = NULL;
+static void xml_writer_escaped(xml_writer_t *w, const char *str, size_t len)
+{
+    size_t start = 0;
+    size_t j;
+
+    /* make sure we convert the following predefined xml entities */
+    /* < = &lt; > = &gt; & = &amp; */
+    for (j = 0; j < len; j++) {
+        const char *entity;
+        size_t entity_len;
+        switch (str[j]) {
+        case '<':
+            entity = "&lt;";
+            entity_len = 4;
+            break;
+        case '>':
+            entity = "&gt;";
+            entity_len = 4;
+            break;
+        case '&':
+            entity = "&amp;";
+            entity_len = 5;
+            break;
+        default:
+            continue;
+        }
+        xml_writer_append(w, str + start, j - start);
+        xml_writer_append(w, entity, entity_len);
+        start = j+1;
+    }
+    xml_writer_append(w, str + start, len - start);
+}
+
+static void xml_writer_data(xml_writer_t *w, const uint8_t *buf, uint64_t length, uint32_t indent)
+{
+    uint32_t maxread = MAX_DATA_BYTES_PER_LINE(indent);
+    uint64_t j = 0;
+
+    if (w->measure) {
+        uint64_t lines = (length + maxread - 1) / maxread;
+        w->total += lines * (indent + 1) + ((length + 2) / 3) * 4;
+        return;
+    }
+    while (j < length) {
+        size_t count = (length-j < maxread) ? (size_t)(length-j) : maxread;
+        size_t b64len = ((count + 2) / 3) * 4;
+        /* base64encode() 0-terminates, the newline takes that byte */
+        char *p = xml_writer_reserve(w, indent + b64len + 1);
+        memcpy(p, XML_TABS, indent);
+        base64encode(p + indent, buf + j, count);
+        p[indent + b64len] = '\n';
+        xml_writer_commit(w, indent + b64len + 1);
+        j += count;
+    }
+}
+
+static void node_to_xml(node_t* node, xml_writer_t *w, uint32_t depth)
+{
+    plist_data_t node_data = NULL;
+
+    const char *tag = "";
     size_t tag_len = 0;
-    char *val = NULL;
+    char val[64];
     size_t val_len = 0;
 
-    uint32_t i = 0;
-
     if (!node)
         return;
 
@@ -166,7 +390,6 @@ static void node_to_xml(node_t* node, bytearray_t **outbuf, uint32_t depth)
     switch (node_data->type)
     {
     case PLIST_BOOLEAN:
-    {
         if (node_data->boolval) {
             tag = XPLIST_TRUE;
             tag_len = XPLIST_TRUE_LEN;
@@ -174,223 +397,114 @@ static void node_to_xml(node_t* node, bytearray_t **outbuf, uint32_t depth)
             tag = XPLIST_FALSE;
             tag_len = XPLIST_FALSE_LEN;
         }
-    }
-    break;
-
+        break;
     case PLIST_UINT:
         tag = XPLIST_INT;
         tag_len = XPLIST_INT_LEN;
-        val = (char*)malloc(64);
         if (node_data->length == 16) {
-            val_len = snprintf(val, 64, "%"PRIu64, node_data->intval);
+            val_len = u64tostr(val, node_data->intval);
         } else {
-            val_len = snprintf(val, 64, "%"PRIi64, node_data->intval);
+            val_len = i64tostr(val, (int64_t)node_data->intval);
         }
         break;
-
     case PLIST_REAL:
         tag = XPLIST_REAL;
         tag_len = XPLIST_REAL_LEN;
-        val = (char*)malloc(64);
-        val_len = dtostr(val, 64, node_data->realval);
+        val_len = dtostr(val, node_data->realval);
         break;
-
     case PLIST_STRING:
         tag = XPLIST_STRING;
         tag_len = XPLIST_STRING_LEN;
-        /* contents processed directly below */
         break;
-
     case PLIST_KEY:
         tag = XPLIST_KEY;
         tag_len = XPLIST_KEY_LEN;
-        /* contents processed directly below */
         break;
-
     case PLIST_DATA:
         tag = XPLIST_DATA;
         tag_len = XPLIST_DATA_LEN;
-        /* contents processed directly below */
         break;
     case PLIST_ARRAY:
         tag = XPLIST_ARRAY;
         tag_len = XPLIST_ARRAY_LEN;
-        isStruct = (node->children) ? TRUE : FALSE;
         break;
     case PLIST_DICT:
         tag = XPLIST_DICT;
         tag_len = XPLIST_DICT_LEN;
-        isStruct = (node->children) ? TRUE : FALSE;
         break;
     case PLIST_DATE:
         tag = XPLIST_DATE;
         tag_len = XPLIST_DATE_LEN;
-        {
-            Time64_T timev = (Time64_T)node_data->realval + MAC_EPOCH;
-            struct TM _btime;
-            struct TM *btime = gmtime64_r(&timev, &_btime);
-            if (btime) {
-                val = (char*)malloc(24);
-                memset(val, 0, 24);
-                struct tm _tmcopy;
-                copy_TM64_to_tm(btime, &_tmcopy);
-                val_len = strftime(val, 24, "%Y-%m-%dT%H:%M:%SZ", &_tmcopy);
-                if (val_len <= 0) {
-                    free (val);
-                    val = NULL;
-                }
-            }
-        }
+        val_len = datetostr(val, node_data->realval);
         break;
     case PLIST_UID:
         tag = XPLIST_DICT;
         tag_len = XPLIST_DICT_LEN;
-        val = (char*)malloc(64);
-        if (node_data->length == 16) {
-            val_len = snprintf(val, 64, "%"PRIu64, node_data->intval);
-        } else {
-            val_len = snprintf(val, 64, "%"PRIi64, node_data->intval);
-        }
+        val_len = i64tostr(val, (int64_t)node_data->intval);
         break;
     default:
         break;
     }
 
-    for (i = 0; i < depth; i++) {
-        str_buf_append(*outbuf, "\t", 1);
-    }
+    xml_writer_indent(w, depth);
+    xml_writer_append(w, "<", 1);
+    xml_writer_append(w, tag, tag_len);
 
-    /* append tag */
-    str_buf_append(*outbuf, "<", 1);
-    str_buf_append(*outbuf, tag, tag_len);
-    if (node_data->type == PLIST_STRING || node_data->type == PLIST_KEY) {
-        size_t j;
-        size_t len;
-        off_t start = 0;
-        off_t cur = 0;
-
-        str_buf_append(*outbuf, ">", 1);
-        tagOpen = TRUE;
-
-        /* make sure we convert the following predefined xml entities */
-        /* < = &lt; > = &gt; & = &amp; */
-        len = node_data->length;
-        for (j = 0; j < len; j++) {
-            switch (node_data->strval[j]) {
-            case '<':
-                str_buf_append(*outbuf, node_data->strval + start, cur - start);
-                str_buf_append(*outbuf, "&lt;", 4);
-                start = cur+1;
-                break;
-            case '>':
-                str_buf_append(*outbuf, node_data->strval + start, cur - start);
-                str_buf_append(*outbuf, "&gt;", 4);
-                start = cur+1;
-                break;
-            case '&':
-                str_buf_append(*outbuf, node_data->strval + start, cur - start);
-                str_buf_append(*outbuf, "&amp;", 5);
-                start = cur+1;
-                break;
-            default:
-                break;
-            }
-            cur++;
-        }
-        str_buf_append(*outbuf, node_data->strval + start, cur - start);
-    } else if (node_data->type == PLIST_DATA) {
-        str_buf_append(*outbuf, ">", 1);
-        tagOpen = TRUE;
-        str_buf_append(*outbuf, "\n", 1);
+    switch (node_data->type)
+    {
+    case PLIST_STRING:
+    case PLIST_KEY:
+        xml_writer_append(w, ">", 1);
+        xml_writer_escaped(w, node_data->strval, node_data->length);
+        xml_writer_close_tag(w, tag, tag_len);
+        break;
+    case PLIST_DATA:
+        xml_writer_append(w, ">\n", 2);
         if (node_data->length > 0) {
-            uint32_t j = 0;
-            uint32_t indent = (depth > 8) ? 8 : depth;
-            uint32_t maxread = MAX_DATA_BYTES_PER_LINE(indent);
-            size_t count = 0;
-            size_t amount = (node_data->length / 3 * 4) + 4 + (((node_data->length / maxread) + 1) * (indent+1));
-            if ((*outbuf)->len + amount > (*outbuf)->capacity) {
-                str_buf_grow(*outbuf, amount);
-            }
-            while (j < node_data->length) {
-                for (i = 0; i < indent; i++) {
-                    str_buf_append(*outbuf, "\t", 1);
-                }
-                count = (node_data->length-j < maxread) ? node_data->length-j : maxread;
-                assert((*outbuf)->len + count < (*outbuf)->capacity);
-                (*outbuf)->len += base64encode((char*)(*outbuf)->data + (*outbuf)->len, node_data->buff + j, count);
-                str_buf_append(*outbuf, "\n", 1);
-                j+=count;
-            }
-        }
-        for (i = 0; i < depth; i++) {
-            str_buf_append(*outbuf, "\t", 1);
+            xml_writer_data(w, node_data->buff, node_data->length, (depth > 8) ? 8 : depth);
         }
-    } else if (node_data->type == PLIST_UID) {
+        xml_writer_indent(w, depth);
+        xml_writer_close_tag(w, tag, tag_len);
+        break;
+    case PLIST_UID:
         /* special case for UID nodes: create a DICT */
-        str_buf_append(*outbuf, ">", 1);
-        tagOpen = TRUE;
-        str_buf_append(*outbuf, "\n", 1);
-
-        /* add CF$UID key */
-        for (i = 0; i < depth+1; i++) {
-            str_buf_append(*outbuf, "\t", 1);
-        }
-        str_buf_append(*outbuf, "<key>CF$UID</key>", 17);
-        str_buf_append(*outbuf, "\n", 1);
-
-        /* add UID value */
-        for (i = 0; i < depth+1; i++) {
-            str_buf_append(*outbuf, "\t", 1);
-        }
-        str_buf_append(*outbuf, "<integer>", 9);
-        str_buf_append(*outbuf, val, val_len);
-        str_buf_append(*outbuf, "</integer>", 10);
-        str_buf_append(*outbuf, "\n", 1);
-
-        for (i = 0; i < depth; i++) {
-            str_buf_append(*outbuf, "\t", 1);
-        }
-    } else if (val) {
-        str_buf_append(*outbuf, ">", 1);
-        tagOpen = TRUE;
-        str_buf_append(*outbuf, val, val_len);
-    } else if (isStruct) {
-        tagOpen = TRUE;
-        str_buf_append(*outbuf, ">", 1);
-    } else {
-        tagOpen = FALSE;
-        str_buf_append(*outbuf, "/>", 2);
-    }
-    free(val);
-
-    if (isStruct) {
-        /* add newline for structured types */
-        str_buf_append(*outbuf, "\n", 1);
-
-        /* add child nodes */
-        if (node_data->type == PLIST_DICT && node->children) {
-            assert((node->children->count % 2) == 0);
-        }
-        node_t *ch;
-        for (ch = node_first_child(node); ch; ch = node_next_sibling(ch)) {
-            node_to_xml(ch, outbuf, depth+1);
+        xml_writer_append(w, ">\n", 2);
+        xml_writer_indent(w, depth+1);
+        xml_writer_append(w, "<key>CF$UID</key>\n", 18);
+        xml_writer_indent(w, depth+1);
+        xml_writer_append(w, "<integer>", 9);
+        xml_writer_append(w, val, val_len);
+        xml_writer_append(w, "</integer>\n", 11);
+        xml_writer_indent(w, depth);
+        xml_writer_close_tag(w, tag, tag_len);
+        break;
+    case PLIST_ARRAY:
+    case PLIST_DICT:
+        if (node->children) {
+            node_t *ch;
+            xml_writer_append(w, ">\n", 2);
+            if (node_data->type == PLIST_DICT) {
+                assert((node->children->count % 2) == 0);
+            }
+            for (ch = node_first_child(node); ch; ch = node_next_sibling(ch)) {
+                node_to_xml(ch, w, depth+1);
+            }
+            xml_writer_indent(w, depth);
+            xml_writer_close_tag(w, tag, tag_len);
+        } else {
+            xml_writer_append(w, "/>\n", 3);
         }
-
-        /* fix indent for structured types */
-        for (i = 0; i < depth; i++) {
-            str_buf_append(*outbuf, "\t", 1);
+        break;
+    default:
+        if (val_len > 0) {
+            xml_writer_append(w, ">", 1);
+            xml_writer_append(w, val, val_len);
+            xml_writer_close_tag(w, tag, tag_len);
+        } else {
+            xml_writer_append(w, "/>\n", 3);
         }
+        break;
     }
-
-    if (tagOpen) {
-        /* add closing tag */
-        str_buf_append(*outbuf, "</", 2);
-        str_buf_append(*outbuf, tag, tag_len);
-        str_buf_append(*outbuf, ">", 1);
-    }
-    str_buf_append(*outbuf, "\n", 1);
-
-    return;
 }
 
 static void parse_date(const char *strval, struct TM *btime)
@@ -413,143 +527,82 @@ static void parse_date(const char *strval, struct TM *btime)
     btime->tm_isdst=0;
 }
 
-#define PO10i_LIMIT (INT64_MAX/10)
-
-/* based on https://stackoverflow.com/a/4143288 */
-static int num_digits_i(int64_t i)
+static void plist_write_xml(plist_t plist, xml_writer_t *w)
 {
-    int n;
-    int64_t po10;
-    n=1;
-    if (i < 0) {
-        i = -i;
-        n++;
-    }
-    po10=10;
-    while (i>=po10) {
-        n++;
-        if (po10 > PO10i_LIMIT) break;
-        po10*=10;
-    }
-    return n;
+    xml_writer_append(w, XML_PLIST_PROLOG, sizeof(XML_PLIST_PROLOG)-1);
+    node_to_xml(plist, w, 0);
+    xml_writer_append(w, XML_PLIST_EPILOG, sizeof(XML_PLIST_EPILOG)-1);
 }
 
-#define PO10u_LIMIT (UINT64_MAX/10)
-
-/* based on https://stackoverflow.com/a/4143288 */
-static int num_digits_u(uint64_t i)
+PLIST_API void plist_to_xml(plist_t plist, char **plist_xml, uint32_t * length)
 {
-    int n;
-    uint64_t po10;
-    n=1;
-    po10=10;
-    while (i>=po10) {
-        n++;
-        if (po10 > PO10u_LIMIT) break;
-        po10*=10;
-    }
-    return n;
-}
+    xml_writer_t w;
 
-static void node_estimate_size(node_t *node, uint64_t *size, uint32_t depth)
-{
-    plist_data_t data;
-    if (!node) {
+    if (!plist_xml || !length) {
         return;
     }
-    data = plist_get_data(node);
-    if (node->children) {
-        node_t *ch;
-        for (ch = node_first_child(node); ch; ch = node_next_sibling(ch)) {
-            node_estimate_size(ch, size, depth + 1);
-        }
-        switch (data->type) {
-        case PLIST_DICT:
-            *size += (XPLIST_DICT_LEN << 1) + 7;
-            break;
-        case PLIST_ARRAY:
-            *size += (XPLIST_ARRAY_LEN << 1) + 7;
-            break;
-        default:
-            break;
-	}
-        *size += (depth << 1);
-    } else {
-        uint32_t indent = (depth > 8) ? 8 : depth;
-        switch (data->type) {
-        case PLIST_DATA: {
-            uint32_t req_lines = (data->length / MAX_DATA_BYTES_PER_LINE(indent)) + 1;
-            uint32_t b64len = data->length + (data->length / 3);
-            b64len += b64len % 4;
-            *size += b64len;
-            *size += (XPLIST_DATA_LEN << 1) + 5 + (indent+1) * (req_lines+1) + 1;
-        }   break;
-        case PLIST_STRING:
-            *size += data->length;
-            *size += (XPLIST_STRING_LEN << 1) + 6;
-            break;
-        case PLIST_KEY:
-            *size += data->length;
-            *size += (XPLIST_KEY_LEN << 1) + 6;
-            break;
-        case PLIST_UINT:
-            if (data->length == 16) {
-                *size += num_digits_u(data->intval);
-            } else {
-                *size += num_digits_i((int64_t)data->intval);
-            }
-            *size += (XPLIST_INT_LEN << 1) + 6;
-            break;
-        case PLIST_REAL:
-            *size += num_digits_i((int64_t)data->realval) + 7;
-            *size += (XPLIST_REAL_LEN << 1) + 6;
-            break;
-        case PLIST_DATE:
-            *size += 20; /* YYYY-MM-DDThh:mm:ssZ */
-            *size += (XPLIST_DATE_LEN << 1) + 6;
-            break;
-        case PLIST_BOOLEAN:
-            *size += ((data->boolval) ? XPLIST_TRUE_LEN : XPLIST_FALSE_LEN) + 4;
-            break;
-        case PLIST_DICT:
-            *size += XPLIST_DICT_LEN + 4; /* <dict/> */
-            break;
-        case PLIST_ARRAY:
-            *size += XPLIST_ARRAY_LEN + 4; /* <array/> */
-            break;
-        case PLIST_UID:
-            *size += num_digits_i((int64_t)data->intval);
-            *size += (XPLIST_DICT_LEN << 1) + 7;
-            *size += indent + ((indent+1) << 1);
-            *size += 18; /* <key>CF$UID</key> */
-            *size += (XPLIST_INT_LEN << 1) + 6;
-            break;
-        default:
-            break;
-        }
-        *size += indent;
+    *plist_xml = NULL;
+    *length = 0;
+
+    /* size pass */
+    memset(&w, 0, sizeof(xml_writer_t));
+    w.measure = 1;
+    plist_write_xml(plist, &w);
+    if (w.total >= UINT32_MAX) {
+        PLIST_XML_ERR("Output would exceed maximum length\n");
+        return;
     }
-}
 
-PLIST_API void plist_to_xml(plist_t plist, char **plist_xml, uint32_t * length)
-{
-    uint64_t size = 0;
-    node_estimate_size(plist, &size, 0);
-    size += sizeof(XML_PLIST_PROLOG) + sizeof(XML_PLIST_EPILOG) - 1;
+    /* output pass */
+    w.measure = 0;
+    w.capacity = (size_t)w.total + 1;
+    w.buf = (char*)malloc(w.capacity);
+    if (!w.buf) {
+        PLIST_XML_ERR("Could not allocate %" PRIu64 " bytes\n", w.total + 1);
+        return;
+    }
+    w.total = 0;
+    plist_write_xml(plist, &w);
+    w.buf[w.len] = '\0';
 
-    strbuf_t *outbuf = str_buf_new(size);
+    *plist_xml = w.buf;
+    *length = (uint32_t)w.len;
+}
 
-    str_buf_append(outbuf, XML_PLIST_PROLOG, sizeof(XML_PLIST_PROLOG)-1);
+PLIST_API int plist_to_xml_cb(plist_t plist, plist_write_cb_t write_cb, void *user_data, uint32_t *length)
+{
+    xml_writer_t w;
 
-    node_to_xml(plist, &outbuf, 0);
+    if (!write_cb) {
+        return -1;
+    }
 
-    str_buf_append(outbuf, XML_PLIST_EPILOG, sizeof(XML_PLIST_EPILOG));
+    memset(&w, 0, sizeof(xml_writer_t));
+    if (length) {
+        /* size pass, so the caller knows the length before any data arrives */
+        w.measure = 1;
+        plist_write_xml(plist, &w);
+        if (w.total >= UINT32_MAX) {
+            PLIST_XML_ERR("Output would exceed maximum length\n");
+            return -1;
+        }
+        *length = (uint32_t)w.total;
+        w.measure = 0;
+        w.total = 0;
+    }
+    w.capacity = XPLIST_WRITE_CHUNK_SIZE;
+    w.buf = (char*)malloc(w.capacity);
+    if (!w.buf) {
+        return -1;
+    }
+    w.write_cb = write_cb;
+    w.user_data = user_data;
 
-    *plist_xml = outbuf->data;
-    *length = outbuf->len - 1;
+    plist_write_xml(plist, &w);
+    xml_writer_flush(&w);
+    free(w.buf);
 
-    outbuf->data = NULL;
-    str_buf_free(outbuf);
+    return (w.err) ? -1 : 0;
 }
 
 struct _parse_ctx {
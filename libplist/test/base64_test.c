@@ -0,0 +1,301 @@
+/*
+ * base64_test.c
+ * libplist base64 codec regression test and benchmark
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#endif
+
+/* reference implementation: the original character-at-a-time codec */
+
+static const char ref_base64_str[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const char ref_base64_pad = '=';
+static signed char ref_base64_table[256];
+
+static void ref_base64_init(void)
+{
+	int i;
+	memset(ref_base64_table, -1, sizeof(ref_base64_table));
+	for (i = 0; i < 64; i++) {
+		ref_base64_table[(unsigned char)ref_base64_str[i]] = i;
+	}
+	ref_base64_table['='] = -2;
+}
+
+static size_t ref_base64encode(char *outbuf, const unsigned char *buf, size_t size)
+{
+	if (!outbuf || !buf || (size <= 0)) {
+		return 0;
+	}
+
+	size_t n = 0;
+	size_t m = 0;
+	unsigned char input[3];
+	unsigned int output[4];
+	while (n < size) {
+		input[0] = buf[n];
+		input[1] = (n+1 < size) ? buf[n+1] : 0;
+		input[2] = (n+2 < size) ? buf[n+2] : 0;
+		output[0] = input[0] >> 2;
+		output[1] = ((input[0] & 3) << 4) + (input[1] >> 4);
+		output[2] = ((input[1] & 15) << 2) + (input[2] >> 6);
+		output[3] = input[2] & 63;
+		outbuf[m++] = ref_base64_str[(int)output[0]];
+		outbuf[m++] = ref_base64_str[(int)output[1]];
+		outbuf[m++] = (n+1 < size) ? ref_base64_str[(int)output[2]] : ref_base64_pad;
+		outbuf[m++] = (n+2 < size) ? ref_base64_str[(int)output[3]] : ref_base64_pad;
+		n+=3;
+	}
+	outbuf[m] = 0;
+	return m;
+}
+
+static unsigned char *ref_base64decode(const char *buf, size_t *size)
+{
+	if (!buf || !size) return NULL;
+	size_t len = (*size > 0) ? *size : strlen(buf);
+	if (len <= 0) return NULL;
+	unsigned char *outbuf = (unsigned char*)malloc((len/4)*3+3);
+	const char *ptr = buf;
+	int p = 0;
+	int wv, w1, w2, w3, w4;
+	int tmpval[4];
+	int tmpcnt = 0;
+
+	do {
+		while (ptr < buf+len && (*ptr == ' ' || *ptr == '\t' || *ptr == '\n' || *ptr == '\r')) {
+			ptr++;
+		}
+		if (ptr >= buf+len || *ptr == '\0') {
+			break;
+		}
+		if ((wv = ref_base64_table[(int)(unsigned char)*ptr++]) == -1) {
+			continue;
+		}
+		tmpval[tmpcnt++] = wv;
+		if (tmpcnt == 4) {
+			tmpcnt = 0;
+			w1 = tmpval[0];
+			w2 = tmpval[1];
+			w3 = tmpval[2];
+			w4 = tmpval[3];
+
+			if (w1 >= 0 && w2 >= 0) {
+				outbuf[p++] = (unsigned char)(((w1 << 2) + (w2 >> 4)) & 0xFF);
+			}
+			if (w2 >= 0 && w3 >= 0) {
+				outbuf[p++] = (unsigned char)(((w2 << 4) + (w3 >> 2)) & 0xFF);
+			}
+			if (w3 >= 0 && w4 >= 0) {
+				outbuf[p++] = (unsigned char)(((w3 << 6) + w4) & 0xFF);
+			}
+		}
+	} while (1);
+
+	outbuf[p] = 0;
+	*size = p;
+	return outbuf;
+}
+
+static unsigned int rnd_state = 0x12345678;
+
+static unsigned int rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+	return rnd_state;
+}
+
+static int check_decode(const char *enc, size_t enc_len)
+{
+	size_t ref_size = enc_len;
+	size_t new_size = enc_len;
+	unsigned char *ref = ref_base64decode(enc, &ref_size);
+	unsigned char *res = (unsigned char*)plist_base64_decode(enc, &new_size);
+	int ok = (ref_size == new_size) && (memcmp(ref, res, ref_size) == 0);
+	free(ref);
+	free(res);
+	return ok;
+}
+
+static int test_correctness(void)
+{
+	static const char noise[] = " \t\r\n=*-_.\x80\xff";
+	size_t len;
+	unsigned char *data = (unsigned char*)calloc(1, 4096);
+	char *ref = (char*)malloc(8192);
+	char *enc = (char*)malloc(8192);
+	char *mixed = (char*)malloc(16384);
+	int failed = 0;
+
+	for (len = 0; len < 4096 && !failed; len += (len < 256) ? 1 : 61) {
+		size_t i, ref_len, enc_len, mixed_len = 0;
+		for (i = 0; i < len; i++) {
+			data[i] = (unsigned char)rnd();
+		}
+		ref_len = ref_base64encode(ref, data, len);
+		enc_len = plist_base64_encode(enc, data, len);
+		if (ref_len != enc_len || memcmp(ref, enc, ref_len + ((len > 0) ? 1 : 0)) != 0) {
+			printf("encode mismatch for %u bytes\n", (unsigned int)len);
+			failed = 1;
+			break;
+		}
+		if (enc_len == 0) {
+			continue;
+		}
+		if (!check_decode(enc, enc_len)) {
+			printf("decode mismatch for %u bytes\n", (unsigned int)len);
+			failed = 1;
+			break;
+		}
+
+		/* sprinkle whitespace, padding and invalid characters over the input */
+		for (i = 0; i < enc_len; i++) {
+			if ((rnd() % 23) == 0) {
+				mixed[mixed_len++] = noise[rnd() % (sizeof(noise)-1)];
+			}
+			mixed[mixed_len++] = enc[i];
+		}
+		mixed[mixed_len] = '\0';
+		if (!check_decode(mixed, mixed_len)) {
+			printf("decode mismatch for %u bytes with noise\n", (unsigned int)len);
+			failed = 1;
+			break;
+		}
+
+		/* embedded 0-terminator */
+		mixed[rnd() % mixed_len] = '\0';
+		if (!check_decode(mixed, mixed_len)) {
+			printf("decode mismatch for %u bytes with embedded NUL\n", (unsigned int)len);
+			failed = 1;
+			break;
+		}
+	}
+
+	free(data);
+	free(ref);
+	free(enc);
+	free(mixed);
+	return failed;
+}
+
+static double now(void)
+{
+	return (double)clock() / CLOCKS_PER_SEC;
+}
+
+#define BENCH_SIZE (64*1024*1024)
+#define BENCH_LINE 68
+
+static void report(const char *what, size_t bytes, int rounds, double start)
+{
+	double elapsed = now() - start;
+	printf("%-24s %6.2f GB/s\n", what, (elapsed > 0) ? ((double)bytes * rounds / elapsed / 1e9) : 0.0);
+}
+
+static void run_benchmark(void)
+{
+	unsigned char *data = (unsigned char*)malloc(BENCH_SIZE);
+	char *enc = (char*)malloc(BENCH_SIZE / 3 * 4 + 8);
+	char *lines = (char*)malloc(BENCH_SIZE / 3 * 4 + BENCH_SIZE / 3 * 4 / BENCH_LINE * 2 + 8);
+	size_t i, enc_len, lines_len = 0, size;
+	int r, rounds = 4;
+	double start;
+
+	for (i = 0; i < BENCH_SIZE; i++) {
+		data[i] = (unsigned char)rnd();
+	}
+
+	start = now();
+	for (r = 0; r < rounds; r++) {
+		enc_len = ref_base64encode(enc, data, BENCH_SIZE);
+	}
+	report("encode (reference)", BENCH_SIZE, rounds, start);
+
+	start = now();
+	for (r = 0; r < rounds; r++) {
+		enc_len = plist_base64_encode(enc, data, BENCH_SIZE);
+	}
+	report("encode", BENCH_SIZE, rounds, start);
+
+	start = now();
+	for (r = 0; r < rounds; r++) {
+		size = enc_len;
+		free(ref_base64decode(enc, &size));
+	}
+	report("decode (reference)", enc_len, rounds, start);
+
+	start = now();
+	for (r = 0; r < rounds; r++) {
+		size = enc_len;
+		free(plist_base64_decode(enc, &size));
+	}
+	report("decode", enc_len, rounds, start);
+
+	/* XML <data> style input with line breaks and indentation */
+	for (i = 0; i < enc_len; i += BENCH_LINE) {
+		size_t n = (enc_len - i < BENCH_LINE) ? enc_len - i : BENCH_LINE;
+		memcpy(lines + lines_len, enc + i, n);
+		lines_len += n;
+		lines[lines_len++] = '\n';
+		lines[lines_len++] = '\t';
+	}
+
+	start = now();
+	for (r = 0; r < rounds; r++) {
+		size = lines_len;
+		free(ref_base64decode(lines, &size));
+	}
+	report("decode lines (reference)", lines_len, rounds, start);
+
+	start = now();
+	for (r = 0; r < rounds; r++) {
+		size = lines_len;
+		free(plist_base64_decode(lines, &size));
+	}
+	report("decode lines", lines_len, rounds, start);
+
+	free(data);
+	free(enc);
+	free(lines);
+}
+
+int main(int argc, char *argv[])
+{
+	ref_base64_init();
+
+	if (argc > 1 && !strcmp(argv[1], "--bench")) {
+		run_benchmark();
+		return 0;
+	}
+
+	if (test_correctness() != 0) {
+		return 1;
+	}
+	printf("base64 codec matches the reference implementation\n");
+	return 0;
+}
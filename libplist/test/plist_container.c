@@ -0,0 +1,303 @@
+/*
+ * plist_container.c
+ * libplist array/dict container consistency test and benchmark
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#endif
+
+static unsigned int rnd_state = 0x2545F491;
+
+static unsigned int rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+	return rnd_state;
+}
+
+#define MAX_ITEMS 2048
+
+/* check every position of the array against the shadow model */
+static int check_array(plist_t array, plist_t *model, uint32_t count)
+{
+	plist_array_iter it = NULL;
+	plist_t item = NULL;
+	uint32_t i;
+
+	if (plist_array_get_size(array) != count) {
+		printf("array size %u, expected %u\n", plist_array_get_size(array), count);
+		return -1;
+	}
+	for (i = 0; i < count; i++) {
+		if (plist_array_get_item(array, i) != model[i]) {
+			printf("array item %u does not match\n", i);
+			return -1;
+		}
+		if (plist_array_get_item_index(model[i]) != i) {
+			printf("array item %u reports index %u\n", i, plist_array_get_item_index(model[i]));
+			return -1;
+		}
+	}
+	if (plist_array_get_item(array, count) != NULL) {
+		printf("array item past the end is not NULL\n");
+		return -1;
+	}
+
+	plist_array_new_iter(array, &it);
+	for (i = 0; ; i++) {
+		plist_array_next_item(array, it, &item);
+		if (!item) break;
+		if (i >= count || item != model[i]) {
+			printf("array iteration mismatch at %u\n", i);
+			free(it);
+			return -1;
+		}
+	}
+	free(it);
+	if (i != count) {
+		printf("array iteration stopped at %u, expected %u\n", i, count);
+		return -1;
+	}
+	return 0;
+}
+
+static int test_array(void)
+{
+	plist_t array = plist_new_array();
+	plist_t *model = (plist_t*)malloc(MAX_ITEMS * sizeof(plist_t));
+	uint32_t count = 0;
+	int round;
+
+	for (round = 0; round < 20000; round++) {
+		unsigned int op = rnd() % 8;
+		plist_t item = NULL;
+		uint32_t n;
+
+		if (count == 0 || (op < 3 && count < MAX_ITEMS)) {
+			/* append */
+			item = plist_new_uint(round);
+			plist_array_append_item(array, item);
+			model[count++] = item;
+		} else if (op < 5 && count < MAX_ITEMS) {
+			/* insert */
+			n = rnd() % (count + 1);
+			item = plist_new_uint(round);
+			plist_array_insert_item(array, item, n);
+			memmove(&model[n + 1], &model[n], (count - n) * sizeof(plist_t));
+			model[n] = item;
+			count++;
+		} else if (op == 5) {
+			/* replace */
+			n = rnd() % count;
+			item = plist_new_uint(round);
+			plist_array_set_item(array, item, n);
+			model[n] = item;
+		} else if (op == 6) {
+			/* remove by index */
+			n = rnd() % count;
+			plist_array_remove_item(array, n);
+			count--;
+			memmove(&model[n], &model[n + 1], (count - n) * sizeof(plist_t));
+		} else {
+			/* remove by item */
+			n = rnd() % count;
+			plist_array_item_remove(model[n]);
+			count--;
+			memmove(&model[n], &model[n + 1], (count - n) * sizeof(plist_t));
+		}
+
+		if ((round % 97) == 0 || count < 8) {
+			if (check_array(array, model, count) < 0) {
+				printf("after round %d\n", round);
+				return -1;
+			}
+		}
+	}
+	if (check_array(array, model, count) < 0) {
+		return -1;
+	}
+
+	/* a copy must be independent of the original and index the same way */
+	plist_t copy = plist_copy(array);
+	uint32_t i;
+	for (i = 0; i < count; i++) {
+		model[i] = plist_array_get_item(copy, i);
+	}
+	plist_free(array);
+	if (check_array(copy, model, count) < 0) {
+		return -1;
+	}
+	plist_free(copy);
+	free(model);
+	return 0;
+}
+
+static int test_dict(void)
+{
+	plist_t dict = plist_new_dict();
+	plist_t values[1024];
+	char key[32];
+	int round, i;
+
+	memset(values, 0, sizeof(values));
+	for (round = 0; round < 20000; round++) {
+		int k = rnd() % 1024;
+		sprintf(key, "key%d", k);
+		if (rnd() % 3) {
+			values[k] = plist_new_uint(round);
+			plist_dict_set_item(dict, key, values[k]);
+		} else if (values[k]) {
+			plist_dict_remove_item(dict, key);
+			values[k] = NULL;
+		}
+	}
+
+	uint32_t count = 0;
+	for (i = 0; i < 1024; i++) {
+		sprintf(key, "key%d", i);
+		if (plist_dict_get_item(dict, key) != values[i]) {
+			printf("dict item %s does not match\n", key);
+			return -1;
+		}
+		if (values[i]) {
+			char *item_key = NULL;
+			plist_dict_get_item_key(values[i], &item_key);
+			if (!item_key || strcmp(item_key, key) != 0) {
+				printf("dict item %s reports key %s\n", key, item_key ? item_key : "(null)");
+				return -1;
+			}
+			free(item_key);
+			count++;
+		}
+	}
+	if (plist_dict_get_size(dict) != count) {
+		printf("dict size %u, expected %u\n", plist_dict_get_size(dict), count);
+		return -1;
+	}
+
+	plist_dict_iter it = NULL;
+	plist_t val = NULL;
+	char *item_key = NULL;
+	uint32_t seen = 0;
+	plist_dict_new_iter(dict, &it);
+	for (;;) {
+		plist_dict_next_item(dict, it, &item_key, &val);
+		if (!val) break;
+		if (plist_dict_get_item(dict, item_key) != val) {
+			printf("dict iteration mismatch for %s\n", item_key);
+			return -1;
+		}
+		free(item_key);
+		seen++;
+	}
+	free(it);
+	if (seen != count) {
+		printf("dict iteration returned %u items, expected %u\n", seen, count);
+		return -1;
+	}
+
+	plist_free(dict);
+	return 0;
+}
+
+static double now(void)
+{
+	return (double)clock() / CLOCKS_PER_SEC;
+}
+
+#define BENCH_ITEMS 100000
+
+static void run_benchmark(void)
+{
+	plist_t array = plist_new_array();
+	plist_t dict = plist_new_dict();
+	uint64_t sum = 0;
+	uint32_t i;
+	double start;
+	char key[32];
+
+	start = now();
+	for (i = 0; i < BENCH_ITEMS; i++) {
+		plist_array_append_item(array, plist_new_uint(i));
+	}
+	printf("%-28s %8.2f ms\n", "array append", (now() - start) * 1000);
+
+	start = now();
+	for (i = 0; i < BENCH_ITEMS; i++) {
+		sum += plist_array_get_item_index(plist_array_get_item(array, (i * 7919) % BENCH_ITEMS));
+	}
+	printf("%-28s %8.2f ms\n", "array random index", (now() - start) * 1000);
+
+	start = now();
+	for (i = 0; i < 1000; i++) {
+		plist_array_insert_item(array, plist_new_uint(i), (i * 7919) % BENCH_ITEMS);
+	}
+	printf("%-28s %8.2f ms\n", "array insert (1000)", (now() - start) * 1000);
+
+	start = now();
+	for (i = 0; i < 100; i++) {
+		plist_array_iter it = NULL;
+		plist_t item = NULL;
+		plist_array_new_iter(array, &it);
+		do {
+			plist_array_next_item(array, it, &item);
+			sum += (item != NULL);
+		} while (item);
+		free(it);
+	}
+	printf("%-28s %8.2f ms\n", "array iterate (100x)", (now() - start) * 1000);
+
+	start = now();
+	for (i = 0; i < BENCH_ITEMS; i++) {
+		sprintf(key, "key%u", i);
+		plist_dict_set_item(dict, key, plist_new_uint(i));
+	}
+	printf("%-28s %8.2f ms\n", "dict set", (now() - start) * 1000);
+
+	start = now();
+	plist_free(array);
+	plist_free(dict);
+	printf("%-28s %8.2f ms\n", "free", (now() - start) * 1000);
+
+	if (sum == 0) {
+		printf("\n");
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc > 1 && !strcmp(argv[1], "--bench")) {
+		run_benchmark();
+		return 0;
+	}
+
+	if (test_array() != 0 || test_dict() != 0) {
+		return 1;
+	}
+	printf("array and dict containers are consistent\n");
+	return 0;
+}
@@ -0,0 +1,171 @@
+/*
+ * plist_nocopy.c
+ * libplist borrowed-buffer binary import regression test
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#endif
+
+/* returns the first data node found in a depth-first walk */
+static plist_t find_data_node(plist_t node)
+{
+    plist_t found = NULL;
+    uint32_t i;
+
+    switch (plist_get_node_type(node)) {
+    case PLIST_DATA:
+        return node;
+    case PLIST_ARRAY:
+        for (i = 0; !found && i < plist_array_get_size(node); i++) {
+            found = find_data_node(plist_array_get_item(node, i));
+        }
+        return found;
+    case PLIST_DICT: {
+        plist_dict_iter it = NULL;
+        plist_t val = NULL;
+        plist_dict_new_iter(node, &it);
+        do {
+            plist_dict_next_item(node, it, NULL, &val);
+            if (val) {
+                found = find_data_node(val);
+            }
+        } while (val && !found);
+        free(it);
+        return found;
+    }
+    default:
+        return NULL;
+    }
+}
+
+static int same_bin(plist_t a, plist_t b)
+{
+    char *bin_a = NULL, *bin_b = NULL;
+    uint32_t size_a = 0, size_b = 0;
+    int res;
+
+    plist_to_bin(a, &bin_a, &size_a);
+    plist_to_bin(b, &bin_b, &size_b);
+    res = (bin_a && bin_b && size_a == size_b && memcmp(bin_a, bin_b, size_a) == 0);
+    free(bin_a);
+    free(bin_b);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *iplist = NULL;
+    plist_t root_node = NULL;
+    plist_t borrowed = NULL;
+    plist_t copy = NULL;
+    char *plist_in = NULL;
+    char *plist_bin = NULL;
+    uint32_t size_bin = 0;
+    struct stat filestats;
+
+    if (argc != 2)
+    {
+        printf("Wrong input\n");
+        return 1;
+    }
+
+    iplist = fopen(argv[1], "rb");
+    if (!iplist)
+    {
+        printf("File does not exists\n");
+        return 2;
+    }
+    stat(argv[1], &filestats);
+    plist_in = (char *) malloc(filestats.st_size + 1);
+    fread(plist_in, 1, filestats.st_size, iplist);
+    fclose(iplist);
+
+    plist_from_memory(plist_in, filestats.st_size, &root_node);
+    free(plist_in);
+    if (!root_node)
+    {
+        printf("PList parsing failed\n");
+        return 3;
+    }
+
+    plist_to_bin(root_node, &plist_bin, &size_bin);
+    if (!plist_bin)
+    {
+        printf("PList BIN writing failed\n");
+        return 4;
+    }
+
+    plist_from_memory_nocopy(plist_bin, size_bin, &borrowed);
+    if (!borrowed || !same_bin(root_node, borrowed))
+    {
+        printf("Borrowed import differs from the regular import\n");
+        return 5;
+    }
+
+    plist_t data = find_data_node(borrowed);
+    if (data)
+    {
+        uint64_t length = 0;
+        const char *ptr = plist_get_data_ptr(data, &length);
+        if (ptr < plist_bin || ptr + length > plist_bin + size_bin)
+        {
+            printf("Data node does not reference the input buffer\n");
+            return 6;
+        }
+
+        /* replacing the value must not touch the input buffer */
+        plist_set_data_val(data, "replaced", 8);
+        ptr = plist_get_data_ptr(data, &length);
+        if (length != 8 || memcmp(ptr, "replaced", 8) != 0 || (ptr >= plist_bin && ptr < plist_bin + size_bin))
+        {
+            printf("Replacing borrowed data failed\n");
+            return 7;
+        }
+    }
+
+    /* copies own their payloads and outlive both the input and the original */
+    copy = plist_copy(borrowed);
+    plist_free(borrowed);
+    memset(plist_bin, 0, size_bin);
+    free(plist_bin);
+
+    if (data)
+    {
+        plist_set_data_val(find_data_node(root_node), "replaced", 8);
+    }
+    if (!same_bin(root_node, copy))
+    {
+        printf("Copy of borrowed import differs\n");
+        return 8;
+    }
+
+    printf("%s: borrowed import matches%s\n", argv[1], data ? ", data is referenced in place" : "");
+
+    plist_free(copy);
+    plist_free(root_node);
+
+    return 0;
+}
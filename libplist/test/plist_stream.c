@@ -0,0 +1,160 @@
+/*
+ * plist_stream.c
+ * libplist streaming export regression test
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#endif
+
+struct out_buf {
+    char *data;
+    uint32_t len;
+    uint32_t capacity;
+    uint32_t chunks;
+    uint32_t announced;
+};
+
+static int out_buf_write(const char *data, uint32_t length, void *user_data)
+{
+    struct out_buf *out = (struct out_buf*)user_data;
+    if (out->chunks == 0 && out->announced > 0) {
+        /* the total length is known up front, allocate once */
+        out->capacity = out->announced;
+        out->data = (char*)malloc(out->capacity);
+    }
+    if (out->len + length > out->capacity) {
+        out->capacity = (out->len + length) * 2;
+        out->data = (char*)realloc(out->data, out->capacity);
+    }
+    memcpy(out->data + out->len, data, length);
+    out->len += length;
+    out->chunks++;
+    return 0;
+}
+
+static int abort_write(const char *data, uint32_t length, void *user_data)
+{
+    return -1;
+}
+
+static int compare_output(const char *what, const char *expected, uint32_t expected_len, struct out_buf *out)
+{
+    if (expected_len != out->len || expected_len != out->announced) {
+        printf("%s: length mismatch (%u vs %u)\n", what, expected_len, out->len);
+        return 0;
+    }
+    if (memcmp(expected, out->data, expected_len) != 0) {
+        printf("%s: content mismatch\n", what);
+        return 0;
+    }
+    printf("%s: %u bytes in %u chunks match\n", what, out->len, out->chunks);
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *iplist = NULL;
+    plist_t root_node = NULL;
+    char *plist_in = NULL;
+    char *plist_xml = NULL;
+    char *plist_bin = NULL;
+    uint32_t size_xml = 0;
+    uint32_t size_bin = 0;
+    struct out_buf out;
+    struct stat filestats;
+    int res = 0;
+
+    if (argc != 2)
+    {
+        printf("Wrong input\n");
+        return 1;
+    }
+
+    iplist = fopen(argv[1], "rb");
+    if (!iplist)
+    {
+        printf("File does not exists\n");
+        return 2;
+    }
+    stat(argv[1], &filestats);
+    plist_in = (char *) malloc(filestats.st_size + 1);
+    fread(plist_in, 1, filestats.st_size, iplist);
+    fclose(iplist);
+
+    plist_from_memory(plist_in, filestats.st_size, &root_node);
+    free(plist_in);
+    if (!root_node)
+    {
+        printf("PList parsing failed\n");
+        return 3;
+    }
+
+    plist_to_xml(root_node, &plist_xml, &size_xml);
+    if (!plist_xml || strlen(plist_xml) != size_xml)
+    {
+        printf("PList XML writing failed\n");
+        return 4;
+    }
+
+    plist_to_bin(root_node, &plist_bin, &size_bin);
+    if (!plist_bin)
+    {
+        printf("PList BIN writing failed\n");
+        return 4;
+    }
+
+    memset(&out, 0, sizeof(out));
+    if (plist_to_xml_cb(root_node, out_buf_write, &out, &out.announced) < 0 || !compare_output("XML", plist_xml, size_xml, &out))
+    {
+        res = 5;
+    }
+    free(out.data);
+
+    memset(&out, 0, sizeof(out));
+    if (plist_to_bin_cb(root_node, out_buf_write, &out, &out.announced) < 0 || !compare_output("BIN", plist_bin, size_bin, &out))
+    {
+        res = 5;
+    }
+    free(out.data);
+
+    free(plist_xml);
+    free(plist_bin);
+
+    if (res == 0 && plist_to_xml_cb(root_node, abort_write, NULL, NULL) == 0)
+    {
+        printf("Aborted XML export did not fail\n");
+        res = 6;
+    }
+    if (res == 0 && plist_to_bin_cb(root_node, abort_write, NULL, NULL) == 0)
+    {
+        printf("Aborted BIN export did not fail\n");
+        res = 6;
+    }
+
+    plist_free(root_node);
+
+    return res;
+}
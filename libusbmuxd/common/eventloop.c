@@ -0,0 +1,318 @@
+/*
+ * eventloop.c
+ * Readiness-driven socket multiplexing (epoll on Linux, poll elsewhere)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#include <unistd.h>
+#elif defined(WIN32)
+#include <winsock2.h>
+#define poll WSAPoll
+#else
+#include <poll.h>
+#endif
+
+#include "eventloop.h"
+#include "collection.h"
+
+#define EVENT_LOOP_MAX_EVENTS 64
+
+struct event_source {
+	int fd;
+	int events;
+	int removed;
+	event_loop_cb_t callback;
+	void *user_data;
+};
+
+struct event_loop {
+	struct collection sources;
+	int dispatching;
+#ifdef HAVE_SYS_EPOLL_H
+	int epfd;
+#else
+	struct pollfd *pfds;
+	struct event_source **polled;
+	int poll_capacity;
+#endif
+};
+
+static struct event_source *event_loop_find(event_loop_t *loop, int fd)
+{
+	FOREACH(struct event_source *source, &loop->sources) {
+		if (source->fd == fd && !source->removed) {
+			return source;
+		}
+	} ENDFOREACH
+	return NULL;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+static uint32_t epoll_events(int events)
+{
+	uint32_t ev = 0;
+	if (events & EVENT_LOOP_READ)
+		ev |= EPOLLIN;
+	if (events & EVENT_LOOP_WRITE)
+		ev |= EPOLLOUT;
+	return ev;
+}
+
+static int epoll_update(event_loop_t *loop, int op, struct event_source *source)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = epoll_events(source->events);
+	ev.data.ptr = source;
+	if (epoll_ctl(loop->epfd, op, source->fd, &ev) < 0) {
+		return -errno;
+	}
+	return 0;
+}
+#endif
+
+event_loop_t *event_loop_new(void)
+{
+	event_loop_t *loop = (event_loop_t*)calloc(1, sizeof(event_loop_t));
+	if (!loop) {
+		return NULL;
+	}
+#ifdef HAVE_SYS_EPOLL_H
+	loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (loop->epfd < 0) {
+		free(loop);
+		return NULL;
+	}
+#endif
+	collection_init(&loop->sources);
+	return loop;
+}
+
+void event_loop_free(event_loop_t *loop)
+{
+	if (!loop) {
+		return;
+	}
+	FOREACH(struct event_source *source, &loop->sources) {
+		free(source);
+	} ENDFOREACH
+	collection_free(&loop->sources);
+#ifdef HAVE_SYS_EPOLL_H
+	close(loop->epfd);
+#else
+	free(loop->pfds);
+	free(loop->polled);
+#endif
+	free(loop);
+}
+
+int event_loop_add(event_loop_t *loop, int fd, int events, event_loop_cb_t callback, void *user_data)
+{
+	struct event_source *source;
+
+	if (!loop || fd < 0 || !callback) {
+		return -EINVAL;
+	}
+	if (event_loop_find(loop, fd)) {
+		return -EEXIST;
+	}
+
+	source = (struct event_source*)calloc(1, sizeof(struct event_source));
+	if (!source) {
+		return -ENOMEM;
+	}
+	source->fd = fd;
+	source->events = events;
+	source->callback = callback;
+	source->user_data = user_data;
+
+#ifdef HAVE_SYS_EPOLL_H
+	int res = epoll_update(loop, EPOLL_CTL_ADD, source);
+	if (res < 0) {
+		free(source);
+		return res;
+	}
+#endif
+	collection_add(&loop->sources, source);
+	return 0;
+}
+
+int event_loop_modify(event_loop_t *loop, int fd, int events)
+{
+	struct event_source *source;
+
+	if (!loop) {
+		return -EINVAL;
+	}
+	source = event_loop_find(loop, fd);
+	if (!source) {
+		return -ENOENT;
+	}
+	if (source->events == events) {
+		return 0;
+	}
+	source->events = events;
+#ifdef HAVE_SYS_EPOLL_H
+	return epoll_update(loop, EPOLL_CTL_MOD, source);
+#else
+	return 0;
+#endif
+}
+
+int event_loop_remove(event_loop_t *loop, int fd)
+{
+	struct event_source *source;
+
+	if (!loop) {
+		return -EINVAL;
+	}
+	source = event_loop_find(loop, fd);
+	if (!source) {
+		return -ENOENT;
+	}
+#ifdef HAVE_SYS_EPOLL_H
+	epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, NULL);
+#endif
+	if (loop->dispatching) {
+		/* events for this source may still be pending in the current
+		 * batch, it is released once the dispatch is finished */
+		source->removed = 1;
+	} else {
+		collection_remove(&loop->sources, source);
+		free(source);
+	}
+	return 0;
+}
+
+static void event_loop_dispatch(event_loop_t *loop, struct event_source *source, int events)
+{
+	if (source->removed) {
+		return;
+	}
+	/* only report what was asked for, errors are always reported */
+	events &= (source->events | EVENT_LOOP_ERROR);
+	if (events) {
+		source->callback(source->fd, events, source->user_data);
+	}
+}
+
+static void event_loop_sweep(event_loop_t *loop)
+{
+	FOREACH(struct event_source *source, &loop->sources) {
+		if (source->removed) {
+			collection_remove(&loop->sources, source);
+			free(source);
+		}
+	} ENDFOREACH
+}
+
+int event_loop_run_once(event_loop_t *loop, int timeout)
+{
+	int count;
+	int i;
+
+	if (!loop || loop->dispatching) {
+		return -EINVAL;
+	}
+
+#ifdef HAVE_SYS_EPOLL_H
+	struct epoll_event ready[EVENT_LOOP_MAX_EVENTS];
+
+	count = epoll_wait(loop->epfd, ready, EVENT_LOOP_MAX_EVENTS, timeout);
+	if (count < 0) {
+		return (errno == EINTR) ? 0 : -errno;
+	}
+
+	loop->dispatching = 1;
+	for (i = 0; i < count; i++) {
+		int events = 0;
+		if (ready[i].events & EPOLLIN)
+			events |= EVENT_LOOP_READ;
+		if (ready[i].events & EPOLLOUT)
+			events |= EVENT_LOOP_WRITE;
+		if (ready[i].events & (EPOLLERR | EPOLLHUP))
+			events |= EVENT_LOOP_ERROR;
+		event_loop_dispatch(loop, (struct event_source*)ready[i].data.ptr, events);
+	}
+#else
+	int nfds = 0;
+
+	if (loop->poll_capacity < loop->sources.capacity) {
+		struct pollfd *pfds = (struct pollfd*)realloc(loop->pfds, sizeof(struct pollfd) * loop->sources.capacity);
+		struct event_source **polled = (struct event_source**)realloc(loop->polled, sizeof(struct event_source*) * loop->sources.capacity);
+		if (pfds)
+			loop->pfds = pfds;
+		if (polled)
+			loop->polled = polled;
+		if (!pfds || !polled) {
+			return -ENOMEM;
+		}
+		loop->poll_capacity = loop->sources.capacity;
+	}
+
+	FOREACH(struct event_source *source, &loop->sources) {
+		loop->pfds[nfds].fd = source->fd;
+		loop->pfds[nfds].events = 0;
+		loop->pfds[nfds].revents = 0;
+		if (source->events & EVENT_LOOP_READ)
+			loop->pfds[nfds].events |= POLLIN;
+		if (source->events & EVENT_LOOP_WRITE)
+			loop->pfds[nfds].events |= POLLOUT;
+		loop->polled[nfds] = source;
+		nfds++;
+	} ENDFOREACH
+
+	count = poll(loop->pfds, nfds, timeout);
+	if (count < 0) {
+#ifdef WIN32
+		/* WSAPoll reports errors through WSAGetLastError, not errno */
+		return (WSAGetLastError() == WSAEINTR) ? 0 : -EIO;
+#else
+		return (errno == EINTR) ? 0 : -errno;
+#endif
+	}
+
+	loop->dispatching = 1;
+	count = 0;
+	for (i = 0; i < nfds; i++) {
+		int events = 0;
+		if (!loop->pfds[i].revents)
+			continue;
+		if (loop->pfds[i].revents & POLLIN)
+			events |= EVENT_LOOP_READ;
+		if (loop->pfds[i].revents & POLLOUT)
+			events |= EVENT_LOOP_WRITE;
+		if (loop->pfds[i].revents & (POLLERR | POLLHUP | POLLNVAL))
+			events |= EVENT_LOOP_ERROR;
+		event_loop_dispatch(loop, loop->polled[i], events);
+		count++;
+	}
+#endif
+	loop->dispatching = 0;
+	event_loop_sweep(loop);
+
+	return count;
+}
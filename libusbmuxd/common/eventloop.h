@@ -0,0 +1,46 @@
+/*
+ * eventloop.h
+ * Readiness-driven socket multiplexing (epoll on Linux, poll elsewhere)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __EVENTLOOP_H
+#define __EVENTLOOP_H
+
+enum event_loop_events {
+	EVENT_LOOP_READ = 1 << 0,
+	EVENT_LOOP_WRITE = 1 << 1,
+	EVENT_LOOP_ERROR = 1 << 2
+};
+
+typedef struct event_loop event_loop_t;
+typedef void (*event_loop_cb_t)(int fd, int events, void *user_data);
+
+/* All functions must be called from the thread that runs the loop.
+ * Callbacks may add, modify and remove descriptors (including their own). */
+event_loop_t *event_loop_new(void);
+void event_loop_free(event_loop_t *loop);
+
+int event_loop_add(event_loop_t *loop, int fd, int events, event_loop_cb_t callback, void *user_data);
+int event_loop_modify(event_loop_t *loop, int fd, int events);
+int event_loop_remove(event_loop_t *loop, int fd);
+
+/* Waits up to timeout milliseconds (-1 waits forever) and dispatches every
+ * ready descriptor once. Returns the number of callbacks invoked or a
+ * negative errno value. */
+int event_loop_run_once(event_loop_t *loop, int timeout);
+
+#endif
@@ -43,6 +43,7 @@ static int wsa_init = 0;
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
+#include <poll.h>
 #endif
 #include "socket.h"
 
@@ -354,11 +355,15 @@ int socket_connect(const char *addr, uint16_t port)
 
 int socket_check_fd(int fd, fd_mode fdm, unsigned int timeout)
 {
-	fd_set fds;
 	int sret;
 	int eagain;
+#ifdef WIN32
+	fd_set fds;
 	struct timeval to;
 	struct timeval *pto;
+#else
+	struct pollfd pfd;
+#endif
 
 	if (fd < 0) {
 		if (verbose >= 2)
@@ -366,12 +371,13 @@ int socket_check_fd(int fd, fd_mode fdm, unsigned int timeout)
 		return -1;
 	}
 
-	FD_ZERO(&fds);
-	FD_SET(fd, &fds);
-
 	sret = -1;
 
 	do {
+		eagain = 0;
+#ifdef WIN32
+		FD_ZERO(&fds);
+		FD_SET(fd, &fds);
 		if (timeout > 0) {
 			to.tv_sec = (time_t) (timeout / 1000);
 			to.tv_usec = (time_t) ((timeout - (to.tv_sec * 1000)) * 1000);
@@ -379,7 +385,6 @@ int socket_check_fd(int fd, fd_mode fdm, unsigned int timeout)
 		} else {
 			pto = NULL;
 		}
-		eagain = 0;
 		switch (fdm) {
 		case FDM_READ:
 			sret = select(fd + 1, &fds, NULL, NULL, pto);
@@ -393,6 +398,25 @@ int socket_check_fd(int fd, fd_mode fdm, unsigned int timeout)
 		default:
 			return -1;
 		}
+#else
+		/* poll is not limited to descriptors below FD_SETSIZE */
+		pfd.fd = fd;
+		pfd.revents = 0;
+		switch (fdm) {
+		case FDM_READ:
+			pfd.events = POLLIN;
+			break;
+		case FDM_WRITE:
+			pfd.events = POLLOUT;
+			break;
+		case FDM_EXCEPT:
+			pfd.events = POLLPRI;
+			break;
+		default:
+			return -1;
+		}
+		sret = poll(&pfd, 1, (timeout > 0) ? (int)timeout : -1);
+#endif
 
 		if (sret < 0) {
 			switch (errno) {
@@ -495,3 +519,92 @@ int socket_send(int fd, void *data, size_t length)
 #endif
 	return send(fd, data, length, flags);
 }
+
+#ifdef WIN32
+static int socket_ready(int fd, fd_mode fdm)
+{
+	fd_set fds;
+	struct timeval to = { 0, 0 };
+
+	FD_ZERO(&fds);
+	FD_SET(fd, &fds);
+	if (fdm == FDM_READ) {
+		return select(fd + 1, &fds, NULL, NULL, &to);
+	}
+	return select(fd + 1, NULL, &fds, NULL, &to);
+}
+#endif
+
+/**
+ * Maps the error of a failed nonblocking send or receive to a negative errno
+ * value, with -EAGAIN meaning the call should be retried later.
+ */
+static int socket_nonblocking_error(void)
+{
+#ifdef WIN32
+	int error = WSAGetLastError();
+	if (error == WSAEWOULDBLOCK || error == WSAEINTR) {
+		return -EAGAIN;
+	}
+	if (error == WSAECONNRESET || error == WSAECONNABORTED) {
+		return -ECONNRESET;
+	}
+	return -EIO;
+#else
+	if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+		return -EAGAIN;
+	}
+	return -errno;
+#endif
+}
+
+int socket_receive_nonblocking(int fd, void *data, size_t length)
+{
+	int result;
+
+#ifdef WIN32
+	result = socket_ready(fd, FDM_READ);
+	if (result < 0) {
+		return socket_nonblocking_error();
+	} else if (result == 0) {
+		return -EAGAIN;
+	}
+	result = recv(fd, data, length, 0);
+#else
+	result = recv(fd, data, length, MSG_DONTWAIT);
+#endif
+	if (result == 0) {
+		if (verbose >= 3)
+			fprintf(stderr, "%s: fd=%d recv returned 0\n", __func__, fd);
+		return -ECONNRESET;
+	}
+	if (result < 0) {
+		return socket_nonblocking_error();
+	}
+	return result;
+}
+
+int socket_send_nonblocking(int fd, void *data, size_t length)
+{
+	int flags = 0;
+	int result;
+
+#ifdef MSG_NOSIGNAL
+	flags |= MSG_NOSIGNAL;
+#endif
+#ifdef WIN32
+	result = socket_ready(fd, FDM_WRITE);
+	if (result < 0) {
+		return socket_nonblocking_error();
+	} else if (result == 0) {
+		return -EAGAIN;
+	}
+#else
+	flags |= MSG_DONTWAIT;
+#endif
+	result = send(fd, data, length, flags);
+	if (result < 0) {
+		return socket_nonblocking_error();
+	}
+	return result;
+}
@@ -60,6 +60,10 @@ int socket_receive_timeout(int fd, void *data, size_t size, int flags,
 
 int socket_send(int fd, void *data, size_t size);
 
+/* never block; return -EAGAIN when the socket is not ready */
+int socket_receive_nonblocking(int fd, void *data, size_t size);
+int socket_send_nonblocking(int fd, void *data, size_t size);
+
 void socket_set_verbose(int level);
 
 #endif	/* SOCKET_SOCKET_H */
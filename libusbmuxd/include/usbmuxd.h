@@ -156,6 +156,22 @@ int usbmuxd_get_device_list(usbmuxd_device_info_t **device_list);
  */
 int usbmuxd_device_list_free(usbmuxd_device_info_t **device_list);
 
+/**
+ * Copies the device table that is kept up to date while an event
+ * subscription (usbmuxd_events_subscribe()) is active. This neither
+ * contacts usbmuxd nor allocates memory, so it is cheap enough to poll.
+ * usbmuxd_get_device_list() uses the same table when it is available.
+ *
+ * @param device_list An array receiving up to max_devices entries.
+ * @param max_devices Number of entries device_list can hold.
+ *
+ * @return number of attached devices, which may be larger than
+ *   max_devices, -ENODATA if there is no active subscription or its
+ *   initial device list has not been received yet, or another negative
+ *   errno value.
+ */
+int usbmuxd_copy_device_list(usbmuxd_device_info_t *device_list, int max_devices);
+
 /**
  * Looks up the device specified by UDID and returns device information.
  *
@@ -259,6 +275,135 @@ int usbmuxd_recv_timeout(int sfd, char *data, uint32_t len, uint32_t *recv_bytes
  */
 int usbmuxd_recv(int sfd, char *data, uint32_t len, uint32_t *recv_bytes);
 
+/**
+ * Send data to the specified socket without blocking.
+ *
+ * @param sfd socket file descriptor returned by usbmuxd_connect()
+ * @param data buffer to send
+ * @param len size of buffer to send
+ * @param sent_bytes how many bytes sent, may be less than len
+ *
+ * @return 0 on success, -EAGAIN if the socket cannot take any data right
+ *    now, another negative errno value otherwise.
+ */
+int usbmuxd_send_nonblocking(int sfd, const char *data, uint32_t len, uint32_t *sent_bytes);
+
+/**
+ * Receive data from the specified socket without blocking.
+ *
+ * @param sfd socket file descriptor returned by usbmuxd_connect()
+ * @param data buffer to put the data to
+ * @param len size of the buffer
+ * @param recv_bytes number of bytes received
+ *
+ * @return 0 on success, -EAGAIN if no data is available right now,
+ *    -ECONNRESET if the peer closed the connection, another negative errno
+ *    value otherwise.
+ */
+int usbmuxd_recv_nonblocking(int sfd, char *data, uint32_t len, uint32_t *recv_bytes);
+
+/**
+ * Event loop type.
+ *
+ * An event loop multiplexes the usbmuxd listening connection and any number
+ * of device connections in one thread (epoll on Linux, poll elsewhere).
+ * It is not thread safe: all functions taking a loop must be called from
+ * the thread running it, callbacks included.
+ */
+typedef struct usbmuxd_event_loop* usbmuxd_event_loop_t;
+
+/**
+ * Readiness flags for usbmuxd_event_loop_add() and the loop callback.
+ */
+enum usbmuxd_loop_events {
+    USBMUXD_LOOP_READ = 1 << 0,
+    USBMUXD_LOOP_WRITE = 1 << 1,
+    USBMUXD_LOOP_ERROR = 1 << 2
+};
+
+/**
+ * Loop callback prototype. Called with the socket and the USBMUXD_LOOP_*
+ * flags it is ready for; USBMUXD_LOOP_ERROR is always reported.
+ */
+typedef void (*usbmuxd_loop_cb_t) (int sfd, int events, void *user_data);
+
+/**
+ * Creates a new event loop.
+ *
+ * @return the new loop or NULL on error.
+ */
+usbmuxd_event_loop_t usbmuxd_event_loop_new(void);
+
+/**
+ * Unsubscribes device events and frees the loop. Sockets added to the
+ * loop are not closed.
+ */
+void usbmuxd_event_loop_free(usbmuxd_event_loop_t loop);
+
+/**
+ * Watches a socket for readiness. The socket should be used with
+ * usbmuxd_send_nonblocking() and usbmuxd_recv_nonblocking() from the
+ * callback.
+ *
+ * @param loop The event loop.
+ * @param sfd socket file descriptor, e.g. returned by usbmuxd_connect()
+ * @param events USBMUXD_LOOP_READ and/or USBMUXD_LOOP_WRITE
+ * @param callback A callback function that is executed when the socket
+ *    becomes ready.
+ * @param user_data Custom data passed on to the callback function.
+ *
+ * @return 0 on success or a negative errno value.
+ */
+int usbmuxd_event_loop_add(usbmuxd_event_loop_t loop, int sfd, int events, usbmuxd_loop_cb_t callback, void *user_data);
+
+/**
+ * Changes the readiness a socket is watched for, e.g. to only ask for
+ * USBMUXD_LOOP_WRITE while there is pending output.
+ *
+ * @return 0 on success or a negative errno value.
+ */
+int usbmuxd_event_loop_modify(usbmuxd_event_loop_t loop, int sfd, int events);
+
+/**
+ * Stops watching a socket. The socket is not closed.
+ *
+ * @return 0 on success or a negative errno value.
+ */
+int usbmuxd_event_loop_remove(usbmuxd_event_loop_t loop, int sfd);
+
+/**
+ * Waits for sockets to become ready and runs their callbacks once.
+ *
+ * @param loop The event loop.
+ * @param timeout how many milliseconds to wait, -1 to wait forever
+ *
+ * @return the number of callbacks executed or a negative errno value.
+ */
+int usbmuxd_event_loop_run_once(usbmuxd_event_loop_t loop, int timeout);
+
+/**
+ * Receives device add/remove/paired events on the loop instead of on a
+ * separate monitor thread. Connected devices are reported as added once
+ * usbmuxd sends them. If the connection to usbmuxd is lost all devices are
+ * reported as removed and the subscription ends.
+ *
+ * @param loop The event loop.
+ * @param callback A callback function that is executed when an event occurs.
+ * @param user_data Custom data passed on to the callback function.
+ *
+ * @return 0 on success, -EBUSY if the loop already has a subscription, or
+ *    another negative errno value.
+ */
+int usbmuxd_event_loop_subscribe(usbmuxd_event_loop_t loop, usbmuxd_event_cb_t callback, void *user_data);
+
+/**
+ * Ends the device event subscription of the loop. May be called from the
+ * event callback.
+ *
+ * @return 0 on success or a negative errno value.
+ */
+int usbmuxd_event_loop_unsubscribe(usbmuxd_event_loop_t loop);
+
 /**
  * Reads the SystemBUID
  *
@@ -48,6 +48,9 @@
 #ifndef ECONNREFUSED
 #define ECONNREFUSED 107
 #endif
+#ifndef ENODATA
+#define ENODATA 120
+#endif
 
 #include <unistd.h>
 #include <signal.h>
@@ -107,6 +110,8 @@ static char *prog_name = NULL;
 // threads
 #include "thread.h"
 
+#include "eventloop.h"
+
 static int libusbmuxd_debug = 0;
 #ifndef PACKAGE
 #define PACKAGE "libusbmuxd"
@@ -134,13 +139,21 @@ static struct collection listeners;
 thread_once_t listener_init_once = THREAD_ONCE_INIT;
 mutex_t listener_mutex;
 
+/* snapshot of 'devices' that other threads can read while the monitor
+ * thread is running, see usbmuxd_copy_device_list() */
+static usbmuxd_device_info_t *device_table = NULL;
+static int device_table_count = 0;
+static int device_table_capacity = 0;
+static int device_table_valid = 0;
+static mutex_t device_table_mutex;
+
 /**
  * Finds a device info record by its handle.
  * if the record is not found, NULL is returned.
  */
-static usbmuxd_device_info_t *devices_find(uint32_t handle)
+static usbmuxd_device_info_t *devices_find(struct collection *devs, uint32_t handle)
 {
-	FOREACH(usbmuxd_device_info_t *dev, &devices) {
+	FOREACH(usbmuxd_device_info_t *dev, devs) {
 		if (dev && dev->handle == handle) {
 			return dev;
 		}
@@ -219,16 +232,13 @@ static void sanitize_udid(usbmuxd_device_info_t *devinfo)
 	}
 }
 
-static usbmuxd_device_info_t *device_info_from_plist(plist_t props)
+static int device_info_from_plist(plist_t props, usbmuxd_device_info_t *devinfo)
 {
-	usbmuxd_device_info_t* devinfo = NULL;
 	plist_t n = NULL;
 	uint64_t val = 0;
-	char *strval = NULL;
+	uint64_t len = 0;
+	const char *strval = NULL;
 
-	devinfo = (usbmuxd_device_info_t*)malloc(sizeof(usbmuxd_device_info_t));
-	if (!devinfo)
-		return NULL;
 	memset(devinfo, 0, sizeof(usbmuxd_device_info_t));
 
 	n = plist_dict_get_item(props, "DeviceID");
@@ -245,18 +255,20 @@ static usbmuxd_device_info_t *device_info_from_plist(plist_t props)
 
 	n = plist_dict_get_item(props, "SerialNumber");
 	if (n && plist_get_node_type(n) == PLIST_STRING) {
-		plist_get_string_val(n, &strval);
+		strval = plist_get_string_ptr(n, &len);
 		if (strval) {
-			char *t = stpncpy(devinfo->udid, strval, sizeof(devinfo->udid)-1);
-			*t = '\0';
+			if (len > sizeof(devinfo->udid)-1) {
+				len = sizeof(devinfo->udid)-1;
+			}
+			memcpy(devinfo->udid, strval, len);
+			devinfo->udid[len] = '\0';
 			sanitize_udid(devinfo);
-			free(strval);
 		}
 	}
 
 	n = plist_dict_get_item(props, "ConnectionType");
 	if (n && plist_get_node_type(n) == PLIST_STRING) {
-		plist_get_string_val(n, &strval);
+		strval = plist_get_string_ptr(n, NULL);
 		if (strval) {
 			if (strcmp(strval, "USB") == 0) {
 				devinfo->conn_type = CONNECTION_TYPE_USB;
@@ -264,64 +276,120 @@ static usbmuxd_device_info_t *device_info_from_plist(plist_t props)
 				devinfo->conn_type = CONNECTION_TYPE_NETWORK;
 				n = plist_dict_get_item(props, "NetworkAddress");
 				if (n && plist_get_node_type(n) == PLIST_DATA) {
-					char *netaddr = NULL;
 					uint64_t addr_len = 0;
-					plist_get_data_val(n, &netaddr, &addr_len);
+					const char *netaddr = plist_get_data_ptr(n, &addr_len);
 					if (netaddr && addr_len > 0 && addr_len < sizeof(devinfo->conn_data)) {
 						memcpy(devinfo->conn_data, netaddr, addr_len);
 					}
-					free(netaddr);
 				}
 			} else {
 				LIBUSBMUXD_ERROR("%s: Unexpected ConnectionType '%s'\n", __func__, strval);
 			}
-			free(strval);
 		}
 	}
 
 	if (!devinfo->udid[0]) {
 		LIBUSBMUXD_ERROR("%s: Failed to get SerialNumber (UDID)!\n", __func__);
-		free(devinfo);
-		return NULL;
+		return -1;
 	}
 	if (!devinfo->conn_type) {
 		LIBUSBMUXD_ERROR("%s: Failed to get ConnectionType!\n", __func__);
-		free(devinfo);
-		devinfo = NULL;
+		return -1;
 	} else if (devinfo->conn_type == CONNECTION_TYPE_NETWORK && !devinfo->conn_data[0]) {
 		LIBUSBMUXD_ERROR("%s: Failed to get EscapedFullServiceName!\n", __func__);
-		free(devinfo);
-		devinfo = NULL;
+		return -1;
 	}
 
-	return devinfo;
+	return 0;
 }
 
-static usbmuxd_device_info_t *device_info_from_device_record(struct usbmuxd_device_record *dev)
+static void device_info_from_device_record(const struct usbmuxd_device_record *dev, usbmuxd_device_info_t *devinfo)
 {
-	if (!dev) {
-		return NULL;
-	}
-	usbmuxd_device_info_t *devinfo = (usbmuxd_device_info_t*)malloc(sizeof(usbmuxd_device_info_t));
-	if (!devinfo) {
-		LIBUSBMUXD_ERROR("%s: Out of memory while allocating device info object\n", __func__);
-		return NULL;
-	}
-
+	memset(devinfo, 0, sizeof(usbmuxd_device_info_t));
 	devinfo->handle = dev->device_id;
 	devinfo->product_id = dev->product_id;
 	char *t = stpncpy(devinfo->udid, dev->serial_number, sizeof(devinfo->udid)-2);
 	*t = '\0';
 	sanitize_udid(devinfo);
+}
 
-	return devinfo;
+/**
+ * Receive buffer that is reused for every packet read from a connection.
+ * It starts out on storage provided by the caller (which may be none) and
+ * only moves to the heap when a payload does not fit.
+ */
+struct packet_buffer {
+	char *data;
+	uint32_t capacity;
+	int owned;
+};
+
+#define PACKET_BUFFER_STACK_SIZE 1024
+
+static void packet_buffer_init(struct packet_buffer *buf, char *storage, uint32_t size)
+{
+	buf->data = storage;
+	buf->capacity = (storage) ? size : 0;
+	buf->owned = 0;
 }
 
-static int receive_packet(int sfd, struct usbmuxd_header *header, void **payload, int timeout)
+/**
+ * Makes room for size bytes. The current contents are not preserved.
+ */
+static int packet_buffer_reserve(struct packet_buffer *buf, uint32_t size)
+{
+	char *data;
+	uint32_t capacity;
+
+	if (size <= buf->capacity) {
+		return 0;
+	}
+	capacity = (buf->capacity * 2 > size) ? buf->capacity * 2 : size;
+	data = (char*)malloc(capacity);
+	if (!data) {
+		return -ENOMEM;
+	}
+	if (buf->owned) {
+		free(buf->data);
+	}
+	buf->data = data;
+	buf->capacity = capacity;
+	buf->owned = 1;
+	return 0;
+}
+
+static void packet_buffer_free(struct packet_buffer *buf)
+{
+	if (buf->owned) {
+		free(buf->data);
+	}
+	packet_buffer_init(buf, NULL, 0);
+}
+
+/* receive buffer of the monitor thread's listening connection */
+static struct packet_buffer listen_buffer;
+
+/**
+ * A decoded packet. Which member is set depends on the message type of the
+ * decoded header: 'number' for MESSAGE_RESULT, MESSAGE_DEVICE_REMOVE and
+ * MESSAGE_DEVICE_PAIRED, 'device' for MESSAGE_DEVICE_ADD, and 'plist' for
+ * any other MESSAGE_PLIST, which the caller has to free.
+ */
+struct usbmuxd_message {
+	uint32_t number;
+	usbmuxd_device_info_t device;
+	plist_t plist;
+};
+
+static int decode_packet(struct usbmuxd_header hdr, const char *payload_loc, struct usbmuxd_header *header, struct usbmuxd_message *msg);
+
+/**
+ * Receives a packet into buf and decodes it in place into msg.
+ */
+static int receive_packet(int sfd, struct packet_buffer *buf, struct usbmuxd_header *header, struct usbmuxd_message *msg, int timeout)
 {
 	int recv_len;
 	struct usbmuxd_header hdr;
-	char *payload_loc = NULL;
 
 	header->length = 0;
 	header->version = 0;
@@ -337,14 +405,20 @@ static int receive_packet(int sfd, struct usbmuxd_header *header, void **payload
 	} else if ((size_t)recv_len < sizeof(hdr)) {
 		LIBUSBMUXD_DEBUG(1, "%s: Received packet is too small, got %d bytes!\n", __func__, recv_len);
 		return recv_len;
+	} else if (hdr.length < sizeof(hdr)) {
+		LIBUSBMUXD_DEBUG(1, "%s: Invalid packet length %d received!\n", __func__, hdr.length);
+		return -EBADMSG;
 	}
 
 	uint32_t payload_size = hdr.length - sizeof(hdr);
 	if (payload_size > 0) {
-		payload_loc = (char*)malloc(payload_size);
+		if (packet_buffer_reserve(buf, payload_size) < 0) {
+			LIBUSBMUXD_ERROR("ERROR: %s: malloc failed\n", __func__);
+			return -ENOMEM;
+		}
 		uint32_t rsize = 0;
 		do {
-			int res = socket_receive_timeout(sfd, payload_loc + rsize, payload_size - rsize, 0, 5000);
+			int res = socket_receive_timeout(sfd, buf->data + rsize, payload_size - rsize, 0, 5000);
 			if (res < 0) {
 				break;
 			}
@@ -352,16 +426,37 @@ static int receive_packet(int sfd, struct usbmuxd_header *header, void **payload
 		} while (rsize < payload_size);
 		if (rsize != payload_size) {
 			LIBUSBMUXD_DEBUG(1, "%s: Error receiving payload of size %d (bytes received: %d)\n", __func__, payload_size, rsize);
-			free(payload_loc);
 			return -EBADMSG;
 		}
 	}
 
+	return decode_packet(hdr, buf->data, header, msg);
+}
+
+static int decode_uint32(uint32_t payload_size, const char *payload_loc, uint32_t *value)
+{
+	if (payload_size < sizeof(uint32_t)) {
+		LIBUSBMUXD_DEBUG(1, "%s: Payload of size %d is too small!\n", __func__, payload_size);
+		return -EBADMSG;
+	}
+	memcpy(value, payload_loc, sizeof(uint32_t));
+	return 0;
+}
+
+/**
+ * Decodes a received packet into the header and message handed to the
+ * callers of receive_packet(). payload_loc is only read from.
+ */
+static int decode_packet(struct usbmuxd_header hdr, const char *payload_loc, struct usbmuxd_header *header, struct usbmuxd_message *msg)
+{
+	uint32_t payload_size = hdr.length - sizeof(hdr);
+
+	msg->plist = NULL;
+
 	if (hdr.message == MESSAGE_PLIST) {
-		char *message = NULL;
+		const char *message = NULL;
 		plist_t plist = NULL;
 		plist_from_xml(payload_loc, payload_size, &plist);
-		free(payload_loc);
 
 		if (!plist) {
 			LIBUSBMUXD_DEBUG(1, "%s: Error getting plist from payload!\n", __func__);
@@ -370,89 +465,71 @@ static int receive_packet(int sfd, struct usbmuxd_header *header, void **payload
 
 		plist_t node = plist_dict_get_item(plist, "MessageType");
 		if (!node || plist_get_node_type(node) != PLIST_STRING) {
-			*payload = plist;
+			msg->plist = plist;
 			hdr.length = sizeof(hdr);
 			memcpy(header, &hdr, sizeof(hdr));
 			return hdr.length;
 		}
 
-		plist_get_string_val(node, &message);
+		message = plist_get_string_ptr(node, NULL);
 		if (message) {
 			uint64_t val = 0;
 			if (strcmp(message, "Result") == 0) {
 				/* result message */
-				uint32_t dwval = 0;
 				plist_t n = plist_dict_get_item(plist, "Number");
 				plist_get_uint_val(n, &val);
-				*payload = malloc(sizeof(uint32_t));
-				dwval = val;
-				memcpy(*payload, &dwval, sizeof(dwval));
-				hdr.length = sizeof(hdr) + sizeof(dwval);
+				msg->number = val;
+				hdr.length = sizeof(hdr) + sizeof(uint32_t);
 				hdr.message = MESSAGE_RESULT;
 			} else if (strcmp(message, "Attached") == 0) {
 				/* device add message */
-				usbmuxd_device_info_t *devinfo = NULL;
 				plist_t props = plist_dict_get_item(plist, "Properties");
 				if (!props) {
 					LIBUSBMUXD_DEBUG(1, "%s: Could not get properties for message '%s' from plist!\n", __func__, message);
-					free(message);
 					plist_free(plist);
 					return -EBADMSG;
 				}
 
-				devinfo = device_info_from_plist(props);
-				if (!devinfo) {
+				if (device_info_from_plist(props, &msg->device) < 0) {
 					LIBUSBMUXD_DEBUG(1, "%s: Could not create device info object from properties!\n", __func__);
-					free(message);
 					plist_free(plist);
 					return -EBADMSG;
 				}
-				*payload = (void*)devinfo;
 				hdr.length = sizeof(hdr) + sizeof(usbmuxd_device_info_t);
 				hdr.message = MESSAGE_DEVICE_ADD;
-			} else if (strcmp(message, "Detached") == 0) {
-				/* device remove message */
-				uint32_t dwval = 0;
+			} else if (strcmp(message, "Detached") == 0 || strcmp(message, "Paired") == 0) {
+				/* device remove or pair message */
 				plist_t n = plist_dict_get_item(plist, "DeviceID");
-				if (n) {
-					plist_get_uint_val(n, &val);
-					*payload = malloc(sizeof(uint32_t));
-					dwval = val;
-					memcpy(*payload, &dwval, sizeof(dwval));
-					hdr.length = sizeof(hdr) + sizeof(dwval);
-					hdr.message = MESSAGE_DEVICE_REMOVE;
-				}
-			} else if (strcmp(message, "Paired") == 0) {
-				/* device pair message */
-				uint32_t dwval = 0;
-				plist_t n = plist_dict_get_item(plist, "DeviceID");
-				if (n) {
-					plist_get_uint_val(n, &val);
-					*payload = malloc(sizeof(uint32_t));
-					dwval = val;
-					memcpy(*payload, &dwval, sizeof(dwval));
-					hdr.length = sizeof(hdr) + sizeof(dwval);
-					hdr.message = MESSAGE_DEVICE_PAIRED;
+				if (!n) {
+					LIBUSBMUXD_DEBUG(1, "%s: Could not get device id for message '%s' from plist!\n", __func__, message);
+					plist_free(plist);
+					return -EBADMSG;
 				}
+				plist_get_uint_val(n, &val);
+				msg->number = val;
+				hdr.length = sizeof(hdr) + sizeof(uint32_t);
+				hdr.message = (message[0] == 'D') ? MESSAGE_DEVICE_REMOVE : MESSAGE_DEVICE_PAIRED;
 			} else {
 				char *xml = NULL;
 				uint32_t len = 0;
 				plist_to_xml(plist, &xml, &len);
 				LIBUSBMUXD_DEBUG(1, "%s: Unexpected message '%s' in plist:\n%s\n", __func__, message, xml);
 				free(xml);
-				free(message);
 				plist_free(plist);
 				return -EBADMSG;
 			}
-			free(message);
 		}
 		plist_free(plist);
 	} else if (hdr.message == MESSAGE_DEVICE_ADD) {
-		usbmuxd_device_info_t *devinfo = device_info_from_device_record((struct usbmuxd_device_record*)payload_loc);
-		free(payload_loc);
-		*payload = devinfo;
-	} else {
-		*payload = payload_loc;
+		if (payload_size < sizeof(struct usbmuxd_device_record)) {
+			LIBUSBMUXD_DEBUG(1, "%s: Device record of size %d is too small!\n", __func__, payload_size);
+			return -EBADMSG;
+		}
+		device_info_from_device_record((const struct usbmuxd_device_record*)payload_loc, &msg->device);
+	} else if (hdr.message == MESSAGE_RESULT || hdr.message == MESSAGE_DEVICE_REMOVE || hdr.message == MESSAGE_DEVICE_PAIRED) {
+		if (decode_uint32(payload_size, payload_loc, &msg->number) < 0) {
+			return -EBADMSG;
+		}
 	}
 
 	memcpy(header, &hdr, sizeof(hdr));
@@ -466,8 +543,10 @@ static int receive_packet(int sfd, struct usbmuxd_header *header, void **payload
 static int usbmuxd_get_result(int sfd, uint32_t tag, uint32_t *result, void **result_plist)
 {
 	struct usbmuxd_header hdr;
+	struct usbmuxd_message msg;
+	struct packet_buffer buf;
+	char storage[PACKET_BUFFER_STACK_SIZE];
 	int recv_len;
-	uint32_t *res = NULL;
 
 	if (!result) {
 		return -EINVAL;
@@ -477,37 +556,33 @@ static int usbmuxd_get_result(int sfd, uint32_t tag, uint32_t *result, void **re
 		*result_plist = NULL;
 	}
 
-	recv_len = receive_packet(sfd, &hdr, (void**)&res, 5000);
+	packet_buffer_init(&buf, storage, sizeof(storage));
+	recv_len = receive_packet(sfd, &buf, &hdr, &msg, 5000);
+	packet_buffer_free(&buf);
 	if (recv_len < 0 || (size_t)recv_len < sizeof(hdr)) {
-		free(res);
 		return (recv_len < 0 ? recv_len : -EPROTO);
 	}
 
 	if (hdr.message == MESSAGE_RESULT) {
-		int ret = 0;
 		if (hdr.tag != tag) {
 			LIBUSBMUXD_DEBUG(1, "%s: WARNING: tag mismatch (%d != %d). Proceeding anyway.\n", __func__, hdr.tag, tag);
 		}
-		if (res) {
-			memcpy(result, res, sizeof(uint32_t));
-			ret = 1;
-		}
-		if (res)
-			free(res);
-		return ret;
+		*result = msg.number;
+		return 1;
 	} else if (hdr.message == MESSAGE_PLIST) {
 		if (!result_plist) {
 			LIBUSBMUXD_DEBUG(1, "%s: MESSAGE_PLIST result but result_plist pointer is NULL!\n", __func__);
+			plist_free(msg.plist);
 			return -1;
 		}
-		*result_plist = (plist_t)res;
+		*result_plist = msg.plist;
 		*result = RESULT_OK;
 		return 1;
 	}
 
 	LIBUSBMUXD_DEBUG(1, "%s: Unexpected message of type %d received!\n", __func__, hdr.message);
-	if (res)
-		free(res);
+	if (msg.plist)
+		plist_free(msg.plist);
 	return -EPROTO;
 }
 
@@ -815,7 +890,7 @@ static int send_pair_record_packet(int sfd, uint32_t tag, const char* msgtype, c
  * A reference to a populated usbmuxd_event_t with information about the event
  * and the corresponding device will be passed to the callback function.
  */
-static void generate_event(const usbmuxd_device_info_t *dev, enum usbmuxd_event_type event)
+static void generate_event(const usbmuxd_device_info_t *dev, enum usbmuxd_event_type event, void *data)
 {
 	usbmuxd_event_t ev;
 
@@ -927,29 +1002,16 @@ end:
 #endif /* HAVE_INOTIFY */
 
 /**
- * Tries to connect to usbmuxd and wait if it is not running.
+ * Sends a Listen request on a freshly connected socket.
+ * Returns 0 when usbmuxd accepted it, 1 when the socket has been closed and
+ * the caller should reconnect with the fallback protocol version, and -1 when
+ * the request failed and the socket has been closed.
  */
-static int usbmuxd_listen()
+static int usbmuxd_request_listen(int sfd)
 {
-	int sfd;
 	uint32_t res = -1;
 	int tag;
 
-retry:
-
-#ifdef HAVE_INOTIFY
-	sfd = usbmuxd_listen_inotify();
-	if (sfd == -2)
-		sfd = usbmuxd_listen_poll();
-#else
-	sfd = usbmuxd_listen_poll();
-#endif
-
-	if (sfd < 0) {
-		LIBUSBMUXD_DEBUG(1, "%s: ERROR: usbmuxd was supposed to be running here...\n", __func__);
-		return sfd;
-	}
-
 	tag = ++use_tag;
 	if (send_listen_packet(sfd, tag) <= 0) {
 		LIBUSBMUXD_DEBUG(1, "%s: ERROR: could not send listen packet\n", __func__);
@@ -960,84 +1022,183 @@ retry:
 		socket_close(sfd);
 		if ((res == RESULT_BADVERSION) && (proto_version == 1)) {
 			proto_version = 0;
-			goto retry;
+			return 1;
 		}
 		LIBUSBMUXD_DEBUG(1, "%s: ERROR: did not get OK but %d\n", __func__, res);
 		return -1;
 	}
-	return sfd;
+	return 0;
 }
 
 /**
- * Waits for an event to occur, i.e. a packet coming from usbmuxd.
- * Calls generate_event to pass the event via callback to the client program.
+ * Tries to connect to usbmuxd and wait if it is not running.
  */
-static int get_next_event(int sfd)
+static int usbmuxd_listen()
 {
-	struct usbmuxd_header hdr;
-	void *payload = NULL;
+	int sfd;
+	int res;
 
-	/* block until we receive something */
-	if (receive_packet(sfd, &hdr, &payload, 0) < 0) {
-		if (!cancelling) {
-			LIBUSBMUXD_DEBUG(1, "%s: Error in usbmuxd connection, disconnecting all devices!\n", __func__);
-		}
-		// when then usbmuxd connection fails,
-		// generate remove events for every device that
-		// is still present so applications know about it
-		FOREACH(usbmuxd_device_info_t *dev, &devices) {
-			generate_event(dev, UE_DEVICE_REMOVE);
-			collection_remove(&devices, dev);
-			free(dev);
-		} ENDFOREACH
-		return -EIO;
+retry:
+
+#ifdef HAVE_INOTIFY
+	sfd = usbmuxd_listen_inotify();
+	if (sfd == -2)
+		sfd = usbmuxd_listen_poll();
+#else
+	sfd = usbmuxd_listen_poll();
+#endif
+
+	if (sfd < 0) {
+		LIBUSBMUXD_DEBUG(1, "%s: ERROR: usbmuxd was supposed to be running here...\n", __func__);
+		return sfd;
 	}
 
-	if ((hdr.length > sizeof(hdr)) && !payload) {
-		LIBUSBMUXD_DEBUG(1, "%s: Invalid packet received, payload is missing!\n", __func__);
-		return -EBADMSG;
+	res = usbmuxd_request_listen(sfd);
+	if (res == 1) {
+		goto retry;
+	} else if (res < 0) {
+		return -1;
 	}
+	return sfd;
+}
 
-	if (hdr.message == MESSAGE_DEVICE_ADD) {
-		usbmuxd_device_info_t *devinfo = (usbmuxd_device_info_t*)payload;
-		collection_add(&devices, devinfo);
-		generate_event(devinfo, UE_DEVICE_ADD);
-		payload = NULL;
-	} else if (hdr.message == MESSAGE_DEVICE_REMOVE) {
-		uint32_t handle;
-		usbmuxd_device_info_t *devinfo;
+typedef void (*event_sink_t)(const usbmuxd_device_info_t *dev, enum usbmuxd_event_type event, void *data);
 
-		memcpy(&handle, payload, sizeof(uint32_t));
+/**
+ * Reports every device in devs as removed and empties the collection.
+ */
+static void remove_all_devices(struct collection *devs, event_sink_t sink, void *data)
+{
+	FOREACH(usbmuxd_device_info_t *dev, devs) {
+		sink(dev, UE_DEVICE_REMOVE, data);
+		collection_remove(devs, dev);
+		free(dev);
+	} ENDFOREACH
+}
 
-		devinfo = devices_find(handle);
+/**
+ * Applies a message received on a listening connection to the device table
+ * devs and passes the resulting event to sink.
+ */
+static int process_event_packet(struct collection *devs, struct usbmuxd_header *hdr, struct usbmuxd_message *msg, event_sink_t sink, void *data)
+{
+	if (hdr->message == MESSAGE_DEVICE_ADD) {
+		usbmuxd_device_info_t *devinfo = (usbmuxd_device_info_t*)malloc(sizeof(usbmuxd_device_info_t));
+		if (!devinfo) {
+			LIBUSBMUXD_ERROR("ERROR: %s: malloc failed\n", __func__);
+			return -ENOMEM;
+		}
+		memcpy(devinfo, &msg->device, sizeof(usbmuxd_device_info_t));
+		collection_add(devs, devinfo);
+		sink(devinfo, UE_DEVICE_ADD, data);
+	} else if (hdr->message == MESSAGE_DEVICE_REMOVE) {
+		uint32_t handle = msg->number;
+		usbmuxd_device_info_t *devinfo = devices_find(devs, handle);
 		if (!devinfo) {
 			LIBUSBMUXD_DEBUG(1, "%s: WARNING: got device remove message for handle %d, but couldn't find the corresponding handle in the device list. This event will be ignored.\n", __func__, handle);
 		} else {
-			generate_event(devinfo, UE_DEVICE_REMOVE);
-			collection_remove(&devices, devinfo);
+			sink(devinfo, UE_DEVICE_REMOVE, data);
+			collection_remove(devs, devinfo);
 			free(devinfo);
 		}
-	} else if (hdr.message == MESSAGE_DEVICE_PAIRED) {
-		uint32_t handle;
-		usbmuxd_device_info_t *devinfo;
-
-		memcpy(&handle, payload, sizeof(uint32_t));
-
-		devinfo = devices_find(handle);
+	} else if (hdr->message == MESSAGE_DEVICE_PAIRED) {
+		uint32_t handle = msg->number;
+		usbmuxd_device_info_t *devinfo = devices_find(devs, handle);
 		if (!devinfo) {
 			LIBUSBMUXD_DEBUG(1, "%s: WARNING: got paired message for device handle %d, but couldn't find the corresponding handle in the device list. This event will be ignored.\n", __func__, handle);
 		} else {
-			generate_event(devinfo, UE_DEVICE_PAIRED);
+			sink(devinfo, UE_DEVICE_PAIRED, data);
 		}
-	} else if (hdr.length > 0) {
-		LIBUSBMUXD_DEBUG(1, "%s: Unexpected message type %d length %d received!\n", __func__, hdr.message, hdr.length);
+	} else if (hdr->length > 0) {
+		LIBUSBMUXD_DEBUG(1, "%s: Unexpected message type %d length %d received!\n", __func__, hdr->message, hdr->length);
 	}
-	if (payload) {
-		free(payload);
+	if (msg->plist) {
+		plist_free(msg->plist);
 	}
 	return 0;
 }
 
+/**
+ * Keeps the shared device table in sync with the events of the monitor
+ * thread before passing them on to the subscribed listeners.
+ */
+static void monitor_event(const usbmuxd_device_info_t *dev, enum usbmuxd_event_type event, void *data)
+{
+	if (!dev) {
+		return;
+	}
+
+	mutex_lock(&device_table_mutex);
+	if (event == UE_DEVICE_ADD) {
+		if (device_table_count == device_table_capacity) {
+			int capacity = (device_table_capacity > 0) ? device_table_capacity * 2 : 8;
+			usbmuxd_device_info_t *table = (usbmuxd_device_info_t*)realloc(device_table, sizeof(usbmuxd_device_info_t) * capacity);
+			if (table) {
+				device_table = table;
+				device_table_capacity = capacity;
+			}
+		}
+		if (device_table_count < device_table_capacity) {
+			memcpy(&device_table[device_table_count++], dev, sizeof(usbmuxd_device_info_t));
+		} else {
+			/* out of memory, make callers ask usbmuxd instead */
+			device_table_valid = 0;
+		}
+	} else if (event == UE_DEVICE_REMOVE) {
+		int i;
+		for (i = 0; i < device_table_count; i++) {
+			if (device_table[i].handle == dev->handle) {
+				memmove(&device_table[i], &device_table[i + 1], sizeof(usbmuxd_device_info_t) * (device_table_count - i - 1));
+				device_table_count--;
+				break;
+			}
+		}
+	}
+	mutex_unlock(&device_table_mutex);
+
+	generate_event(dev, event, data);
+}
+
+static void device_table_set_valid(int valid)
+{
+	mutex_lock(&device_table_mutex);
+	device_table_valid = valid;
+	if (!valid) {
+		device_table_count = 0;
+	}
+	mutex_unlock(&device_table_mutex);
+}
+
+/**
+ * Waits for an event to occur, i.e. a packet coming from usbmuxd.
+ * Calls generate_event to pass the event via callback to the client program.
+ * Returns 1 when a packet was processed, 0 when the timeout expired, and a
+ * negative errno value when the connection failed.
+ */
+static int get_next_event(int sfd, int timeout)
+{
+	struct usbmuxd_header hdr;
+	struct usbmuxd_message msg;
+	int res;
+
+	res = receive_packet(sfd, &listen_buffer, &hdr, &msg, timeout);
+	if (res < 0) {
+		if (!cancelling) {
+			LIBUSBMUXD_DEBUG(1, "%s: Error in usbmuxd connection, disconnecting all devices!\n", __func__);
+		}
+		// when then usbmuxd connection fails,
+		// generate remove events for every device that
+		// is still present so applications know about it
+		remove_all_devices(&devices, monitor_event, NULL);
+		return -EIO;
+	} else if ((size_t)res < sizeof(hdr)) {
+		return 0;
+	}
+
+	res = process_event_packet(&devices, &hdr, &msg, monitor_event, NULL);
+	return (res < 0) ? res : 1;
+}
+
 static void device_monitor_cleanup(void* data)
 {
 	FOREACH(usbmuxd_device_info_t *dev, &devices) {
@@ -1045,6 +1206,8 @@ static void device_monitor_cleanup(void* data)
 		free(dev);
 	} ENDFOREACH
 	collection_free(&devices);
+	device_table_set_valid(0);
+	packet_buffer_free(&listen_buffer);
 
 	socket_close(listenfd);
 	listenfd = -1;
@@ -1071,12 +1234,23 @@ static void *device_monitor(void *data)
 			continue;
 		}
 
-		while (running) {
-			int res = get_next_event(listenfd);
-			if (res < 0) {
-			    break;
+		/* usbmuxd reports the attached devices right after the listen
+		 * request, once that burst is over the device table is complete */
+		int res;
+		do {
+			res = get_next_event(listenfd, 100);
+		} while (res > 0);
+
+		if (res == 0) {
+			device_table_set_valid(1);
+			while (running) {
+				res = get_next_event(listenfd, 0);
+				if (res < 0) {
+				    break;
+				}
 			}
 		}
+		device_table_set_valid(0);
 
 		mutex_lock(&listener_mutex);
 		if (collection_count(&listeners) == 0) {
@@ -1098,6 +1272,7 @@ static void init_listeners(void)
 {
 	collection_init(&listeners);
 	mutex_init(&listener_mutex);
+	mutex_init(&device_table_mutex);
 }
 
 USBMUXD_API int usbmuxd_events_subscribe(usbmuxd_subscription_context_t *ctx, usbmuxd_event_cb_t callback, void *user_data)
@@ -1215,11 +1390,30 @@ USBMUXD_API int usbmuxd_get_device_list(usbmuxd_device_info_t **device_list)
 	struct collection tmpdevs;
 	usbmuxd_device_info_t *newlist = NULL;
 	struct usbmuxd_header hdr;
+	struct usbmuxd_message msg;
+	struct packet_buffer buf;
+	char storage[PACKET_BUFFER_STACK_SIZE];
 	int dev_cnt = 0;
-	void *payload = NULL;
 
 	*device_list = NULL;
 
+	/* a running device monitor already knows all devices */
+	thread_once(&listener_init_once, init_listeners);
+	mutex_lock(&device_table_mutex);
+	if (device_table_valid) {
+		newlist = (usbmuxd_device_info_t*)malloc(sizeof(usbmuxd_device_info_t) * (device_table_count + 1));
+		if (newlist) {
+			dev_cnt = device_table_count;
+			memcpy(newlist, device_table, sizeof(usbmuxd_device_info_t) * dev_cnt);
+			memset(&newlist[dev_cnt], 0, sizeof(usbmuxd_device_info_t));
+		}
+	}
+	mutex_unlock(&device_table_mutex);
+	if (newlist) {
+		*device_list = newlist;
+		return dev_cnt;
+	}
+
 retry:
 	sfd = connect_usbmuxd_socket();
 	if (sfd < 0) {
@@ -1240,8 +1434,9 @@ retry:
 					for (i = 0; i < numdevs; i++) {
 						plist_t pdev = plist_array_get_item(devlist, i);
 						plist_t props = plist_dict_get_item(pdev, "Properties");
-						usbmuxd_device_info_t *devinfo = device_info_from_plist(props);
-						if (!devinfo) {
+						usbmuxd_device_info_t *devinfo = (usbmuxd_device_info_t*)malloc(sizeof(usbmuxd_device_info_t));
+						if (!devinfo || device_info_from_plist(props, devinfo) < 0) {
+							free(devinfo);
 							socket_close(sfd);
 							LIBUSBMUXD_DEBUG(1, "%s: Could not create device info object from properties!\n", __func__);
 							plist_free(list);
@@ -1289,26 +1484,19 @@ retry:
 	}
 
 	collection_init(&tmpdevs);
+	packet_buffer_init(&buf, storage, sizeof(storage));
 
 	// receive device list
 	while (1) {
-		if (receive_packet(sfd, &hdr, &payload, 100) > 0) {
+		if (receive_packet(sfd, &buf, &hdr, &msg, 100) > 0) {
 			if (hdr.message == MESSAGE_DEVICE_ADD) {
-				usbmuxd_device_info_t *devinfo = payload;
-				collection_add(&tmpdevs, devinfo);
-				payload = NULL;
+				usbmuxd_device_info_t *devinfo = (usbmuxd_device_info_t*)malloc(sizeof(usbmuxd_device_info_t));
+				if (devinfo) {
+					memcpy(devinfo, &msg.device, sizeof(usbmuxd_device_info_t));
+					collection_add(&tmpdevs, devinfo);
+				}
 			} else if (hdr.message == MESSAGE_DEVICE_REMOVE) {
-				uint32_t handle;
-				usbmuxd_device_info_t *devinfo = NULL;
-
-				memcpy(&handle, payload, sizeof(uint32_t));
-
-				FOREACH(usbmuxd_device_info_t *di, &tmpdevs) {
-					if (di && di->handle == handle) {
-						devinfo = di;
-						break;
-					}
-				} ENDFOREACH
+				usbmuxd_device_info_t *devinfo = devices_find(&tmpdevs, msg.number);
 				if (devinfo) {
 					collection_remove(&tmpdevs, devinfo);
 					free(devinfo);
@@ -1316,14 +1504,15 @@ retry:
 			} else {
 				LIBUSBMUXD_DEBUG(1, "%s: Unexpected message %d\n", __func__, hdr.message);
 			}
-			if (payload)
-				free(payload);
+			if (msg.plist)
+				plist_free(msg.plist);
 		} else {
 			// we _should_ have all of them now.
 			// or perhaps an error occured.
 			break;
 		}
 	}
+	packet_buffer_free(&buf);
 
 got_device_list:
 
@@ -1348,6 +1537,25 @@ got_device_list:
 	return dev_cnt;
 }
 
+USBMUXD_API int usbmuxd_copy_device_list(usbmuxd_device_info_t *device_list, int max_devices)
+{
+	int dev_cnt = -ENODATA;
+
+	if (!device_list && max_devices > 0) {
+		return -EINVAL;
+	}
+
+	thread_once(&listener_init_once, init_listeners);
+	mutex_lock(&device_table_mutex);
+	if (device_table_valid) {
+		dev_cnt = device_table_count;
+		memcpy(device_list, device_table, sizeof(usbmuxd_device_info_t) * ((dev_cnt < max_devices) ? dev_cnt : max_devices));
+	}
+	mutex_unlock(&device_table_mutex);
+
+	return dev_cnt;
+}
+
 USBMUXD_API int usbmuxd_device_list_free(usbmuxd_device_info_t **device_list)
 {
 	if (device_list) {
@@ -1562,6 +1770,268 @@ USBMUXD_API int usbmuxd_recv(int sfd, char *data, uint32_t len, uint32_t *recv_b
 	return usbmuxd_recv_timeout(sfd, data, len, recv_bytes, 5000);
 }
 
+USBMUXD_API int usbmuxd_send_nonblocking(int sfd, const char *data, uint32_t len, uint32_t *sent_bytes)
+{
+	int num_sent;
+
+	if (sfd < 0 || !sent_bytes) {
+		return -EINVAL;
+	}
+	*sent_bytes = 0;
+
+	num_sent = socket_send_nonblocking(sfd, (void*)data, len);
+	if (num_sent < 0) {
+		if (num_sent != -EAGAIN) {
+			LIBUSBMUXD_DEBUG(1, "%s: Error %d when sending: %s\n", __func__, -num_sent, strerror(-num_sent));
+		}
+		return num_sent;
+	}
+
+	*sent_bytes = num_sent;
+
+	return 0;
+}
+
+USBMUXD_API int usbmuxd_recv_nonblocking(int sfd, char *data, uint32_t len, uint32_t *recv_bytes)
+{
+	int num_recv;
+
+	if (sfd < 0 || !recv_bytes) {
+		return -EINVAL;
+	}
+	*recv_bytes = 0;
+
+	num_recv = socket_receive_nonblocking(sfd, (void*)data, len);
+	if (num_recv < 0) {
+		return num_recv;
+	}
+
+	*recv_bytes = num_recv;
+
+	return 0;
+}
+
+struct usbmuxd_event_loop {
+	event_loop_t *loop;
+
+	/* device monitoring on the loop, see usbmuxd_event_loop_subscribe() */
+	int monitor_fd;
+	usbmuxd_event_cb_t callback;
+	void *user_data;
+	struct collection devices;
+	struct usbmuxd_header hdr;
+	struct packet_buffer buf;
+	uint32_t received;
+	int dispatching;
+	int unsubscribing;
+};
+
+USBMUXD_API usbmuxd_event_loop_t usbmuxd_event_loop_new(void)
+{
+	usbmuxd_event_loop_t loop = (usbmuxd_event_loop_t)calloc(1, sizeof(struct usbmuxd_event_loop));
+	if (!loop) {
+		return NULL;
+	}
+	loop->loop = event_loop_new();
+	if (!loop->loop) {
+		LIBUSBMUXD_DEBUG(1, "%s: ERROR: Could not create event loop backend\n", __func__);
+		free(loop);
+		return NULL;
+	}
+	loop->monitor_fd = -1;
+	collection_init(&loop->devices);
+	return loop;
+}
+
+USBMUXD_API void usbmuxd_event_loop_free(usbmuxd_event_loop_t loop)
+{
+	if (!loop) {
+		return;
+	}
+	usbmuxd_event_loop_unsubscribe(loop);
+	packet_buffer_free(&loop->buf);
+	collection_free(&loop->devices);
+	event_loop_free(loop->loop);
+	free(loop);
+}
+
+/* the public event flags are passed through to the backend unchanged */
+USBMUXD_API int usbmuxd_event_loop_add(usbmuxd_event_loop_t loop, int sfd, int events, usbmuxd_loop_cb_t callback, void *user_data)
+{
+	if (!loop) {
+		return -EINVAL;
+	}
+	return event_loop_add(loop->loop, sfd, events, (event_loop_cb_t)callback, user_data);
+}
+
+USBMUXD_API int usbmuxd_event_loop_modify(usbmuxd_event_loop_t loop, int sfd, int events)
+{
+	if (!loop) {
+		return -EINVAL;
+	}
+	return event_loop_modify(loop->loop, sfd, events);
+}
+
+USBMUXD_API int usbmuxd_event_loop_remove(usbmuxd_event_loop_t loop, int sfd)
+{
+	if (!loop) {
+		return -EINVAL;
+	}
+	return event_loop_remove(loop->loop, sfd);
+}
+
+USBMUXD_API int usbmuxd_event_loop_run_once(usbmuxd_event_loop_t loop, int timeout)
+{
+	if (!loop) {
+		return -EINVAL;
+	}
+	return event_loop_run_once(loop->loop, timeout);
+}
+
+static void event_loop_generate_event(const usbmuxd_device_info_t *dev, enum usbmuxd_event_type event, void *data)
+{
+	usbmuxd_event_loop_t loop = (usbmuxd_event_loop_t)data;
+	usbmuxd_event_t ev;
+
+	if (!dev || loop->unsubscribing) {
+		return;
+	}
+
+	ev.event = event;
+	memcpy(&ev.device, dev, sizeof(usbmuxd_device_info_t));
+
+	loop->callback(&ev, loop->user_data);
+}
+
+static void event_loop_monitor_stop(usbmuxd_event_loop_t loop, int notify)
+{
+	event_loop_remove(loop->loop, loop->monitor_fd);
+	socket_close(loop->monitor_fd);
+	loop->monitor_fd = -1;
+
+	loop->received = 0;
+
+	if (!notify) {
+		loop->unsubscribing = 1;
+	}
+	remove_all_devices(&loop->devices, event_loop_generate_event, loop);
+	loop->unsubscribing = 0;
+}
+
+/**
+ * Assembles packets from the listening connection as they arrive and applies
+ * them to the device table of the loop without ever blocking.
+ */
+static void event_loop_monitor_cb(int sfd, int events, void *user_data)
+{
+	usbmuxd_event_loop_t loop = (usbmuxd_event_loop_t)user_data;
+
+	while (1) {
+		int res;
+
+		if (loop->received < sizeof(loop->hdr)) {
+			res = socket_receive_nonblocking(sfd, (char*)&loop->hdr + loop->received, sizeof(loop->hdr) - loop->received);
+		} else {
+			res = socket_receive_nonblocking(sfd, loop->buf.data + (loop->received - sizeof(loop->hdr)), loop->hdr.length - loop->received);
+		}
+		if (res == -EAGAIN) {
+			return;
+		} else if (res < 0) {
+			LIBUSBMUXD_DEBUG(1, "%s: Error in usbmuxd connection, disconnecting all devices!\n", __func__);
+			event_loop_monitor_stop(loop, 1);
+			return;
+		}
+		loop->received += res;
+
+		if (loop->received == sizeof(loop->hdr)) {
+			if (loop->hdr.length < sizeof(loop->hdr)) {
+				LIBUSBMUXD_DEBUG(1, "%s: Invalid packet length %d received!\n", __func__, loop->hdr.length);
+				event_loop_monitor_stop(loop, 1);
+				return;
+			}
+			if (packet_buffer_reserve(&loop->buf, loop->hdr.length - sizeof(loop->hdr)) < 0) {
+				LIBUSBMUXD_ERROR("ERROR: %s: malloc failed\n", __func__);
+				event_loop_monitor_stop(loop, 1);
+				return;
+			}
+		}
+
+		if (loop->received >= sizeof(loop->hdr) && loop->received == loop->hdr.length) {
+			struct usbmuxd_header hdr;
+			struct usbmuxd_message msg;
+
+			loop->received = 0;
+			if (decode_packet(loop->hdr, loop->buf.data, &hdr, &msg) < 0) {
+				continue;
+			}
+
+			loop->dispatching = 1;
+			process_event_packet(&loop->devices, &hdr, &msg, event_loop_generate_event, loop);
+			loop->dispatching = 0;
+
+			if (loop->unsubscribing) {
+				event_loop_monitor_stop(loop, 0);
+				return;
+			}
+		}
+	}
+}
+
+USBMUXD_API int usbmuxd_event_loop_subscribe(usbmuxd_event_loop_t loop, usbmuxd_event_cb_t callback, void *user_data)
+{
+	int sfd;
+	int res;
+
+	if (!loop || !callback) {
+		return -EINVAL;
+	}
+	if (loop->monitor_fd >= 0) {
+		return -EBUSY;
+	}
+
+	do {
+		sfd = connect_usbmuxd_socket();
+		if (sfd < 0) {
+			LIBUSBMUXD_DEBUG(1, "%s: Error: Connection to usbmuxd failed: %s\n", __func__, strerror(errno));
+			return -ECONNREFUSED;
+		}
+		res = usbmuxd_request_listen(sfd);
+	} while (res == 1);
+	if (res < 0) {
+		return -EPROTO;
+	}
+
+	loop->callback = callback;
+	loop->user_data = user_data;
+	loop->received = 0;
+
+	res = event_loop_add(loop->loop, sfd, EVENT_LOOP_READ, event_loop_monitor_cb, loop);
+	if (res < 0) {
+		socket_close(sfd);
+		return res;
+	}
+	loop->monitor_fd = sfd;
+
+	return 0;
+}
+
+USBMUXD_API int usbmuxd_event_loop_unsubscribe(usbmuxd_event_loop_t loop)
+{
+	if (!loop) {
+		return -EINVAL;
+	}
+	if (loop->monitor_fd < 0) {
+		return 0;
+	}
+	if (loop->dispatching) {
+		/* called from the event callback, finish once it returns */
+		loop->unsubscribing = 1;
+		return 0;
+	}
+	event_loop_monitor_stop(loop, 0);
+	return 0;
+}
+
 USBMUXD_API int usbmuxd_read_buid(char **buid)
 {
 	int sfd;